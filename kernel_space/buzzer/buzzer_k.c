@@ -10,7 +10,7 @@
 #include <linux/delay.h>  
 #include <linux/uaccess.h> /* for put_user */
 #include "buzzer_ioctl.h" 
-#include "register_map.h"
+#include "car_gpio.h"    /* shared GPIO register access (car_gpio.ko) */
 
 #include <linux/cdev.h>
 static struct cdev mycdev;
@@ -18,20 +18,30 @@ static struct cdev mycdev;
 #define DEVICE_NAME "buzzer"
 int Major;
 
-uint32_t *PERIBase;
-uint32_t *reg_GPFSEL0, *reg_GPFSEL1;
-uint32_t *reg_GPSET0;
-uint32_t *reg_GPCLR0;
-
 // To do: declare a class for udev used
 static struct class *charmodule_class; 
 
-uint32_t fn;
 uint32_t pin[10]={0,3,6,9,12,15,18,21,24,27};
 int buzzer_on = 0;
 
+/* GPIOs already switched to output by buzzer_output() */
+static uint32_t out_mask;
+
 module_param(buzzer_on, int, 0644);
 
+/* Switch the GPIO to output the first time it is driven, so pins owned by
+ * other drivers (HC-SR04 echo, TCRT5000) are never touched at load time */
+static int buzzer_output(unsigned long gpio)
+{
+    if (gpio >= CAR_GPIO_BANK_PINS)
+        return -EINVAL;
+    if (!(out_mask & BIT(gpio))) {
+        car_gpio_set_function(gpio, CAR_GPIO_FUNC_OUT);
+        out_mask |= BIT(gpio);
+    }
+    return 0;
+}
+
 static int buzzer_open(struct inode *inode, struct file *file)
 {
     printk("buzzer_open() Nothing to do\n");
@@ -77,10 +87,11 @@ static ssize_t buzzer_write(struct file *filp, const char *buff, size_t len, lof
         return -EFAULT;
     }
     sscanf(pwbuf,"%d",&buzzer_on);
+    /* GPSET0/GPCLR0 are write-only: write just the bit, no read-modify-write */
     if ( buzzer_on )
-        writel(readl(reg_GPSET0)|(0x01<<pin[0]), reg_GPSET0);
+        car_gpio_set_mask(0x01<<pin[0]);
     else
-        writel(readl(reg_GPCLR0)|(0x01<<pin[0]), reg_GPCLR0);
+        car_gpio_clear_mask(0x01<<pin[0]);
 
     bytes_written++;
     return bytes_written;
@@ -91,29 +102,31 @@ long buzzer_ioctl(struct file *file,unsigned int ioctl_num, unsigned long ioctl_
     /* if ioctl_param ==0, should access the GPIO10 */
     if ( ioctl_param == 0)
 	ioctl_param += 10;
+    if ( buzzer_output(ioctl_param) < 0 )
+        return -EINVAL;
 
     switch (ioctl_num) {
         case IOCTL_SET_BUZZER_ON:
 		printk("IOCTL_SET_BUZZER_ON, %ld\n", ioctl_param);
-		writel((0x01<<ioctl_param), reg_GPSET0);
+		car_gpio_set_mask(0x01<<ioctl_param);
 #if 0 /* Use this line to turn the other GPIO low */
 		//    0b 0010 0000
 		// ~  0b 1101 1111
-        	writel(~(0x01<<ioctl_param), reg_GPCLR0);
+        	car_gpio_clear_mask(~(0x01<<ioctl_param));
 #endif
 		buzzer_on = 1;
     		break;
         case IOCTL_SET_BUZZER_OFF:
 		printk("IOCTL_SET_BUZZER_OFF %ld\n", ioctl_param);
-		writel((0x01<<ioctl_param), reg_GPCLR0);
+		car_gpio_clear_mask(0x01<<ioctl_param);
 		buzzer_on = 0;
             break;
         case IOCTL_TOGGLE_BUZZER:
 		printk("IOCTL_TOGGLE_LED %ld\n", ioctl_param);
 		if ( buzzer_on )
-			writel((0x01<<ioctl_param), reg_GPCLR0);
+			car_gpio_clear_mask(0x01<<ioctl_param);
 		else
-			writel((0x01<<ioctl_param), reg_GPSET0);
+			car_gpio_set_mask(0x01<<ioctl_param);
 		buzzer_on ^= 0;
             break;
         default:
@@ -187,52 +200,12 @@ int __init init_module(void)
 #endif
     printk(KERN_ALERT"'mknod /dev/buzzer0 c %d 0'.\n", Major);
 
-       // Use ioremap to map the physical address into virtual address
-    PERIBase = ioremap(GPIO_BASE, 1 * 256);
-    if ( PERIBase == NULL ) {
-        printk("ioremap() fail\n");
-	goto failed_ioremap;
-    }
-    reg_GPFSEL0=(PERIBase+GPFSEL0/4);
-    reg_GPFSEL1=(PERIBase+GPFSEL1/4);
-    reg_GPSET0=(PERIBase+GPSET0/4);
-    reg_GPCLR0=(PERIBase+GPCLR0/4);
-
-    /* Set the IO pin as Output
-     *   Bit 29:27, 0b001, GPIO 9, output
-     *   Bit 26:24, 0b001, GPIO 8, output
-     *   Bit 23:21, 0b001, GPIO 7, output
-     *   Bit 20:18, 0b001, GPIO 6, output
-     *   Bit 17:15, 0b001, GPIO 5, output
-     *   Bit 14:12, 0b001, GPIO 4, output
-     *   Bit 11:9, 0b001, GPIO 3, output
-     *   Bit 8:6, 0b001, GPIO 2, output
-     *   Bit 5:3, 0b001, GPIO 1, output
-     * */
-    fn = (0x1 << pin[1]) | \
-	 (0x1 << pin[2]) | \
-	 (0x1 << pin[3]) | \
-	 (0x1 << pin[4]) | \
-	 (0x1 << pin[5]) | \
-	 (0x1 << pin[6]) | \
-	 (0x1 << pin[7]) | \
-	 (0x1 << pin[8]) | \
-	 (0x1 << pin[9]);
-
-    writel(readl(reg_GPFSEL0)|fn, reg_GPFSEL0);
-    printk("reg_GPFSEL0:%x\n", readl(reg_GPFSEL0));
-    /* Set the IO pin as Output
-     *   Bit 2:0, 0b001, GPIO 10, output
-     */
-    fn = (0x1 << pin[0]);
-    writel(readl(reg_GPFSEL1)|fn, reg_GPFSEL1);
-    printk("reg_GPFSEL1:%x\n", readl(reg_GPFSEL1));
+    /* The default buzzer pin (ioctl param 0 = GPIO 10) as output; other pins
+     * are switched on first use (buzzer_output), GPIO registers via car_gpio */
+    buzzer_output(10);
 
     return 0;
 
-failed_ioremap:
-    device_destroy(charmodule_class, MKDEV(Major, 0)); 
-    class_destroy(charmodule_class); 
 fail_cdev_add:
 fail_register_chrdev:
     return -1;
@@ -240,9 +213,6 @@ fail_register_chrdev:
 
 void __exit cleanup_module(void)
 {
-    // To do: Unmap the virtual address
-    iounmap(PERIBase);
-
 #if LINUX_VERSION_CODE > KERNEL_VERSION(2,6,9)
     // Delete device node under /dev
     device_destroy(charmodule_class, MKDEV(Major, 0)); 
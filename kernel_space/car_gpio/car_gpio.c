@@ -0,0 +1,460 @@
+// 車上各 driver 共用的 GPIO 存取層
+// 原本 hc_sr04、buzzer、tcrt5000_hal、motor 各自 ioremap GPIO_BASE，GPFSEL 的讀-改-寫彼此沒有互斥
+// 現在只在這裡映射一次，提供:
+//   car_gpio_read_bank()   一次讀 GPLEV0 取多個腳位
+//   car_gpio_set_mask()    GPSET0/GPCLR0 整組寫入 (只寫暫存器，不需讀回)
+//   car_gpio_clear_mask()
+//   car_gpio_set_function() GPFSEL 讀-改-寫 (spinlock 保護)
+//   car_gpio_request_irq() 腳位雙緣中斷
+//
+// 模擬模式 (insmod car_gpio.ko sim=1): 暫存器改用一般記憶體，不需要樹莓派
+//   輸出 (set/clear) 直接改 GPLEV0，電位改變時呼叫該腳位的中斷 handler
+//   /sys/kernel/debug/car_gpio/level  讀: GPLEV0   寫 "<gpio> <0|1>": 設定輸入電位 (例如 TCRT5000)
+//   /sys/kernel/debug/car_gpio/sonar  寫 "<trig> <echo> <mm>": trig 拉高後在 echo 產生對應距離的脈波
+//                                     (mm = 0 沒有回波，-1 移除)  讀: 目前設定
+//   /sys/kernel/debug/car_gpio/regs   讀: GPFSEL0~2 與 GPLEV0 (看 buzzer 輸出、PWM 腳位功能)
+#include <linux/module.h>
+#include <linux/init.h>
+#include <linux/io.h>		// ioremap, readl, writel
+#include <linux/slab.h>		// 模擬用的暫存器
+#include <linux/spinlock.h>
+#include <linux/gpio.h>		// gpio_to_irq
+#include <linux/interrupt.h>	// request_irq
+#include <linux/hrtimer.h>	// 模擬回波
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/uaccess.h>
+#include <linux/math64.h>	// div_u64
+#include "register_map.h"	// GPIO 暫存器 offset 定義(datasheet)
+#include "car_gpio.h"
+
+
+#define CAR_GPIO_SIM_SONARS	4	// 模擬的超聲波數量 (和 /dev/ultrasonic0~3 一樣)
+#define CAR_GPIO_SIM_ECHO_DELAY_US 200	// trigger 到回波開始的時間 (模組送出 8 個脈波)
+
+
+// kernel 的虛擬位址 (模擬模式為 kzalloc 的記憶體)
+static void __iomem *gpio_base;
+
+// GPFSEL 一個暫存器管 10 支腳，不同 driver 同時設定要互斥 (中斷內也可能呼叫)
+static DEFINE_SPINLOCK(fsel_lock);
+
+// 模擬模式
+static bool sim;
+module_param(sim, bool, 0444);
+MODULE_PARM_DESC(sim, "Back the GPIO registers with RAM and drive inputs from debugfs (default 0)");
+
+// BCM GPIO 編號轉 Linux GPIO 編號的位移 (6.6 之後的 Pi kernel gpiochip0 從 512 開始)
+static int gpio_offset = 512;
+module_param(gpio_offset, int, 0444);
+MODULE_PARM_DESC(gpio_offset, "Linux GPIO number of BCM GPIO0 (default 512)");
+
+// 每支腳的中斷 handler
+struct car_gpio_irq {
+	irq_handler_t handler;		// NULL = 沒有申請
+	void *dev_id;
+	int irq;			// 實體中斷號 (模擬模式不用)
+};
+static struct car_gpio_irq irqs[CAR_GPIO_BANK_PINS];
+
+// 模擬模式: sim_lock 保護 GPLEV0 的讀-改-寫
+// irq_lock 保護 irqs[] 的申請/釋放 (兩種模式)，模擬模式在呼叫 handler 期間也持有 (free/synchronize 用)
+static DEFINE_SPINLOCK(sim_lock);
+static DEFINE_SPINLOCK(irq_lock);
+
+// 模擬的超聲波: trig 拉高 → 延遲後 echo 拉高 → 脈寬 = 往返時間 → echo 拉低
+struct car_gpio_sonar {
+	int trig;			// -1 = 未使用
+	int echo;
+	int distance_mm;		// 0 = 沒有回波
+	bool high;			// echo 目前為高 (下一次 timer 要拉低)
+	struct hrtimer timer;
+};
+static struct car_gpio_sonar sonars[CAR_GPIO_SIM_SONARS];
+static DEFINE_MUTEX(sonar_mutex);	// debugfs 設定互斥
+
+static struct dentry *debug_dir;
+
+
+// ---------------- 模擬 ----------------
+
+// 呼叫 edges 內各腳位的 handler (關中斷執行，和硬體中斷相同的環境)
+static void car_gpio_sim_dispatch(u32 edges){
+	unsigned long flags;
+	int gpio;
+
+	spin_lock_irqsave(&irq_lock, flags);
+	for(gpio = 0; edges; gpio++, edges >>= 1)
+		if((edges & 0x1) && irqs[gpio].handler)
+			irqs[gpio].handler(gpio, irqs[gpio].dev_id);
+	spin_unlock_irqrestore(&irq_lock, flags);
+}
+
+// 模擬腳位電位改變 (set/clear 或 debugfs)，有變化的腳位觸發中斷與模擬的超聲波
+static void car_gpio_sim_drive(u32 mask, bool high){
+	unsigned long flags;
+	u32 old, val;
+	int i;
+
+	spin_lock_irqsave(&sim_lock, flags);
+	old = readl(gpio_base + GPLEV0);
+	val = high ? (old | mask) : (old & ~mask);
+	writel(val, gpio_base + GPLEV0);
+	spin_unlock_irqrestore(&sim_lock, flags);
+
+	if(old == val)
+		return;
+
+	// trig 上升緣: 開始模擬回波 (沒有回波的距離不產生脈波，driver 會在時槽結束記為逾時)
+	for(i = 0; i < CAR_GPIO_SIM_SONARS; i++){
+		struct car_gpio_sonar *s = &sonars[i];
+		int trig = READ_ONCE(s->trig);
+
+		if(trig < 0 || !(val & ~old & BIT(trig)) || READ_ONCE(s->distance_mm) <= 0)
+			continue;
+
+		// 回波還在進行 (等延遲或 echo 為高) 就忽略這次 trigger，重設 timer 會把脈寬截短
+		if(READ_ONCE(s->high) || hrtimer_active(&s->timer))
+			continue;
+		hrtimer_start(&s->timer, us_to_ktime(CAR_GPIO_SIM_ECHO_DELAY_US), HRTIMER_MODE_REL);
+	}
+
+	car_gpio_sim_dispatch(old ^ val);
+}
+
+// 模擬回波: 第一次拉高 echo 並等脈寬，第二次拉低
+static enum hrtimer_restart car_gpio_sonar_timer(struct hrtimer *timer){
+	struct car_gpio_sonar *s = container_of(timer, struct car_gpio_sonar, timer);
+	u64 width_us;
+
+	if(!s->high){
+		// 往返距離 / 聲速 340 m/s: mm * 2 / 0.34 = mm * 2000 / 340 (us)
+		width_us = div_u64((u64)READ_ONCE(s->distance_mm) * 2000, 340);
+		s->high = true;
+		car_gpio_sim_drive(BIT(s->echo), true);
+		hrtimer_forward_now(timer, us_to_ktime(width_us));
+		return HRTIMER_RESTART;
+	}
+
+	s->high = false;
+	car_gpio_sim_drive(BIT(s->echo), false);
+	return HRTIMER_NORESTART;
+}
+
+
+// ---------------- debugfs ----------------
+
+// level 讀: 目前 GPLEV0
+static ssize_t level_read(struct file *file, char __user *buf, size_t len, loff_t *off){
+	char out[16];
+	int n = snprintf(out, sizeof(out), "0x%08x\n", readl(gpio_base + GPLEV0));
+
+	return simple_read_from_buffer(buf, len, off, out, n);
+}
+
+// level 寫: "<gpio> <0|1>"
+static ssize_t level_write(struct file *file, const char __user *buf, size_t len, loff_t *off){
+	char in[32];
+	unsigned int gpio, val;
+
+	if(len >= sizeof(in)) return -EINVAL;
+	if(copy_from_user(in, buf, len)) return -EFAULT;
+	in[len] = '\0';
+
+	if(sscanf(in, "%u %u", &gpio, &val) != 2 || gpio >= CAR_GPIO_BANK_PINS || val > 1)
+		return -EINVAL;
+	car_gpio_sim_drive(BIT(gpio), val);
+	return len;
+}
+
+// sonar 讀: 每行 "<trig> <echo> <mm>"
+static ssize_t sonar_read(struct file *file, char __user *buf, size_t len, loff_t *off){
+	char out[CAR_GPIO_SIM_SONARS * 32];
+	int i, n = 0;
+
+	mutex_lock(&sonar_mutex);
+	for(i = 0; i < CAR_GPIO_SIM_SONARS; i++)
+		if(sonars[i].trig >= 0)
+			n += scnprintf(out + n, sizeof(out) - n, "%d %d %d\n",
+					sonars[i].trig, sonars[i].echo, sonars[i].distance_mm);
+	mutex_unlock(&sonar_mutex);
+
+	return simple_read_from_buffer(buf, len, off, out, n);
+}
+
+// sonar 寫: "<trig> <echo> <mm>"，同一個 trig 覆蓋設定，mm = -1 移除
+static ssize_t sonar_write(struct file *file, const char __user *buf, size_t len, loff_t *off){
+	struct car_gpio_sonar *s = NULL;
+	char in[48];
+	int trig, echo, mm, i;
+
+	if(len >= sizeof(in)) return -EINVAL;
+	if(copy_from_user(in, buf, len)) return -EFAULT;
+	in[len] = '\0';
+
+	if(sscanf(in, "%d %d %d", &trig, &echo, &mm) != 3 ||
+	   trig < 0 || trig >= CAR_GPIO_BANK_PINS || echo < 0 || echo >= CAR_GPIO_BANK_PINS || mm < -1)
+		return -EINVAL;
+
+	mutex_lock(&sonar_mutex);
+	// 1.找同一個 trig 的設定，沒有就找空位
+	for(i = 0; i < CAR_GPIO_SIM_SONARS; i++)
+		if(sonars[i].trig == trig)
+			s = &sonars[i];
+	for(i = 0; !s && mm >= 0 && i < CAR_GPIO_SIM_SONARS; i++)
+		if(sonars[i].trig < 0)
+			s = &sonars[i];
+	if(!s){
+		mutex_unlock(&sonar_mutex);
+		return mm < 0 ? len : -ENOSPC;
+	}
+
+	// 2.改腳位前停掉進行中的回波 (距離可以直接改，下一次 trigger 生效)
+	if(mm < 0 || s->echo != echo){
+		WRITE_ONCE(s->trig, -1);
+		hrtimer_cancel(&s->timer);
+		if(s->high)
+			car_gpio_sim_drive(BIT(s->echo), false);
+		s->high = false;
+	}
+	if(mm >= 0){
+		s->echo = echo;
+		WRITE_ONCE(s->distance_mm, mm);
+		WRITE_ONCE(s->trig, trig);
+	}
+	mutex_unlock(&sonar_mutex);
+	return len;
+}
+
+// regs 讀: 輸出狀態與腳位功能
+static int regs_show(struct seq_file *m, void *v){
+	seq_printf(m, "GPFSEL0 0x%08x\n", readl(gpio_base + GPFSEL0));
+	seq_printf(m, "GPFSEL1 0x%08x\n", readl(gpio_base + GPFSEL1));
+	seq_printf(m, "GPFSEL2 0x%08x\n", readl(gpio_base + GPFSEL2));
+	seq_printf(m, "GPLEV0  0x%08x\n", readl(gpio_base + GPLEV0));
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(regs);
+
+static const struct file_operations level_fops = {
+	.owner = THIS_MODULE,
+	.read = level_read,
+	.write = level_write,
+};
+
+static const struct file_operations sonar_fops = {
+	.owner = THIS_MODULE,
+	.read = sonar_read,
+	.write = sonar_write,
+};
+
+
+// ---------------- 匯出 ----------------
+
+// 一次讀取 bank 0 的電位
+u32 car_gpio_read_bank(u32 mask){
+	return readl(gpio_base + GPLEV0) & mask;
+}
+EXPORT_SYMBOL_GPL(car_gpio_read_bank);
+
+
+// mask 內的腳位設為高電位
+void car_gpio_set_mask(u32 mask){
+	if(!mask)
+		return;
+	if(sim)
+		car_gpio_sim_drive(mask, true);
+	else
+		writel(mask, gpio_base + GPSET0);
+}
+EXPORT_SYMBOL_GPL(car_gpio_set_mask);
+
+
+// mask 內的腳位設為低電位
+void car_gpio_clear_mask(u32 mask){
+	if(!mask)
+		return;
+	if(sim)
+		car_gpio_sim_drive(mask, false);
+	else
+		writel(mask, gpio_base + GPCLR0);
+}
+EXPORT_SYMBOL_GPL(car_gpio_clear_mask);
+
+
+// 設定腳位功能 (輸入/輸出/ALTx)
+int car_gpio_set_function(unsigned int gpio, unsigned int func){
+	void __iomem *reg;
+	unsigned int shift;
+	unsigned long flags;
+	u32 val;
+
+	if(gpio >= CAR_GPIO_BANK_PINS || func > 7)
+		return -EINVAL;
+
+	// GPFSEL0 = GPIO 0~9, GPFSEL1 = GPIO 10~19 ... 每支腳 3 bits
+	reg = gpio_base + GPFSEL0 + (gpio / 10) * 4;
+	shift = (gpio % 10) * 3;
+
+	spin_lock_irqsave(&fsel_lock, flags);
+	val = readl(reg);
+	val &= ~(0x7 << shift);		// 清除原來模式
+	val |= func << shift;
+	writel(val, reg);
+	spin_unlock_irqrestore(&fsel_lock, flags);
+	return 0;
+}
+EXPORT_SYMBOL_GPL(car_gpio_set_function);
+
+
+// 申請腳位雙緣中斷
+int car_gpio_request_irq(unsigned int gpio, irq_handler_t handler, const char *name, void *dev_id){
+	unsigned long flags;
+	int irq, ret;
+
+	if(gpio >= CAR_GPIO_BANK_PINS || !handler)
+		return -EINVAL;
+
+	// 1.在 irq_lock 內檢查並佔用腳位 (兩個 driver 同時申請只有一個成功)
+	spin_lock_irqsave(&irq_lock, flags);
+	if(irqs[gpio].handler){
+		spin_unlock_irqrestore(&irq_lock, flags);
+		return -EBUSY;
+	}
+	irqs[gpio].irq = -1;
+	irqs[gpio].dev_id = dev_id;
+	irqs[gpio].handler = handler;
+	spin_unlock_irqrestore(&irq_lock, flags);
+
+	// 2.模擬模式: 電位改變時由 car_gpio_sim_dispatch 呼叫
+	if(sim)
+		return 0;
+
+	// 3.實體中斷 (request_irq 可能睡眠，不能持有 irq_lock；失敗再釋放佔用)
+	irq = gpio_to_irq(gpio + gpio_offset);
+	if(irq < 0){
+		printk(KERN_ERR "car_gpio: gpio_to_irq(%u) failed: %d\n", gpio, irq);
+		ret = irq;
+		goto err_release;
+	}
+	ret = request_irq(irq, handler, IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING, name, dev_id);
+	if(ret < 0){
+		printk(KERN_ERR "car_gpio: request_irq for GPIO%u failed: %d\n", gpio, ret);
+		goto err_release;
+	}
+	WRITE_ONCE(irqs[gpio].irq, irq);
+	return 0;
+
+err_release:
+	spin_lock_irqsave(&irq_lock, flags);
+	irqs[gpio].handler = NULL;
+	spin_unlock_irqrestore(&irq_lock, flags);
+	return ret;
+}
+EXPORT_SYMBOL_GPL(car_gpio_request_irq);
+
+
+// 釋放腳位中斷 (返回後 handler 不會再被呼叫)
+void car_gpio_free_irq(unsigned int gpio, void *dev_id){
+	unsigned long flags;
+
+	if(gpio >= CAR_GPIO_BANK_PINS || !irqs[gpio].handler || irqs[gpio].dev_id != dev_id)
+		return;
+
+	if(sim){
+		spin_lock_irqsave(&irq_lock, flags);
+		irqs[gpio].handler = NULL;
+		spin_unlock_irqrestore(&irq_lock, flags);
+		return;
+	}
+
+	if(READ_ONCE(irqs[gpio].irq) < 0)	// 還在 request_irq 中
+		return;
+	free_irq(irqs[gpio].irq, dev_id);
+	spin_lock_irqsave(&irq_lock, flags);
+	irqs[gpio].handler = NULL;
+	spin_unlock_irqrestore(&irq_lock, flags);
+}
+EXPORT_SYMBOL_GPL(car_gpio_free_irq);
+
+
+// 等正在執行的 handler 結束
+void car_gpio_synchronize_irq(unsigned int gpio){
+	unsigned long flags;
+
+	if(gpio >= CAR_GPIO_BANK_PINS || !irqs[gpio].handler)
+		return;
+
+	if(sim){
+		spin_lock_irqsave(&irq_lock, flags);	// dispatch 全程持有 irq_lock
+		spin_unlock_irqrestore(&irq_lock, flags);
+		return;
+	}
+	if(READ_ONCE(irqs[gpio].irq) >= 0)	// -1 = 還在 request_irq 中
+		synchronize_irq(irqs[gpio].irq);
+}
+EXPORT_SYMBOL_GPL(car_gpio_synchronize_irq);
+
+
+// ---------------- 模組 ----------------
+
+// 模擬模式的 debugfs 與回波 timer
+static void car_gpio_sim_init(void){
+	int i;
+
+	for(i = 0; i < CAR_GPIO_SIM_SONARS; i++){
+		sonars[i].trig = -1;
+		hrtimer_init(&sonars[i].timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+		sonars[i].timer.function = car_gpio_sonar_timer;
+	}
+
+	debug_dir = debugfs_create_dir("car_gpio", NULL);
+	debugfs_create_file("level", 0600, debug_dir, NULL, &level_fops);
+	debugfs_create_file("sonar", 0600, debug_dir, NULL, &sonar_fops);
+	debugfs_create_file("regs", 0400, debug_dir, NULL, &regs_fops);
+}
+
+
+// 模組初始化
+static int __init car_gpio_init(void){
+
+	// 1. 模擬模式用一般記憶體，否則對 GPIO BASE 做 ioremap 取虛擬位址
+	if(sim)
+		gpio_base = (void __force __iomem *)kzalloc(0x100, GFP_KERNEL);
+	else
+		gpio_base = ioremap(GPIO_BASE, 0x100);
+	if(!gpio_base){
+		printk(KERN_ERR "car_gpio: %s failed\n", sim ? "kzalloc" : "ioremap");
+		return -ENOMEM;
+	}
+
+	// 2. 模擬的輸入來源
+	if(sim)
+		car_gpio_sim_init();
+
+	printk(KERN_INFO "car_gpio: GPIO access layer loaded%s\n", sim ? " (simulated registers)" : "");
+	return 0;
+}
+
+
+// 模組卸載 (使用中的 driver 會讓 rmmod 失敗，不會在這之後存取)
+static void __exit car_gpio_exit(void){
+	int i;
+
+	if(sim){
+		debugfs_remove_recursive(debug_dir);
+		for(i = 0; i < CAR_GPIO_SIM_SONARS; i++)
+			hrtimer_cancel(&sonars[i].timer);
+		kfree((void __force *)gpio_base);
+	} else {
+		iounmap(gpio_base);
+	}
+	printk(KERN_INFO "car_gpio: unloaded\n");
+}
+
+
+module_init(car_gpio_init);
+module_exit(car_gpio_exit);
+
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Shared GPIO register access for the car drivers");
@@ -2,28 +2,94 @@
  * hc_sr04_multi.c - Linux kernel module to support multiple HC-SR04 sensors
  * with user-space configurable GPIO trigger/echo pins via ioctl.
  * Supports up to 4 sensors, mapped as /dev/ultrasonic0 to /dev/ultrasonic3
+ * Triggers are fired from an hrtimer and echoes are timed by GPIO interrupt,
+ * so read()/poll() only ever return the latest completed measurement.
+ * Sensors in different crosstalk groups fire in overlapping slots; once every
+ * group has fired, a timestamped 4-sensor frame is published (HC_SR04_*_FRAME).
+ * A per-sensor emergency brake (HC_SR04_SET_BRAKE) calls the motor driver's
+ * motor_emergency_stop() straight from the echo interrupt once tripped.
+ * Distances are also classified into clear/caution/danger zones with
+ * hysteresis (HC_SR04_SET_ZONES); zone-mode files only see POLLPRI on change.
+ * Each sensor keeps a ring of its last N echoes (HC_SR04_SET_FILTER); everything
+ * above sees the median of N with outliers dropped, plus a confidence value.
+ * GPIO registers go through the shared car_gpio module (load it first).
  */
 
-#include <linux/module.h>
+#include <linux/module.h>      // symbol_get/symbol_put
 #include <linux/init.h>
 #include <linux/fs.h>
 #include <linux/cdev.h>
 #include <linux/device.h>
 #include <linux/uaccess.h>
-#include <linux/io.h>
 #include <linux/ktime.h>
 #include <linux/delay.h>
+#include <linux/slab.h>
+#include <linux/interrupt.h>   // irqreturn_t
+#include <linux/hrtimer.h>     // 觸發排程
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/spinlock.h>
 #include "hc_sr_ioctl.h" 
-#include "register_map.h" // 樹莓派 GPIO 的定義
+#include "motor_estop.h"       // motor_emergency_stop() (馬達 driver 匯出)
+#include "car_gpio.h"     // 共用 GPIO 存取層 (car_gpio.ko)
 
 #define DEVICE_NAME "ultrasonic"    // 裝置名稱前綴
 #define MAX_DEVICES 4               // 最多支援 4 組感測器
+#define TRIG_PULSE_US 10            // trigger 脈寬 (us)，HC-SR04 至少 10us
 
 // 定義每個感測器裝置的結構體
 struct hc_sr04_dev {
     int index;         // 裝置索引 (第幾個感測器)
     int trigger_gpio;  // trigger 腳位 GPIO 編號
     int echo_gpio;     // echo 腳位 GPIO 編號
+    bool echo_irq;     // echo 腳位中斷已申請 (car_gpio_request_irq)
+    bool trigger_set;  // trigger 是否已由 ioctl 設定
+    int group;         // 干擾群組: 同群組在同一個時槽一起觸發
+    u32 frame_seq;     // 上一幀收錄時的 seq (判斷本幀是否有新結果)
+
+    spinlock_t lock;          // 保護以下量測狀態 (中斷/hrtimer 會改)
+    bool pending;             // 已送出 trigger，等待回波結束
+    ktime_t echo_start;       // 回波上升緣時間 (0 = 尚未開始)
+    unsigned int distance_mm; // 最新一次完成的距離 (濾波後)
+    bool timeout;             // 最新一次是否無效 (逾時或濾波後不可信)
+    u8 confidence;            // 最新一次濾波採用的樣本比例 (0~100)
+    u32 seq;                  // 完成的量測次數 (0 = 還沒有任何結果)
+    wait_queue_head_t wq;     // read/poll 等待新量測
+
+    // 多次取樣濾波 (同樣由 dev->lock 保護)
+    int ring[HC_SR04_FILTER_MAX];  // 最近的原始距離 (mm)，-1 = 逾時
+    unsigned int ring_pos;         // 下一個寫入位置
+    unsigned int ring_fill;        // 已有幾個樣本 (最多 filter_n)
+    unsigned int filter_n;         // 視窗大小，1 = 不濾波
+    unsigned int filter_outlier_mm;
+    unsigned int filter_min_valid;
+    unsigned int timeout_us;       // 回波脈寬上限，0 = 到時槽結束
+
+    // 緊急煞車 (同樣由 dev->lock 保護)
+    unsigned int brake_mm;       // 煞車距離，0 = 關閉
+    unsigned int brake_debounce; // 連續幾次過近才觸發
+    unsigned int brake_count;    // 目前連續過近次數
+    bool brake_tripped;          // 已觸發，距離恢復前不再重複通知
+
+    // 距離區間 (同樣由 dev->lock 保護)
+    unsigned int zone_caution_mm;  // 0 = 關閉
+    unsigned int zone_danger_mm;
+    unsigned int zone_hyst_mm;
+    u32 zone;                      // HC_SR04_ZONE_*
+    u32 zone_seq;                  // 區間或煞車狀態改變次數
+    int zone_dist_mm;              // 最後一次改變時的距離
+    u64 zone_ts_ns;                // 最後一次改變的時間
+    wait_queue_head_t zone_wq;     // 區間模式的 poll 只等這個 (不會每次量測都醒)
+};
+
+// 每個 open() 各自記錄看過的量測序號 (poll 用)
+struct hc_sr04_file {
+    struct hc_sr04_dev *dev;
+    u32 seen_seq;
+    u32 seen_frame;    // WAIT_FRAME 上次拿到的幀序號
+    bool frame_mode;   // 用過幀 ioctl 後，poll 改為等待新的一幀
+    bool zone_mode;    // 用過區間 ioctl 後，poll 只在區間改變時回 POLLPRI
+    u32 seen_zone;     // GET_ZONE 上次拿到的 zone_seq
 };
 
 // 全域裝置陣列 & cdev 物件
@@ -32,106 +98,705 @@ static struct cdev cdevs[MAX_DEVICES];
 static struct class *ultra_class;
 static dev_t dev_number;
 
-// GPIO 寄存器指標
-static volatile uint32_t *PERIBase;
-static volatile uint32_t *reg_GPFSEL0, *reg_GPFSEL1, *reg_GPSET0, *reg_GPCLR0, *reg_GPLEV0;
+// 觸發排程: 一個 hrtimer 輪流觸發各干擾群組，每個時槽一個群組 (群組內同時觸發)
+static struct hrtimer sched_timer;
+static int sched_group = -1;           // 目前時槽的群組 (-1 = 無)
+static u32 sched_trig_mask;            // 目前拉高中的 trigger 腳位 (下一次 hrtimer 到期拉低)
+static atomic_t open_count = ATOMIC_INIT(0);
+static DEFINE_MUTEX(sched_mutex);      // 保護排程啟動/停止與 irq 設定
+
+// 緊急煞車: 有任何一顆設定煞車時持有馬達 driver 的 motor_emergency_stop (symbol_get)
+// 中斷內以 READ_ONCE 讀取，改變需持有 sched_mutex
+static int (*brake_hook)(u32 source);
+
+// 最新一幀 (所有群組都觸發過一輪)
+static struct hc_sr04_frame cur_frame;
+static DEFINE_SPINLOCK(frame_lock);
+static DECLARE_WAIT_QUEUE_HEAD(frame_wq);
+
+// 每個時槽長度 (us)，需大於沒有回波時的 echo 脈寬 (約 38ms)
+static unsigned int slot_us = 40000;
+module_param(slot_us, uint, 0644);
+MODULE_PARM_DESC(slot_us, "Trigger slot length in microseconds (default 40000)");
+
+
+
+// ---------------- 距離區間 ----------------
+
+// 區間或煞車狀態改變: 記錄並喚醒區間模式的 poll (需持有 dev->lock)
+static void hc_sr04_zone_notify(struct hc_sr04_dev *dev, unsigned int distance_mm) {
+    dev->zone_seq++;
+    dev->zone_dist_mm = distance_mm;
+    dev->zone_ts_ns = ktime_get_ns();
+    wake_up_interruptible_poll(&dev->zone_wq, EPOLLPRI);
+}
+
+// 依門檻分類，離開較近的區間要超過門檻 + hysteresis (需持有 dev->lock)
+static void hc_sr04_zone_update(struct hc_sr04_dev *dev, unsigned int distance_mm) {
+    unsigned int hyst = dev->zone_hyst_mm;
+    u32 zone;
+
+    if (!dev->zone_caution_mm)
+        return;
+
+    if (distance_mm < dev->zone_danger_mm)
+        zone = HC_SR04_ZONE_DANGER;
+    else if (dev->zone == HC_SR04_ZONE_DANGER && distance_mm < dev->zone_danger_mm + hyst)
+        zone = HC_SR04_ZONE_DANGER;
+    else if (distance_mm < dev->zone_caution_mm)
+        zone = HC_SR04_ZONE_CAUTION;
+    else if (dev->zone >= HC_SR04_ZONE_CAUTION && distance_mm < dev->zone_caution_mm + hyst)
+        zone = HC_SR04_ZONE_CAUTION;
+    else
+        zone = HC_SR04_ZONE_CLEAR;
+
+    if (zone == dev->zone)
+        return;
+    dev->zone = zone;
+    hc_sr04_zone_notify(dev, distance_mm);
+}
+
+// HC_SR04_SET_ZONES (需持有 sched_mutex)，重新從 UNKNOWN 開始分類
+static int hc_sr04_set_zones(struct hc_sr04_dev *dev, const struct hc_sr04_zones *z) {
+    if (z->caution_mm && z->danger_mm >= z->caution_mm)
+        return -EINVAL;
+
+    spin_lock_irq(&dev->lock);
+    dev->zone_caution_mm = z->caution_mm;
+    dev->zone_danger_mm = z->danger_mm;
+    dev->zone_hyst_mm = z->hysteresis_mm;
+    dev->zone = HC_SR04_ZONE_UNKNOWN;
+    spin_unlock_irq(&dev->lock);
+    return 0;
+}
+
+// 取目前區間，這個 file 的 POLLPRI 清除
+static long hc_sr04_get_zone(struct hc_sr04_file *f, unsigned long arg) {
+    struct hc_sr04_dev *dev = f->dev;
+    struct hc_sr04_zone_event ev;
+
+    WRITE_ONCE(f->zone_mode, true);
+
+    memset(&ev, 0, sizeof(ev));
+    spin_lock_irq(&dev->lock);
+    ev.zone = dev->zone;
+    ev.seq = dev->zone_seq;
+    ev.distance_mm = dev->zone_dist_mm;
+    ev.brake = dev->brake_tripped;
+    ev.ts_ns = dev->zone_ts_ns;
+    f->seen_zone = dev->zone_seq;
+    spin_unlock_irq(&dev->lock);
+
+    if (copy_to_user((void __user *)arg, &ev, sizeof(ev)))
+        return -EFAULT;
+    return 0;
+}
+
+
+// ---------------- 緊急煞車 ----------------
+
+// 判斷是否煞車 (需持有 dev->lock，在回波中斷內執行)
+// 連續 debounce 次過近就直接呼叫馬達 driver 停車，最壞反應時間 = debounce 個量測週期
+// (開了濾波 (N >= 3) 時單一雜訊不會讓它計數，debounce 可以設 1)
+static void hc_sr04_brake_check(struct hc_sr04_dev *dev, unsigned int distance_mm) {
+    int (*hook)(u32 source);
+
+    if (!dev->brake_mm)
+        return;
+
+    // 距離恢復: 重新計數，下次過近可以再觸發
+    if (distance_mm >= dev->brake_mm) {
+        dev->brake_count = 0;
+        if (dev->brake_tripped) {
+            dev->brake_tripped = false;
+            hc_sr04_zone_notify(dev, distance_mm);
+        }
+        return;
+    }
+
+    if (dev->brake_count < dev->brake_debounce)
+        dev->brake_count++;
+    if (dev->brake_count < dev->brake_debounce)
+        return;
+
+    // 仍在煞車距離內就每次都呼叫: 使用者空間解除故障鎖定後障礙物還在，下一次量測會再鎖定
+    // (motor_emergency_stop 已鎖定時直接回傳，重複呼叫沒有副作用)
+    hook = READ_ONCE(brake_hook);
+    if (hook)
+        hook(MOTOR_FAULT_SONIC);
+    if (dev->brake_tripped)
+        return;
+    dev->brake_tripped = true;
+    hc_sr04_zone_notify(dev, distance_mm);
+}
+
+// 是否有任何一顆設定了煞車
+static bool hc_sr04_brake_armed(void) {
+    int i;
+
+    for (i = 0; i < MAX_DEVICES; i++)
+        if (READ_ONCE(devices[i].brake_mm))
+            return true;
+    return false;
+}
+
+// 取得馬達 driver 的停車函式 (需持有 sched_mutex)  回傳=> 0成功 -ENODEV 馬達 driver 未載入
+static int hc_sr04_brake_hook_get(void) {
+    int (*hook)(u32 source);
 
-// open：裝置開啟時呼叫，把對應裝置結構指到 file->private_data
+    if (brake_hook)
+        return 0;
+    hook = symbol_get(motor_emergency_stop);
+    if (!hook)
+        return -ENODEV;
+    WRITE_ONCE(brake_hook, hook);
+    return 0;
+}
+
+// 放開馬達 driver (需持有 sched_mutex)，等正在執行的回波中斷結束才 symbol_put
+static void hc_sr04_brake_hook_put(void) {
+    int i;
+
+    if (!brake_hook)
+        return;
+    WRITE_ONCE(brake_hook, NULL);
+    for (i = 0; i < MAX_DEVICES; i++)
+        if (devices[i].echo_irq)
+            car_gpio_synchronize_irq(devices[i].echo_gpio);
+    symbol_put(motor_emergency_stop);
+}
+
+// HC_SR04_SET_BRAKE (需持有 sched_mutex)
+static int hc_sr04_set_brake(struct hc_sr04_dev *dev, const struct hc_sr04_brake *b) {
+    int ret;
+
+    if (b->threshold_mm && (b->debounce < 1 || b->debounce > HC_SR04_BRAKE_DEBOUNCE_MAX))
+        return -EINVAL;
+
+    // 開啟煞車需要馬達 driver，沒載入就回報讓 user space 用自己的判斷
+    if (b->threshold_mm) {
+        ret = hc_sr04_brake_hook_get();
+        if (ret < 0) {
+            printk("[HC-SR04] brake on sensor %d needs the motor driver loaded\n", dev->index);
+            return ret;
+        }
+    }
+
+    spin_lock_irq(&dev->lock);
+    dev->brake_mm = b->threshold_mm;
+    dev->brake_debounce = b->debounce;
+    dev->brake_count = 0;
+    dev->brake_tripped = false;
+    spin_unlock_irq(&dev->lock);
+
+    if (!hc_sr04_brake_armed())
+        hc_sr04_brake_hook_put();
+    return 0;
+}
+
+
+// ---------------- 多次取樣濾波 ----------------
+
+// 排序後取中位數 (偶數個取中間兩個的平均)，n 最多 HC_SR04_FILTER_MAX，插入排序即可
+static int hc_sr04_median(int *s, int n) {
+    int i, j, v;
+
+    for (i = 1; i < n; i++) {
+        v = s[i];
+        for (j = i; j > 0 && s[j - 1] > v; j--)
+            s[j] = s[j - 1];
+        s[j] = v;
+    }
+    return (n & 1) ? s[n / 2] : (s[n / 2 - 1] + s[n / 2]) / 2;
+}
+
+// 放入一個原始樣本 (-1 = 逾時)，算出濾波後的距離 (需持有 dev->lock，在中斷內執行)
+// 回傳=> true 有效 (*distance_mm 為結果)  false 採用的樣本不足
+static bool hc_sr04_filter(struct hc_sr04_dev *dev, int raw_mm, unsigned int *distance_mm) {
+    int s[HC_SR04_FILTER_MAX];
+    int i, n = 0, kept = 0, med;
+
+    // 1.放進環形緩衝
+    dev->ring[dev->ring_pos] = raw_mm;
+    dev->ring_pos = (dev->ring_pos + 1) % dev->filter_n;
+    if (dev->ring_fill < dev->filter_n)
+        dev->ring_fill++;
+
+    // 2.有回波的樣本取中位數
+    for (i = 0; i < dev->ring_fill; i++)
+        if (dev->ring[i] >= 0)
+            s[n++] = dev->ring[i];
+    if (n == 0) {
+        dev->confidence = 0;
+        return false;
+    }
+    med = hc_sr04_median(s, n);
+
+    // 3.剔除離群值，剩下的再取一次中位數 (已排序，保留的仍是連續一段)
+    if (dev->filter_outlier_mm) {
+        for (i = 0; i < n; i++)
+            if (abs(s[i] - med) <= dev->filter_outlier_mm)
+                s[kept++] = s[i];
+        if (kept)
+            med = hc_sr04_median(s, kept);
+    } else {
+        kept = n;
+    }
+
+    // 4.信心 = 採用的樣本佔整個視窗的比例 (剛開始還沒填滿時較低)
+    dev->confidence = kept * 100 / dev->filter_n;
+    if (kept < dev->filter_min_valid)
+        return false;
+    *distance_mm = med;
+    return true;
+}
+
+// HC_SR04_SET_FILTER (需持有 sched_mutex)，清空視窗重新累積
+static int hc_sr04_set_filter(struct hc_sr04_dev *dev, const struct hc_sr04_filter *flt) {
+    if (flt->samples < 1 || flt->samples > HC_SR04_FILTER_MAX ||
+        flt->min_valid < 1 || flt->min_valid > flt->samples)
+        return -EINVAL;
+
+    spin_lock_irq(&dev->lock);
+    dev->filter_n = flt->samples;
+    dev->filter_outlier_mm = flt->outlier_mm;
+    dev->filter_min_valid = flt->min_valid;
+    dev->timeout_us = flt->timeout_us;
+    dev->ring_pos = 0;
+    dev->ring_fill = 0;
+    spin_unlock_irq(&dev->lock);
+    return 0;
+}
+
+
+// ---------------- 量測 ----------------
+
+// 記錄一次量測結果並喚醒讀取者 (需持有 dev->lock)
+// 原始樣本先經過濾波；無效 (逾時或樣本不足) 不影響煞車計數與區間
+static void hc_sr04_complete(struct hc_sr04_dev *dev, unsigned int raw_mm, bool raw_timeout) {
+    unsigned int distance_mm = 0;
+    bool timeout;
+
+    timeout = !hc_sr04_filter(dev, raw_timeout ? -1 : (int)raw_mm, &distance_mm);
+    if (!timeout) {
+        hc_sr04_brake_check(dev, distance_mm);
+        hc_sr04_zone_update(dev, distance_mm);
+    }
+
+    dev->pending = false;
+    dev->echo_start = 0;
+    dev->distance_mm = distance_mm;
+    dev->timeout = timeout;
+    dev->seq++;
+    if (dev->seq == 0) dev->seq = 1;   // 0 保留給「尚未有結果」
+    wake_up_interruptible(&dev->wq);
+}
+
+// echo 腳位雙緣中斷: 上升緣記錄開始時間，下降緣算出距離
+static irqreturn_t hc_sr04_echo_irq(int irq, void *data) {
+    struct hc_sr04_dev *dev = data;
+    ktime_t now = ktime_get();
+    unsigned long flags;
+    s64 duration_us;
+    u64 temp;
+
+    spin_lock_irqsave(&dev->lock, flags);
+
+    if (!dev->pending) {
+        // 不是我們觸發的回波 (或已逾時)，忽略
+    } else if (car_gpio_read_bank(BIT(dev->echo_gpio))) {
+        dev->echo_start = now;         // 回波開始
+    } else if (dev->echo_start) {
+        // --- 計算距離 ---
+        duration_us = ktime_to_us(ktime_sub(now, dev->echo_start)); // 時間差 (微秒)
+        if (dev->timeout_us && duration_us > dev->timeout_us) {
+            hc_sr04_complete(dev, 0, true);   // 超過設定的量測距離，當作沒有回波
+        } else {
+            temp = duration_us * 340; // 聲速 340 m/s，單位換算：微秒*340
+            do_div(temp, 2);          // 往返距離除以2
+            do_div(temp, 1000);       // 轉為 mm
+            hc_sr04_complete(dev, (unsigned int)temp, false);
+        }
+    }
+
+    spin_unlock_irqrestore(&dev->lock, flags);
+    return IRQ_HANDLED;
+}
+
+// 標記等待回波，回傳這顆的 trigger 腳位 (由呼叫者和同群組的一起送出脈波)
+static u32 hc_sr04_arm(struct hc_sr04_dev *dev) {
+    unsigned long flags;
+
+    spin_lock_irqsave(&dev->lock, flags);
+    dev->pending = true;
+    dev->echo_start = 0;
+    spin_unlock_irqrestore(&dev->lock, flags);
+
+    return BIT(dev->trigger_gpio);
+}
+
+
+// 上一個時槽的感測器若還沒收到回波結束，記為逾時
+static void hc_sr04_expire(struct hc_sr04_dev *dev) {
+    unsigned long flags;
+
+    spin_lock_irqsave(&dev->lock, flags);
+    if (dev->pending)
+        hc_sr04_complete(dev, 0, true);
+    spin_unlock_irqrestore(&dev->lock, flags);
+}
+
+// 感測器是否已設定好 trigger/echo 可以參與量測
+static bool hc_sr04_ready(const struct hc_sr04_dev *dev) {
+    return dev->trigger_set && dev->echo_irq;
+}
+
+// 一輪結束: 收集各顆本輪的結果成為一幀，喚醒等待者
+static void hc_sr04_publish_frame(void) {
+    struct hc_sr04_dev *dev;
+    unsigned long flags;
+    int i;
+
+    spin_lock_irqsave(&frame_lock, flags);
+    cur_frame.seq++;
+    cur_frame.ts_ns = ktime_get_ns();
+    cur_frame.valid_mask = 0;
+    cur_frame.brake_mask = 0;
+    for (i = 0; i < MAX_DEVICES; i++) {
+        dev = &devices[i];
+        cur_frame.distance_mm[i] = -1;
+        cur_frame.confidence[i] = 0;
+
+        spin_lock(&dev->lock);
+        if (hc_sr04_ready(dev) && dev->seq != dev->frame_seq) {
+            cur_frame.confidence[i] = dev->confidence;
+            if (!dev->timeout) {
+                cur_frame.distance_mm[i] = dev->distance_mm;
+                cur_frame.valid_mask |= 1 << i;
+            }
+        }
+        if (dev->brake_tripped)
+            cur_frame.brake_mask |= 1 << i;
+        dev->frame_seq = dev->seq;
+        spin_unlock(&dev->lock);
+    }
+    spin_unlock_irqrestore(&frame_lock, flags);
+
+    wake_up_interruptible(&frame_wq);
+}
+
+// 找 after 之後下一個有已設定感測器的群組 (循環)，都沒有回傳 -1
+static int hc_sr04_next_group(int after) {
+    int g, i, best = -1, lowest = -1;
+
+    for (i = 0; i < MAX_DEVICES; i++) {
+        if (!hc_sr04_ready(&devices[i]))
+            continue;
+        g = devices[i].group;
+        if (lowest < 0 || g < lowest)
+            lowest = g;
+        if (g > after && (best < 0 || g < best))
+            best = g;
+    }
+    return best >= 0 ? best : lowest;
+}
+
+// hrtimer: 每個時槽結束時收尾上一個群組，並觸發下一個群組
+// trigger 脈波由第二次到期結束 (不在中斷內 udelay 空轉 10us)，同群組的腳位一次寫入 GPSET0/GPCLR0
+static enum hrtimer_restart hc_sr04_sched(struct hrtimer *timer) {
+    int i, prev = sched_group;
+    u32 trig_mask = 0;
+    unsigned int rest_us;
+
+    // 0.脈波結束: 拉低 trigger，等到這個時槽結束
+    if (sched_trig_mask) {
+        car_gpio_clear_mask(sched_trig_mask);
+        sched_trig_mask = 0;
+        rest_us = slot_us > TRIG_PULSE_US ? slot_us - TRIG_PULSE_US : TRIG_PULSE_US;
+        hrtimer_forward_now(timer, ns_to_ktime((u64)rest_us * NSEC_PER_USEC));
+        return HRTIMER_RESTART;
+    }
+
+    // 1.上一個群組沒收到回波的記為逾時
+    if (prev >= 0) {
+        for (i = 0; i < MAX_DEVICES; i++)
+            if (devices[i].group == prev)
+                hc_sr04_expire(&devices[i]);
+    }
+
+    // 2.下一個群組，繞回開頭代表一輪結束 → 發布一幀
+    sched_group = hc_sr04_next_group(prev);
+    if (prev >= 0 && sched_group >= 0 && sched_group <= prev)
+        hc_sr04_publish_frame();
+
+    // 3.同群組的感測器一起觸發
+    for (i = 0; i < MAX_DEVICES; i++)
+        if (sched_group >= 0 && devices[i].group == sched_group && hc_sr04_ready(&devices[i]))
+            trig_mask |= hc_sr04_arm(&devices[i]);
+    if (trig_mask) {
+        car_gpio_set_mask(trig_mask);
+        sched_trig_mask = trig_mask;
+        hrtimer_forward_now(timer, ns_to_ktime((u64)TRIG_PULSE_US * NSEC_PER_USEC));
+        return HRTIMER_RESTART;
+    }
+
+    hrtimer_forward_now(timer, ns_to_ktime((u64)slot_us * NSEC_PER_USEC));
+    return HRTIMER_RESTART;
+}
+
+// 啟動排程 (第一個開啟者)，有設定煞車就重新取得馬達 driver
+static void hc_sr04_sched_start(void) {
+    if (hc_sr04_brake_armed() && hc_sr04_brake_hook_get() < 0)
+        printk("[HC-SR04] motor driver not loaded, brake only reported in frames\n");
+    sched_group = -1;
+    sched_trig_mask = 0;
+    hrtimer_start(&sched_timer, 0, HRTIMER_MODE_REL);
+}
+
+// 停止排程 (最後一個關閉者)，未完成的量測記為逾時
+static void hc_sr04_sched_stop(void) {
+    int i;
+
+    hrtimer_cancel(&sched_timer);
+    if (sched_trig_mask)                // 停在脈波中間: 拉低 trigger
+        car_gpio_clear_mask(sched_trig_mask);
+    sched_trig_mask = 0;
+    for (i = 0; i < MAX_DEVICES; i++) {
+        hc_sr04_expire(&devices[i]);
+        spin_lock_irq(&devices[i].lock);
+        devices[i].brake_count = 0;
+        devices[i].brake_tripped = false;
+        devices[i].zone = HC_SR04_ZONE_UNKNOWN;
+        devices[i].ring_pos = 0;
+        devices[i].ring_fill = 0;
+        spin_unlock_irq(&devices[i].lock);
+    }
+    sched_group = -1;
+
+    // 沒有人在量測，放開馬達 driver (讓它可以卸載)
+    hc_sr04_brake_hook_put();
+}
+
+
+// ---------------- 檔案操作 ----------------
+
+// open：裝置開啟時呼叫，第一個開啟者啟動觸發排程
 static int hc_sr04_open(struct inode *inode, struct file *file) {
     int minor = iminor(inode);          // 取得 minor number (代表第幾個裝置)
-    file->private_data = &devices[minor];
+    struct hc_sr04_file *f;
+
+    f = kzalloc(sizeof(*f), GFP_KERNEL);
+    if (!f)
+        return -ENOMEM;
+    f->dev = &devices[minor];
+    f->seen_seq = 0;
+    f->seen_frame = 0;
+    f->frame_mode = false;
+    f->zone_mode = false;
+    f->seen_zone = 0;
+    file->private_data = f;
+
+    mutex_lock(&sched_mutex);
+    if (atomic_inc_return(&open_count) == 1)
+        hc_sr04_sched_start();
+    mutex_unlock(&sched_mutex);
     return 0;
 }
 
-// release：裝置關閉時呼叫，這邊不用做什麼
+// release：最後一個關閉者停止觸發排程
 static int hc_sr04_release(struct inode *inode, struct file *file) {
+    mutex_lock(&sched_mutex);
+    if (atomic_dec_and_test(&open_count))
+        hc_sr04_sched_stop();
+    mutex_unlock(&sched_mutex);
+
+    kfree(file->private_data);
     return 0;
 }
 
-// read：用來觸發測距並回傳距離
+// read：回傳最新一次完成的距離 (mm)，不會等待聲波飛行時間
+// 只有在還沒有任何量測結果時才等待 (O_NONBLOCK 則回傳 -EAGAIN)
 static ssize_t hc_sr04_read(struct file *filp, char __user *buf, size_t len, loff_t *off) {
-    struct hc_sr04_dev *dev = filp->private_data;
-    ktime_t start, end;    // 記錄回波開始、結束時間
-    s64 duration_us;       // 回波持續時間 (微秒)
-    unsigned int distance_mm;  // 計算出來的距離 (mm)
+    struct hc_sr04_file *f = filp->private_data;
+    struct hc_sr04_dev *dev = f->dev;
+    unsigned int distance_mm;  // 最新的距離 (mm)
+    bool timeout;
     char outbuf[16];       // 輸出用 buffer
+    int n, ret;
 
-    u64 temp;
-    int timeout = 1000000; // 等待超時用 (防止無限迴圈)
-
-    // --- 觸發超音波脈波 ---
-    // 先確保 trigger 低電位
-    writel(readl(reg_GPCLR0) | (1 << dev->trigger_gpio), reg_GPCLR0);
-    udelay(2); // 2 微秒
-    // 產生 10 微秒高電位脈波
-    writel(readl(reg_GPSET0) | (1 << dev->trigger_gpio), reg_GPSET0);
-    udelay(10); // 10 微秒
-    // 再拉回低電位
-    writel(readl(reg_GPCLR0) | (1 << dev->trigger_gpio), reg_GPCLR0);
-
-    // --- 等待 echo 高電位開始 ---
-    while (((readl(reg_GPLEV0) >> dev->echo_gpio) & 0x1) == 0 && timeout--) cpu_relax();
-    if (timeout <= 0) return -EIO;   // 超時沒等到，回傳錯誤
-    start = ktime_get();             // 記錄回波開始時間
-
-    timeout = 1000000;
-    // --- 等待 echo 變低電位 (回波結束) ---
-    while (((readl(reg_GPLEV0) >> dev->echo_gpio) & 0x1) == 1 && timeout--) cpu_relax();
-    if (timeout <= 0) return -EIO;   // 超時沒等到，回傳錯誤
-    end = ktime_get();               // 記錄回波結束時間
-
-    // --- 計算距離 ---
-    duration_us = ktime_to_us(ktime_sub(end, start)); // 時間差 (微秒)
-    temp = duration_us * 340; // 聲速 340 m/s，單位換算：微秒*340
-    do_div(temp, 2);          // 往返距離除以2
-    do_div(temp, 1000);       // 轉為 mm
-    distance_mm = (unsigned int)temp;
+    // 1.還沒有任何結果
+    if (READ_ONCE(dev->seq) == 0) {
+        if (filp->f_flags & O_NONBLOCK)
+            return -EAGAIN;
+        ret = wait_event_interruptible(dev->wq, READ_ONCE(dev->seq) != 0);
+        if (ret)
+            return ret;
+    }
+
+    // 2.取出最新結果
+    spin_lock_irq(&dev->lock);
+    distance_mm = dev->distance_mm;
+    timeout = dev->timeout;
+    f->seen_seq = dev->seq;
+    spin_unlock_irq(&dev->lock);
+
+    if (timeout)
+        return -EIO;   // 最近一次沒等到回波
 
     // 距離以字串型式回傳
-    snprintf(outbuf, sizeof(outbuf), "%u", distance_mm);
-    return copy_to_user(buf, outbuf, strlen(outbuf)) ? -EFAULT : strlen(outbuf);
+    n = snprintf(outbuf, sizeof(outbuf), "%u", distance_mm);
+    if (len < n)
+        return -EINVAL;
+    return copy_to_user(buf, outbuf, n) ? -EFAULT : n;
 }
 
-// 設定 GPIO 腳位模式 (輸入/輸出)
-static void set_gpio_function(int gpio, int is_output) {
-    volatile uint32_t *reg;
-    uint32_t shift, val;
+// poll：有這個 file 還沒讀過的新量測時可讀
+// 幀模式下 (用過 GET_FRAME/WAIT_FRAME) 改成有還沒拿過的新幀時可讀，給 epoll 事件迴圈用
+// 區間模式下 (用過 SET_ZONES/GET_ZONE) 只在區間或煞車狀態改變時回 POLLPRI
+static __poll_t hc_sr04_poll(struct file *filp, poll_table *wait) {
+    struct hc_sr04_file *f = filp->private_data;
 
-    // 根據 GPIO 編號選對寄存器
-    if (gpio < 10) {
-        reg = reg_GPFSEL0;
-        shift = gpio * 3;
-    } else {
-        reg = reg_GPFSEL1;
-        shift = (gpio - 10) * 3;
+    if (READ_ONCE(f->zone_mode)) {
+        poll_wait(filp, &f->dev->zone_wq, wait);
+        if (READ_ONCE(f->dev->zone_seq) != f->seen_zone)
+            return EPOLLPRI;
+        return 0;
+    }
+
+    if (READ_ONCE(f->frame_mode)) {
+        poll_wait(filp, &frame_wq, wait);
+        if (READ_ONCE(cur_frame.seq) != f->seen_frame)
+            return EPOLLIN | EPOLLRDNORM;
+        return 0;
+    }
+
+    poll_wait(filp, &f->dev->wq, wait);
+    if (READ_ONCE(f->dev->seq) != f->seen_seq)
+        return EPOLLIN | EPOLLRDNORM;
+    return 0;
+}
+
+// 設定 echo 腳位並申請雙緣中斷 (需持有 sched_mutex)
+static int hc_sr04_set_echo(struct hc_sr04_dev *dev, int gpio) {
+    int ret;
+
+    // 先釋放舊的中斷
+    if (dev->echo_irq) {
+        car_gpio_free_irq(dev->echo_gpio, dev);
+        dev->echo_irq = false;
     }
 
-    // 先清除原來模式
-    val = readl(reg);
-    val &= ~(0x7 << shift);
-    if (is_output) {
-        val |= (0x1 << shift); // 設成 output
+    dev->echo_gpio = gpio;
+    car_gpio_set_function(dev->echo_gpio, CAR_GPIO_FUNC_IN);    // 設成輸入
+
+    ret = car_gpio_request_irq(gpio, hc_sr04_echo_irq, "hc_sr04", dev);
+    if (ret < 0) {
+        printk("[HC-SR04] echo GPIO%d irq failed: %d\n", gpio, ret);
+        return ret;
     }
-    writel(val, reg);
+    dev->echo_irq = true;
+    return 0;
 }
 
-// ioctl：可由 user-space 設定 trigger/echo 腳位
+// 取出最新一幀
+static void hc_sr04_get_frame(struct hc_sr04_frame *frame) {
+    spin_lock_irq(&frame_lock);
+    *frame = cur_frame;
+    spin_unlock_irq(&frame_lock);
+}
+
+// 幀相關 ioctl (不持有 sched_mutex，WAIT_FRAME 會睡眠)
+static long hc_sr04_frame_ioctl(struct hc_sr04_file *f, unsigned int cmd, unsigned long arg) {
+    struct hc_sr04_frame frame;
+    long ret;
+
+    WRITE_ONCE(f->frame_mode, true);
+
+    if (cmd == HC_SR04_WAIT_FRAME) {
+        // 等到比上次拿到的更新的一幀 (最多 1 秒，避免沒有感測器時卡死)
+        ret = wait_event_interruptible_timeout(frame_wq,
+                READ_ONCE(cur_frame.seq) != f->seen_frame, HZ);
+        if (ret == 0)
+            return -ETIMEDOUT;
+        if (ret < 0)
+            return ret;
+    }
+
+    hc_sr04_get_frame(&frame);
+    if (frame.seq == 0)
+        return -EAGAIN;    // 還沒有任何一幀
+    f->seen_frame = frame.seq;
+
+    if (copy_to_user((void __user *)arg, &frame, sizeof(frame)))
+        return -EFAULT;
+    return 0;
+}
+
+// ioctl：可由 user-space 設定 trigger/echo 腳位、干擾群組，讀取整幀
 static long hc_sr04_ioctl(struct file *file, unsigned int cmd, unsigned long arg) {
-    struct hc_sr04_dev *dev = file->private_data;
+    struct hc_sr04_file *f = file->private_data;
+    struct hc_sr04_dev *dev = f->dev;
+    struct hc_sr04_brake brake;
+    struct hc_sr04_zones zones;
+    struct hc_sr04_filter filter;
+    int ret = 0;
+
+    if (cmd == HC_SR04_GET_FRAME || cmd == HC_SR04_WAIT_FRAME)
+        return hc_sr04_frame_ioctl(f, cmd, arg);
+    if (cmd == HC_SR04_GET_ZONE)
+        return hc_sr04_get_zone(f, arg);
+    if (cmd == HC_SR04_SET_BRAKE &&
+        copy_from_user(&brake, (void __user *)arg, sizeof(brake)))
+        return -EFAULT;
+    if (cmd == HC_SR04_SET_ZONES &&
+        copy_from_user(&zones, (void __user *)arg, sizeof(zones)))
+        return -EFAULT;
+    if (cmd == HC_SR04_SET_FILTER &&
+        copy_from_user(&filter, (void __user *)arg, sizeof(filter)))
+        return -EFAULT;
 
+    mutex_lock(&sched_mutex);
     switch (cmd) {
         case HC_SR04_SET_TRIGGER:
+            if (arg >= CAR_GPIO_BANK_PINS) {
+                ret = -EINVAL;
+                break;
+            }
             dev->trigger_gpio = arg;
-            set_gpio_function(dev->trigger_gpio, 1); // 設成輸出
+            car_gpio_set_function(dev->trigger_gpio, CAR_GPIO_FUNC_OUT); // 設成輸出
+            car_gpio_clear_mask(BIT(dev->trigger_gpio));
+            dev->trigger_set = true;
             break;
         case HC_SR04_SET_ECHO:
-            dev->echo_gpio = arg;
-            set_gpio_function(dev->echo_gpio, 0);    // 設成輸入
+            if (arg >= CAR_GPIO_BANK_PINS) {
+                ret = -EINVAL;
+                break;
+            }
+            ret = hc_sr04_set_echo(dev, arg);
+            break;
+        case HC_SR04_SET_GROUP:
+            if (arg >= MAX_DEVICES) {
+                ret = -EINVAL;
+                break;
+            }
+            dev->group = arg;
+            break;
+        case HC_SR04_SET_BRAKE:
+            ret = hc_sr04_set_brake(dev, &brake);
+            break;
+        case HC_SR04_SET_ZONES:
+            ret = hc_sr04_set_zones(dev, &zones);
+            if (ret == 0)
+                WRITE_ONCE(f->zone_mode, true);
+            break;
+        case HC_SR04_SET_FILTER:
+            ret = hc_sr04_set_filter(dev, &filter);
             break;
         default:
-            return -EINVAL; // 不支援的命令
+            ret = -EINVAL; // 不支援的命令
     }
-    return 0;
+    mutex_unlock(&sched_mutex);
+    return ret;
 }
 
 // 檔案操作函式表
@@ -140,6 +805,7 @@ static struct file_operations hc_sr04_fops = {
     .open = hc_sr04_open,
     .release = hc_sr04_release,
     .read = hc_sr04_read,
+    .poll = hc_sr04_poll,
     .unlocked_ioctl = hc_sr04_ioctl,
 };
 
@@ -149,19 +815,22 @@ static int __init hc_sr04_init(void) {
     alloc_chrdev_region(&dev_number, 0, MAX_DEVICES, DEVICE_NAME); // 申請裝置編號
     ultra_class = class_create(DEVICE_NAME);                       // 創建裝置類別 (for /dev/)
 
-    // 取得/對應 GPIO 寄存器的虛擬記憶體位址
-    PERIBase = ioremap(GPIO_BASE, 0x100);
-    reg_GPFSEL0 = PERIBase + (GPFSEL0 / 4);
-    reg_GPFSEL1 = PERIBase + (GPFSEL1 / 4);
-    reg_GPSET0  = PERIBase + (GPSET0 / 4);
-    reg_GPCLR0  = PERIBase + (GPCLR0 / 4);
-    reg_GPLEV0  = PERIBase + (GPLEV0 / 4);
+    // 觸發排程用的 hrtimer (開啟裝置時才啟動)
+    hrtimer_init(&sched_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    sched_timer.function = hc_sr04_sched;
 
     // 建立多個裝置節點
     for (i = 0; i < MAX_DEVICES; i++) {
         devices[i].index = i;
         devices[i].trigger_gpio = 3; // 預設 trigger
         devices[i].echo_gpio = 4;    // 預設 echo
+        devices[i].echo_irq = false; // echo 由 ioctl 設定後才申請中斷
+        devices[i].group = i % 2;    // 預設兩組: 0/2 一組、1/3 一組
+        devices[i].filter_n = 1;     // 預設不濾波 (每次量測直接回報)
+        devices[i].filter_min_valid = 1;
+        spin_lock_init(&devices[i].lock);
+        init_waitqueue_head(&devices[i].wq);
+        init_waitqueue_head(&devices[i].zone_wq);
         cdev_init(&cdevs[i], &hc_sr04_fops);
         cdevs[i].owner = THIS_MODULE;
         cdev_add(&cdevs[i], MKDEV(MAJOR(dev_number), i), 1);
@@ -175,13 +844,16 @@ static int __init hc_sr04_init(void) {
 // 模組卸載函式
 static void __exit hc_sr04_exit(void) {
     int i;
+    hrtimer_cancel(&sched_timer);
+    hc_sr04_brake_hook_put();
     for (i = 0; i < MAX_DEVICES; i++) {
+        if (devices[i].echo_irq)
+            car_gpio_free_irq(devices[i].echo_gpio, &devices[i]);
         device_destroy(ultra_class, MKDEV(MAJOR(dev_number), i));
         cdev_del(&cdevs[i]);
     }
     class_destroy(ultra_class);
     unregister_chrdev_region(dev_number, MAX_DEVICES);
-    iounmap(PERIBase); // 釋放 ioremap 的資源
     printk("[HC-SR04] Driver unloaded\n");
 }
 
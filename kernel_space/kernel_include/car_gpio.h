@@ -0,0 +1,40 @@
+// 車上各 driver 共用的 GPIO 存取層 (car_gpio.ko 匯出)
+// 只有 car_gpio 會 ioremap GPIO 暫存器，其他 driver 透過這裡存取
+// 載入時 sim=1 改用一般記憶體模擬暫存器 (沒有樹莓派也能載入，由 debugfs 驅動輸入)
+
+#ifndef __CAR_GPIO_H__
+#define __CAR_GPIO_H__
+
+#include <linux/types.h>
+#include <linux/bits.h>
+#include <linux/interrupt.h>	// irq_handler_t
+
+// 只支援 bank 0 (GPIO 0~31)，車上所有腳位都在這裡
+#define CAR_GPIO_BANK_PINS	32
+
+// GPFSEL 功能代碼 (BCM2711 datasheet)
+#define CAR_GPIO_FUNC_IN	0
+#define CAR_GPIO_FUNC_OUT	1
+#define CAR_GPIO_FUNC_ALT0	4
+#define CAR_GPIO_FUNC_ALT5	2
+
+// 一次讀取 GPLEV0，回傳 mask 內各腳位的電位 (同一個時間點，不會讀到一半的狀態)
+u32 car_gpio_read_bank(u32 mask);
+
+// mask 內的腳位一起設為高/低電位 (GPSET0/GPCLR0 只寫，不影響其他腳位，可在中斷內呼叫)
+void car_gpio_set_mask(u32 mask);
+void car_gpio_clear_mask(u32 mask);
+
+// 設定腳位功能 (CAR_GPIO_FUNC_*)，GPFSEL 讀-改-寫由 car_gpio 上鎖
+// 回傳=> 0成功 -EINVAL 腳位或功能不合法
+int car_gpio_set_function(unsigned int gpio, unsigned int func);
+
+// 腳位雙緣中斷，每支腳一個 handler
+// 實體板子: gpio_to_irq + request_irq；sim=1: 模擬的電位改變時直接呼叫 (關中斷，和硬體中斷一樣)
+// handler 內不可再改變模擬的電位 (car_gpio_set_mask/clear_mask)
+// 回傳=> 0成功 負值失敗
+int car_gpio_request_irq(unsigned int gpio, irq_handler_t handler, const char *name, void *dev_id);
+void car_gpio_free_irq(unsigned int gpio, void *dev_id);
+void car_gpio_synchronize_irq(unsigned int gpio);   // 等正在執行的 handler 結束
+
+#endif
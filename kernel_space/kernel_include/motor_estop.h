@@ -0,0 +1,16 @@
+/* 馬達 driver (motorv1.c) 匯出給其他 kernel driver 的緊急停車
+ * 用 symbol_get(motor_emergency_stop) 取得，馬達 driver 沒載入時不影響其他 driver 載入
+ * (motor_gpio.h 和 user space 共用且帶 GPIO 暫存器定義，其他 driver 改引入這個檔) */
+#ifndef _MOTOR_ESTOP_H_
+#define _MOTOR_ESTOP_H_
+
+#include <linux/types.h>
+
+/* 故障來源，和 motor_gpio.h 的定義相同 (兩邊都引入時定義不同會有警告) */
+#define MOTOR_FAULT_SONIC    1
+
+/* 立即停車並鎖定故障，解除 (IOCTL_CLEAR_FAULT) 前拒絕出力命令
+ * 可在中斷內呼叫  回傳=> 0成功 -ENODEV 馬達 driver 尚未 probe -EINVAL 來源為 0 */
+int motor_emergency_stop(u32 source);
+
+#endif
@@ -39,6 +39,9 @@
 #ifndef _MOTOR_GPIO_H_
 #define _MOTOR_GPIO_H_
 
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
 /* BCM2711 (Pi4) GPIO 暫存器定義 */
 #define BCM2711_GPIO_BASE  0xFE200000
 #define GPIO_SIZE          0x1000
@@ -74,5 +77,101 @@
 #define IOCTL_TURN_LEFT         _IO(MOTOR_IOC_MAGIC, 11)           // 左轉 (左馬達反轉，右馬達前進)
 #define IOCTL_TURN_RIGHT        _IO(MOTOR_IOC_MAGIC, 12)           // 右轉 (左馬達前進，右馬達反轉)
 #define IOCTL_SET_PERIOD        _IOW(MOTOR_IOC_MAGIC, 13, unsigned int)
+#define IOCTL_SET_DRIVE         _IOW(MOTOR_IOC_MAGIC, 14, struct motor_drive) // 一次設定雙輪方向與速度
+#define IOCTL_SHM_DOORBELL      _IO(MOTOR_IOC_MAGIC, 15)                      // 立即套用共用頁上的命令 (不複製參數)
+#define IOCTL_SET_SHM_POLL      _IOW(MOTOR_IOC_MAGIC, 16, unsigned int)        // 共用頁檢查週期 (us)，0 = 只靠 doorbell
+#define IOCTL_SET_RAMP          _IOW(MOTOR_IOC_MAGIC, 17, struct motor_ramp)   // 目標速度 + 加速度上限，driver 逐步調整
+#define IOCTL_GET_RAMP          _IOR(MOTOR_IOC_MAGIC, 18, struct motor_ramp_state) // 目前漸變狀態
+#define IOCTL_GET_FAULT         _IOR(MOTOR_IOC_MAGIC, 19, struct motor_fault)  // 故障鎖定狀態
+#define IOCTL_CLEAR_FAULT       _IO(MOTOR_IOC_MAGIC, 20)                       // 解除故障鎖定 (之後才接受出力命令)
+
+/* IOCTL_SET_DRIVE 參數: 兩輪在同一把鎖內一起更新 (避免兩輪不同時改變造成車身抖動) */
+struct motor_drive {
+    __s32 left_dir;      // 左馬達方向 (1:前進, -1:後退, 0:停止)
+    __s32 right_dir;     // 右馬達方向
+    __u32 left_speed;    // 左馬達速度 (0-100%)
+    __u32 right_speed;   // 右馬達速度 (0-100%)
+};
+
+/* IOCTL_SET_RAMP 參數: driver 以 hrtimer 每 MOTOR_RAMP_TICK_US 把占空比往目標調整，
+ * 每秒最多改變 accel %；方向相反時先減到 0 再反轉 (不會瞬間倒轉)
+ * 之後的 IOCTL_SET_DRIVE/共用頁命令/停車 會取消進行中的漸變 */
+#define MOTOR_RAMP_TICK_US   5000        // 漸變步進週期 (us)
+#define MOTOR_RAMP_ACCEL_MAX 10000       // 加速度上限的最大值 (%/s)
+
+struct motor_ramp {
+    struct motor_drive target;   // 目標方向與速度
+    __u32 left_accel;            // 左輪加速度上限 (%/s)，0 = 立即
+    __u32 right_accel;           // 右輪加速度上限 (%/s)，0 = 立即
+};
+
+/* 目前漸變狀態 (速度單位 0.1%，正 = 前進，負 = 後退) */
+struct motor_ramp_state {
+    __s32 left_cur;
+    __s32 right_cur;
+    __s32 left_target;
+    __s32 right_target;
+    __u32 left_accel;
+    __u32 right_accel;
+    __u32 active;                // 1 = 還沒到達目標
+    __u32 reserved;
+};
+
+/* 故障鎖定: 其他 driver (例如超聲波) 在 kernel 內呼叫 motor_emergency_stop() 立即停車，
+ * 解除 (IOCTL_CLEAR_FAULT) 之前出力命令 (SET_DRIVE/SET_RAMP/單輪指令/共用頁) 回 -EPERM，停車指令照常 */
+#define MOTOR_FAULT_NONE     0
+#define MOTOR_FAULT_SONIC    1           // 超聲波緊急煞車 (hc_sr04 driver)
+
+struct motor_fault {
+    __u32 latched;               // MOTOR_FAULT_*，0 = 沒有鎖定
+    __u32 count;                 // 累計觸發次數
+    __u64 ts_ns;                 // 最近一次觸發時間 CLOCK_MONOTONIC
+};
+
+/* ===== mmap 共用頁 (mmap /dev/motor0 第 0 頁) =====
+ * 命令: user 寫，seqlock 保護 (cmd_seq 奇數 = 寫入中)
+ *   cmd_seq++ -> 寫 cmd/cmd_ns/cmd_gen++ -> cmd_seq++
+ *   driver 以 hrtimer 每 poll_us 檢查 cmd_gen，有新命令就套用；或由 IOCTL_SHM_DOORBELL 立即套用
+ * 狀態: driver 寫，st_seq 保護，讀法相同 (st_seq 奇數或前後不同就重讀)
+ *   ioctl 的 IOCTL_SET_DRIVE/IOCTL_BOTH_STOP 也會更新狀態，並讓之前寫在共用頁的命令失效
+ * 三個區塊各佔一條 64 bytes cache line，user 與 driver 不寫同一條 */
+#define MOTOR_SHM_MAGIC      0x4D4F5452  // "MOTR"
+#define MOTOR_SHM_VERSION    1
+#define MOTOR_SHM_POLL_US    1000        // 預設檢查週期 (us)
+
+/* 最後改變輸出的來源 */
+#define MOTOR_SRC_NONE       0
+#define MOTOR_SRC_IOCTL      1           // IOCTL_SET_DRIVE
+#define MOTOR_SRC_SHM        2           // 共用頁命令
+#define MOTOR_SRC_STOP       3           // IOCTL_BOTH_STOP / 關閉裝置
+#define MOTOR_SRC_RAMP       4           // IOCTL_SET_RAMP 漸變中的一步
+#define MOTOR_SRC_FAULT      5           // motor_emergency_stop() 故障停車
+
+struct motor_shm {
+    /* 資訊 (driver 寫) */
+    __u32 magic;                 // MOTOR_SHM_MAGIC
+    __u32 version;               // MOTOR_SHM_VERSION
+    __u32 poll_us;               // 目前檢查週期，0 = 只靠 doorbell
+    __u32 reserved0[13];
+
+    /* 命令 (user 寫) */
+    __u32 cmd_seq;
+    __u32 cmd_gen;               // 每個新命令 +1
+    struct motor_drive cmd;
+    __u64 cmd_ns;                // 寫入時間 CLOCK_MONOTONIC (選填，driver 原樣帶回狀態)
+    __u32 reserved1[8];
+
+    /* 狀態 (driver 寫) */
+    __u32 st_seq;
+    __u32 applied_gen;           // 最後處理的命令 generation
+    struct motor_drive applied;  // 目前輸出
+    __u64 applied_cmd_ns;        // 該命令的 cmd_ns
+    __u64 applied_ns;            // 套用時間 CLOCK_MONOTONIC
+    __u32 applied_count;         // 套用的共用頁命令數
+    __u32 rejected_count;        // 參數不合法被丟棄的共用頁命令數
+    __u32 source;                // MOTOR_SRC_*
+    __u32 fault;                 // 故障鎖定 MOTOR_FAULT_* (0 = 沒有)，不用系統呼叫就能檢查
+    __u32 reserved2[2];
+};
 
 #endif
\ No newline at end of file
@@ -4,6 +4,7 @@
 #define __TCRT5000_HAL_H__
 
 int read_gpio(int gpio);
+int read_gpio_state(void);	// 3 顆一次讀取 (左 << 2 | 中 << 1 | 右)
 
 #endif
 
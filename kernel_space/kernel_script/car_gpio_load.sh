@@ -0,0 +1,15 @@
+#!/bin/sh
+set -x  # 顯示每個指令（方便除錯）
+
+# 共用 GPIO 存取層: buzzer、tcrt5000_hal、hc_sr04、motorv1 都需要它，必須最先載入
+# 已載入就跳過 (可以重複呼叫)
+# 參數直接交給 insmod，例如 ./car_gpio_load.sh sim=1 (模擬模式，見 sim_load.sh)
+
+module="/home/pi/rpi_project/modules/car_gpio.ko"
+
+if lsmod | grep -q "^car_gpio "; then
+  echo "car_gpio already loaded"
+  exit 0
+fi
+
+/sbin/insmod $module "$@" || exit 1
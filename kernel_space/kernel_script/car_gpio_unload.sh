@@ -0,0 +1,12 @@
+#!/bin/sh
+
+# 共用 GPIO 存取層，必須最後卸載 (還有 driver 使用時 rmmod 會失敗)
+
+module="car_gpio"
+
+if ! lsmod | grep -q "^car_gpio "; then
+  echo "car_gpio not loaded"
+  exit 0
+fi
+
+/sbin/rmmod $module || exit 1
@@ -1,6 +1,6 @@
 #!/bin/bash
 
-# 總腳本(掛載功能): 依序載入buzzer、tcrt5000(紅外線)、HC-SR04(超聲波)、馬達控制器 
+# 總腳本(掛載功能): 依序載入共用 GPIO 層、buzzer、tcrt5000(紅外線)、HC-SR04(超聲波)、馬達控制器 
 
 # 設定模組腳本所在的資料夾(避免路徑不同找不到檔案)
 SCRIPT_DIR="/home/pi/rpi_project/kernel_space/kernel_script"
@@ -8,6 +8,13 @@ SCRIPT_DIR="/home/pi/rpi_project/kernel_space/kernel_script"
 echo ">>> 開始載入所有模組..."
 
 
+# 0. 載入共用 GPIO 存取層 (其他模組都用它存取 GPIO 暫存器)
+if ! $SCRIPT_DIR/car_gpio_load.sh; then
+    echo "[ERROR] car_gpio_load.sh 載入失敗"
+    exit 1
+fi
+
+
 # 1. 載入蜂鳴器(Buzzer)模組
 if ! $SCRIPT_DIR/buzzy_load.sh; then
     echo "[ERROR] buzzy_load.sh 載入失敗"
@@ -1,6 +1,6 @@
 #!/bin/bash
 
-# 總腳本(卸載模組): 依序卸載 buzzer、tcrt5000(紅外線)、hc-sr04(超聲波)、馬達控制器
+# 總腳本(卸載模組): 依序卸載 buzzer、tcrt5000(紅外線)、hc-sr04(超聲波)、馬達控制器、共用 GPIO 層
 
 # 設定模組腳本所在的資料夾
 SCRIPT_DIR="/home/pi/rpi_project/kernel_space/kernel_script"
@@ -34,7 +34,13 @@ if ! $SCRIPT_DIR/motor_unload.sh; then
     exit 1
 fi
 
+# 5. 卸載共用 GPIO 存取層 (最後，其他模組都卸載後才能移除)
+if ! $SCRIPT_DIR/car_gpio_unload.sh; then
+    echo "[ERROR] car_gpio_unload.sh 卸載失敗"
+    exit 1
+fi
+
 
-# 5. 全部模組卸載成功
+# 6. 全部模組卸載成功
 echo ">>> 所有模組卸載成功!"
 exit 0
@@ -0,0 +1,47 @@
+#!/bin/bash
+
+# 模擬模式總腳本: 沒有樹莓派也能載入 buzzer、tcrt5000(紅外線)、HC-SR04(超聲波)
+# car_gpio 以 sim=1 載入，GPIO 暫存器改用記憶體，輸入由 debugfs 控制:
+#   echo "9 1" > /sys/kernel/debug/car_gpio/level        左側紅外線 (GPIO9) 拉高
+#   echo "0 1 300" > /sys/kernel/debug/car_gpio/sonar    前左超聲波量到 30cm (0 = 沒有回波，-1 移除)
+#   cat /sys/kernel/debug/car_gpio/regs                  輸出電位與腳位功能
+# 馬達走 pwm/gpiod framework (需要 device tree)，模擬模式不載入
+
+# 設定模組腳本所在的資料夾(避免路徑不同找不到檔案)
+SCRIPT_DIR="/home/pi/rpi_project/kernel_space/kernel_script"
+SIM_DIR="/sys/kernel/debug/car_gpio"
+
+echo ">>> 模擬模式載入模組..."
+
+
+# 0. 以模擬模式載入共用 GPIO 存取層 (已經用實體模式載入就不能模擬)
+if lsmod | grep -q "^car_gpio " && [ ! -d $SIM_DIR ]; then
+    echo "[ERROR] car_gpio 已用實體模式載入，請先執行 device_unload.sh"
+    exit 1
+fi
+if ! $SCRIPT_DIR/car_gpio_load.sh sim=1; then
+    echo "[ERROR] car_gpio_load.sh 載入失敗"
+    exit 1
+fi
+
+
+# 1. 預設 4 顆超聲波都量到 1m (腳位同 user_space hcsr04.c)
+for pins in "0 1" "4 5" "6 7" "12 13"
+do
+    echo "$pins 1000" > $SIM_DIR/sonar
+done
+
+
+# 2. 載入 buzzer、tcrt5000、HC-SR04
+for script in buzzy_load.sh tcrt_load.sh hc_sr04_load.sh
+do
+    if ! $SCRIPT_DIR/$script; then
+        echo "[ERROR] $script 載入失敗"
+        exit 1
+    fi
+done
+
+
+# 3. 全部模組載成功
+echo ">>> 模擬模式載入成功，輸入由 $SIM_DIR 控制"
+exit 0
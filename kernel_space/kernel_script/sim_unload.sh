@@ -0,0 +1,19 @@
+#!/bin/bash
+
+# 模擬模式總腳本(卸載): 依序卸載 buzzer、tcrt5000、HC-SR04，最後卸載 car_gpio
+
+# 設定模組腳本所在的資料夾
+SCRIPT_DIR="/home/pi/rpi_project/kernel_space/kernel_script"
+
+echo ">>> 模擬模式卸載模組..."
+
+for script in buzzy_unload.sh tcrt_unload.sh hc_sr04_unload.sh car_gpio_unload.sh
+do
+    if ! $SCRIPT_DIR/$script; then
+        echo "[ERROR] $script 卸載失敗"
+        exit 1
+    fi
+done
+
+echo ">>> 模擬模式卸載成功!"
+exit 0
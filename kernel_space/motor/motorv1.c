@@ -15,7 +15,14 @@
 #include <linux/platform_device.h>
 #include <linux/of.h>
 #include <linux/of_device.h>
+#include <linux/mutex.h>
+#include <linux/mm.h>
+#include <linux/hrtimer.h>
+#include <linux/workqueue.h>
+#include <linux/math64.h>
 #include "motor_gpio.h"
+#include "motor_estop.h"
+#include "car_gpio.h"       // 共用 GPIO 存取層 (car_gpio.ko)
 
 /* ===== 基本定義 ===== */
 #define DEVICE_NAME "motor"
@@ -26,7 +33,6 @@ struct l298n_dev {
     struct cdev cdev;                    // 字符設備結構
     struct class *class;                 // 設備類別
     dev_t dev_num;                       // 設備號碼
-    void __iomem *gpio_base;             // GPIO暫存器基址
     unsigned int period_ns;              // PWM週期 (奈秒)
     unsigned int duty_ns;                // PWM duty cycle (奈秒)
     bool gpio_requested;                 // GPIO是否已申請
@@ -35,6 +41,30 @@ struct l298n_dev {
     int right_speed;                     // 右馬達速度 (0-100%)
     struct device *device;               // 設備指標
     struct platform_device *pdev;       // 平台設備指標
+    struct mutex lock;                   // 保護 GPIO 方向腳與 PWM (ioctl/release/共用頁工作 互斥)
+
+    /* mmap 共用頁 */
+    struct motor_shm *shm;               // 命令/狀態共用頁
+    u32 shm_gen;                         // 最後處理的命令 generation
+    ktime_t shm_period;                  // 檢查週期，0 = 只靠 doorbell
+    struct hrtimer shm_timer;            // 週期檢查新命令 (hardirq，只排工作)
+    struct work_struct shm_work;         // 套用命令 (可睡眠)
+    atomic_t shm_maps;                   // 目前的映射數，沒有映射就停止檢查
+
+    /* 加速度漸變 (速度單位 0.1%，正 = 前進) [0]=左 [1]=右 */
+    int ramp_cur[2];                     // 目前輸出
+    int ramp_target[2];                  // 目標
+    unsigned int ramp_accel[2];          // 加速度上限 %/s，0 = 立即
+    bool ramp_active;                    // 還沒到達目標
+    ktime_t ramp_last;                   // 上一步的時間 (依實際經過時間計算步幅)
+    struct hrtimer ramp_timer;           // 每 MOTOR_RAMP_TICK_US 一步 (hardirq，只排工作)
+    struct work_struct ramp_work;        // 調整占空比 (可睡眠)
+
+    /* 故障鎖定 (motor_emergency_stop，可能在其他 driver 的中斷內觸發) */
+    atomic_t fault;                      // MOTOR_FAULT_*，0 = 沒有鎖定
+    u32 fault_count;                     // 累計觸發次數
+    u64 fault_ns;                        // 最近一次觸發時間
+    struct work_struct fault_work;       // 在 lock 內完整停車 (PWM 操作可能睡眠)
 
     // GPIO descriptors
     struct gpio_desc *gpio_in1;
@@ -48,6 +78,13 @@ struct l298n_dev {
 
 static struct l298n_dev *global_motor_dev = NULL;
 
+static void motor_shm_work(struct work_struct *work);
+static enum hrtimer_restart motor_shm_timer(struct hrtimer *timer);
+static void shm_supersede(struct l298n_dev *ln, const struct motor_drive *d, u32 source);
+static void motor_ramp_work(struct work_struct *work);
+static enum hrtimer_restart motor_ramp_timer(struct hrtimer *timer);
+static void motor_fault_work(struct work_struct *work);
+
 /* ===== Platform Driver 函數 ===== */
 
 static int motor_probe(struct platform_device *pdev)
@@ -63,6 +100,7 @@ static int motor_probe(struct platform_device *pdev)
         return -ENOMEM;
 
     ln->pdev = pdev;
+    mutex_init(&ln->lock);
     platform_set_drvdata(pdev, ln);
     global_motor_dev = ln;
 
@@ -125,6 +163,31 @@ static int motor_probe(struct platform_device *pdev)
     }
 
     ln->pwm_configured = true;
+
+    /* mmap 共用頁 (user 直接寫命令、讀狀態) */
+    ln->shm = (struct motor_shm *)devm_get_free_pages(dev, GFP_KERNEL | __GFP_ZERO, 0);
+    if (!ln->shm) {
+        pwm_disable(ln->pwm0);
+        pwm_disable(ln->pwm1);
+        return -ENOMEM;
+    }
+    ln->shm->magic = MOTOR_SHM_MAGIC;
+    ln->shm->version = MOTOR_SHM_VERSION;
+    ln->shm->poll_us = MOTOR_SHM_POLL_US;
+    ln->shm_period = us_to_ktime(MOTOR_SHM_POLL_US);
+    INIT_WORK(&ln->shm_work, motor_shm_work);
+    hrtimer_init(&ln->shm_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    ln->shm_timer.function = motor_shm_timer;
+
+    /* 加速度漸變 */
+    INIT_WORK(&ln->ramp_work, motor_ramp_work);
+    hrtimer_init(&ln->ramp_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+    ln->ramp_timer.function = motor_ramp_timer;
+
+    /* 故障鎖定 */
+    atomic_set(&ln->fault, MOTOR_FAULT_NONE);
+    INIT_WORK(&ln->fault_work, motor_fault_work);
+
     dev_info(dev, "Motor driver probe completed successfully\n");
 
     return 0;
@@ -140,6 +203,15 @@ static void motor_remove(struct platform_device *pdev)
         pr_info("err\n");
         //REMOVE_RETURN_VALUE;
 
+    /* 先停掉共用頁的檢查，之後不會再改 PWM */
+    hrtimer_cancel(&ln->shm_timer);
+    cancel_work_sync(&ln->shm_work);
+    ln->ramp_active = false;
+    hrtimer_cancel(&ln->ramp_timer);
+    cancel_work_sync(&ln->ramp_work);
+    global_motor_dev = NULL;             /* 之後 motor_emergency_stop 回 -ENODEV */
+    cancel_work_sync(&ln->fault_work);
+
     if (ln->pwm_configured) {
         /* 停止PWM並設定安全狀態 */
         pwm_config(ln->pwm0, 0, ln->period_ns);
@@ -174,38 +246,17 @@ static struct platform_driver motor_platform_driver = {
 
 /* ===== GPIO 控制函數 ===== */
 
+/* GPFSEL 由共用的 car_gpio 讀-改-寫 (和其他 driver 互斥) */
 static void gpio_set_function(int gpio, int func)
 {
-    u32 reg_offset, shift, val;
-    
-    if (!global_motor_dev || !global_motor_dev->gpio_base)
-        return;
-    
-    reg_offset = (gpio / 10) * 4;
-    shift = (gpio % 10) * 3;
-    
-    val = readl(global_motor_dev->gpio_base + reg_offset);
-    val &= ~(7 << shift);
-    val |= (func << shift);
-    writel(val, global_motor_dev->gpio_base + reg_offset);
-    
-    dev_info(&global_motor_dev->pdev->dev, "GPIO%d 設定為功能 %d\n", gpio, func);
-}
-
-static void gpio_set_high(int gpio)
-{
-    if (!global_motor_dev || !global_motor_dev->gpio_base)
+    if (!global_motor_dev)
         return;
-        
-    writel(1 << gpio, global_motor_dev->gpio_base + GPSET0);
-}
 
-static void gpio_set_low(int gpio)
-{
-    if (!global_motor_dev || !global_motor_dev->gpio_base)
+    if (car_gpio_set_function(gpio, func) < 0) {
+        dev_warn(&global_motor_dev->pdev->dev, "GPIO%d 功能設定失敗\n", gpio);
         return;
-        
-    writel(1 << gpio, global_motor_dev->gpio_base + GPCLR0);
+    }
+    dev_info(&global_motor_dev->pdev->dev, "GPIO%d 設定為功能 %d\n", gpio, func);
 }
 
 static int setup_gpio_pins(void)
@@ -253,10 +304,10 @@ static int setup_gpio_pins(void)
     desc_to_gpio(global_motor_dev->gpio_in4),
         
     
-    /* 如果有映射GPIO記憶體，設定PWM功能 */
+    /* 設定PWM功能 (GPFSEL 經由 car_gpio) */
     
-        gpio_set_function(PWM_LEFT_GPIO, 2);    // GPIO18 PWM0_0
-        gpio_set_function(PWM_RIGHT_GPIO, 2);   // GPIO19 PWM0_1
+        gpio_set_function(PWM_LEFT_GPIO, CAR_GPIO_FUNC_ALT5);    // GPIO18 PWM0_0
+        gpio_set_function(PWM_RIGHT_GPIO, CAR_GPIO_FUNC_ALT5);   // GPIO19 PWM0_1
     
     
     dev_info(&global_motor_dev->pdev->dev, "GPIO腳位設定完成\n");
@@ -278,7 +329,6 @@ static int set_motor_speed_pwm(struct pwm_device *pwm, int speed)
     
     duty = (global_motor_dev->period_ns * speed) / 100;
 
-    printk("284 duty is %d , period is %d\n",global_motor_dev->duty_ns,global_motor_dev->period_ns);
     return pwm_config(pwm, duty, global_motor_dev->period_ns);
 }
 
@@ -432,33 +482,466 @@ static int motor_open(struct inode *inode, struct file *file)
 }
 
 static int motor_release(struct inode *inode, struct file *file)
+{
+    /* 唯讀開啟的是監看工具 (只讀共用頁)，關閉時不影響馬達 */
+    if (!global_motor_dev || !(file->f_mode & FMODE_WRITE))
+        return 0;
+
+    dev_info(&global_motor_dev->pdev->dev, "馬達設備已關閉，停止所有馬達\n");
+    mutex_lock(&global_motor_dev->lock);
+    global_motor_dev->ramp_active = false;
+    stop_all_motors();
+    global_motor_dev->ramp_cur[0] = global_motor_dev->ramp_cur[1] = 0;
+    shm_supersede(global_motor_dev, &(struct motor_drive){ 0 }, MOTOR_SRC_STOP);
+    mutex_unlock(&global_motor_dev->lock);
+    return 0;
+}
+
+/* 設定單輪方向腳 (a=1,b=0 前進; a=0,b=1 後退; 皆 0 停止) */
+static void set_wheel_dir(struct gpio_desc *a, struct gpio_desc *b, int dir)
+{
+    gpiod_set_value(a, dir > 0);
+    gpiod_set_value(b, dir < 0);
+}
+
+/* 兩輪輸出 (呼叫者持有 lock)，left/right 單位 0.1%，正 = 前進 負 = 後退
+ * 先算好兩輪占空比，再依序設方向腳、PWM，兩輪的改變緊接在一起 */
+static int motor_output(struct l298n_dev *ln, int left, int right)
+{
+    unsigned int left_duty, right_duty;
+    int ret = 0;
+
+    left_duty = (unsigned int)(((u64)ln->period_ns * abs(left)) / 1000);
+    right_duty = (unsigned int)(((u64)ln->period_ns * abs(right)) / 1000);
+
+    /* 1.方向 (左輪 IN3/IN4，右輪 IN1/IN2) */
+    set_wheel_dir(ln->gpio_in3, ln->gpio_in4, left);
+    set_wheel_dir(ln->gpio_in1, ln->gpio_in2, right);
+
+    /* 2.速度 (左輪 PWM1，右輪 PWM0) */
+    if (ln->pwm_configured) {
+        ret = pwm_config(ln->pwm1, left_duty, ln->period_ns);
+        if (ret == 0)
+            ret = pwm_config(ln->pwm0, right_duty, ln->period_ns);
+        if (ret == 0) {
+            pwm_enable(ln->pwm1);
+            pwm_enable(ln->pwm0);
+        }
+    }
+
+    ln->left_speed = abs(left) / 10;
+    ln->right_speed = abs(right) / 10;
+    ln->ramp_cur[0] = left;
+    ln->ramp_cur[1] = right;
+    dev_dbg(&ln->pdev->dev, "output L %d R %d (0.1%%) ret %d\n", left, right, ret);
+    return ret;
+}
+
+/* motor_drive 轉成帶正負號的 0.1% */
+static int drive_to_signed(int dir, unsigned int speed)
+{
+    return dir ? dir * (int)speed * 10 : 0;
+}
+
+/* 帶正負號的 0.1% 轉回 motor_drive (發布狀態用) */
+static void signed_to_drive(const int v[2], struct motor_drive *d)
+{
+    d->left_dir = (v[0] > 0) - (v[0] < 0);
+    d->right_dir = (v[1] > 0) - (v[1] < 0);
+    d->left_speed = abs(v[0]) / 10;
+    d->right_speed = abs(v[1]) / 10;
+}
+
+/* IOCTL_SET_DRIVE/共用頁命令: 立即設定兩輪，取消進行中的漸變 (呼叫者持有 lock) */
+static int motor_set_drive(const struct motor_drive *d)
+{
+    struct l298n_dev *ln = global_motor_dev;
+
+    ln->ramp_active = false;
+    return motor_output(ln, drive_to_signed(d->left_dir, d->left_speed),
+                        drive_to_signed(d->right_dir, d->right_speed));
+}
+
+/* 舊的單輪指令之後，依方向腳與 left/right_speed 換算目前輸出 (呼叫者持有 lock)
+ * 舊指令只改方向或只改速度，讓下一次 IOCTL_SET_RAMP 從實際輸出開始漸變 */
+static void motor_sync_ramp_cur(struct l298n_dev *ln)
+{
+    int left_dir = gpiod_get_value(ln->gpio_in3) - gpiod_get_value(ln->gpio_in4);
+    int right_dir = gpiod_get_value(ln->gpio_in1) - gpiod_get_value(ln->gpio_in2);
+
+    ln->ramp_cur[0] = left_dir * ln->left_speed * 10;
+    ln->ramp_cur[1] = right_dir * ln->right_speed * 10;
+}
+
+/* 參數檢查 (ioctl 與共用頁共用) */
+static bool drive_valid(const struct motor_drive *d)
+{
+    return d->left_speed <= 100 && d->right_speed <= 100 &&
+           d->left_dir >= -1 && d->left_dir <= 1 &&
+           d->right_dir >= -1 && d->right_dir <= 1;
+}
+
+/* ===== mmap 共用頁 ===== */
+
+/* 發布目前輸出 (呼叫者持有 lock)，st_seq 奇數期間 user 會重讀 */
+static void shm_publish(struct l298n_dev *ln, const struct motor_drive *d, u64 cmd_ns, u32 source)
+{
+    struct motor_shm *shm = ln->shm;
+
+    WRITE_ONCE(shm->st_seq, shm->st_seq + 1);
+    smp_wmb();
+    shm->applied = *d;
+    shm->applied_gen = ln->shm_gen;
+    shm->applied_cmd_ns = cmd_ns;
+    shm->applied_ns = ktime_get_ns();
+    shm->source = source;
+    shm->fault = atomic_read(&ln->fault);
+    if (source == MOTOR_SRC_SHM)
+        shm->applied_count++;
+    smp_wmb();
+    WRITE_ONCE(shm->st_seq, shm->st_seq + 1);
+}
+
+/* ioctl 直接改了輸出: 之前寫在共用頁、還沒處理的命令作廢 (避免緊急停止後被舊命令重新啟動) */
+static void shm_supersede(struct l298n_dev *ln, const struct motor_drive *d, u32 source)
+{
+    ln->shm_gen = READ_ONCE(ln->shm->cmd_gen);
+    shm_publish(ln, d, 0, source);
+}
+
+/* 讀出一致的新命令 (seqlock)  回傳=> 1有新命令 0沒有/user 寫到一半 (下次再看) */
+static int shm_read_cmd(struct l298n_dev *ln, struct motor_drive *d, u32 *gen, u64 *cmd_ns)
+{
+    struct motor_shm *shm = ln->shm;
+    u32 seq;
+    int tries;
+
+    for (tries = 0; tries < 4; tries++) {
+        seq = READ_ONCE(shm->cmd_seq);
+        if (seq & 1) {
+            cpu_relax();
+            continue;
+        }
+        smp_rmb();
+        *gen = READ_ONCE(shm->cmd_gen);
+        *d = shm->cmd;
+        *cmd_ns = shm->cmd_ns;
+        smp_rmb();
+        if (READ_ONCE(shm->cmd_seq) == seq)
+            return *gen != ln->shm_gen;
+    }
+    return 0;
+}
+
+/* 套用共用頁上的新命令 (呼叫者持有 lock) */
+static int motor_shm_apply(struct l298n_dev *ln)
+{
+    struct motor_drive d;
+    u32 gen;
+    u64 cmd_ns;
+    int ret;
+
+    if (!shm_read_cmd(ln, &d, &gen, &cmd_ns))
+        return 0;
+
+    ln->shm_gen = gen;
+    if (!drive_valid(&d)) {
+        ln->shm->rejected_count++;
+        return -EINVAL;
+    }
+    if (atomic_read(&ln->fault)) {
+        ln->shm->rejected_count++;       /* 故障鎖定中，命令作廢 */
+        return -EPERM;
+    }
+
+    ret = motor_set_drive(&d);
+    if (ret == 0)
+        shm_publish(ln, &d, cmd_ns, MOTOR_SRC_SHM);
+    return ret;
+}
+
+static void motor_shm_work(struct work_struct *work)
+{
+    struct l298n_dev *ln = container_of(work, struct l298n_dev, shm_work);
+
+    mutex_lock(&ln->lock);
+    motor_shm_apply(ln);
+    mutex_unlock(&ln->lock);
+}
+
+/* hardirq: 只比較 generation，有新命令才排工作 (PWM/GPIO 操作可能睡眠) */
+static enum hrtimer_restart motor_shm_timer(struct hrtimer *timer)
+{
+    struct l298n_dev *ln = container_of(timer, struct l298n_dev, shm_timer);
+    ktime_t period = READ_ONCE(ln->shm_period);
+
+    if (READ_ONCE(ln->shm->cmd_gen) != READ_ONCE(ln->shm_gen))
+        queue_work(system_highpri_wq, &ln->shm_work);
+
+    if (!period)
+        return HRTIMER_NORESTART;
+    hrtimer_forward_now(timer, period);
+    return HRTIMER_RESTART;
+}
+
+/* 開始/調整/停止週期檢查 (呼叫者持有 lock，沒有映射時只記下週期) */
+static void shm_set_poll(struct l298n_dev *ln, unsigned int poll_us)
+{
+    WRITE_ONCE(ln->shm_period, us_to_ktime(poll_us));
+    ln->shm->poll_us = poll_us;
+
+    if (poll_us && atomic_read(&ln->shm_maps) > 0)
+        hrtimer_start(&ln->shm_timer, ln->shm_period, HRTIMER_MODE_REL);
+    else
+        hrtimer_try_to_cancel(&ln->shm_timer);
+}
+
+/* 映射數: fork/拆分時 +1，munmap/行程結束時 -1，最後一個映射消失就停止檢查 */
+static void motor_vm_open(struct vm_area_struct *vma)
 {
     if (global_motor_dev)
-        dev_info(&global_motor_dev->pdev->dev, "馬達設備已關閉，停止所有馬達\n");
+        atomic_inc(&global_motor_dev->shm_maps);
+}
+
+static void motor_vm_close(struct vm_area_struct *vma)
+{
+    struct l298n_dev *ln = global_motor_dev;
+
+    if (ln && atomic_dec_and_test(&ln->shm_maps))
+        hrtimer_try_to_cancel(&ln->shm_timer);
+}
+
+static const struct vm_operations_struct motor_vm_ops = {
+    .open = motor_vm_open,
+    .close = motor_vm_close,
+};
+
+/* mmap: 只映射共用頁，有映射時才週期檢查 */
+static int motor_mmap(struct file *file, struct vm_area_struct *vma)
+{
+    struct l298n_dev *ln = global_motor_dev;
+    unsigned long size = vma->vm_end - vma->vm_start;
+    int ret;
+
+    if (!ln || !ln->shm)
+        return -ENODEV;
+    if (vma->vm_pgoff != 0 || size > PAGE_SIZE)
+        return -EINVAL;
+
+    vm_flags_set(vma, VM_DONTEXPAND | VM_DONTDUMP);
+    ret = remap_pfn_range(vma, vma->vm_start, virt_to_phys(ln->shm) >> PAGE_SHIFT,
+                          size, vma->vm_page_prot);
+    if (ret)
+        return ret;
+    vma->vm_ops = &motor_vm_ops;
+    atomic_inc(&ln->shm_maps);
+
+    mutex_lock(&ln->lock);
+    if (ln->shm->poll_us && !hrtimer_active(&ln->shm_timer))
+        shm_set_poll(ln, ln->shm->poll_us);
+    mutex_unlock(&ln->lock);
+
+    dev_info(&ln->pdev->dev, "共用頁已映射，檢查週期 %u us\n", ln->shm->poll_us);
+    return 0;
+}
+
+/* ===== 加速度漸變 ===== */
+
+/* 往目標走一步: 步幅 = 加速度 x 實際經過時間 (工作延遲時不會變慢) */
+static int ramp_toward(int cur, int target, unsigned int accel, s64 dt_us)
+{
+    s64 step;
+
+    if (accel == 0)
+        return target;
+
+    step = div_s64((s64)accel * 10 * dt_us, USEC_PER_SEC);    /* 0.1% */
+    if (step < 1)
+        step = 1;
+    if (cur < target)
+        return (int)min_t(s64, (s64)cur + step, target);
+    return (int)max_t(s64, (s64)cur - step, target);
+}
+
+/* 一步 (呼叫者持有 lock)，到達目標就結束漸變 */
+static void motor_ramp_step(struct l298n_dev *ln)
+{
+    struct motor_drive d;
+    ktime_t now = ktime_get();
+    s64 dt_us = ktime_us_delta(now, ln->ramp_last);
+    int next[2];
+    int i;
+
+    ln->ramp_last = now;
+    for (i = 0; i < 2; i++)
+        next[i] = ramp_toward(ln->ramp_cur[i], ln->ramp_target[i], ln->ramp_accel[i], dt_us);
+
+    if (motor_output(ln, next[0], next[1]) < 0) {
+        ln->ramp_active = false;        /* PWM 失敗，停在目前輸出 */
+        return;
+    }
+    if (next[0] == ln->ramp_target[0] && next[1] == ln->ramp_target[1])
+        ln->ramp_active = false;
+
+    signed_to_drive(next, &d);
+    shm_publish(ln, &d, 0, MOTOR_SRC_RAMP);
+}
+
+static void motor_ramp_work(struct work_struct *work)
+{
+    struct l298n_dev *ln = container_of(work, struct l298n_dev, ramp_work);
+
+    mutex_lock(&ln->lock);
+    if (ln->ramp_active)
+        motor_ramp_step(ln);
+    mutex_unlock(&ln->lock);
+}
+
+/* hardirq: 漸變中才排工作 (PWM/GPIO 操作可能睡眠) */
+static enum hrtimer_restart motor_ramp_timer(struct hrtimer *timer)
+{
+    struct l298n_dev *ln = container_of(timer, struct l298n_dev, ramp_timer);
+
+    if (!READ_ONCE(ln->ramp_active))
+        return HRTIMER_NORESTART;
+
+    queue_work(system_highpri_wq, &ln->ramp_work);
+    hrtimer_forward_now(timer, us_to_ktime(MOTOR_RAMP_TICK_US));
+    return HRTIMER_RESTART;
+}
+
+/* IOCTL_SET_RAMP: 設定目標並立即走第一步 (呼叫者持有 lock) */
+static int motor_set_ramp(struct l298n_dev *ln, const struct motor_ramp *r)
+{
+    ln->ramp_target[0] = drive_to_signed(r->target.left_dir, r->target.left_speed);
+    ln->ramp_target[1] = drive_to_signed(r->target.right_dir, r->target.right_speed);
+    ln->ramp_accel[0] = r->left_accel;
+    ln->ramp_accel[1] = r->right_accel;
+    ln->ramp_last = ktime_sub_us(ktime_get(), MOTOR_RAMP_TICK_US);
+    ln->ramp_active = true;
+
+    /* 之前寫在共用頁的命令作廢 */
+    ln->shm_gen = READ_ONCE(ln->shm->cmd_gen);
+
+    motor_ramp_step(ln);
+    if (ln->ramp_active)
+        hrtimer_start(&ln->ramp_timer, us_to_ktime(MOTOR_RAMP_TICK_US), HRTIMER_MODE_REL);
+    return 0;
+}
+
+static void motor_get_ramp(struct l298n_dev *ln, struct motor_ramp_state *st)
+{
+    memset(st, 0, sizeof(*st));
+    st->left_cur = ln->ramp_cur[0];
+    st->right_cur = ln->ramp_cur[1];
+    st->left_target = ln->ramp_target[0];
+    st->right_target = ln->ramp_target[1];
+    st->left_accel = ln->ramp_accel[0];
+    st->right_accel = ln->ramp_accel[1];
+    st->active = ln->ramp_active;
+}
+
+/* ===== 故障鎖定 (緊急停車) ===== */
+
+/* 完整停車: 取消漸變、關 PWM、讓共用頁上的舊命令作廢 */
+static void motor_fault_work(struct work_struct *work)
+{
+    struct l298n_dev *ln = container_of(work, struct l298n_dev, fault_work);
+
+    if (!READ_ONCE(global_motor_dev))    /* remove 中，PWM 由 remove 關閉 */
+        return;
+
+    mutex_lock(&ln->lock);
+    ln->ramp_active = false;
     stop_all_motors();
+    ln->ramp_cur[0] = ln->ramp_cur[1] = 0;
+    shm_supersede(ln, &(struct motor_drive){ 0 }, MOTOR_SRC_FAULT);
+    mutex_unlock(&ln->lock);
+
+    dev_warn(&ln->pdev->dev, "緊急停車 (來源 %d)，等待解除\n", atomic_read(&ln->fault));
+}
+
+/* 緊急停車 (給其他 driver 用，可在中斷內呼叫)
+ * 1.鎖定故障 (之後出力命令回 -EPERM)
+ * 2.方向腳立即拉低 (GPIO 不會睡眠時直接寫，L298N 兩腳皆低 = 煞車)
+ * 3.排工作在 lock 內完整停車
+ * 剛好有 ioctl 持有 lock 正在改輸出時，3 會在它放開 lock 後再停一次 */
+int motor_emergency_stop(u32 source)
+{
+    struct l298n_dev *ln = READ_ONCE(global_motor_dev);
+
+    if (!ln || !ln->pwm_configured)
+        return -ENODEV;
+    if (source == MOTOR_FAULT_NONE)
+        return -EINVAL;
+
+    /* 已經鎖定 */
+    if (atomic_cmpxchg(&ln->fault, MOTOR_FAULT_NONE, source) != MOTOR_FAULT_NONE)
+        return 0;
+
+    WRITE_ONCE(ln->ramp_active, false);
+    WRITE_ONCE(ln->fault_ns, ktime_get_ns());
+    WRITE_ONCE(ln->fault_count, ln->fault_count + 1);
+
+    if (!gpiod_cansleep(ln->gpio_in1) && !gpiod_cansleep(ln->gpio_in3)) {
+        gpiod_set_value(ln->gpio_in1, 0);
+        gpiod_set_value(ln->gpio_in2, 0);
+        gpiod_set_value(ln->gpio_in3, 0);
+        gpiod_set_value(ln->gpio_in4, 0);
+    }
+
+    queue_work(system_highpri_wq, &ln->fault_work);
     return 0;
 }
+EXPORT_SYMBOL_GPL(motor_emergency_stop);
 
-static long motor_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+/* IOCTL_CLEAR_FAULT (呼叫者持有 lock): 解除後維持停車，等新的出力命令 */
+static void motor_clear_fault(struct l298n_dev *ln)
+{
+    if (atomic_xchg(&ln->fault, MOTOR_FAULT_NONE) == MOTOR_FAULT_NONE)
+        return;
+    shm_supersede(ln, &(struct motor_drive){ 0 }, MOTOR_SRC_STOP);
+    dev_info(&ln->pdev->dev, "故障鎖定已解除\n");
+}
+
+static void motor_get_fault(struct l298n_dev *ln, struct motor_fault *f)
+{
+    memset(f, 0, sizeof(*f));
+    f->latched = atomic_read(&ln->fault);
+    f->count = READ_ONCE(ln->fault_count);
+    f->ts_ns = READ_ONCE(ln->fault_ns);
+}
+
+/* 會讓馬達出力的指令 (故障鎖定中拒絕) */
+static bool motor_cmd_drives(unsigned int cmd)
+{
+    switch (cmd) {
+        case IOCTL_SET_SPEED_LEFT:
+        case IOCTL_SET_SPEED_RIGHT:
+        case IOCTL_LEFT_FORWARD:
+        case IOCTL_LEFT_BACKWARD:
+        case IOCTL_RIGHT_FORWARD:
+        case IOCTL_RIGHT_BACKWARD:
+        case IOCTL_BOTH_FORWARD:
+        case IOCTL_BOTH_BACKWARD:
+        case IOCTL_TURN_LEFT:
+        case IOCTL_TURN_RIGHT:
+        case IOCTL_SET_DRIVE:
+        case IOCTL_SET_RAMP:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* 單一指令 (呼叫者持有 lock) */
+static long motor_ioctl_locked(unsigned int cmd, unsigned long arg)
 {
     int ret = 0;
     int speed;
     unsigned int duty_ns;
     unsigned int new_period;
 
-    
-    if (!global_motor_dev) {
-        pr_err("Motor device not initialized\n");
-        return -ENODEV;
-    }
-    
-    if (_IOC_TYPE(cmd) != MOTOR_IOC_MAGIC) {
-        dev_err(&global_motor_dev->pdev->dev, "無效的ioctl magic number\n");
-        return -ENOTTY;
-    }
-    
-    dev_info(&global_motor_dev->pdev->dev, "收到ioctl指令: %u, 參數: %lu\n", cmd, arg);
-    
     switch (cmd) {
         case IOCTL_SET_PERIOD:
         
@@ -479,7 +962,6 @@ static long motor_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 
         case IOCTL_SET_SPEED_LEFT:
         
-            printk("IOCTL_SET_SPEED_LEFT\n");
             if (copy_from_user(&duty_ns, (unsigned int __user *)arg, sizeof(duty_ns)))
                 return -EFAULT;
 
@@ -490,7 +972,7 @@ static long motor_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
             }
 
             // 計算百分比
-            int speed = (duty_ns * 100) / global_motor_dev->period_ns;
+            speed = (duty_ns * 100) / global_motor_dev->period_ns;
             global_motor_dev->left_speed = speed;
 
             if (global_motor_dev->pwm1 && global_motor_dev->pwm_configured) {
@@ -503,7 +985,7 @@ static long motor_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
                 } 
             }
 
-            dev_info(&global_motor_dev->pdev->dev, "左馬達速度設定為: %d%%\n", speed);
+            dev_dbg(&global_motor_dev->pdev->dev, "左馬達速度設定為: %d%%\n", speed);
             break;
         
             
@@ -524,7 +1006,6 @@ static long motor_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
 
             if (global_motor_dev->pwm0 && global_motor_dev->pwm_configured) {
                 ret = set_motor_speed_pwm(global_motor_dev->pwm0, speed);
-                printk("ret is %d\n",ret);
                 if(ret == 0)
                 {
                    // gpiod_set_value(global_motor_dev->gpio_in1, 1);
@@ -533,7 +1014,7 @@ static long motor_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
                 }
              }
 
-            dev_info(&global_motor_dev->pdev->dev, "右馬達速度設定為: %d%%\n", speed);
+            dev_dbg(&global_motor_dev->pdev->dev, "右馬達速度設定為: %d%%\n", speed);
             break;
         
         case IOCTL_LEFT_FORWARD:
@@ -548,7 +1029,7 @@ static long motor_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
                     pwm_enable(global_motor_dev->pwm1);
                 }
             }
-            dev_info(&global_motor_dev->pdev->dev, "左馬達前進\n");
+            dev_dbg(&global_motor_dev->pdev->dev, "左馬達前進\n");
             break;
             
         case IOCTL_LEFT_BACKWARD:
@@ -563,7 +1044,7 @@ static long motor_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
                     pwm_enable(global_motor_dev->pwm1);
                 }
             }
-            dev_info(&global_motor_dev->pdev->dev, "左馬達後退\n");
+            dev_dbg(&global_motor_dev->pdev->dev, "左馬達後退\n");
             break;
             
         case IOCTL_LEFT_STOP:
@@ -574,7 +1055,7 @@ static long motor_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
                 pwm_config(global_motor_dev->pwm1, 0, global_motor_dev->period_ns);
                 pwm_enable(global_motor_dev->pwm1);
             }
-            dev_info(&global_motor_dev->pdev->dev, "左馬達停止\n");
+            dev_dbg(&global_motor_dev->pdev->dev, "左馬達停止\n");
             break;
         
 
@@ -583,18 +1064,14 @@ static long motor_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
             gpiod_set_value(global_motor_dev->gpio_in1, 1);
             gpiod_set_value(global_motor_dev->gpio_in2, 0);
             if (global_motor_dev->pwm0 && global_motor_dev->pwm_configured) {
-               ret = pwm_config(global_motor_dev->pwm0, 
-                   (global_motor_dev->right_speed * global_motor_dev->period_ns) / 100, 
-                     global_motor_dev->period_ns);
-                    ret = pwm_config(global_motor_dev->pwm0,  (global_motor_dev->right_speed * global_motor_dev->period_ns) / 100, 
+                ret = pwm_config(global_motor_dev->pwm0, 
+                    (global_motor_dev->right_speed * global_motor_dev->period_ns) / 100, 
                     global_motor_dev->period_ns);
-                    printk("duty cycle %d period %d\n", (global_motor_dev->right_speed * global_motor_dev->period_ns) / 100,global_motor_dev->period_ns);
                 if (ret == 0) {
                     pwm_enable(global_motor_dev->pwm0);
-                    printk("587\n");
                 }
             }
-            dev_info(&global_motor_dev->pdev->dev, "右馬達前進\n");
+            dev_dbg(&global_motor_dev->pdev->dev, "右馬達前進\n");
             break;
         
         case IOCTL_RIGHT_BACKWARD:
@@ -609,7 +1086,7 @@ static long motor_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
                     pwm_enable(global_motor_dev->pwm0);
                 }
             }
-            dev_info(&global_motor_dev->pdev->dev, "右馬達後退\n");
+            dev_dbg(&global_motor_dev->pdev->dev, "右馬達後退\n");
             break;
             
         case IOCTL_RIGHT_STOP:
@@ -620,7 +1097,7 @@ static long motor_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
                 pwm_config(global_motor_dev->pwm0, 0, global_motor_dev->period_ns);
                 pwm_disable(global_motor_dev->pwm0);
             }
-            dev_info(&global_motor_dev->pdev->dev, "右馬達停止\n");
+            dev_dbg(&global_motor_dev->pdev->dev, "右馬達停止\n");
             break;
             
         case IOCTL_BOTH_FORWARD:
@@ -647,7 +1124,7 @@ static long motor_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
                     pwm_enable(global_motor_dev->pwm1);
                 }
             }
-            dev_info(&global_motor_dev->pdev->dev, "直線前進\n");
+            dev_dbg(&global_motor_dev->pdev->dev, "直線前進\n");
             break;
             
         case IOCTL_BOTH_BACKWARD:
@@ -674,7 +1151,7 @@ static long motor_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
                     pwm_enable(global_motor_dev->pwm1);
                 }
             }
-            dev_info(&global_motor_dev->pdev->dev, "直線後退\n");
+            dev_dbg(&global_motor_dev->pdev->dev, "直線後退\n");
             break;
             
         case IOCTL_BOTH_STOP:
@@ -691,7 +1168,7 @@ static long motor_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
                 pwm_config(global_motor_dev->pwm1, 0, global_motor_dev->period_ns);
                 pwm_disable(global_motor_dev->pwm1);
             }
-            dev_info(&global_motor_dev->pdev->dev, "煞車停止\n");
+            dev_dbg(&global_motor_dev->pdev->dev, "煞車停止\n");
             break;
         
         case IOCTL_TURN_LEFT:
@@ -718,7 +1195,7 @@ static long motor_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
                     pwm_enable(global_motor_dev->pwm1);
                 }
             }
-            dev_info(&global_motor_dev->pdev->dev, "執行左轉\n");
+            dev_dbg(&global_motor_dev->pdev->dev, "執行左轉\n");
             break;
             
         case IOCTL_TURN_RIGHT:
@@ -745,7 +1222,7 @@ static long motor_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
                     pwm_enable(global_motor_dev->pwm1);
                 }
             } 
-            dev_info(&global_motor_dev->pdev->dev, "執行右轉\n");
+            dev_dbg(&global_motor_dev->pdev->dev, "執行右轉\n");
             break;
             
         default:
@@ -756,11 +1233,113 @@ static long motor_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
     return ret;
 }
 
+static long motor_ioctl(struct file *file, unsigned int cmd, unsigned long arg)
+{
+    struct motor_drive drive;
+    struct motor_ramp ramp;
+    struct motor_ramp_state ramp_st;
+    struct motor_fault fault;
+    unsigned int poll_us;
+    long ret;
+
+    if (!global_motor_dev) {
+        pr_err("Motor device not initialized\n");
+        return -ENODEV;
+    }
+    
+    if (_IOC_TYPE(cmd) != MOTOR_IOC_MAGIC) {
+        dev_err(&global_motor_dev->pdev->dev, "無效的ioctl magic number\n");
+        return -ENOTTY;
+    }
+    
+    /* 控制迴圈每個 tick 都會呼叫，記錄用 dev_dbg (預設不輸出) */
+    dev_dbg(&global_motor_dev->pdev->dev, "收到ioctl指令: %u, 參數: %lu\n", cmd, arg);
+
+    /* 參數在上鎖前先複製與檢查 */
+    if (cmd == IOCTL_SET_DRIVE) {
+        if (copy_from_user(&drive, (struct motor_drive __user *)arg, sizeof(drive)))
+            return -EFAULT;
+        if (!drive_valid(&drive))
+            return -EINVAL;
+    } else if (cmd == IOCTL_SET_SHM_POLL) {
+        if (copy_from_user(&poll_us, (unsigned int __user *)arg, sizeof(poll_us)))
+            return -EFAULT;
+    } else if (cmd == IOCTL_SET_RAMP) {
+        if (copy_from_user(&ramp, (struct motor_ramp __user *)arg, sizeof(ramp)))
+            return -EFAULT;
+        if (!drive_valid(&ramp.target) ||
+            ramp.left_accel > MOTOR_RAMP_ACCEL_MAX || ramp.right_accel > MOTOR_RAMP_ACCEL_MAX)
+            return -EINVAL;
+    }
+
+    mutex_lock(&global_motor_dev->lock);
+    if (atomic_read(&global_motor_dev->fault) && motor_cmd_drives(cmd)) {
+        mutex_unlock(&global_motor_dev->lock);
+        return -EPERM;
+    }
+
+    switch (cmd) {
+        case IOCTL_SET_DRIVE:
+            ret = motor_set_drive(&drive);
+            if (ret == 0)
+                shm_supersede(global_motor_dev, &drive, MOTOR_SRC_IOCTL);
+            break;
+
+        case IOCTL_SHM_DOORBELL:
+            ret = motor_shm_apply(global_motor_dev);
+            break;
+
+        case IOCTL_SET_SHM_POLL:
+            shm_set_poll(global_motor_dev, poll_us);
+            ret = 0;
+            break;
+
+        case IOCTL_SET_RAMP:
+            ret = motor_set_ramp(global_motor_dev, &ramp);
+            break;
+
+        case IOCTL_GET_RAMP:
+            motor_get_ramp(global_motor_dev, &ramp_st);
+            ret = 0;
+            break;
+
+        case IOCTL_GET_FAULT:
+            motor_get_fault(global_motor_dev, &fault);
+            ret = 0;
+            break;
+
+        case IOCTL_CLEAR_FAULT:
+            motor_clear_fault(global_motor_dev);
+            ret = 0;
+            break;
+
+        default:
+            /* 舊的單輪指令直接改輸出，取消漸變 */
+            global_motor_dev->ramp_active = false;
+            ret = motor_ioctl_locked(cmd, arg);
+            motor_sync_ramp_cur(global_motor_dev);
+            if (cmd == IOCTL_BOTH_STOP)
+                shm_supersede(global_motor_dev, &(struct motor_drive){ 0 }, MOTOR_SRC_STOP);
+            break;
+    }
+    mutex_unlock(&global_motor_dev->lock);
+
+    if (cmd == IOCTL_GET_RAMP && ret == 0 &&
+        copy_to_user((struct motor_ramp_state __user *)arg, &ramp_st, sizeof(ramp_st)))
+        ret = -EFAULT;
+    if (cmd == IOCTL_GET_FAULT && ret == 0 &&
+        copy_to_user((struct motor_fault __user *)arg, &fault, sizeof(fault)))
+        ret = -EFAULT;
+
+    return ret;
+}
+
 static const struct file_operations motor_fops = {
     .owner = THIS_MODULE,
     .open = motor_open,
     .release = motor_release,
     .unlocked_ioctl = motor_ioctl,
+    .mmap = motor_mmap,
 };
 
 /* ===== 字符設備初始化 ===== */
@@ -856,12 +1435,6 @@ static int __init motor_init(void)
         return -ENODEV;
     }
     
-    /* 映射GPIO記憶體 */
-    global_motor_dev->gpio_base = ioremap(BCM2711_GPIO_BASE, GPIO_SIZE);
-    if (!global_motor_dev->gpio_base) {
-        dev_warn(&global_motor_dev->pdev->dev, "GPIO記憶體映射失敗，將使用標準GPIO API\n");
-    }
-    
     /* 設定GPIO腳位 */
     ret = setup_gpio_pins();
     if (ret < 0) {
@@ -885,8 +1458,6 @@ static int __init motor_init(void)
     return 0;
 
 err_gpio:
-    if (global_motor_dev && global_motor_dev->gpio_base)
-        iounmap(global_motor_dev->gpio_base);
     platform_driver_unregister(&motor_platform_driver);
     
     return ret;
@@ -902,10 +1473,6 @@ static void __exit motor_exit(void)
     /* 清理字符設備 */
     destroy_char_device();
     
-    /* 清理GPIO記憶體映射 */
-    if (global_motor_dev && global_motor_dev->gpio_base)
-        iounmap(global_motor_dev->gpio_base);
-    
     /* 註銷平台驅動程式 */
     platform_driver_unregister(&motor_platform_driver);
     
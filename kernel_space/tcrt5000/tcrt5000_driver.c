@@ -5,14 +5,101 @@
 #include <linux/uaccess.h>
 #include <linux/device.h>
 #include <linux/cdev.h>
+#include <linux/slab.h>		// kzalloc, kfree
+#include <linux/interrupt.h>	// irqreturn_t
+#include <linux/kfifo.h>	// 事件佇列
+#include <linux/wait.h>		// wait queue (阻塞 read)
+#include <linux/poll.h>		// poll/epoll
+#include <linux/spinlock.h>
+#include <linux/list.h>
+#include <linux/ktime.h>	// ktime_get_ns
 #include "pin_mapping.h"
 #include "tcrt5000_hal.h"
+#include "tcrt5000_ioctl.h"	// 二進位樣本格式、ioctl
+#include "car_gpio.h"		// car_gpio_request_irq, car_gpio_free_irq
+
+
+#define TCRT5000_NUM_PINS	3	// 左中右 3 顆感測器
+#define TCRT5000_FIFO_SIZE	64	// 每個開啟者的事件佇列長度(必須是 2 的次方)
+#define TCRT5000_READ_BATCH	16	// 二進位模式每次從佇列搬出的筆數
+
+
+// ---------- 結構體 ------------
+
+// 每個 open() 的讀取者，各自擁有一份事件佇列 (事件格式見 tcrt5000_ioctl.h)
+struct tcrt5000_reader {
+	struct list_head node;						// 串在 readers 清單上
+	DECLARE_KFIFO(fifo, struct tcrt5000_sample, TCRT5000_FIFO_SIZE);	// 事件佇列
+	wait_queue_head_t wq;						// 阻塞 read / poll 等待
+	unsigned long dropped;						// 佇列滿時丟掉的舊事件數
+	int mode;							// TCRT5000_MODE_TEXT / BINARY
+};
+
 	
 // ---------- 全域變數 ------------
 static dev_t dev;		// 儲存分配到的 major/minor 
 static struct cdev c_dev;	// 字元裝置的結構體
 static struct class *cl;	// class 用來 /dev 創建節點
 
+static LIST_HEAD(readers);		// 目前所有開啟者
+static DEFINE_SPINLOCK(readers_lock);	// 保護 readers 與 last_state (中斷內也會用)
+static u8 last_state;			// 最後一次的狀態，只在狀態真的變化時才排入事件
+static u32 event_seq;			// 狀態變化序號
+
+// 3 顆感測器的 GPIO (中斷由 car_gpio 申請，sim=1 時由模擬電位觸發)
+static const int tcrt5000_pins[TCRT5000_NUM_PINS] = {TCRT5000_LEFT, TCRT5000_MIDDLE, TCRT5000_RIGHT};
+
+
+
+// ---------- 感測器狀態 -------------
+
+// 讀取目前 3 顆感測器，組成 3bit 狀態 (同一次暫存器讀取，不會混到兩個時間點)
+static u8 tcrt5000_read_state(void){
+	return (u8)read_gpio_state();
+}
+
+
+// 把一筆事件排進某個讀取者的佇列 (需持有 readers_lock)
+static void tcrt5000_push_event(struct tcrt5000_reader *r, const struct tcrt5000_sample *ev){
+	
+	// 佇列滿了就丟掉最舊的一筆，保留最新的狀態
+	if(kfifo_is_full(&r->fifo)){
+		kfifo_skip(&r->fifo);
+		r->dropped++;
+	}
+	kfifo_put(&r->fifo, *ev);
+	wake_up_interruptible(&r->wq);
+}
+
+
+// GPIO 雙緣中斷: 任一顆感測器變化就記錄一次 (帶時間戳)
+static irqreturn_t tcrt5000_irq_handler(int irq, void *dev_id){
+	
+	struct tcrt5000_reader *r;
+	struct tcrt5000_sample ev = { .version = TCRT5000_SAMPLE_VERSION };
+	unsigned long flags;
+
+	ev.ts_ns = ktime_get_ns();
+
+	spin_lock_irqsave(&readers_lock, flags);
+
+	// 1.讀取狀態，抖動造成的重複中斷不排入
+	ev.state = tcrt5000_read_state();
+	if(ev.state == last_state){
+		spin_unlock_irqrestore(&readers_lock, flags);
+		return IRQ_HANDLED;
+	}
+	last_state = ev.state;
+	ev.seq = ++event_seq;
+
+	// 2.發給每一個開啟者
+	list_for_each_entry(r, &readers, node)
+		tcrt5000_push_event(r, &ev);
+
+	spin_unlock_irqrestore(&readers_lock, flags);
+	return IRQ_HANDLED;
+}
+
 
 
 // ---------- 檔案處理 -------------
@@ -20,37 +107,175 @@ static struct class *cl;	// class 用來 /dev 創建節點
 
 // 開啟檔案 open()
 static int tcrt5000_open(struct inode *inode, struct file *file){
+	
+	struct tcrt5000_reader *r;
+	struct tcrt5000_sample ev = { .version = TCRT5000_SAMPLE_VERSION };
+	unsigned long flags;
+
+	r = kzalloc(sizeof(*r), GFP_KERNEL);
+	if(!r) return -ENOMEM;
+
+	INIT_KFIFO(r->fifo);
+	init_waitqueue_head(&r->wq);
+
+	// 先放入目前狀態，讓讀取者一開始就知道起始位置
+	// (只給這個讀取者，last_state 留給中斷更新，否則還沒處理的變化會被當成抖動丟掉)
+	ev.ts_ns = ktime_get_ns();
+
+	spin_lock_irqsave(&readers_lock, flags);
+	ev.state = tcrt5000_read_state();
+	ev.seq = event_seq;		// 起始狀態沿用目前序號，下一次變化才 +1
+	kfifo_put(&r->fifo, ev);
+	list_add_tail(&r->node, &readers);
+	spin_unlock_irqrestore(&readers_lock, flags);
+
+	file->private_data = r;
+
 	printk(KERN_INFO "tcrt5000: device opened\n");
 	return 0;
 }
 
 
-// 讀取檔案 read()
-static ssize_t tcrt5000_read(struct file *file, char __user *buf, size_t count, loff_t *ppos ){
+// 等到佇列有事件 (O_NONBLOCK 則回傳 -EAGAIN)
+static int tcrt5000_wait_event(struct tcrt5000_reader *r, struct file *file){
 	
-	// 1.讀取感測器(左中右)
-	int left = read_gpio(TCRT5000_LEFT);
-	int middle = read_gpio(TCRT5000_MIDDLE);
-	int right = read_gpio(TCRT5000_RIGHT);
+	if(!kfifo_is_empty(&r->fifo)) return 0;
+	if(file->f_flags & O_NONBLOCK) return -EAGAIN;
 
-	printk(KERN_INFO "TCRT5000 Read -Left: %d, -Middle: %d, -Right: %d", left, middle, right);
+	return wait_event_interruptible(r->wq, !kfifo_is_empty(&r->fifo));
+}
 
 
-	// 2.封裝成字串，例 "010\n"
-	char msg[20];
-	int len = snprintf(msg, sizeof(msg), "%d%d%d\n", left, middle, right);
- 
+// 文字模式: 每次回傳一筆狀態變化，例 "010\n"
+static ssize_t tcrt5000_read_text(struct tcrt5000_reader *r, struct file *file,
+		char __user *buf, size_t count){
+	
+	struct tcrt5000_sample ev;
+	char msg[8];
+	int len, ret;
+
+	// 0.緩衝區放不下一筆 "010\n" 就不取出事件，避免事件遺失
+	if(count < 4) return -EINVAL;
+
+	for(;;){
+		// 1.取出一筆事件
+		spin_lock_irq(&readers_lock);
+		ret = kfifo_get(&r->fifo, &ev);
+		spin_unlock_irq(&readers_lock);
+		if(ret) break;
+
+		// 2.沒有事件: 非阻塞直接返回，阻塞則睡到有狀態變化
+		ret = tcrt5000_wait_event(r, file);
+		if(ret) return ret;
+	}
+
+
+	// 3.封裝成字串，例 "010\n"
+	len = snprintf(msg, sizeof(msg), "%d%d%d\n",
+			(ev.state >> 2) & 0x1, (ev.state >> 1) & 0x1, ev.state & 0x1);
 	
-	// 3.將資料複製到user space(cat /dev/trct5000時顯示)
+	// 4.將資料複製到user space(cat /dev/trct5000時顯示)
 	if(copy_to_user(buf, msg, len)) return -EFAULT;
 	
 	return len;	// 回傳實際讀到的字元數
+}
+
+
+// 二進位模式: 一次 read() 盡量讀完佇列內的樣本 (count 需為樣本大小的倍數)
+static ssize_t tcrt5000_read_binary(struct tcrt5000_reader *r, struct file *file,
+		char __user *buf, size_t count){
+	
+	struct tcrt5000_sample batch[TCRT5000_READ_BATCH];
+	size_t want = count / sizeof(struct tcrt5000_sample);
+	size_t done = 0;
+	unsigned int n;
+	int ret;
 
+	if(want == 0) return -EINVAL;
+
+	// 1.至少要有一筆才返回
+	ret = tcrt5000_wait_event(r, file);
+	if(ret) return ret;
+
+	// 2.分批搬出 (copy_to_user 不能在 spinlock 內)
+	while(done < want){
+		spin_lock_irq(&readers_lock);
+		n = kfifo_out(&r->fifo, batch, min_t(size_t, want - done, TCRT5000_READ_BATCH));
+		spin_unlock_irq(&readers_lock);
+		if(n == 0) break;
+
+		if(copy_to_user(buf + done * sizeof(batch[0]), batch, n * sizeof(batch[0])))
+			return -EFAULT;
+		done += n;
+	}
+
+	// 被其他執行緒搶先讀完
+	if(done == 0) return -EAGAIN;
+
+	return done * sizeof(struct tcrt5000_sample);
+}
+
+
+// 讀取檔案 read()
+// 沒有變化時阻塞 (O_NONBLOCK 則回傳 -EAGAIN)
+static ssize_t tcrt5000_read(struct file *file, char __user *buf, size_t count, loff_t *ppos ){
+	
+	struct tcrt5000_reader *r = file->private_data;
+
+	if(r->mode == TCRT5000_MODE_BINARY)
+		return tcrt5000_read_binary(r, file, buf, count);
+	return tcrt5000_read_text(r, file, buf, count);
 }	
 
 
+// ioctl: 切換 read() 的輸出格式
+static long tcrt5000_ioctl(struct file *file, unsigned int cmd, unsigned long arg){
+	
+	struct tcrt5000_reader *r = file->private_data;
+	int mode;
+
+	switch(cmd){
+		case TCRT5000_SET_MODE:
+			if(copy_from_user(&mode, (int __user *)arg, sizeof(mode))) return -EFAULT;
+			if(mode != TCRT5000_MODE_TEXT && mode != TCRT5000_MODE_BINARY) return -EINVAL;
+			r->mode = mode;
+			return 0;
+
+		case TCRT5000_GET_MODE:
+			return put_user(r->mode, (int __user *)arg);
+
+		default:
+			return -ENOTTY;
+	}
+}
+
+
+// poll()/epoll: 有事件時可讀
+static __poll_t tcrt5000_poll(struct file *file, poll_table *wait){
+	
+	struct tcrt5000_reader *r = file->private_data;
+
+	poll_wait(file, &r->wq, wait);
+	if(!kfifo_is_empty(&r->fifo))
+		return EPOLLIN | EPOLLRDNORM;
+	return 0;
+}
+
+
 // 關閉裝置 release()
 static int tcrt5000_release(struct inode *inode, struct file *file){
+	
+	struct tcrt5000_reader *r = file->private_data;
+	unsigned long flags;
+
+	spin_lock_irqsave(&readers_lock, flags);
+	list_del(&r->node);
+	spin_unlock_irqrestore(&readers_lock, flags);
+
+	if(r->dropped)
+		printk(KERN_INFO "tcrt5000: %lu events dropped (queue full)\n", r->dropped);
+	kfree(r);
+
 	printk(KERN_INFO "tcrt5000: device closed\n");
 	return 0;
 }
@@ -61,10 +286,41 @@ static struct file_operations fops = {
 	.owner = THIS_MODULE,			// 防止模組卸載時，仍有操作
 	.open = tcrt5000_open,
 	.read = tcrt5000_read,
+	.poll = tcrt5000_poll,
+	.unlocked_ioctl = tcrt5000_ioctl,
 	.release = tcrt5000_release,
 };
 
 
+// ------------ 中斷 -------------
+
+// 釋放已申請的中斷 (n: 已成功申請的數量)
+static void tcrt5000_free_irqs(int n){
+	while(n--)
+		car_gpio_free_irq(tcrt5000_pins[n], NULL);
+}
+
+
+// 3 顆感測器都設定雙緣觸發中斷
+static int tcrt5000_request_irqs(void){
+	
+	int i, ret;
+
+	for(i = 0; i < TCRT5000_NUM_PINS; i++){
+		ret = car_gpio_request_irq(tcrt5000_pins[i], tcrt5000_irq_handler, "tcrt5000", NULL);
+		if(ret < 0){
+			printk(KERN_ALERT "TCRT5000: request irq of GPIO %d failed: %d\n", tcrt5000_pins[i], ret);
+			goto fail;
+		}
+	}
+	return 0;
+
+fail:
+	tcrt5000_free_irqs(i);
+	return ret;
+}
+
+
 // 定義 devnode callback，設定 /dev/tcrt5000 權限 改成0666
 static char *tcrt5000_devnode(const struct device *dev, umode_t *mode){
 	if(mode) *mode = 0666;	// 所有人都可以寫入
@@ -121,6 +377,23 @@ static int __init tcrt5000_driver_init(void){
 	device_create(cl, NULL, dev, NULL, "tcrt5000");
 
 
+	// 6.設定左中右感測器的雙緣中斷
+	// 先記下目前狀態，否則 last_state 從 0 開始，第一次變成 000 的邊緣會被當成抖動丟掉
+	spin_lock_irq(&readers_lock);
+	last_state = tcrt5000_read_state();
+	spin_unlock_irq(&readers_lock);
+
+	ret = tcrt5000_request_irqs();
+	if(ret < 0){
+		device_destroy(cl, dev);
+		class_destroy(cl);
+		cdev_del(&c_dev);
+		unregister_chrdev_region(dev, 1);
+		printk(KERN_ALERT "TCRT5000: Failed to request irqs\n");
+		return ret;
+	}
+
+
 	// 成功註冊
 	printk(KERN_INFO "TCRT5000 driver loaded successfully!\n");
 	return 0;
@@ -130,6 +403,9 @@ static int __init tcrt5000_driver_init(void){
 // 卸載 解除註冊 device
 static void __exit tcrt5000_driver_exit(void){
 	
+	// 0.先釋放中斷，不再產生事件
+	tcrt5000_free_irqs(TCRT5000_NUM_PINS);
+
 	// 1.刪除 device node
 	device_destroy(cl, dev);
 
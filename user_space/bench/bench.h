@@ -0,0 +1,40 @@
+// 端到端延遲量測 標頭檔
+// 車輛主程式 (main.c) 原封不動連結進量測程式，外部全部換成假的:
+//   fake_broker.c: 同一個行程內的假 MQTT broker (實作 mosquitto_* API)，量測端用它注入指令
+//   fake_dev.c   : 以 ld --wrap 攔截 open/ioctl/close/tc*attr，/dev/motor0 等裝置換成
+//                  pipe/eventfd/socketpair，馬達 ioctl 回呼量測端，超聲波幀由量測端注入
+#ifndef __BENCH_H__
+#define __BENCH_H__
+
+#include <stdint.h>
+
+
+// ------------ 假 broker -------------
+
+// 送一則訊息給車子 (和 broker 轉送訂閱訊息相同)  回傳=> 0成功 -1車子未連線
+int fake_broker_publish(const char *topic, const char *payload);
+
+// 等待車子連線並訂閱 topic  回傳=> 0成功 -1逾時
+int fake_broker_wait_subscribed(const char *topic, int timeout_ms);
+
+// 車子發布的訊息數
+unsigned long fake_broker_published(void);
+
+
+// ------------ 假裝置 -------------
+
+// 馬達 ioctl 回呼 (在車子的事件迴圈 thread 呼叫，必須很快返回)
+typedef void (*fake_motor_hook_t)(unsigned long cmd);
+void fake_dev_set_motor_hook(fake_motor_hook_t hook);
+
+// 注入超聲波一幀 (distance_mm[i] = -1 代表該顆無效)  回傳=> 幀序號
+uint32_t fake_sonic_push(const int distance_mm[4]);
+
+// 等待車子取走序號 seq 的幀  回傳=> 0成功 -1逾時
+int fake_sonic_wait_consumed(uint32_t seq, int timeout_ms);
+
+
+// 單調時鐘 (ns)
+uint64_t bench_now_ns(void);
+
+#endif
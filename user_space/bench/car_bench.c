@@ -0,0 +1,385 @@
+// 端到端延遲量測: 調度中心指令 -> 馬達，前方障礙物 -> 停車
+// 車輛主程式 main.c 以 -Dmain=car_main 編譯，在另一個 thread 照常跑事件迴圈；
+// MQTT broker 與所有裝置都是假的 (見 bench.h)，量測端注入指令/超聲波幀，
+// 由假馬達 ioctl 的回呼記下動作時間。
+//
+// 量測路徑:
+//   mqtt_start_to_motor : broker 送出 {"start":1} -> 第一個馬達 ioctl
+//   sonic_near_to_stop  : 第 3 幀前方 <5cm (去彈跳門檻) 注入 -> IOCTL_BOTH_STOP
+//
+// 用法: car_bench [-n 次數] [-o 報告.json] [-v 顯示車子輸出]
+// 報告為 JSON: 每條路徑的 min/mean/p50/p99/max (us)、log2 直方圖、每筆 [開始時間 ms, 延遲 us]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include "motor_gpio.h"		// IOCTL_BOTH_STOP
+#include "mqtt_config.h"	// MQTT_TOPIC_CAR
+#include "line_ctrl.h"		// LINE_CTRL_TICK_MS
+#include "bench.h"
+
+#define BENCH_ITER		200			// 預設每條路徑量測次數
+#define BENCH_REPORT		"bench_results.json"	// 預設報告檔
+#define BENCH_TIMEOUT_MS	1000			// 等待動作的上限
+#define BENCH_SETTLE_MS		20			// 兩次量測間的間隔
+#define BENCH_ROUTE		"{\"route\":[1,1,1,1],\"delivery\":1}"
+#define BENCH_NEAR_MM		30			// 3 cm (< 5 cm 觸發)
+#define BENCH_SAFE_MM		1000			// 100 cm
+#define BENCH_HIST_BUCKETS	24			// log2 直方圖: [2^k, 2^(k+1)) us
+#define ANY_MOTOR_CMD		0UL
+
+int car_main(void);	// main.c 的 main()
+
+
+// 一條量測路徑
+typedef struct {
+	const char *name;
+	const char *from;
+	const char *to;
+	uint64_t *t_ns;		// 每筆開始時間
+	uint64_t *lat_ns;	// 每筆延遲
+	int count;
+	int timeouts;
+} bench_path;
+
+static FILE *out;		// 量測結果輸出 (車子的 stdout 可能被導到 /dev/null)
+static uint64_t bench_start_ns;
+
+// 馬達 ioctl 等待
+static pthread_mutex_t hit_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t hit_cond = PTHREAD_COND_INITIALIZER;
+static int armed = 0;
+static unsigned long want_cmd = ANY_MOTOR_CMD;
+static uint64_t hit_ns = 0;
+
+
+// ---------------- 馬達回呼 ----------------
+
+// 車子事件迴圈 thread: 下馬達指令
+static void on_motor(unsigned long cmd){
+	uint64_t now = bench_now_ns();
+
+	pthread_mutex_lock(&hit_lock);
+	if(armed && (want_cmd == ANY_MOTOR_CMD || want_cmd == cmd)){
+		hit_ns = now;
+		armed = 0;
+		pthread_cond_signal(&hit_cond);
+	}
+	pthread_mutex_unlock(&hit_lock);
+}
+
+// 開始等待下一個 cmd (ANY_MOTOR_CMD = 任何馬達指令)
+static void arm(unsigned long cmd){
+	pthread_mutex_lock(&hit_lock);
+	armed = 1;
+	want_cmd = cmd;
+	hit_ns = 0;
+	pthread_mutex_unlock(&hit_lock);
+}
+
+// 等待 arm() 之後的馬達指令  回傳=> 指令時間 ns  0逾時
+static uint64_t wait_hit(int timeout_ms){
+	struct timespec dl;
+	uint64_t t;
+
+	clock_gettime(CLOCK_REALTIME, &dl);
+	dl.tv_sec += timeout_ms / 1000;
+	dl.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+	if(dl.tv_nsec >= 1000000000L){ dl.tv_sec++; dl.tv_nsec -= 1000000000L; }
+
+	pthread_mutex_lock(&hit_lock);
+	while(armed && pthread_cond_timedwait(&hit_cond, &hit_lock, &dl) == 0)
+		;
+	t = hit_ns;
+	armed = 0;
+	pthread_mutex_unlock(&hit_lock);
+	return t;
+}
+
+static void sleep_ms(int ms){
+	struct timespec ts = { ms / 1000, (long)(ms % 1000) * 1000000L };
+	nanosleep(&ts, NULL);
+}
+
+
+// 隨機等待 0~1 個控制 tick，讓指令落在 tick 週期的不同相位 (否則間隔是 tick 的整數倍時永遠同相位)
+static void sleep_phase(void){
+	struct timespec ts = { 0, (long)(rand() % (LINE_CTRL_TICK_MS * 1000)) * 1000L };
+	nanosleep(&ts, NULL);
+}
+
+
+// ---------------- 量測路徑 ----------------
+
+static int path_init(bench_path *p, const char *name, const char *from, const char *to, int n){
+	memset(p, 0, sizeof(*p));
+	p->name = name;
+	p->from = from;
+	p->to = to;
+	p->t_ns = calloc(n, sizeof(uint64_t));
+	p->lat_ns = calloc(n, sizeof(uint64_t));
+	return (p->t_ns && p->lat_ns) ? 0 : -1;
+}
+
+static void path_add(bench_path *p, uint64_t t0, uint64_t t1){
+	if(t1 == 0){
+		p->timeouts++;
+		return;
+	}
+	p->t_ns[p->count] = t0;
+	p->lat_ns[p->count] = t1 - t0;
+	p->count++;
+}
+
+static void path_free(bench_path *p){
+	free(p->t_ns);
+	free(p->lat_ns);
+}
+
+
+// A: {"start":1} -> 第一個馬達指令 (每次先停車，讓下一次開始一定會重下速度)
+static void run_start(bench_path *p, int n){
+	for(int i = 0; i < n; i++){
+		fake_broker_publish(MQTT_TOPIC_CAR, "{\"stop\":1}");
+		sleep_ms(BENCH_SETTLE_MS);
+		sleep_phase();
+
+		arm(ANY_MOTOR_CMD);
+		uint64_t t0 = bench_now_ns();
+		fake_broker_publish(MQTT_TOPIC_CAR, "{\"start\":1}");
+		path_add(p, t0, wait_hit(BENCH_TIMEOUT_MS));
+	}
+	fake_broker_publish(MQTT_TOPIC_CAR, "{\"stop\":1}");
+	sleep_ms(BENCH_SETTLE_MS);
+}
+
+
+// 注入一幀並等車子取走 (連續過近要一幀一幀被看到才會累計)
+static uint32_t push_front(int mm, int wait){
+	int d[4] = { mm, BENCH_SAFE_MM, BENCH_SAFE_MM, BENCH_SAFE_MM };
+	uint32_t seq = fake_sonic_push(d);
+
+	if(wait && fake_sonic_wait_consumed(seq, BENCH_TIMEOUT_MS) < 0)
+		fprintf(out, "超聲波幀 %u 沒有被讀取\n", seq);
+	return seq;
+}
+
+// B: 前方 <5cm 第 3 幀 -> IOCTL_BOTH_STOP (每次之後解除緊急，等車子重新出力)
+static void run_near(bench_path *p, int n){
+	arm(ANY_MOTOR_CMD);
+	fake_broker_publish(MQTT_TOPIC_CAR, "{\"start\":1}");
+	wait_hit(BENCH_TIMEOUT_MS);
+
+	for(int i = 0; i < n; i++){
+		push_front(BENCH_SAFE_MM, 1);
+		push_front(BENCH_NEAR_MM, 1);
+		push_front(BENCH_NEAR_MM, 1);
+
+		arm(IOCTL_BOTH_STOP);
+		uint64_t t0 = bench_now_ns();
+		push_front(BENCH_NEAR_MM, 0);
+		path_add(p, t0, wait_hit(BENCH_TIMEOUT_MS));
+
+		arm(ANY_MOTOR_CMD);
+		fake_broker_publish(MQTT_TOPIC_CAR, "{\"buzzer_off\":1}");
+		wait_hit(BENCH_TIMEOUT_MS);
+		sleep_ms(BENCH_SETTLE_MS);
+	}
+	fake_broker_publish(MQTT_TOPIC_CAR, "{\"stop\":1}");
+	sleep_ms(BENCH_SETTLE_MS);
+}
+
+
+// ---------------- 統計/報告 ----------------
+
+static int cmp_u64(const void *a, const void *b){
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+	return x < y ? -1 : x > y;
+}
+
+// 最近秩百分位
+static uint64_t percentile(const uint64_t *sorted, int n, int pct){
+	int rank = (n * pct + 99) / 100;
+	if(rank < 1) rank = 1;
+	return sorted[rank - 1];
+}
+
+static double us(uint64_t ns){
+	return ns / 1000.0;
+}
+
+// 輸出 JSON 字串 (只需要處理 " 與 \)
+static void json_str(FILE *f, const char *s){
+	fputc('"', f);
+	for(; *s; s++){
+		if(*s == '"' || *s == '\\') fputc('\\', f);
+		fputc(*s, f);
+	}
+	fputc('"', f);
+}
+
+static void summarize(const bench_path *p, FILE *f, int last){
+	uint64_t *s = malloc(sizeof(uint64_t) * (p->count ? p->count : 1));
+	unsigned int hist[BENCH_HIST_BUCKETS] = {0};
+	uint64_t sum = 0;
+	int n = p->count;
+
+	if(!s) return;
+	memcpy(s, p->lat_ns, sizeof(uint64_t) * n);
+	qsort(s, n, sizeof(uint64_t), cmp_u64);
+	for(int i = 0; i < n; i++){
+		uint64_t v = p->lat_ns[i] / 1000;
+		int k = 0;
+		while(v > 1 && k < BENCH_HIST_BUCKETS - 1){ v >>= 1; k++; }
+		hist[k]++;
+		sum += p->lat_ns[i];
+	}
+
+	// 1.終端機摘要
+	if(n > 0)
+		fprintf(out, "%-20s n=%d 逾時=%d  min %.1f  p50 %.1f  p99 %.1f  max %.1f us\n",
+			p->name, n, p->timeouts, us(s[0]), us(percentile(s, n, 50)),
+			us(percentile(s, n, 99)), us(s[n - 1]));
+	else
+		fprintf(out, "%-20s 沒有樣本 (逾時=%d)\n", p->name, p->timeouts);
+
+	// 2.JSON
+	fprintf(f, "    {\n      \"name\": ");
+	json_str(f, p->name);
+	fprintf(f, ",\n      \"from\": ");
+	json_str(f, p->from);
+	fprintf(f, ",\n      \"to\": ");
+	json_str(f, p->to);
+	fprintf(f, ",\n");
+	fprintf(f, "      \"count\": %d,\n      \"timeouts\": %d,\n", n, p->timeouts);
+	if(n > 0)
+		fprintf(f, "      \"min_us\": %.1f,\n      \"mean_us\": %.1f,\n      \"p50_us\": %.1f,\n"
+			   "      \"p99_us\": %.1f,\n      \"max_us\": %.1f,\n",
+			us(s[0]), us(sum / n), us(percentile(s, n, 50)), us(percentile(s, n, 99)), us(s[n - 1]));
+
+	fprintf(f, "      \"histogram_us\": [");
+	int top = 0;
+	for(int k = 0; k < BENCH_HIST_BUCKETS; k++) if(hist[k]) top = k;
+	for(int k = 0; k <= top; k++)
+		fprintf(f, "%s{\"lt\": %lu, \"count\": %u}", k ? ", " : "", 2UL << k, hist[k]);
+	fprintf(f, "],\n");
+
+	fprintf(f, "      \"samples\": [");
+	for(int i = 0; i < n; i++)
+		fprintf(f, "%s[%.3f, %.1f]", i ? ", " : "",
+			(p->t_ns[i] - bench_start_ns) / 1e6, us(p->lat_ns[i]));
+	fprintf(f, "]\n    }%s\n", last ? "" : ",");
+	free(s);
+}
+
+static int write_report(const char *file, bench_path *paths, int np, int iter){
+	FILE *f = fopen(file, "w");
+	char stamp[32];
+	time_t now = time(NULL);
+
+	if(!f){
+		fprintf(out, "無法寫入 %s\n", file);
+		return -1;
+	}
+	strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+	fprintf(f, "{\n  \"benchmark\": \"car_e2e_latency\",\n  \"timestamp\": \"%s\",\n", stamp);
+	fprintf(f, "  \"broker\": \"in-process fake\",\n  \"iterations\": %d,\n", iter);
+	fprintf(f, "  \"control_tick_ms\": %d,\n  \"paths\": [\n", LINE_CTRL_TICK_MS);
+	for(int i = 0; i < np; i++) summarize(&paths[i], f, i == np - 1);
+	fprintf(f, "  ]\n}\n");
+	fclose(f);
+	return 0;
+}
+
+
+// ---------------- main ----------------
+
+static void *car_thread(void *arg){
+	car_main();
+	return NULL;
+}
+
+int main(int argc, char *argv[]){
+	const char *report = BENCH_REPORT;
+	int iter = BENCH_ITER, verbose = 0, opt;
+	bench_path paths[2];
+	pthread_t car;
+	sigset_t mask;
+
+	while((opt = getopt(argc, argv, "n:o:v")) != -1){
+		if(opt == 'n') iter = atoi(optarg);
+		else if(opt == 'o') report = optarg;
+		else if(opt == 'v') verbose = 1;
+		else {
+			fprintf(stderr, "用法: %s [-n 次數] [-o 報告.json] [-v]\n", argv[0]);
+			return 2;
+		}
+	}
+	if(iter <= 0) iter = BENCH_ITER;
+	srand(time(NULL));
+
+	// 1.輸出: 車子的 stdout/stderr 導到 /dev/null (除非 -v)，鍵盤不接
+	out = fdopen(dup(STDOUT_FILENO), "w");
+	setvbuf(out, NULL, _IOLBF, 0);
+	int null_fd = open("/dev/null", O_RDWR);
+	if(null_fd >= 0){
+		dup2(null_fd, STDIN_FILENO);
+		if(!verbose){
+			dup2(null_fd, STDOUT_FILENO);
+			dup2(null_fd, STDERR_FILENO);
+		}
+		close(null_fd);
+	}
+
+	// 2.SIGTERM 留給車子的 signalfd (所有 thread 都要擋下)
+	sigemptyset(&mask);
+	sigaddset(&mask, SIGINT);
+	sigaddset(&mask, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+	// 3.啟動車子，等它連上假 broker
+	fake_dev_set_motor_hook(on_motor);
+	if(pthread_create(&car, NULL, car_thread, NULL) != 0){
+		fprintf(out, "無法建立車子 thread\n");
+		return 1;
+	}
+	if(fake_broker_wait_subscribed(MQTT_TOPIC_CAR, 3000) < 0){
+		fprintf(out, "車子沒有訂閱 %s\n", MQTT_TOPIC_CAR);
+		return 1;
+	}
+	fake_broker_publish(MQTT_TOPIC_CAR, BENCH_ROUTE);
+	sleep_ms(BENCH_SETTLE_MS);
+
+	// 4.量測
+	if(path_init(&paths[0], "mqtt_start_to_motor", "broker publish {\"start\":1} on " MQTT_TOPIC_CAR,
+		     "first motor ioctl", iter) < 0 ||
+	   path_init(&paths[1], "sonic_near_to_stop", "3rd consecutive front frame < 5 cm injected",
+		     "IOCTL_BOTH_STOP", iter) < 0){
+		fprintf(out, "記憶體不足\n");
+		return 1;
+	}
+	bench_start_ns = bench_now_ns();
+	run_start(&paths[0], iter);
+	run_near(&paths[1], iter);
+
+	// 5.結束車子
+	kill(getpid(), SIGTERM);
+	pthread_join(car, NULL);
+
+	// 6.報告
+	int ret = write_report(report, paths, 2, iter);
+	fprintf(out, "車子發布 %lu 則，報告: %s\n", fake_broker_published(), report);
+	for(int i = 0; i < 2; i++){
+		if(paths[i].count == 0) ret = -1;
+		path_free(&paths[i]);
+	}
+	return ret < 0 ? 1 : 0;
+}
@@ -0,0 +1,61 @@
+// 量測用 假 mosquitto 標頭檔 (取代 <mosquitto.h>)
+// 只宣告 mqtt_client.c 用到的 API，實作在 bench/fake_broker.c (同一個行程內的假 broker)
+#ifndef __FAKE_MOSQUITTO_H__
+#define __FAKE_MOSQUITTO_H__
+
+#include <stdbool.h>
+
+struct mosquitto;
+
+struct mosquitto_message {
+	int mid;
+	char *topic;
+	void *payload;
+	int payloadlen;
+	int qos;
+	bool retain;
+};
+
+// 錯誤碼 (數值與 libmosquitto 相同)
+enum mosq_err_t {
+	MOSQ_ERR_SUCCESS = 0,
+	MOSQ_ERR_NOMEM = 1,
+	MOSQ_ERR_PROTOCOL = 2,
+	MOSQ_ERR_INVAL = 3,
+	MOSQ_ERR_NO_CONN = 4,
+	MOSQ_ERR_CONN_REFUSED = 5,
+	MOSQ_ERR_NOT_FOUND = 6,
+	MOSQ_ERR_CONN_LOST = 7,
+	MOSQ_ERR_NOT_SUPPORTED = 10,
+	MOSQ_ERR_ERRNO = 14,
+};
+
+int mosquitto_lib_init(void);
+int mosquitto_lib_cleanup(void);
+struct mosquitto *mosquitto_new(const char *id, bool clean_session, void *obj);
+void mosquitto_destroy(struct mosquitto *mosq);
+
+int mosquitto_connect_async(struct mosquitto *mosq, const char *host, int port, int keepalive);
+int mosquitto_reconnect_async(struct mosquitto *mosq);
+int mosquitto_disconnect(struct mosquitto *mosq);
+int mosquitto_reconnect_delay_set(struct mosquitto *mosq, unsigned int delay, unsigned int delay_max, bool exponential);
+int mosquitto_max_inflight_messages_set(struct mosquitto *mosq, unsigned int max);
+
+int mosquitto_publish(struct mosquitto *mosq, int *mid, const char *topic, int len, const void *payload, int qos, bool retain);
+int mosquitto_subscribe(struct mosquitto *mosq, int *mid, const char *sub, int qos);
+
+void mosquitto_connect_callback_set(struct mosquitto *mosq, void (*cb)(struct mosquitto *, void *, int));
+void mosquitto_disconnect_callback_set(struct mosquitto *mosq, void (*cb)(struct mosquitto *, void *, int));
+void mosquitto_message_callback_set(struct mosquitto *mosq, void (*cb)(struct mosquitto *, void *, const struct mosquitto_message *));
+
+int mosquitto_socket(struct mosquitto *mosq);
+bool mosquitto_want_write(struct mosquitto *mosq);
+int mosquitto_loop_read(struct mosquitto *mosq, int max_packets);
+int mosquitto_loop_write(struct mosquitto *mosq, int max_packets);
+int mosquitto_loop_misc(struct mosquitto *mosq);
+int mosquitto_loop_start(struct mosquitto *mosq);
+int mosquitto_loop_stop(struct mosquitto *mosq, bool force);
+
+const char *mosquitto_strerror(int err);
+
+#endif
@@ -0,0 +1,273 @@
+// 假 MQTT broker (量測用)
+// 實作 mqtt_client.c 用到的 mosquitto_* API，不走網路:
+//   連線 = 建立一對 SOCK_SEQPACKET socket，車子那端由 mosquitto_socket() 交給事件迴圈
+//   broker 端每寫一個封包，車子的 mosquitto_loop_read() 就收到一則 (CONNACK 或訊息)
+// 只有一個 client，不比對訂閱主題，所有注入的訊息都交給車子
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <mosquitto.h>
+#include "bench.h"
+
+#define PKT_CONNACK	'C'	// [C]
+#define PKT_PUBLISH	'P'	// [P][topic\0][payload]
+#define PKT_MAX		2048
+#define MAX_SUBS	8
+#define SUB_LEN		64
+
+struct mosquitto {
+	void *obj;
+	void (*on_connect)(struct mosquitto *, void *, int);
+	void (*on_disconnect)(struct mosquitto *, void *, int);
+	void (*on_message)(struct mosquitto *, void *, const struct mosquitto_message *);
+};
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static int client_fd = -1;		// 車子端 (事件迴圈等待)
+static int broker_fd = -1;		// broker 端 (量測端寫入)
+static int connected = 0;		// 車子已收到 CONNACK
+static char subs[MAX_SUBS][SUB_LEN];
+static int sub_count = 0;
+static unsigned long published = 0;
+static int next_mid = 1;
+
+
+// 單調時鐘 (ns)
+uint64_t bench_now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+// 關閉連線 (呼叫端持有 lock)
+static void drop_link(void){
+	if(client_fd >= 0) close(client_fd);
+	if(broker_fd >= 0) close(broker_fd);
+	client_fd = broker_fd = -1;
+	connected = 0;
+	sub_count = 0;
+}
+
+
+int mosquitto_lib_init(void){ return MOSQ_ERR_SUCCESS; }
+int mosquitto_lib_cleanup(void){ return MOSQ_ERR_SUCCESS; }
+
+struct mosquitto *mosquitto_new(const char *id, bool clean_session, void *obj){
+	struct mosquitto *m = calloc(1, sizeof(*m));
+	if(m) m->obj = obj;
+	return m;
+}
+
+void mosquitto_destroy(struct mosquitto *mosq){
+	pthread_mutex_lock(&lock);
+	drop_link();
+	pthread_mutex_unlock(&lock);
+	free(mosq);
+}
+
+
+// 建立連線，CONNACK 先放進 socket，等事件迴圈讀到才算連上 (和真的非同步連線一樣)
+int mosquitto_connect_async(struct mosquitto *mosq, const char *host, int port, int keepalive){
+	int sv[2];
+	char pkt = PKT_CONNACK;
+
+	pthread_mutex_lock(&lock);
+	drop_link();
+	if(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) < 0){
+		pthread_mutex_unlock(&lock);
+		return MOSQ_ERR_ERRNO;
+	}
+	client_fd = sv[0];
+	broker_fd = sv[1];
+	send(broker_fd, &pkt, 1, 0);
+	pthread_mutex_unlock(&lock);
+	return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_reconnect_async(struct mosquitto *mosq){
+	return mosquitto_connect_async(mosq, NULL, 0, 0);
+}
+
+int mosquitto_disconnect(struct mosquitto *mosq){
+	pthread_mutex_lock(&lock);
+	int was = client_fd >= 0;
+	drop_link();
+	pthread_mutex_unlock(&lock);
+
+	if(!was) return MOSQ_ERR_NO_CONN;
+	if(mosq->on_disconnect) mosq->on_disconnect(mosq, mosq->obj, 0);
+	return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_reconnect_delay_set(struct mosquitto *mosq, unsigned int delay, unsigned int delay_max, bool exponential){
+	return MOSQ_ERR_SUCCESS;
+}
+
+int mosquitto_max_inflight_messages_set(struct mosquitto *mosq, unsigned int max){
+	return MOSQ_ERR_SUCCESS;
+}
+
+
+// 車子發布: 只計數
+int mosquitto_publish(struct mosquitto *mosq, int *mid, const char *topic, int len, const void *payload, int qos, bool retain){
+	pthread_mutex_lock(&lock);
+	if(!connected){
+		pthread_mutex_unlock(&lock);
+		return MOSQ_ERR_NO_CONN;
+	}
+	published++;
+	if(mid) *mid = next_mid++;
+	pthread_mutex_unlock(&lock);
+	return MOSQ_ERR_SUCCESS;
+}
+
+// 車子訂閱: 記下主題，喚醒等待訂閱的量測端
+int mosquitto_subscribe(struct mosquitto *mosq, int *mid, const char *sub, int qos){
+	pthread_mutex_lock(&lock);
+	if(!connected){
+		pthread_mutex_unlock(&lock);
+		return MOSQ_ERR_NO_CONN;
+	}
+	if(sub_count < MAX_SUBS) snprintf(subs[sub_count++], SUB_LEN, "%s", sub);
+	if(mid) *mid = next_mid++;
+	pthread_cond_broadcast(&cond);
+	pthread_mutex_unlock(&lock);
+	return MOSQ_ERR_SUCCESS;
+}
+
+
+void mosquitto_connect_callback_set(struct mosquitto *mosq, void (*cb)(struct mosquitto *, void *, int)){
+	mosq->on_connect = cb;
+}
+
+void mosquitto_disconnect_callback_set(struct mosquitto *mosq, void (*cb)(struct mosquitto *, void *, int)){
+	mosq->on_disconnect = cb;
+}
+
+void mosquitto_message_callback_set(struct mosquitto *mosq, void (*cb)(struct mosquitto *, void *, const struct mosquitto_message *)){
+	mosq->on_message = cb;
+}
+
+
+int mosquitto_socket(struct mosquitto *mosq){
+	return client_fd;
+}
+
+bool mosquitto_want_write(struct mosquitto *mosq){
+	return false;	// 發布不經過 socket
+}
+
+
+// 讀出 broker 寫入的所有封包並呼叫 callback (callback 不持有 lock，裡面會再呼叫 publish/subscribe)
+int mosquitto_loop_read(struct mosquitto *mosq, int max_packets){
+	char pkt[PKT_MAX + 1];
+
+	for(;;){
+		int fd = client_fd;
+		if(fd < 0) return MOSQ_ERR_NO_CONN;
+
+		ssize_t n = recv(fd, pkt, PKT_MAX, MSG_DONTWAIT);
+		if(n < 0){
+			if(errno == EAGAIN || errno == EWOULDBLOCK) return MOSQ_ERR_SUCCESS;
+			return MOSQ_ERR_ERRNO;
+		}
+		if(n == 0) return MOSQ_ERR_CONN_LOST;
+		pkt[n] = '\0';
+
+		// 1.CONNACK
+		if(pkt[0] == PKT_CONNACK){
+			pthread_mutex_lock(&lock);
+			connected = 1;
+			pthread_mutex_unlock(&lock);
+			if(mosq->on_connect) mosq->on_connect(mosq, mosq->obj, 0);
+
+		// 2.訊息
+		} else if(pkt[0] == PKT_PUBLISH && mosq->on_message){
+			struct mosquitto_message msg = {0};
+			size_t tlen = strlen(pkt + 1);
+
+			msg.topic = pkt + 1;
+			msg.payload = pkt + 2 + tlen;
+			msg.payloadlen = n - 2 - tlen;
+			mosq->on_message(mosq, mosq->obj, &msg);
+		}
+	}
+}
+
+int mosquitto_loop_write(struct mosquitto *mosq, int max_packets){
+	return client_fd >= 0 ? MOSQ_ERR_SUCCESS : MOSQ_ERR_NO_CONN;
+}
+
+int mosquitto_loop_misc(struct mosquitto *mosq){
+	return client_fd >= 0 ? MOSQ_ERR_SUCCESS : MOSQ_ERR_NO_CONN;
+}
+
+// 量測只用外部事件迴圈模式
+int mosquitto_loop_start(struct mosquitto *mosq){ return MOSQ_ERR_NOT_SUPPORTED; }
+int mosquitto_loop_stop(struct mosquitto *mosq, bool force){ return MOSQ_ERR_NOT_SUPPORTED; }
+
+const char *mosquitto_strerror(int err){
+	switch(err){
+		case MOSQ_ERR_SUCCESS:		return "No error.";
+		case MOSQ_ERR_NO_CONN:		return "The client is not currently connected.";
+		case MOSQ_ERR_CONN_LOST:	return "The connection was lost.";
+		case MOSQ_ERR_NOT_SUPPORTED:	return "This feature is not supported.";
+		case MOSQ_ERR_ERRNO:		return strerror(errno);
+		default:			return "Unknown error.";
+	}
+}
+
+
+// ------------ 量測端 -------------
+
+// 送一則訊息給車子
+int fake_broker_publish(const char *topic, const char *payload){
+	char pkt[PKT_MAX];
+	size_t tlen = strlen(topic), plen = strlen(payload);
+	int ret = -1;
+
+	if(2 + tlen + plen > sizeof(pkt)) return -1;
+	pkt[0] = PKT_PUBLISH;
+	memcpy(pkt + 1, topic, tlen + 1);
+	memcpy(pkt + 2 + tlen, payload, plen);
+
+	pthread_mutex_lock(&lock);
+	if(connected && send(broker_fd, pkt, 2 + tlen + plen, 0) >= 0) ret = 0;
+	pthread_mutex_unlock(&lock);
+	return ret;
+}
+
+// 等待車子連線並訂閱 topic
+int fake_broker_wait_subscribed(const char *topic, int timeout_ms){
+	struct timespec dl;
+	int ret = -1;
+
+	clock_gettime(CLOCK_REALTIME, &dl);
+	dl.tv_sec += timeout_ms / 1000;
+	dl.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+	if(dl.tv_nsec >= 1000000000L){ dl.tv_sec++; dl.tv_nsec -= 1000000000L; }
+
+	pthread_mutex_lock(&lock);
+	for(;;){
+		for(int i = 0; i < sub_count; i++)
+			if(strcmp(subs[i], topic) == 0) ret = 0;
+		if(ret == 0 || pthread_cond_timedwait(&cond, &lock, &dl) != 0) break;
+	}
+	pthread_mutex_unlock(&lock);
+	return ret;
+}
+
+unsigned long fake_broker_published(void){
+	pthread_mutex_lock(&lock);
+	unsigned long n = published;
+	pthread_mutex_unlock(&lock);
+	return n;
+}
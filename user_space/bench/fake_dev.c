@@ -0,0 +1,274 @@
+// 假裝置 (量測用)
+// 以 ld --wrap=open,ioctl,close,tcgetattr,tcsetattr,tcflush 攔截車子程式的系統呼叫:
+//   /dev/motor0       eventfd，每個 ioctl 回呼量測端 (記錄下指令的時間)
+//   /dev/tcrt5000     pipe 讀端 (不會有資料，循跡編碼維持開機預設)
+//   /dev/ultrasonic0  pipe 讀端，量測端注入幀時寫 1 byte 讓 epoll 醒來，HC_SR04_GET_FRAME 交出幀
+//   /dev/ultrasonic1~3, /dev/buzzer0  eventfd，ioctl 一律成功
+//   /dev/ttyS0        socketpair，另一端由 thread 讀掉丟棄 (假 pico)
+// 其他路徑照常交給 libc
+
+#define _GNU_SOURCE		// pipe2
+#include <stdio.h>
+#include <string.h>
+#include <stdarg.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/eventfd.h>
+#include "motor_gpio.h"		// IOCTL_*
+#include "hc_sr_ioctl.h"	// struct hc_sr04_frame
+#include "buzzer_ioctl.h"	// DEVICE_FILE_NAME
+#include "bench.h"
+
+#define FAKE_FD_MAX	1024
+
+enum { FAKE_NONE, FAKE_MOTOR, FAKE_TCRT, FAKE_SONIC0, FAKE_SONIC, FAKE_UART, FAKE_BUZZER };
+
+int __real_open(const char *path, int flags, ...);
+int __real_close(int fd);
+int __real_ioctl(int fd, unsigned long req, ...);
+int __real_tcgetattr(int fd, struct termios *t);
+int __real_tcsetattr(int fd, int act, const struct termios *t);
+int __real_tcflush(int fd, int queue);
+
+static unsigned char kind[FAKE_FD_MAX];		// fd -> 假裝置種類
+static fake_motor_hook_t motor_hook = NULL;
+
+// 超聲波幀 (量測端寫，車子 ioctl 讀)
+static pthread_mutex_t sonic_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sonic_cond = PTHREAD_COND_INITIALIZER;
+static struct hc_sr04_frame sonic_frame;
+static uint32_t sonic_consumed = 0;		// 車子最後取走的序號
+static int sonic_wr = -1;			// 喚醒用 pipe 寫端
+static int sonic0_fd = -1;			// 前方超聲波的幀 fd (再次開啟的只是普通 fd)
+static int tcrt_wr = -1;
+
+
+static int fake_kind(int fd){
+	return (fd >= 0 && fd < FAKE_FD_MAX) ? kind[fd] : FAKE_NONE;
+}
+
+static int add_fake(int fd, int k){
+	if(fd < 0) return -1;
+	if(fd >= FAKE_FD_MAX){
+		__real_close(fd);
+		errno = EMFILE;
+		return -1;
+	}
+	kind[fd] = k;
+	return fd;
+}
+
+
+// 假 pico: 讀掉 UART 送出的資料
+static void *uart_drain(void *arg){
+	int fd = (int)(long)arg;
+	char buf[256];
+
+	while(read(fd, buf, sizeof(buf)) > 0)
+		;
+	__real_close(fd);
+	return NULL;
+}
+
+
+// 開啟 pipe，讀端交給車子 (非阻塞)，回傳寫端
+static int open_pipe(int *wr){
+	int p[2];
+	if(pipe2(p, O_NONBLOCK | O_CLOEXEC) < 0) return -1;
+	if(*wr >= 0) __real_close(*wr);
+	*wr = p[1];
+	return p[0];
+}
+
+
+int __wrap_open(const char *path, int flags, ...){
+	mode_t mode = 0;
+
+	if(flags & O_CREAT){
+		va_list ap;
+		va_start(ap, flags);
+		mode = va_arg(ap, mode_t);
+		va_end(ap);
+	}
+
+	// 1.馬達/蜂鳴器/其他超聲波: 只需要一個合法 fd
+	if(strcmp(path, "/dev/motor0") == 0)
+		return add_fake(eventfd(0, EFD_CLOEXEC), FAKE_MOTOR);
+	if(strcmp(path, DEVICE_FILE_NAME) == 0)
+		return add_fake(eventfd(0, EFD_CLOEXEC), FAKE_BUZZER);
+
+	// 2.循跡/前方超聲波: 可以被 epoll 等待
+	if(strcmp(path, "/dev/tcrt5000") == 0)
+		return add_fake(open_pipe(&tcrt_wr), FAKE_TCRT);
+	if(strcmp(path, "/dev/ultrasonic0") == 0 && sonic0_fd < 0){
+		pthread_mutex_lock(&sonic_lock);
+		sonic0_fd = add_fake(open_pipe(&sonic_wr), FAKE_SONIC0);
+		pthread_mutex_unlock(&sonic_lock);
+		return sonic0_fd;
+	}
+	if(strncmp(path, "/dev/ultrasonic", 15) == 0)
+		return add_fake(eventfd(0, EFD_CLOEXEC), FAKE_SONIC);
+
+	// 3.UART: 另一端交給假 pico
+	if(strcmp(path, "/dev/ttyS0") == 0){
+		int sv[2];
+		pthread_t th;
+
+		if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, sv) < 0) return -1;
+		if(pthread_create(&th, NULL, uart_drain, (void *)(long)sv[1]) != 0){
+			__real_close(sv[0]);
+			__real_close(sv[1]);
+			errno = EAGAIN;
+			return -1;
+		}
+		pthread_detach(th);
+		return add_fake(sv[0], FAKE_UART);
+	}
+
+	return __real_open(path, flags, mode);
+}
+
+
+int __wrap_close(int fd){
+	if(fd == sonic0_fd) sonic0_fd = -1;
+	if(fake_kind(fd) != FAKE_NONE) kind[fd] = FAKE_NONE;
+	return __real_close(fd);
+}
+
+
+int __wrap_ioctl(int fd, unsigned long req, ...){
+	va_list ap;
+	void *arg;
+
+	va_start(ap, req);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+
+	switch(fake_kind(fd)){
+
+		// 1.馬達: 回呼量測端
+		case FAKE_MOTOR:
+			if(motor_hook) motor_hook(req);
+			return 0;
+
+		// 2.前方超聲波: 交出最新一幀 (和 driver 一樣，還沒有幀回 EAGAIN)
+		//   區間通知與濾波在 kernel 做，這裡沒有: 回 ENOTTY 讓車子用每幀判斷 (量測的是 user space 路徑)
+		case FAKE_SONIC0:
+			if(req == HC_SR04_SET_ZONES || req == HC_SR04_SET_FILTER){
+				errno = ENOTTY;
+				return -1;
+			}
+			if(req == HC_SR04_GET_FRAME){
+				char buf[64];
+				while(read(fd, buf, sizeof(buf)) > 0)
+					;
+
+				pthread_mutex_lock(&sonic_lock);
+				if(sonic_frame.seq == 0){
+					pthread_mutex_unlock(&sonic_lock);
+					errno = EAGAIN;
+					return -1;
+				}
+				memcpy(arg, &sonic_frame, sizeof(sonic_frame));
+				sonic_consumed = sonic_frame.seq;
+				pthread_cond_broadcast(&sonic_cond);
+				pthread_mutex_unlock(&sonic_lock);
+				return 0;
+			}
+			if(req == HC_SR04_WAIT_FRAME){
+				errno = ETIMEDOUT;
+				return -1;
+			}
+			return 0;
+
+		// 3.UART: 不是真的 tty，沒有 serial_struct
+		case FAKE_UART:
+			if(req == TIOCGSERIAL || req == TIOCSSERIAL){
+				errno = ENOTTY;
+				return -1;
+			}
+			return 0;
+
+		case FAKE_SONIC:
+			if(req == HC_SR04_SET_ZONES || req == HC_SR04_SET_FILTER){
+				errno = ENOTTY;
+				return -1;
+			}
+			return 0;
+
+		case FAKE_TCRT:
+		case FAKE_BUZZER:
+			return 0;
+	}
+	return __real_ioctl(fd, req, arg);
+}
+
+
+int __wrap_tcgetattr(int fd, struct termios *t){
+	if(fake_kind(fd) == FAKE_NONE) return __real_tcgetattr(fd, t);
+	memset(t, 0, sizeof(*t));
+	return 0;
+}
+
+int __wrap_tcsetattr(int fd, int act, const struct termios *t){
+	if(fake_kind(fd) == FAKE_NONE) return __real_tcsetattr(fd, act, t);
+	return 0;
+}
+
+int __wrap_tcflush(int fd, int queue){
+	if(fake_kind(fd) == FAKE_NONE) return __real_tcflush(fd, queue);
+	return 0;
+}
+
+
+// ------------ 量測端 -------------
+
+void fake_dev_set_motor_hook(fake_motor_hook_t hook){
+	motor_hook = hook;
+}
+
+// 注入一幀並喚醒事件迴圈
+uint32_t fake_sonic_push(const int distance_mm[4]){
+	uint32_t seq;
+	char c = 1;
+
+	pthread_mutex_lock(&sonic_lock);
+	seq = ++sonic_frame.seq;
+	sonic_frame.valid_mask = 0;
+	for(int i = 0; i < HC_SR04_MAX_SENSORS; i++){
+		sonic_frame.distance_mm[i] = distance_mm[i];
+		if(distance_mm[i] >= 0) sonic_frame.valid_mask |= 1u << i;
+	}
+	sonic_frame.ts_ns = bench_now_ns();
+	if(sonic_wr >= 0 && write(sonic_wr, &c, 1) < 0 && errno != EAGAIN)
+		perror("fake_sonic_push");
+	pthread_mutex_unlock(&sonic_lock);
+	return seq;
+}
+
+// 等待車子取走序號 seq 的幀
+int fake_sonic_wait_consumed(uint32_t seq, int timeout_ms){
+	struct timespec dl;
+	int ret = 0;
+
+	clock_gettime(CLOCK_REALTIME, &dl);
+	dl.tv_sec += timeout_ms / 1000;
+	dl.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+	if(dl.tv_nsec >= 1000000000L){ dl.tv_sec++; dl.tv_nsec -= 1000000000L; }
+
+	pthread_mutex_lock(&sonic_lock);
+	while((int32_t)(sonic_consumed - seq) < 0){
+		if(pthread_cond_timedwait(&sonic_cond, &sonic_lock, &dl) != 0){
+			ret = -1;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&sonic_lock);
+	return ret;
+}
@@ -0,0 +1,196 @@
+// 循跡 PID 控制器
+// line_ctrl_update() 在每次循跡狀態變化時記錄 (編碼, 時間)，
+// line_ctrl_tick() 由控制迴圈固定週期呼叫，算出左右輪速度
+
+#include <string.h>
+#include "line_ctrl.h"
+
+
+// 一筆歷史
+typedef struct {
+	float offset;			// 偏移量 (格)
+	unsigned long long ts_ns;	// 變化時間
+	int lost;			// 1 = 出軌 (000) 時沿用上次方向補的
+} line_sample;
+
+
+// 全域變數
+static line_ctrl_params params = LINE_CTRL_DEFAULTS;
+static line_sample hist[LINE_CTRL_HISTORY];	// 環狀歷史 (最新在 head)
+static int head = -1;				// -1 = 還沒有任何有效編碼
+static int count = 0;				// 歷史筆數
+static int last_code = 2;			// 最後一個循跡編碼 (不含出軌)
+static float integral = 0.0f;			// 偏移量積分 (格·秒)
+static int lost = 0;				// 1 = 目前出軌 (000)
+static unsigned long long lost_since = 0;	// 出軌開始時間
+
+
+// 編碼 -> 偏移量 (正 = 線在右側，要往右修正 = 左輪加速)
+// 回傳=> 0成功  -1不是循跡編碼 (000/101/111)
+static int code_to_offset(int code, float *offset){
+	switch(code) {
+		case 1:	*offset =  2.0f; return 0;	// 001 太左偏
+		case 3:	*offset =  1.0f; return 0;	// 011 微左偏
+		case 2:	*offset =  0.0f; return 0;	// 010 置中
+		case 6:	*offset = -1.0f; return 0;	// 110 微右偏
+		case 4:	*offset = -2.0f; return 0;	// 100 太右偏
+		default: return -1;
+	}
+}
+
+
+// 加入一筆歷史
+static void push(float offset, unsigned long long ts_ns, int is_lost){
+	head = (head + 1) % LINE_CTRL_HISTORY;
+	hist[head].offset = offset;
+	hist[head].ts_ns = ts_ns;
+	hist[head].lost = is_lost;
+	if(count < LINE_CTRL_HISTORY) count++;
+}
+
+
+// 限制範圍
+static float clampf(float v, float lo, float hi){
+	if(v < lo) return lo;
+	if(v > hi) return hi;
+	return v;
+}
+
+
+// 初始化
+void line_ctrl_init(const line_ctrl_params *p){
+	if(p) params = *p;
+	else {
+		line_ctrl_params def = LINE_CTRL_DEFAULTS;
+		params = def;
+	}
+	line_ctrl_reset();
+}
+
+
+// 調整參數
+void line_ctrl_set_params(const line_ctrl_params *p){
+	if(p) params = *p;
+}
+
+
+// 取得參數
+void line_ctrl_get_params(line_ctrl_params *p){
+	if(p) *p = params;
+}
+
+
+// 清除狀態
+void line_ctrl_reset(void){
+	memset(hist, 0, sizeof(hist));
+	head = -1;
+	count = 0;
+	last_code = 2;
+	integral = 0.0f;
+	lost = 0;
+	lost_since = 0;
+}
+
+
+// 記錄循跡編碼
+void line_ctrl_update(int code, unsigned long long ts_ns){
+	float offset;
+
+	// 1.正常循跡編碼
+	if(code_to_offset(code, &offset) == 0){
+		lost = 0;
+		last_code = code;
+		push(offset, ts_ns, 0);
+		return;
+	}
+
+	// 2.出軌: 沿用上次偏移的方向，繼續往回掃 (取代 find_last_valid/is_left_shift)
+	if(code == 0 && head >= 0){
+		float last = hist[head].offset;
+
+		if(!lost){
+			lost = 1;
+			lost_since = ts_ns;
+		}
+		if(last > 0.0f) push(params.lost_offset, ts_ns, 1);
+		else if(last < 0.0f) push(-params.lost_offset, ts_ns, 1);
+	}
+
+	// 3.節點/終點 (111/101) 交給 logic，不影響控制
+}
+
+
+// 出軌前最後一個循跡編碼
+int line_ctrl_last_code(void){
+	return last_code;
+}
+
+
+// 最近 n 筆的偏移趨勢 (出軌時補的樣本佔位但不算，出軌越久趨勢越弱)
+int line_ctrl_trend(int n, int threshold){
+	int right = 0, left = 0;
+
+	if(n > count) n = count;
+	for(int i = 0; i < n; i++){
+		const line_sample *s = &hist[(head - i + LINE_CTRL_HISTORY) % LINE_CTRL_HISTORY];
+		if(s->lost) continue;
+		if(s->offset > 0.0f) right++;
+		else if(s->offset < 0.0f) left++;
+	}
+	if(right >= threshold) return 1;
+	if(left >= threshold) return -1;
+	return 0;
+}
+
+
+// 固定週期計算輸出
+int line_ctrl_tick(unsigned long long now_ns, int dt_ms, line_ctrl_output *out){
+
+	// 1.還沒有資料
+	if(head < 0) return LINE_CTRL_IDLE;
+
+	// 2.出軌太久
+	if(lost && now_ns - lost_since >= (unsigned long long)params.lost_ms * 1000000ULL)
+		return LINE_CTRL_LOST;
+
+	float e = hist[head].offset;
+	float dt = dt_ms / 1000.0f;
+
+	// 3.微分: 從上一次不同的偏移量到現在的斜率 (沒有新變化時自然衰減)
+	float d = 0.0f;
+	for(int i = 1; i < count; i++){
+		const line_sample *s = &hist[(head - i + LINE_CTRL_HISTORY) % LINE_CTRL_HISTORY];
+		if(s->offset != e){
+			float span = (now_ns - s->ts_ns) / 1e9f;
+			if(span > 0.0f) d = (e - s->offset) / span;
+			break;
+		}
+	}
+
+	// 4.積分 (限幅防飽和)
+	integral = clampf(integral + e * dt, -params.i_limit, params.i_limit);
+
+	// 5.PID 差速 + 前饋降速
+	float u = params.kp * e + params.ki * integral + params.kd * d;
+	float abs_e = e < 0.0f ? -e : e;
+	float base = params.cruise - params.slow_gain * abs_e;
+	float left = base + u;
+	float right = base - u;
+
+	// 6.每輪飽和: 一輪超過上限時把多出來的差速轉到另一輪，保留轉向量
+	if(left > params.speed_max){
+		right -= left - params.speed_max;
+		left = params.speed_max;
+	} else if(right > params.speed_max){
+		left -= right - params.speed_max;
+		right = params.speed_max;
+	}
+	left = clampf(left, params.speed_min, params.speed_max);
+	right = clampf(right, params.speed_min, params.speed_max);
+
+	out->left = (int)(left + 0.5f);
+	out->right = (int)(right + 0.5f);
+	out->offset = e;
+	out->derivative = d;
+	return LINE_CTRL_OK;
+}
@@ -0,0 +1,188 @@
+// 測試 循跡 PID 控制器 (不需要硬體)
+// 用假的時間軸餵 line_ctrl_update()/line_ctrl_tick()，檢查:
+// 1.偏移方向: 線在右側 (001/011) 要左輪比右輪快，線在左側 (100/110) 相反，置中兩輪相同
+// 2.積分限幅: 長時間偏向一側，積分項不超過 ki * i_limit，換邊後很快反轉 (不會積分飽和)
+// 3.出軌: 沿上次方向掃回，超過 lost_ms 回報 LINE_CTRL_LOST，重新看到線後恢復輸出
+// 4.出軌前編碼與偏移趨勢 (給 test/a0x 實驗程式用)
+
+#include <stdio.h>
+#include "line_ctrl.h"
+
+#define MS	1000000ULL	// ns
+
+
+static int fail = 0;
+
+#define CHECK(cond, ...) do { \
+	if(!(cond)){ printf("FAIL "); printf(__VA_ARGS__); printf("\n"); fail++; } \
+} while(0)
+
+
+// 餵一個編碼後 tick 一次
+static int step(int code, unsigned long long *now, line_ctrl_output *out){
+	line_ctrl_update(code, *now);
+	*now += LINE_CTRL_TICK_MS * MS;
+	return line_ctrl_tick(*now, LINE_CTRL_TICK_MS, out);
+}
+
+
+// 1.偏移方向
+static void test_error_sign(void){
+	line_ctrl_output out;
+	unsigned long long now = 1000 * MS;
+	int ret;
+
+	line_ctrl_init(NULL);
+	CHECK(line_ctrl_tick(now, LINE_CTRL_TICK_MS, &out) == LINE_CTRL_IDLE, "還沒有編碼時要回報 IDLE");
+
+	ret = step(2, &now, &out);
+	CHECK(ret == LINE_CTRL_OK && out.left == out.right, "010 置中: 左 %d 右 %d", out.left, out.right);
+
+	line_ctrl_reset();
+	ret = step(3, &now, &out);
+	CHECK(ret == LINE_CTRL_OK && out.offset > 0 && out.left > out.right, "011 線在右側: 左 %d 右 %d", out.left, out.right);
+	ret = step(1, &now, &out);
+	CHECK(ret == LINE_CTRL_OK && out.offset > 0 && out.left > out.right, "001 線在右側: 左 %d 右 %d", out.left, out.right);
+
+	line_ctrl_reset();
+	ret = step(6, &now, &out);
+	CHECK(ret == LINE_CTRL_OK && out.offset < 0 && out.left < out.right, "110 線在左側: 左 %d 右 %d", out.left, out.right);
+	ret = step(4, &now, &out);
+	CHECK(ret == LINE_CTRL_OK && out.offset < 0 && out.left < out.right, "100 線在左側: 左 %d 右 %d", out.left, out.right);
+
+	// 節點/終點不影響控制
+	ret = step(7, &now, &out);
+	CHECK(ret == LINE_CTRL_OK && out.offset < 0, "111 不應改變偏移量 (%.1f)", out.offset);
+
+	if(!fail) printf("ok   偏移方向\n");
+}
+
+
+// 2.積分限幅
+static void test_integral_clamp(void){
+	line_ctrl_params p = LINE_CTRL_DEFAULTS;
+	line_ctrl_output out;
+	unsigned long long now = 1000 * MS;
+	int before = fail;
+	int ticks;
+
+	// 只留積分項，前饋關掉，速度範圍放寬，輸出差速 = 2 * ki * integral
+	p.kp = 0.0f;
+	p.kd = 0.0f;
+	p.ki = 10.0f;
+	p.i_limit = 0.5f;
+	p.slow_gain = 0.0f;
+	p.cruise = 50;
+	p.speed_min = 0;
+	p.speed_max = 100;
+	line_ctrl_init(&p);
+
+	// 偏右 2 秒: 沒限幅積分會到 4 格·秒 (差速 80)，限幅後最多 0.5 (差速 10)
+	line_ctrl_update(1, now);
+	for(int i = 0; i < 200; i++){
+		now += LINE_CTRL_TICK_MS * MS;
+		line_ctrl_tick(now, LINE_CTRL_TICK_MS, &out);
+	}
+	CHECK(out.left == 55 && out.right == 45, "積分應限制在 i_limit: 左 %d 右 %d", out.left, out.right);
+
+	// 換邊: 0.5 格·秒 / (2 格 * 10ms) = 25 個 tick 積分歸零，再幾個 tick 差速超過四捨五入就反轉
+	// (沒限幅要 200 個 tick 以上)
+	line_ctrl_update(4, now);
+	for(ticks = 1; ticks <= 200; ticks++){
+		now += LINE_CTRL_TICK_MS * MS;
+		line_ctrl_tick(now, LINE_CTRL_TICK_MS, &out);
+		if(out.left < out.right) break;
+	}
+	CHECK(ticks <= 30, "換邊後 %d 個 tick 才反轉 (積分飽和)", ticks);
+
+	if(fail == before) printf("ok   積分限幅\n");
+}
+
+
+// 3.出軌 -> 掃回 -> 找回線
+static void test_lost_reacquire(void){
+	line_ctrl_params p;
+	line_ctrl_output out;
+	unsigned long long now = 1000 * MS;
+	unsigned long long lost_at;
+	int before = fail;
+	int ret;
+
+	line_ctrl_init(NULL);
+	line_ctrl_get_params(&p);
+
+	// 線在右側時出軌: 繼續往右掃 (左輪快)
+	step(3, &now, &out);
+	lost_at = now;
+	ret = step(0, &now, &out);
+	CHECK(ret == LINE_CTRL_OK && out.offset == p.lost_offset && out.left > out.right,
+	      "出軌後應往右掃回: ret %d 偏移 %.1f 左 %d 右 %d", ret, out.offset, out.left, out.right);
+
+	// 還沒超過 lost_ms 仍在掃
+	while(now + LINE_CTRL_TICK_MS * MS < lost_at + p.lost_ms * MS){
+		now += LINE_CTRL_TICK_MS * MS;
+		ret = line_ctrl_tick(now, LINE_CTRL_TICK_MS, &out);
+		if(ret != LINE_CTRL_OK) break;
+	}
+	CHECK(ret == LINE_CTRL_OK, "lost_ms 之前不應回報出軌 (ret %d)", ret);
+
+	// 找回線: 不再回報出軌，偏移量回到實際值
+	ret = step(6, &now, &out);
+	CHECK(ret == LINE_CTRL_OK && out.offset < 0, "找回線後應恢復循跡: ret %d 偏移 %.1f", ret, out.offset);
+
+	// 線在左側時出軌: 往左掃 (右輪快)，超過 lost_ms 回報 LOST
+	lost_at = now;
+	ret = step(0, &now, &out);
+	CHECK(ret == LINE_CTRL_OK && out.left < out.right, "出軌後應往左掃回: 左 %d 右 %d", out.left, out.right);
+	now = lost_at + p.lost_ms * MS;
+	ret = line_ctrl_tick(now, LINE_CTRL_TICK_MS, &out);
+	CHECK(ret == LINE_CTRL_LOST, "出軌超過 lost_ms 應回報 LOST (ret %d)", ret);
+
+	// 停車後重新看到線
+	ret = step(2, &now, &out);
+	CHECK(ret == LINE_CTRL_OK && out.offset == 0.0f, "重新看到線應恢復輸出: ret %d 偏移 %.1f", ret, out.offset);
+
+	if(fail == before) printf("ok   出軌掃回/找回線\n");
+}
+
+
+// 4.出軌前編碼與偏移趨勢
+static void test_trend(void){
+	unsigned long long now = 1000 * MS;
+	int before = fail;
+
+	line_ctrl_init(NULL);
+	CHECK(line_ctrl_last_code() == 2 && line_ctrl_trend(5, 1) == 0, "沒有資料時應為置中、無趨勢");
+
+	line_ctrl_update(2, now += MS);
+	line_ctrl_update(3, now += MS);
+	line_ctrl_update(1, now += MS);
+	line_ctrl_update(3, now += MS);
+	CHECK(line_ctrl_trend(5, 3) == 1, "三次線在右側應為右側趨勢 (%d)", line_ctrl_trend(5, 3));
+	CHECK(line_ctrl_trend(5, 4) == 0, "未達門檻不應有趨勢");
+
+	// 出軌: 出軌前編碼不變，補的樣本不算趨勢，出軌越久趨勢越弱
+	line_ctrl_update(0, now += MS);
+	CHECK(line_ctrl_last_code() == 3, "出軌前編碼應為 011 (%d)", line_ctrl_last_code());
+	CHECK(line_ctrl_trend(5, 3) == 1, "剛出軌仍有右側趨勢");
+	line_ctrl_update(0, now += MS);
+	line_ctrl_update(0, now += MS);
+	CHECK(line_ctrl_trend(5, 3) == 0, "出軌多次後趨勢應消失 (%d)", line_ctrl_trend(5, 3));
+
+	line_ctrl_update(6, now += MS);
+	line_ctrl_update(4, now += MS);
+	CHECK(line_ctrl_last_code() == 4 && line_ctrl_trend(2, 2) == -1, "線在左側應為左側趨勢");
+
+	if(fail == before) printf("ok   出軌前編碼/偏移趨勢\n");
+}
+
+
+int main(void){
+	test_error_sign();
+	test_integral_clamp();
+	test_lost_reacquire();
+	test_trend();
+
+	printf("%s\n", fail ? "line_ctrl test FAILED" : "line_ctrl test passed");
+	return fail ? 1 : 0;
+}
@@ -1,6 +1,8 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <stdint.h>
+#include <time.h>			// clock_gettime
 
 // 自訂標頭檔
 #include "hcsr04.h"  			// 超聲波(避障功能)
@@ -12,30 +14,88 @@
 #include "mqtt_config.h"		// 無線通訊(調度中心Rpi)
 #include "uart.h"			// 有線通訊 open/release(開/關檔案 <-> pico)
 #include "uart_thread.h"		// 有線通訊 read/write(非阻塞讀/寫 <-> pico)
+#include "logic.h"
+#include "reactor.h"			// 事件迴圈計時器 (取代 sleep)
+#include "maneuver.h"			// 節點動作狀態機
+#include "line_ctrl.h"			// 循跡 PID 控制器
+#include "telemetry.h"			// 遙測 (不直接呼叫 mqtt_publish)
+
+
+// 控制迴圈與到站延遲 (ms)，由計時器推進，事件迴圈不會被卡住
+// 馬達速度由 line_ctrl (PID) 在每個 tick 算出，參數見 line_ctrl.h
+#define CONTROL_TICK_MS		LINE_CTRL_TICK_MS	// 控制 tick 週期
+#define ARRIVE_DELAY_MS		3000	// 到達終點停車後的等待 (避免慣性)
+
+bool node_active = false;  	// 節點動作/到站等待時紅外線鎖定旗標
+
+static int last_code = 2;		// 最近一次的循跡編碼 (給控制 tick 用)
+static int control_timer = -1;		// 控制 tick 計時器 (timerfd)
+static int arrive_timer = -1;		// 到站延遲計時器 (timerfd)
+static bool emergency = false;		// 超聲波緊急停止中，控制器不出力
+static bool lost_reported = false;	// 出軌已通報 (重新看到線才再通報)
+static int front_cm = 0;		// 最近一次前方超聲波距離 (遙測摘要用)
+static int normal_cruise = -1;		// 進入警戒區前的巡航速度 (-1 = 不在警戒區)
+
+
+// 單調時鐘 (ns)，和 driver 的樣本時間同一個時鐘
+static unsigned long long now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+// 通報調度中心: 填入目前速度與感測器摘要後交給遙測 (不直接碰網路)
+// event: 1 = 邊緣事件立即送  0 = 狀態 (去重、限速)
+static void report(int status, int delivery, int event){
+	int left = 0, right = 0;
+
+	motor_get_drive(&left, &right);		// 馬達模組快取的實際輸出 (不做系統呼叫)
+
+	telemetry_record r = {
+		.kind = TELEMETRY_KIND_STATUS,
+		.status = status,
+		.delivery = delivery,
+		.speed_left = left > 0 ? left : -left,
+		.speed_right = right > 0 ? right : -right,
+		.line_code = last_code,
+		.front_cm = front_cm > 0 ? front_cm : 0,
+	};
+
+	if(event) telemetry_event(MQTT_TOPIC_CAR, &r);
+	else telemetry_status(MQTT_TOPIC_CAR, &r);
+}
 
 
-// 馬達速度設定
-#define SPEED_INIT   40    	// 基本速度百分比
-#define SPEED1 	 3     		// 微調整
-#define SPEED2 	 6    		// 中等調整
-#define SPEED3 	10      	// 大調整
+// 清除控制器狀態，從目前的編碼重新開始
+static void line_restart(void){
+	line_ctrl_reset();
+	line_ctrl_update(last_code, now_ns());
+	lost_reported = false;
+}
 
-bool node_active = false;  	// 碰到節點時紅外線鎖定旗標
+
+// 取消進行中的節點動作/到站計時，並解鎖
+void logic_reset(void){
+	maneuver_cancel();
+	if(arrive_timer >= 0) reactor_timer_set(arrive_timer, 0, 0);
+	node_active = false;
+	line_restart();
+}
 
 
 // 超聲波避障功能
 void emergency_stop() {
 	
-    	// 1. 停止馬達
+    	// 1. 停止馬達，控制器暫停出力直到解除
     	stop_all_motors();
+    	emergency = true;
 
-    	// 2. 解鎖節點，避免後續邏輯被鎖死
-    	node_active = false;
+    	// 2. 取消進行中的轉彎/到站並解鎖節點，避免後續邏輯被鎖死
+    	logic_reset();
 
-    	// 3. MQTT 通知調度中心
-    	char msg[128];
-    	sprintf(msg, "{\"status\":\"stuck\"}");
-    	mqtt_publish(MQTT_TOPIC_CAR, msg);
+    	// 3. MQTT 通知調度中心 (邊緣事件，立即送出)
+    	report(CAR_STATUS_STUCK, CAR_DELIVERY_NONE, 1);
 
     	// 4. UART 發紅燈
     	uart_send("D");
@@ -47,6 +107,9 @@ void emergency_stop() {
 
 // 解除超聲波
 void emergency_clear() {
+
+	// 0. 解除 kernel 煞車的馬達鎖定 (沒有鎖定也沒關係)
+	motor_clear_fault();
 	
     	// 1. 蜂鳴器關閉
     	buzzer_write(0);
@@ -54,30 +117,88 @@ void emergency_clear() {
     	// 2. 紅燈關閉
    	uart_send("d");  // 假設小寫 d 代表紅燈熄滅
 	
-	// 3. 解鎖節點，避免後續邏輯被鎖死
-    	node_active = false;
+	// 3. 解鎖節點，避免後續邏輯被鎖死，控制器恢復
+    	logic_reset();
+    	emergency = false;
 	
 	// 4. MQTT 通知調度中心
-    	char msg[128];
-    	sprintf(msg, "{\"status\":\"restart\"}");
-    	mqtt_publish(MQTT_TOPIC_CAR, msg);
+    	report(CAR_STATUS_RESTART, CAR_DELIVERY_NONE, 1);
+
+}
+
+
+// 警戒區: 巡航降速 (PID 參數，不清除控制器狀態)；離開後恢復
+static void caution_slow(bool on){
+	line_ctrl_params p;
+
+	if(on == (normal_cruise >= 0)) return;
+	line_ctrl_get_params(&p);
+
+	if(on){
+		normal_cruise = p.cruise;
+		if(p.cruise > CAUTION_CRUISE) p.cruise = CAUTION_CRUISE;
+	} else {
+		p.cruise = normal_cruise;
+		normal_cruise = -1;
+	}
+	line_ctrl_set_params(&p);
+}
+
+
+// 超聲波區間 callback 函式
+// 由事件迴圈在前方那顆的區間或煞車狀態改變時呼叫 (空曠路段幾乎不會被叫醒)
+void hcsr04_zone_callback(hcsr04_zone_event *ev) {
 
+	if(ev->distance >= 0) front_cm = ev->distance;
+
+	// 1. kernel 已經煞車 (馬達鎖定)，補做蜂鳴器、紅燈、通報
+	if(ev->brake && !emergency) {
+		printf("[EMERGENCY] kernel 煞車: 前方障礙物 <%dcm\n", EMERGENCY_DIST_CM);
+		emergency_stop();
+	}
+
+	// 2. 警戒/危險區降速，淨空後恢復
+	switch(ev->zone) {
+		case HC_SR04_ZONE_CAUTION:
+		case HC_SR04_ZONE_DANGER:
+			if(normal_cruise < 0) printf("[LOGIC] 前方 %dcm，進入警戒區降速\n", ev->distance);
+			caution_slow(true);
+			break;
+		case HC_SR04_ZONE_CLEAR:
+			if(normal_cruise >= 0) printf("[LOGIC] 前方淨空，恢復巡航速度\n");
+			caution_slow(false);
+			break;
+		default:
+			break;
+	}
 }
 
 
 // 超聲波資料 callback 函式
-// 由 hcsr04_thread_func 執行緒呼叫，每次讀取到新的距離就會觸發
+// 由事件迴圈在每收到一幀時呼叫
 void hcsr04_callback(hcsr04_all_data *data) {
 	// 靜態計數器，用來累計連續距離過近的次數
     	static int cnt = 0;
+	// driver 濾波過的距離不用再連續計數
+	int need = (data->filter_mask & 0x1) ? EMERGENCY_FRAMES_FILTERED : EMERGENCY_FRAMES;
+
+    	front_cm = data->ultrasonic[0].distance;
+
+	// kernel 已經煞車 (馬達鎖定)，補做蜂鳴器、紅燈、通報
+	if((data->brake_mask & 0x1) && !emergency) {
+		printf("[EMERGENCY] kernel 煞車: 前方障礙物 <%dcm\n", EMERGENCY_DIST_CM);
+		emergency_stop();
+		cnt = 0;
+		return;
+	}
 
-    	// 檢查前方超聲波距離是否有效且小於 5 公分
-    	if(data->ultrasonic[0].distance > 0 && data->ultrasonic[0].distance < 5) {
+    	// 檢查前方超聲波距離是否有效且小於門檻 (kernel 煞車沒啟用時的備援)
+    	if(data->ultrasonic[0].distance > 0 && data->ultrasonic[0].distance < EMERGENCY_DIST_CM) {
         	cnt++;  // 連續危險計數累加
 
-        	// 如果連續三次小於 5 公分，就觸發緊急停止
-        	if(cnt >= 3) {
-            		printf("[EMERGENCY] 前方障礙物 <5cm，緊急停止\n");
+        	// 連續 need 次過近，就觸發緊急停止
+        	if(cnt >= need) {
+            		printf("[EMERGENCY] 前方障礙物 <%dcm，緊急停止\n", EMERGENCY_DIST_CM);
 
 	            	// 統一處理緊急停止：停車、蜂鳴器、紅燈、MQTT 通知
             		emergency_stop();
@@ -92,130 +213,170 @@ void hcsr04_callback(hcsr04_all_data *data) {
 
 
 
-// 讀取節點
-void handle_node(Route *route) {
+// 出軌處理: 停車、紅燈、通知調度中心
+static void off_track(void){
+
+	// 停止馬達
+	stop_all_motors();
+	printf("[LOGIC] 出軌！停車並啟動尋線模式\n");
+
+	// 通知pico閃紅燈
+	uart_send("D");  
+
+	// 通知調度中心 (狀態: 重複的會被去重並限速)
+	report(CAR_STATUS_OFF_TRACK, CAR_DELIVERY_NONE, 0);
+}
+
+
+// 推進節點動作，完成或失敗時解鎖
+static void maneuver_step(int code){
+	int ret = maneuver_tick(code);
+
+	if(ret > 0) return;		// 進行中
+	if(ret < 0) off_track();	// 轉彎找不到線
+	node_active = false;
+
+	// 交回循跡控制
+	line_restart();
+}
+
+
+// 循跡控制: 算出左右輪速度下給馬達
+static void line_step(void){
+	line_ctrl_output out;
+	int ret = line_ctrl_tick(now_ns(), CONTROL_TICK_MS, &out);
+
+	// 出軌太久: 停車通報一次，重新看到線後控制器自動恢復
+	if(ret == LINE_CTRL_LOST){
+		if(!lost_reported) off_track();
+		lost_reported = true;
+		return;
+	}
+	if(ret != LINE_CTRL_OK) return;
+	lost_reported = false;
+	report(CAR_STATUS_MOVING, CAR_DELIVERY_NONE, 0);	// JSON 相同不會重送，二進位帶速度
+
+	// 兩輪一起改，避免車身抖動 (和目前輸出相同時馬達模組直接省略)
+	set_drive(out.left, 1, out.right, 1);
+}
+
+
+// 控制 tick: 固定週期推進節點動作 (逾時檢查) 或循跡 PID
+static void control_timer_cb(int fd, uint32_t events, void *arg){
+	if(maneuver_active()){
+		maneuver_step(last_code);
+		return;
+	}
+	if(stop_flag || node_active || emergency) return;
+	line_step();
+}
+
+
+// 讀取節點 (只開始動作，後續由感測器事件與控制 tick 推進)
+// 回傳=> 1開始處理(完成後自動解鎖)  0沒有下一步/不需要等待
+int handle_node(Route *route) {
     
 	// 1.檢查是否有值
-	if (!route) return;
+	if (!route) return 0;
 
     	// 2.檢查是否有下一步
-    	if (!has_next(route)) return;
+    	if (!has_next(route)) return 0;
 	
 	// 3.取得下一步
     	Action next = next_step(route);
     	printf("[ROUTE] 下一步: %s\n", action_to_string(next));
 	
-	// 4. 發送 MQTT 訊息
-	int current_node = route->current;  // next_step 已經自動 +1
-	char msg[128];
-	sprintf(msg, "{\"node\":%d,\"doing\":\"%s\"}", current_node, action_to_string(next));
-	mqtt_publish(MQTT_TOPIC_CAR, msg);
-
-    	// 5.先降到基礎速度
-	set_left_motor(SPEED_INIT, 1);
-	set_right_motor(SPEED_INIT, 1);
-    
-	// 6. 延遲2秒後再執行判斷
-	sleep(1);        
-
-    	// 7.執行指令
-    	switch (next) {
-        	// 直行指令
-		case STRAIGHT:
-            		move_forward();
-            		break;
-        
-		// 左轉指令
-		case LEFT:
-			uart_send("L");  	// 左轉燈亮(uart->pico)
-            		turn_left();		// 馬達左轉
-			sleep(1);		// 緩衝
-			move_forward();		// 轉彎後直行
-			uart_send("l");  	// 關閉左轉燈亮(uart->pico)
-            		break;
-        
-		// 右轉指令
-		case RIGHT:
-			uart_send("R");  	// 右轉燈亮(uart->pico)
-            		turn_right();		// 馬達右轉
-			sleep(1);		// 緩衝
-			move_forward();		// 轉彎後直行
-			uart_send("r");  	// 關閉右轉燈亮(uart->pico)
-            		break;
-        
-		// 停車
-		case STOP:
-            		stop_all_motors();
-            		break;
-			
-		// 其他
-        	default:
-            		move_forward();
-            		break;
-    	}
+	// 4. 發送 MQTT 訊息 (每個節點一次，當事件送)
+	telemetry_record r = {
+		.kind = TELEMETRY_KIND_NODE,
+		.node = route->current,		// next_step 已經自動 +1
+		.action = next,
+		.line_code = last_code,
+	};
+	telemetry_event(MQTT_TOPIC_CAR, &r);
+
+    	// 5.交給節點動作狀態機 (減速 -> 轉彎 -> 找回線 -> 恢復)
+	maneuver_start(next);
+	return maneuver_active();
 }
 
 
+// 到站延遲結束: 通知調度中心並依節點類型啟動輸送帶
+static void arrive_timer_cb(int fd, uint32_t events, void *arg){
 
-
-// 邏輯函式
-void logic(int code) { 
-
-    switch(code) {
-	
-	// 000 => 出軌
-        case 0:
-            	// 停止馬達 
-            	stop_all_motors();
-                printf("[LOGIC] 出軌！停車並啟動尋線模式\n");
+	// 通知調度中心
+	report(CAR_STATUS_ARRIVED, CAR_DELIVERY_NONE, 1);
 				
-		// 通知pico閃紅燈
-		uart_send("D");  
+	// 根據節點最後一碼類型啟動輸送帶
+	if(my_route && my_route->node_type[my_route->length - 1] == 1){ 	
+		// 1 = 送貨
+		uart_send("S");   // 啟動輸送帶(uart->pico)
+					
+		// 通報調度中心(送出貨物中)
+		report(CAR_STATUS_MOVING, CAR_DELIVERY_DELIVERING, 1);
+	} else {			
+		// 0 = 接貨
 				
-		// 通知調度中心(mqtt)
-		char msg[128];
-		sprintf(msg, "{\"status\":\"off_track\"}");
-		mqtt_publish(MQTT_TOPIC_CAR, msg);
-                break;
-
-
-	// 010 => 正常在線上
-        case 2: 
-            	// 前進，雙輪等速
-            	move_forward();
-            	printf("[LOGIC] 正常行駛，繼續前進\n");
-            	break;
+		// 通報調度中心(接收貨物中)
+		report(CAR_STATUS_MOVING, CAR_DELIVERY_RECEIVING, 1);
+	}
+				
+	// 通知調度中心(任務結束)
+	report(CAR_STATUS_ARRIVED, CAR_DELIVERY_COMPLETED, 1);
 
+	// 解鎖
+	node_active = false;
+}
 
-	// 001 => 太左偏
-        case 1: 
-		// 左輪調快
-		set_left_motor(SPEED_INIT + SPEED2, 1);  	
-           	printf("[LOGIC] 太左偏，強力往右修正\n");           		
-            	break;
 
+// 建立控制 tick 與到站計時器 (reactor_init 之後呼叫)
+int logic_init(void){
+	line_ctrl_init(NULL);
+	control_timer = reactor_timer_add(control_timer_cb, NULL);
+	arrive_timer = reactor_timer_add(arrive_timer_cb, NULL);
+	if(control_timer < 0 || arrive_timer < 0) return -1;
+	return reactor_timer_set(control_timer, CONTROL_TICK_MS, CONTROL_TICK_MS);
+}
 
-	// 011 => 微左偏
-        case 3: 
-                // 左輪稍加速
-                set_left_motor(SPEED_INIT + SPEED1, 1);            		
-		printf("[LOGIC] 微左偏， 左輪微加速\n");
-            	break;
 
 
-	// 100 => 太右偏
-        case 4: 
-		// 右輪調快
-            	set_right_motor(SPEED_INIT + SPEED2, 1);  
-		printf("[LOGIC] 太右偏，強力往左修正\n");
-            	break;
 
+// 邏輯函式 (沒有樣本時間時用目前時間)
+void logic(int code) { 
+    logic_event(code, now_ns());
+}
+
+
+// 邏輯函式: code = 循跡編碼  ts_ns = driver 記錄的變化時間
+void logic_event(int code, unsigned long long ts_ns) { 
+
+    last_code = code;
 
-	// 110 => 微右偏
-        case 6: 
-               	// 右輪稍加速
-                set_right_motor(SPEED_INIT + SPEED1, 1);
-            	printf("[LOGIC] 微右偏， 右輪微加速\n");
+    // 停止中或超聲波緊急停車中只記錄目前編碼 (恢復時控制器從這裡起算)
+    // 緊急停車中不能處理節點/終點，否則會動到馬達並消耗路線步驟
+    if(stop_flag || emergency) return;
+
+    // 節點動作進行中: 感測器變化交給狀態機 (例如中間感測器重新看到線)
+    if(maneuver_active()) {
+	maneuver_step(code);
+	return;
+    }
+
+    // 到站等待中
+    if(node_active) return;
+
+    switch(code) {
+	
+	// 000 => 出軌 (控制器沿上次方向掃回，超過時間才停車通報)
+	// 001/011 => 左偏   010 => 在線上   110/100 => 右偏
+        case 0:
+        case 1:
+        case 2:
+        case 3:
+        case 4:
+        case 6:
+		// 交給 PID 控制器，馬達速度在控制 tick 更新
+		line_ctrl_update(code, ts_ns);
             	break;
 
 
@@ -223,42 +384,20 @@ void logic(int code) {
         case 5: 
             	printf("[LOGIC] 到達終點，準備停車(3秒後)\n");
 			stop_all_motors();   // 停車
-			sleep(3);            // 延遲3秒，避免慣性
 
-			// 通知調度中心
-			sprintf(msg, "{\"status\":\"arrived\"}");
-			mqtt_publish(MQTT_TOPIC_CAR, msg);
-				
-			// 根據節點最後一碼類型啟動輸送帶
-			if(route->current_node_type == 1){ 	
-				// 1 = 送貨
-				uart_send("S");   // 啟動輸送帶(uart->pico)
-					
-				// 通報調度中心(送出貨物中)
-				sprintf(msg, "{\"status\":\"moving\",\"delivery_status\":\"delivering\"}");
-				mqtt_publish(MQTT_TOPIC_CAR, msg);
-			} else {			
-				// 0 = 接貨
-				
-				// 通報調度中心(接收貨物中)
-				sprintf(msg, "{\"status\":\"moving\",\"delivery_status\":\"receiving\"}");
-				mqtt_publish(MQTT_TOPIC_CAR, msg);
-			}
-				
-			// 通知調度中心(任務結束)
-			sprintf(msg, "{\"status\":\"arrived\",\"delivery_status\":\"completed\"}");
-			mqtt_publish(MQTT_TOPIC_CAR, msg);
+			// 延遲3秒避免慣性 (鎖住循跡，到期由 arrive_timer_cb 通知調度中心)
+			node_active = true;
+			if(reactor_timer_set(arrive_timer, ARRIVE_DELAY_MS, 0) < 0)
+				node_active = false;
 			break;
 
 
 	// 111 => 節點
         case 7: 
-		if(!node_active){
-			node_active = true;       		// 鎖定節點
-			handle_node(route);			// 調用讀取節點函式
-			printf("[LOGIC] 碰到節點\n");
-			node_active = false;      		// 轉彎完成解鎖
-		}
+		node_active = true;       		// 鎖定節點
+		printf("[LOGIC] 碰到節點\n");
+		if(!handle_node(my_route))		// 調用讀取節點函式
+			node_active = false;      	// 沒有下一步，直接解鎖 (否則動作完成才解鎖)
 				
 		break;   
      
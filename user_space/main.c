@@ -1,105 +1,294 @@
 // 車輛入口應用程式
+// 單一執行緒事件迴圈 (reactor)：循跡、超聲波、UART、MQTT、鍵盤指令、計時器都由 epoll 分派
 
 #include <stdio.h>      	// printf, fprintf
 #include <stdlib.h>     	// exit, NULL
-#include <unistd.h>     	// sleep
-#include <pthread.h>    	// pthread_create, pthread_join
-#include <signal.h>     	// signal, SIGINT
+#include <string.h>     	// strcmp, strstr
+#include <stdint.h>     	// uint32_t
+#include <unistd.h>     	// read
+#include <signal.h>     	// sigset_t, SIGINT
+#include <sys/signalfd.h>	// signalfd
 
 #include "tcrt5000.h"		// 循跡感測器 API
 #include "hcsr04.h"      	// 超聲波感測器 API
-#include "logic.h"      	// logic_cb callback 宣告
+#include "logic.h"      	// logic_event / hcsr04_callback
 #include "motor_ctrl.h" 	// stop_all_motors() 與馬達控制
 #include "mqtt_config.h"	// 無線通訊
 #include "route.h"		// 路線解析
+#include "uart.h"		// uart_get_fd
+#include "uart_thread.h"	// 有線通訊 (TX thread + 事件迴圈 RX)
+#include "reactor.h"		// 事件迴圈
+#include "car_cmd.h"		// 調度中心指令解析
+#include "telemetry.h"		// 遙測發布 (去重/限速/編碼協商)
+
+
+#define UART_DEVICE	"/dev/ttyS0"	// 與 pico 連線的 UART
+#define MQTT_MISC_MS	200		// MQTT keepalive/重連 維護週期 (ms)
+#define UART_PING_MS	1000		// UART 來回延遲量測週期 (ms)
+#define CAR_ROUTE_MAX	256		// 一條路線最多步驟數
+#define MOTOR_POLL_US	1000		// 馬達共用頁檢查週期 (us)，控制 tick 10ms 內一定生效
 
 
 // ---------------- 全域變數 ----------------
-int stop_flag = 1;                 // 1 = 停止, 0 = 運行
-bool node_active = false;          // 節點鎖定旗標
+volatile int stop_flag = 1;        // 1 = 停止, 0 = 運行
 Route *my_route = NULL;            // 存放解析後路線
+static int route_buf[CAR_ROUTE_MAX]; // 指令解析用的路線緩衝
+
+static int sig_fd = -1;            // SIGINT/SIGTERM 的 signalfd
+static int mqtt_fd = -1;           // MQTT socket (重連後可能改變)
+static int mqtt_timer = -1;        // MQTT 維護計時器
+static int ping_timer = -1;        // UART PING 計時器
+static uint32_t mqtt_events = 0;   // MQTT socket 目前等待的事件
+static unsigned int mqtt_gen = 0;  // 註冊 mqtt_fd 時的連線代數
+
+
+void mqtt_message_callback(const char *topic, const char *payload);
+
+
+// ---------------- 事件處理 ----------------
+
+// 循跡: 有狀態變化，依序處理每一筆 (讀完才返回)
+static void on_tcrt5000(int fd, uint32_t events, void *arg) {
+    	tcrt5000_data sensor;
+    	int ret;
+
+    	while((ret = tcrt5000_read_event(&sensor)) > 0) {
+        		// 將3個感測器組成一個 code(二進位轉十進位)
+        		int code = sensor.left*4 + sensor.middle*2 + sensor.right*1;
+
+        		// 每筆都交給 logic (停止中只記錄，節點動作進行中由狀態機判斷轉彎完成)
+        		logic_event(code, sensor.ts_ns);
+    	}
+    	if(ret < 0) fprintf(stderr, "TCRT5000 讀取失敗\n");
+}
+
+// 超聲波: 新的一幀
+static void on_hcsr04(int fd, uint32_t events, void *arg) {
+    	hcsr04_all_data data;
+
+    	if(hcsr04_read_frame(&data) > 0 && distance_cb != NULL)
+        		distance_cb(&data);
+}
+
+// 超聲波: 前方區間或煞車狀態改變 (POLLPRI)
+static void on_hcsr04_zone(int fd, uint32_t events, void *arg) {
+    	hcsr04_zone_event ev;
+
+    	if(hcsr04_zone_read(&ev) > 0)
+        		hcsr04_zone_callback(&ev);
+}
 
-pthread_t tcrt_thread;
-pthread_t hcsr_thread;
+// UART: pico 有資料
+static void on_uart(int fd, uint32_t events, void *arg) {
+    	uart_handle_rx();
+}
+
+// MQTT: socket 可讀/可寫
+static void on_mqtt(int fd, uint32_t events, void *arg) {
+    	if(events & (EPOLLIN | EPOLLERR | EPOLLHUP)) mqtt_handle_read();
+    	if(events & EPOLLOUT) mqtt_handle_write();
+}
+
+// UART: 定期 PING pico，量測來回延遲
+static void on_ping_timer(int fd, uint32_t events, void *arg) {
+    	uart_ping();
+}
+
+// MQTT: 定期維護 (keepalive)
+static void on_mqtt_timer(int fd, uint32_t events, void *arg) {
+    	mqtt_handle_misc();
+}
+
+// 每輪 epoll_wait 前: 同步 MQTT socket 與是否要等 EPOLLOUT
+static void reactor_prepare(void *arg) {
+    	int sock = mqtt_socket();
+    	unsigned int gen = mqtt_conn_gen();
+    	uint32_t want = EPOLLIN | (mqtt_want_write() ? EPOLLOUT : 0);
+
+    	// 1. socket 換了 (斷線/重連)；重連後 fd 號碼可能被重用，舊 socket close 時 epoll 註冊已被移除，
+    	//    所以連線代數變了也要重新註冊
+    	if(sock != mqtt_fd || gen != mqtt_gen) {
+        		if(mqtt_fd >= 0) reactor_del(mqtt_fd);
+        		mqtt_fd = -1;
+        		if(sock >= 0 && reactor_add(sock, want, on_mqtt, NULL) == 0) {
+            			mqtt_fd = sock;
+            			mqtt_gen = gen;
+            			mqtt_events = want;
+        		}
+        		return;
+    	}
+
+    	// 2. 等待的事件改變 (失敗 = 註冊已不在，下一輪重新註冊)
+    	if(mqtt_fd >= 0 && want != mqtt_events) {
+        		if(reactor_mod(mqtt_fd, want) == 0) mqtt_events = want;
+        		else {
+            			reactor_del(mqtt_fd);
+            			mqtt_fd = -1;
+        		}
+    	}
+}
+
+// Ctrl+C / kill: 結束事件迴圈
+static void on_signal(int fd, uint32_t events, void *arg) {
+    	struct signalfd_siginfo si;
+
+    	if(read(fd, &si, sizeof(si)) == sizeof(si)) {
+        		printf("\n收到訊號 %u，結束程式\n", si.ssi_signo);
+        		reactor_stop();
+    	}
+}
+
+// 鍵盤指令
+static void on_stdin(int fd, uint32_t events, void *arg);
 
 
 // ---------------- 初始化系統 ----------------
 void initialize_system() {
-    	// 1. 停止馬達
-    	stop_all_motors();
+    	sigset_t mask;
 
-    	// 2. 開啟循跡感測器
-    	if (tcrt5000_open() != 0) {
-        		fprintf(stderr, "無法開啟 TCRT5000\n");
+    	// 1. 開啟馬達並停止
+    	if (open_motor_device() != 0) {
+        		fprintf(stderr, "無法開啟馬達\n");
         		exit(-1);
     	}
+    	stop_all_motors();
+    	motor_shm_open(MOTOR_POLL_US);	// 失敗 (舊 driver) 就維持 ioctl
+	if(motor_fault() > 0)		// 鎖定不隨程式重啟解除，要人確認
+		printf("馬達故障鎖定中 (之前的緊急煞車)，輸入 4 解除\n");
 
-    	// 3. 設定紅外線 callback
-    	logic_cb = logic;
+    	// 2. 建立事件迴圈與節點計時器
+    	if(reactor_init() != 0 || logic_init() != 0) {
+        		fprintf(stderr, "無法建立事件迴圈\n");
+        		exit(-1);
+    	}
 
-    	// 4. 啟動循跡 thread
-    	if(pthread_create(&tcrt_thread, NULL, tcrt5000_thread_func, NULL) != 0) {
-        		fprintf(stderr, "無法建立循跡 thread\n");
+    	// 3. 開啟循跡感測器，設定紅外線 callback
+    	if (tcrt5000_open() != 0 ||
+            	    reactor_add(tcrt5000_fd(), EPOLLIN, on_tcrt5000, NULL) != 0) {
+        		fprintf(stderr, "無法開啟 TCRT5000\n");
         		exit(-1);
     	}
 
-    	// 5. 設定超聲波 callback
-    	distance_cb = hcsr04_callback;
-    	if(pthread_create(&hcsr_thread, NULL, hcsr04_thread_func, NULL) != 0) {
-        		fprintf(stderr, "無法建立超聲波 thread\n");
+    	// 4. 開啟超聲波，設定超聲波 callback
+    	if (hcsr04_open_all() != 0) {
+        		fprintf(stderr, "無法開啟超聲波\n");
         		exit(-1);
     	}
 
-    	// 6. 初始化 MQTT
-    	mqtt_init();
-    	mqtt_subscribe(MQTT_TOPIC_CAR, mqtt_message_callback);
+	// 前方那顆先在 driver 做中位數濾波，煞車就不用再連續計數
+	int sonic_filtered = hcsr04_set_filter(0, SONIC_FILTER_N, SONIC_OUTLIER_CM,
+					       SONIC_FILTER_MIN_VALID, SONIC_TIMEOUT_US) == 0;
+	if (!sonic_filtered)
+		printf("超聲波: driver 不支援濾波，使用單次量測\n");
+
+	// 前方那顆交給 kernel 直接煞車 (一個量測週期內停車)，事件迴圈只等區間改變 (POLLPRI)
+	// 任一項不支援就每幀讀取，由 hcsr04_callback 判斷
+	if (hcsr04_set_brake(0, EMERGENCY_DIST_CM,
+			     sonic_filtered ? EMERGENCY_FRAMES_FILTERED : EMERGENCY_FRAMES) == 0 &&
+	    hcsr04_zone_open(0, CAUTION_DIST_CM, EMERGENCY_DIST_CM, ZONE_HYST_CM) == 0 &&
+	    reactor_add(hcsr04_zone_fd(), EPOLLPRI, on_hcsr04_zone, NULL) == 0) {
+		printf("超聲波: kernel 緊急煞車 + 區間通知\n");
+	} else {
+		printf("超聲波: kernel 煞車/區間通知無法啟用，每幀判斷\n");
+		if (reactor_add(hcsr04_fd(), EPOLLIN, on_hcsr04, NULL) != 0) {
+			fprintf(stderr, "無法開啟超聲波\n");
+			exit(-1);
+		}
+		distance_cb = hcsr04_callback;
+	}
+
+    	// 5. UART (TX 保留 thread，RX 由事件迴圈讀)
+    	if (uart_thread_start_tx(UART_DEVICE) != 0 ||
+            	    reactor_add(uart_get_fd(), EPOLLIN, on_uart, NULL) != 0) {
+        		fprintf(stderr, "無法開啟 UART\n");
+        		exit(-1);
+    	}
+    	ping_timer = reactor_timer_add(on_ping_timer, NULL);
+    	reactor_timer_set(ping_timer, UART_PING_MS, UART_PING_MS);
+
+    	// 6. 初始化 MQTT (不開背景 thread、不等連線，socket 在 reactor_prepare 註冊，斷線自動重連)
+    	if (mqtt_init_external() == 0) {
+        		mqtt_subscribe(MQTT_TOPIC_CAR, mqtt_message_callback);
+        		mqtt_timer = reactor_timer_add(on_mqtt_timer, NULL);
+        		reactor_timer_set(mqtt_timer, MQTT_MISC_MS, MQTT_MISC_MS);
+        		reactor_set_prepare(reactor_prepare, NULL);
+    	} else {
+        		fprintf(stderr, "無法建立 MQTT client，僅能手動操作\n");
+    	}
+    	if(telemetry_init(TELEMETRY_PERIOD_MS) != 0)
+        		fprintf(stderr, "無法建立遙測發布\n");
+
+    	// 7. 鍵盤指令
+    	reactor_add(STDIN_FILENO, EPOLLIN, on_stdin, NULL);
+
+    	// 8. SIGINT/SIGTERM 改由 signalfd 進事件迴圈
+    	sigemptyset(&mask);
+    	sigaddset(&mask, SIGINT);
+    	sigaddset(&mask, SIGTERM);
+    	sigprocmask(SIG_BLOCK, &mask, NULL);
+    	sig_fd = signalfd(-1, &mask, SFD_CLOEXEC);
+    	if(sig_fd >= 0) reactor_add(sig_fd, EPOLLIN, on_signal, NULL);
 }
 
 
 // ---------------- MQTT callback ----------------
+// 只訂閱在 MQTT_TOPIC_CAR，路由已依主題分派，不需要再比對 topic
 void mqtt_message_callback(const char *topic, const char *payload) {
-    	if (strcmp(topic, MQTT_TOPIC_CAR) != 0) return;
+    	car_cmd cmd;
+    	int ret;
+
+	// 車子自己發布的二進位遙測 (同一個主題) 不是指令
+    	if ((unsigned char)payload[0] == TELEMETRY_BIN_MAGIC) return;
+
+	// 0. 一次掃描解析 (路線寫進 route_buf，不配置記憶體)
+    	car_cmd_init(&cmd, route_buf, CAR_ROUTE_MAX);
+    	ret = car_cmd_parse(payload, strlen(payload), &cmd);
+    	if (ret != CAR_CMD_OK) {
+        		printf("[MQTT] 無法解析指令 (%s): %.64s\n", car_cmd_strerror(ret), payload);
+        		return;
+    	}
 
 	// 1. 收到開始訊號
-    	if (strstr(payload, "\"start\":1")) {
+	// 0-1. 協商遙測編碼 (可和其他指令一起送)
+    	if (cmd.flags & CAR_CMD_ENCODING) {
+        		int enc = cmd.encoding == CAR_CMD_ENC_BINARY ? TELEMETRY_ENC_BINARY : TELEMETRY_ENC_JSON;
+        		telemetry_set_encoding(MQTT_TOPIC_CAR, enc);
+        		printf("[MQTT] 遙測編碼: %s\n", enc == TELEMETRY_ENC_BINARY ? "binary" : "json");
+    	}
+
+    	if (cmd.flags & CAR_CMD_START) {
         		printf("[MQTT] 收到開始訊號\n");
         		if(my_route != NULL) {
             			reset_route(my_route);
+            			logic_reset();
             			stop_flag = 0;
-            			node_active = false;
         		} else {
             			printf("[MQTT] 尚未有路線資料\n");
         		}
 
 	// 2. 收到停止訊號
-    	}  else if (strstr(payload, "\"stop\":1")) {
+    	}  else if (cmd.flags & CAR_CMD_STOP) {
         		printf("[MQTT] 收到停止訊號\n");
         		stop_flag = 1;
+        		logic_reset();
 	        	stop_all_motors();
 
 	// 3. 收到路線資料
-    	} else if (strstr(payload, "\"route\":")) {
+    	} else if (cmd.flags & CAR_CMD_ROUTE) {
         	printf("[MQTT] 收到路線資料\n");
 
-    		int raw_steps[15];   // 最多 15 步
-    		int count = 0;
-
-   		// 找到 "route":[ 開始解析
-    		const char *p = strstr(payload, "\"route\":[") + 9;
-    		while(*p && *p != ']' && count < 15) {
-       			if(*p >= '1' && *p <= '4') {
-           			raw_steps[count++] = *p - '0';  // 字元轉數字
-       	 		}
-        		p++;
-   	 	}
-
+    		int count = cmd.route_len;
     		if(count > 0) {
+        		Route *r = create_route(cmd.route, count);
+        		if(!r) {
+            			printf("[MQTT] 路線配置失敗\n");
+            			return;
+        		}
         		if(my_route) free_route(my_route);
-        		my_route = create_route(raw_steps, count);
-        		printf("[MQTT] 路線解析完成，步驟數: %d\n", count);
+        		my_route = r;
 
 			// 判定最後一步送貨/接貨
-            		if (strstr(payload, "\"delivery\":1")) {
+            		if ((cmd.flags & CAR_CMD_DELIVERY) && cmd.delivery) {
                 		my_route->node_type[count-1] = 1; // 送貨
             		} else {
                 		my_route->node_type[count-1] = 2; // 接貨
@@ -112,7 +301,7 @@ void mqtt_message_callback(const char *topic, const char *payload) {
     		}
 
     	 // 4. 收到關閉蜂鳴器訊號
-	} else if (strstr(payload, "\"buzzer_off\":1")) {
+	} else if (cmd.flags & CAR_CMD_BUZZER_OFF) {
         		printf("[MQTT] 收到關閉蜂鳴器訊號\n");
         		emergency_clear();
     	}
@@ -122,27 +311,48 @@ void mqtt_message_callback(const char *topic, const char *payload) {
 // ---------------- 停止系統 ----------------
 void shutdown_system() {
     	stop_flag = 1;
-    	pthread_join(tcrt_thread, NULL);
-    	pthread_join(hcsr_thread, NULL);
+    	stop_all_motors();
 
     	tcrt5000_close();
-    	stop_all_motors();
+    	hcsr04_close_all();
+    	uart_thread_stop();
+    	telemetry_flush();
+    	telemetry_close();
+    	mqtt_close();
+
+    	if(sig_fd >= 0) close(sig_fd);
+    	reactor_close();
 
     	if(my_route) free_route(my_route);
-    	mqtt_close();
 }
 
-// ---------------- 主迴圈 ----------------
-void main_loop() {
-    	while(1) {
-        		char cmd;
-        		printf("\n輸入指令 (0=立即停止, 1=開始運行, 3=結束程式, 4=解除緊急): ");
-        		scanf(" %c", &cmd);
+
+// ---------------- 鍵盤指令 ----------------
+static void print_prompt(void) {
+    	printf("\n輸入指令 (0=立即停止, 1=開始運行, 3=結束程式, 4=解除緊急, 5=UART 狀態, 6=遙測/MQTT 統計, 7=馬達命令統計): ");
+    	fflush(stdout);
+}
+
+static void on_stdin(int fd, uint32_t events, void *arg) {
+    	char line[64];
+    	ssize_t n = read(fd, line, sizeof(line) - 1);
+
+    	// stdin 關閉 (例如背景執行)，不再等待鍵盤
+    	if(n <= 0) {
+        		reactor_del(fd);
+        		return;
+    	}
+    	line[n] = '\0';
+
+    	for(char *p = line; *p; p++) {
+        		char cmd = *p;
+        		if(cmd == ' ' || cmd == '\n' || cmd == '\r' || cmd == '\t') continue;
 
 		// 1.手動停止，未結束程式
         		if(cmd == '0') {
             			printf("立即停止\n");
             			stop_flag = 1;
+            			logic_reset();
             			stop_all_motors();
 		
 		// 2.手動開始
@@ -150,8 +360,8 @@ void main_loop() {
             			if(my_route != NULL) {
         		        		printf("手動開始運行\n");
                 			reset_route(my_route);
+                			logic_reset();
                 			stop_flag = 0;
-                			node_active = false;
             			} else {
                 			printf("尚未有路線資料\n");
            	 		}
@@ -159,20 +369,55 @@ void main_loop() {
 		// 3.結束整個程式
         		} else if(cmd == '3') {
             			printf("結束程式\n");
-            			break;
+            			reactor_stop();
+            			return;
 
 		// 4.解除超生坡問題
         		} else if(cmd == '4') {
             			printf("解除緊急狀態\n");
             			emergency_clear();
+
+		// 5.UART 封包與來回延遲統計
+        		} else if(cmd == '5') {
+            			uart_stats st;
+            			uart_get_stats(&st);
+            			printf("UART 送出 %lu 封包/%lu 次 write, 收到 %lu (ACK %lu, CRC 錯誤 %lu)\n",
+                   			st.tx_frames, st.tx_writes, st.rx_frames, st.acks, st.crc_errors);
+            			printf("UART RTT 最近 %u us, 最小 %u, 平均 %u, 最大 %u (%lu 次)\n",
+                   			st.rtt_last_us, st.rtt_min_us, st.rtt_avg_us, st.rtt_max_us, st.pongs);
 		
-		// 5.其他
+		// 6.遙測發布統計
+        		} else if(cmd == '6') {
+            			telemetry_stats st;
+            			telemetry_get_stats(&st);
+            			printf("遙測 狀態 放入 %lu/去重 %lu/合併 %lu/發布 %lu, 事件 發布 %lu/丟棄 %lu, 失敗 %lu\n",
+                   			st.status_posted, st.status_deduped, st.status_coalesced, st.status_published,
+                   			st.events_sent, st.events_dropped, st.publish_errors);
+            			mqtt_stats ms;
+            			mqtt_get_stats(&ms);
+            			printf("MQTT 狀態 %d, 送出 %lu, 離線存 %lu/補送 %lu/待送 %u, 遺失 %lu (丟棄 %lu + 覆蓋 %lu), 連線 %lu/%lu 次 (失敗 %lu, 斷線 %lu)\n",
+                   			ms.state, ms.published, ms.offline_queued, ms.replayed, ms.outbox_pending,
+                   			ms.offline_dropped + ms.outbox_overwritten, ms.offline_dropped, ms.outbox_overwritten,
+                   			ms.connects, ms.connect_attempts, ms.connect_failures, ms.disconnects);
+
+		// 7.馬達命令統計 (省略的命令不做系統呼叫)
+        		} else if(cmd == '7') {
+            			motor_stats st;
+            			int left, right;
+            			motor_get_stats(&st);
+            			printf("馬達命令 送出 %lu/省略 %lu, ioctl %lu 次, 失敗 %lu\n",
+                   			st.issued, st.suppressed, st.syscalls, st.errors);
+            			if(motor_get_drive(&left, &right) == 0)
+                			printf("馬達輸出 左 %d%% 右 %d%%\n", left, right);
+            			else
+                			printf("馬達輸出 不確定\n");
+
+		// 8.其他
         		} else {
             			printf("未知指令\n");
         		}
-
-        		usleep(100000); // 避免 CPU 空轉
     	}
+    	print_prompt();
 }
 
 
@@ -180,11 +425,12 @@ void main_loop() {
 int main() {
     	printf("=== 車輛程式啟動 ===\n");
 
-	// 1.初始化感測器、MQTT、thread
+	// 1.初始化感測器、MQTT、事件迴圈
     	initialize_system();  
 
-	// 2.主迴圈 (手動指令)
-    	main_loop();           
+	// 2.事件迴圈 (感測器、通訊、手動指令都在這裡處理)
+    	print_prompt();
+    	reactor_run();
 
 	// 3.清理資源
     	shutdown_system();    
@@ -192,5 +438,3 @@ int main() {
     	printf("程式已結束\n");
     	return 0;
 }
-
-
@@ -0,0 +1,169 @@
+// 節點動作(maneuver) 狀態機
+// 由 logic.c 在碰到節點時 maneuver_start()，之後每個感測器事件與控制 tick 呼叫 maneuver_tick()
+// 階段靠感測器條件結束，逾時只是保護，不會有固定 sleep 造成的盲區
+
+#include <stdio.h>
+#include <time.h>		// clock_gettime
+#include "maneuver.h"
+#include "motor_ctrl.h"		// 馬達控制器
+#include "uart_thread.h"	// 方向燈 (uart -> pico)
+
+
+// 全域變數
+static maneuver_phase_t phase = MANEUVER_IDLE;	// 目前階段
+static Action action = STOP;			// 目前動作
+static unsigned long long phase_start_ns = 0;	// 進入目前階段的時間
+static unsigned long long start_ns = 0;		// 動作開始的時間
+static int left_line = 0;			// 原地轉時中間感測器是否已離開原本的線
+static unsigned long long clear_ns = 0;		// 減速時離開節點橫線 (不是 111) 的時間，0 = 還在橫線上
+
+
+// 單調時鐘 (ns)
+static unsigned long long now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+// 目前階段經過的時間 (ms)
+static unsigned int phase_ms(void){
+	return (now_ns() - phase_start_ns) / 1000000ULL;
+}
+
+
+// 切換階段
+static void enter(maneuver_phase_t p){
+	phase = p;
+	phase_start_ns = now_ns();
+	left_line = 0;
+}
+
+
+// 開始原地轉 (左轉: 左輪後退右輪前進)，accel = 0 立即改變
+static void pivot(int speed, unsigned int accel){
+	if(action == LEFT)
+		set_drive_ramp(speed, -1, speed, 1, accel);
+	else
+		set_drive_ramp(speed, 1, speed, -1, accel);
+}
+
+
+// 開始節點動作
+void maneuver_start(Action a){
+
+	action = a;
+	start_ns = now_ns();
+	clear_ns = 0;
+
+	// 停車不需要階段
+	if(a == STOP){
+		stop_all_motors();
+		phase = MANEUVER_IDLE;
+		return;
+	}
+
+	// 先減速通過節點
+	set_drive_ramp(MANEUVER_SPEED_DECEL, 1, MANEUVER_SPEED_DECEL, 1, MANEUVER_ACCEL);
+	enter(MANEUVER_DECELERATE);
+	printf("[MANEUVER] %s: 減速\n", action_to_string(a));
+}
+
+
+// 推進狀態機
+int maneuver_tick(int code){
+
+	int middle = (code >> 1) & 0x1;
+
+	switch(phase) {
+
+		// 1.沒有動作
+		case MANEUVER_IDLE:
+			return 0;
+
+		// 2.減速: 車身離開節點橫線或逾時
+		// 單次抖動 (7->x->7) 不算離開: 要連續 MANEUVER_CLEAR_MS 不是 111，且至少前進 MANEUVER_ADVANCE_MS
+		case MANEUVER_DECELERATE:
+			if(code == 7)
+				clear_ns = 0;
+			else if(!clear_ns)
+				clear_ns = now_ns();
+
+			if(phase_ms() < MANEUVER_DECEL_MS &&
+			   (phase_ms() < MANEUVER_ADVANCE_MS || !clear_ns ||
+			    (now_ns() - clear_ns) / 1000000ULL < MANEUVER_CLEAR_MS))
+				break;
+
+			if(action == LEFT || action == RIGHT){
+				uart_send(action == LEFT ? "L" : "R");	// 方向燈亮(uart->pico)
+				pivot(MANEUVER_SPEED_PIVOT, MANEUVER_ACCEL);
+				enter(MANEUVER_PIVOT);
+				printf("[MANEUVER] %s: 原地轉\n", action_to_string(action));
+			} else {
+				enter(MANEUVER_RESUME);
+			}
+			break;
+
+		// 3.原地轉: 中間感測器先離開原本的線，再看到新的線
+		case MANEUVER_PIVOT:
+			if(!middle){
+				left_line = 1;
+			} else if(left_line){
+				pivot(MANEUVER_SPEED_SEEK, 0);	// 放慢避免轉過頭
+				enter(MANEUVER_REACQUIRE);
+				break;
+			}
+
+			// 逾時: 找不到線，停車交給呼叫者處理
+			if(phase_ms() >= MANEUVER_PIVOT_MS){
+				stop_all_motors();
+				uart_send(action == LEFT ? "l" : "r");	// 關閉方向燈
+				printf("[MANEUVER] %s: 原地轉逾時，找不到線\n", action_to_string(action));
+				phase = MANEUVER_IDLE;
+				return -1;
+			}
+			break;
+
+		// 4.找回線: 線回到正中間 (010)，逾時也當作已在線上交給循跡修正
+		case MANEUVER_REACQUIRE:
+			if(code == 2 || phase_ms() >= MANEUVER_REACQUIRE_MS)
+				enter(MANEUVER_RESUME);
+			break;
+
+		default:
+			break;
+	}
+
+	// 5.恢復直行，動作完成
+	if(phase == MANEUVER_RESUME){
+		set_drive_ramp(MANEUVER_SPEED_DECEL, 1, MANEUVER_SPEED_DECEL, 1, MANEUVER_ACCEL);
+		if(action == LEFT || action == RIGHT)
+			uart_send(action == LEFT ? "l" : "r");	// 關閉方向燈(uart->pico)
+		printf("[MANEUVER] %s: 完成 (%llu ms)\n", action_to_string(action),
+			(now_ns() - start_ns) / 1000000ULL);
+		phase = MANEUVER_IDLE;
+		return 0;
+	}
+	return 1;
+}
+
+
+// 是否有動作進行中
+int maneuver_active(void){
+	return phase != MANEUVER_IDLE;
+}
+
+
+// 目前階段
+maneuver_phase_t maneuver_phase(void){
+	return phase;
+}
+
+
+// 取消動作
+void maneuver_cancel(void){
+	// 轉彎中取消要關閉方向燈
+	if(phase == MANEUVER_PIVOT || phase == MANEUVER_REACQUIRE)
+		uart_send(action == LEFT ? "l" : "r");
+	phase = MANEUVER_IDLE;
+}
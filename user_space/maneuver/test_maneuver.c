@@ -0,0 +1,218 @@
+// 測試 節點動作(maneuver) 狀態機 (不需要硬體)
+// 馬達/方向燈換成記錄用的假函式，clock_gettime 用 --wrap 換成假時鐘，檢查:
+// 1.左轉/右轉: 減速 -> 原地轉 (中間感測器離線=線遺失) -> 看到新的線放慢 -> 置中後恢復直行
+// 2.原地轉時中間感測器一直在原本的線上不算找到線
+// 3.找回線逾時也當作完成；原地轉逾時停車並回報 -1
+// 4.直行: 減速通過節點後直接恢復
+// 5.節點橫線上的抖動 (7->2->7) 不算離開橫線，也要前進一段時間才離開減速階段
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "maneuver.h"
+#include "motor_ctrl.h"
+#include "uart_thread.h"
+
+#define MS	1000000ULL	// ns
+
+
+static int fail = 0;
+
+#define CHECK(cond, ...) do { \
+	if(!(cond)){ printf("FAIL "); printf(__VA_ARGS__); printf("\n"); fail++; } \
+} while(0)
+
+
+// ---------- 假時鐘 ----------
+static unsigned long long fake_ns = 1000 * MS;
+
+int __wrap_clock_gettime(clockid_t clk, struct timespec *ts){
+	ts->tv_sec = fake_ns / 1000000000ULL;
+	ts->tv_nsec = fake_ns % 1000000000ULL;
+	return 0;
+}
+
+
+// ---------- 假馬達/方向燈 (記錄最後一次指令) ----------
+static int drive_left, drive_right;	// 有號速度 (方向 * 速度)
+static unsigned int drive_accel;
+static int stops = 0;
+static char last_uart[8];
+
+int set_drive_ramp(int left_speed, int left_dir, int right_speed, int right_dir, unsigned int accel){
+	drive_left = left_dir * left_speed;
+	drive_right = right_dir * right_speed;
+	drive_accel = accel;
+	return 0;
+}
+
+int stop_all_motors(void){
+	drive_left = drive_right = 0;
+	stops++;
+	return 0;
+}
+
+int uart_send(const char *data){
+	snprintf(last_uart, sizeof(last_uart), "%s", data);
+	return 0;
+}
+
+const char *action_to_string(Action a){
+	return a == LEFT ? "LEFT" : a == RIGHT ? "RIGHT" : a == STRAIGHT ? "STRAIGHT" : "STOP";
+}
+
+
+// 推進一次 (時間先往前 10ms)
+static int tick(int code){
+	fake_ns += 10 * MS;
+	return maneuver_tick(code);
+}
+
+
+// 同一個編碼一直 tick 到離開減速階段 (最多到逾時)，回傳最後一次的結果
+static int pass_node(int code){
+	int ret = 1;
+	for(int i = 0; i < MANEUVER_DECEL_MS / 10 && maneuver_phase() == MANEUVER_DECELERATE; i++)
+		ret = tick(code);
+	return ret;
+}
+
+
+// 1.轉彎: 線遺失 -> 找線 -> 找回線
+static void test_turn(Action a){
+	const char *name = action_to_string(a);
+	int sign = a == LEFT ? 1 : -1;		// 左轉右輪前進
+	int before = fail;
+	int ret;
+
+	maneuver_start(a);
+	CHECK(maneuver_phase() == MANEUVER_DECELERATE && drive_left == MANEUVER_SPEED_DECEL && drive_right == MANEUVER_SPEED_DECEL,
+	      "%s 開始應先減速直行 (%d/%d)", name, drive_left, drive_right);
+
+	// 還在節點橫線上
+	ret = tick(7);
+	CHECK(ret == 1 && maneuver_phase() == MANEUVER_DECELERATE, "%s 111 時應繼續減速", name);
+
+	// 感測器剛離開橫線，車軸還沒到節點
+	ret = tick(2);
+	CHECK(ret == 1 && maneuver_phase() == MANEUVER_DECELERATE, "%s 還沒前進到節點不應開始轉", name);
+
+	// 離開橫線: 原地轉，方向燈
+	ret = pass_node(2);
+	CHECK(ret == 1 && maneuver_phase() == MANEUVER_PIVOT, "%s 離開橫線應開始原地轉", name);
+	CHECK(drive_left == -sign * MANEUVER_SPEED_PIVOT && drive_right == sign * MANEUVER_SPEED_PIVOT,
+	      "%s 原地轉方向錯誤 (%d/%d)", name, drive_left, drive_right);
+	CHECK(strcmp(last_uart, a == LEFT ? "L" : "R") == 0, "%s 應打方向燈 (%s)", name, last_uart);
+
+	// 中間感測器還在原本的線上，不算找到
+	ret = tick(2);
+	CHECK(ret == 1 && maneuver_phase() == MANEUVER_PIVOT, "%s 還在原本的線上不算找到線", name);
+
+	// 線遺失 (中間離線) 後繼續轉
+	ret = tick(0);
+	CHECK(ret == 1 && maneuver_phase() == MANEUVER_PIVOT, "%s 線遺失時應繼續原地轉", name);
+	ret = tick(a == LEFT ? 4 : 1);
+	CHECK(ret == 1 && maneuver_phase() == MANEUVER_PIVOT, "%s 邊緣感測器看到線還不算", name);
+
+	// 中間看到新的線: 放慢找回線
+	ret = tick(a == LEFT ? 6 : 3);
+	CHECK(ret == 1 && maneuver_phase() == MANEUVER_REACQUIRE, "%s 中間看到線應進入找回線", name);
+	CHECK(drive_left == -sign * MANEUVER_SPEED_SEEK && drive_right == sign * MANEUVER_SPEED_SEEK && drive_accel == 0,
+	      "%s 找回線應立即放慢 (%d/%d accel %u)", name, drive_left, drive_right, drive_accel);
+
+	// 置中: 恢復直行，關方向燈
+	ret = tick(2);
+	CHECK(ret == 0 && !maneuver_active(), "%s 置中後應完成 (ret %d)", name, ret);
+	CHECK(drive_left == MANEUVER_SPEED_DECEL && drive_right == MANEUVER_SPEED_DECEL, "%s 完成後應直行", name);
+	CHECK(strcmp(last_uart, a == LEFT ? "l" : "r") == 0, "%s 完成後應關方向燈 (%s)", name, last_uart);
+
+	if(fail == before) printf("ok   %s 線遺失 -> 找線 -> 找回線\n", name);
+}
+
+
+// 2.逾時
+static void test_timeouts(void){
+	int before = fail;
+	int ret;
+
+	// 找回線逾時: 當作已在線上
+	maneuver_start(LEFT);
+	pass_node(2);
+	tick(0);
+	tick(2);
+	CHECK(maneuver_phase() == MANEUVER_REACQUIRE, "應在找回線階段");
+	ret = tick(6);
+	CHECK(ret == 1, "找回線還沒逾時不應結束");
+	fake_ns += MANEUVER_REACQUIRE_MS * MS;
+	ret = tick(6);
+	CHECK(ret == 0 && !maneuver_active(), "找回線逾時應完成 (ret %d)", ret);
+
+	// 原地轉逾時: 找不到線，停車
+	stops = 0;
+	maneuver_start(RIGHT);
+	pass_node(2);
+	CHECK(maneuver_phase() == MANEUVER_PIVOT, "應在原地轉階段");
+	tick(0);
+	fake_ns += MANEUVER_PIVOT_MS * MS;
+	ret = tick(0);
+	CHECK(ret == -1 && !maneuver_active() && stops == 1, "原地轉逾時應停車回報 -1 (ret %d stops %d)", ret, stops);
+	CHECK(strcmp(last_uart, "r") == 0, "逾時應關方向燈 (%s)", last_uart);
+
+	if(fail == before) printf("ok   逾時\n");
+}
+
+
+// 3.直行
+static void test_straight(void){
+	int before = fail;
+	int ret;
+
+	maneuver_start(STRAIGHT);
+	ret = tick(7);
+	CHECK(ret == 1 && maneuver_phase() == MANEUVER_DECELERATE, "直行 111 時應繼續減速");
+	ret = pass_node(2);
+	CHECK(ret == 0 && !maneuver_active(), "直行離開橫線應完成 (ret %d)", ret);
+
+	if(fail == before) printf("ok   直行\n");
+}
+
+
+// 4.橫線上的抖動
+static void test_flicker(void){
+	unsigned long long clear_at;
+	int before = fail;
+	int ret = 1;
+
+	// 在橫線上前進超過 MANEUVER_ADVANCE_MS
+	maneuver_start(STRAIGHT);
+	for(int i = 0; i < MANEUVER_ADVANCE_MS / 10 + 1; i++)
+		ret = tick(7);
+	CHECK(ret == 1 && maneuver_phase() == MANEUVER_DECELERATE, "直行 111 時應繼續減速");
+
+	// 7->2->7: 單次抖動不算離開
+	ret = tick(2);
+	CHECK(ret == 1 && maneuver_phase() == MANEUVER_DECELERATE, "抖動 (單次 010) 不應結束減速");
+	ret = tick(7);
+	CHECK(ret == 1 && maneuver_phase() == MANEUVER_DECELERATE, "回到 111 應繼續減速");
+
+	// 真的離開: 連續 MANEUVER_CLEAR_MS 沒有 111 才完成
+	clear_at = fake_ns + 10 * MS;
+	ret = pass_node(2);
+	CHECK(ret == 0 && !maneuver_active(), "離開橫線應完成 (ret %d)", ret);
+	CHECK(fake_ns - clear_at >= MANEUVER_CLEAR_MS * MS, "離開橫線 %llu ms 就完成 (應至少 %d ms)",
+	      (fake_ns - clear_at) / MS, MANEUVER_CLEAR_MS);
+
+	if(fail == before) printf("ok   橫線抖動 (7->2->7)\n");
+}
+
+
+int main(void){
+	test_turn(LEFT);
+	test_turn(RIGHT);
+	test_timeouts();
+	test_straight();
+	test_flicker();
+
+	printf("%s\n", fail ? "maneuver test FAILED" : "maneuver test passed");
+	return fail ? 1 : 0;
+}
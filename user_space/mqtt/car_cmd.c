@@ -0,0 +1,279 @@
+// 調度中心指令解析
+// 手寫的單次掃描 JSON 解析，只認得頂層物件的 start/stop/route/delivery/buzzer_off，
+// 其他欄位略過；不配置記憶體，長度與巢狀層數都有上限，垃圾資料在有限時間內被拒絕
+
+#include <string.h>
+#include "car_cmd.h"
+
+#define NUMBER_MAX_DIGITS 9	// 整數最多 9 位 (不會溢位)
+
+
+// 掃描位置
+typedef struct {
+	const char *p;		// 目前位置
+	const char *end;	// payload 結尾
+} cursor;
+
+
+// 跳過空白
+static void skip_ws(cursor *c){
+	while(c->p < c->end && (*c->p == ' ' || *c->p == '\t' || *c->p == '\n' || *c->p == '\r'))
+		c->p++;
+}
+
+
+// 下一個非空白字元是否為 ch (是就吃掉)
+static int accept(cursor *c, char ch){
+	skip_ws(c);
+	if(c->p < c->end && *c->p == ch){
+		c->p++;
+		return 1;
+	}
+	return 0;
+}
+
+
+// 字串: 回傳內容起點與長度 (不處理跳脫，只略過)
+static int parse_string(cursor *c, const char **s, size_t *n){
+	if(!accept(c, '"')) return CAR_CMD_ERR_SYNTAX;
+
+	const char *start = c->p;
+	while(c->p < c->end && *c->p != '"'){
+		if(*c->p == '\\'){
+			c->p++;			// 跳脫字元後面那個也略過
+			if(c->p >= c->end) return CAR_CMD_ERR_SYNTAX;
+		}
+		c->p++;
+	}
+	if(c->p >= c->end) return CAR_CMD_ERR_SYNTAX;
+
+	*s = start;
+	*n = c->p - start;
+	c->p++;		// 結尾的 "
+	return CAR_CMD_OK;
+}
+
+
+// 整數 (可有負號，最多 NUMBER_MAX_DIGITS 位，不接受小數)
+static int parse_int(cursor *c, int *v){
+	int neg = 0, digits = 0;
+	long val = 0;
+
+	skip_ws(c);
+	if(c->p < c->end && *c->p == '-'){
+		neg = 1;
+		c->p++;
+	}
+	while(c->p < c->end && *c->p >= '0' && *c->p <= '9'){
+		if(++digits > NUMBER_MAX_DIGITS) return CAR_CMD_ERR_NUMBER;
+		val = val * 10 + (*c->p - '0');
+		c->p++;
+	}
+	if(digits == 0) return CAR_CMD_ERR_NUMBER;
+	if(c->p < c->end && (*c->p == '.' || *c->p == 'e' || *c->p == 'E')) return CAR_CMD_ERR_NUMBER;
+
+	*v = neg ? -val : val;
+	return CAR_CMD_OK;
+}
+
+
+// 固定字 true/false/null
+static int match_word(cursor *c, const char *w){
+	size_t n = strlen(w);
+	if((size_t)(c->end - c->p) < n || memcmp(c->p, w, n) != 0) return 0;
+	c->p += n;
+	return 1;
+}
+
+
+// 旗標值: 數字非 0 或 true 視為成立  回傳=> 1成立 0不成立 <0錯誤
+static int parse_flag(cursor *c){
+	int v;
+
+	skip_ws(c);
+	if(match_word(c, "true")) return 1;
+	if(match_word(c, "false") || match_word(c, "null")) return 0;
+
+	int ret = parse_int(c, &v);
+	if(ret < 0) return ret;
+	return v != 0;
+}
+
+
+// 略過任意值 (未知欄位)
+static int skip_value(cursor *c, int depth){
+	const char *s;
+	size_t n;
+	int v, ret;
+
+	if(depth > CAR_CMD_MAX_DEPTH) return CAR_CMD_ERR_TOO_DEEP;
+	skip_ws(c);
+	if(c->p >= c->end) return CAR_CMD_ERR_SYNTAX;
+
+	switch(*c->p){
+		// 字串
+		case '"':
+			return parse_string(c, &s, &n);
+
+		// 物件
+		case '{':
+			c->p++;
+			if(accept(c, '}')) return CAR_CMD_OK;
+			do {
+				if((ret = parse_string(c, &s, &n)) < 0) return ret;
+				if(!accept(c, ':')) return CAR_CMD_ERR_SYNTAX;
+				if((ret = skip_value(c, depth + 1)) < 0) return ret;
+			} while(accept(c, ','));
+			return accept(c, '}') ? CAR_CMD_OK : CAR_CMD_ERR_SYNTAX;
+
+		// 陣列
+		case '[':
+			c->p++;
+			if(accept(c, ']')) return CAR_CMD_OK;
+			do {
+				if((ret = skip_value(c, depth + 1)) < 0) return ret;
+			} while(accept(c, ','));
+			return accept(c, ']') ? CAR_CMD_OK : CAR_CMD_ERR_SYNTAX;
+
+		// 固定字
+		case 't': return match_word(c, "true") ? CAR_CMD_OK : CAR_CMD_ERR_SYNTAX;
+		case 'f': return match_word(c, "false") ? CAR_CMD_OK : CAR_CMD_ERR_SYNTAX;
+		case 'n': return match_word(c, "null") ? CAR_CMD_OK : CAR_CMD_ERR_SYNTAX;
+
+		// 數字 (略過小數/指數部分)
+		default:
+			ret = parse_int(c, &v);
+			if(ret == CAR_CMD_ERR_NUMBER && c->p < c->end && (*c->p == '.' || *c->p == 'e' || *c->p == 'E')){
+				while(c->p < c->end && strchr("0123456789.eE+-", *c->p)) c->p++;
+				return CAR_CMD_OK;
+			}
+			return ret;
+	}
+}
+
+
+// 路線陣列 [1, 12, 3]
+static int parse_route(cursor *c, car_cmd *cmd){
+	int v, ret;
+
+	if(!accept(c, '[')) return CAR_CMD_ERR_SYNTAX;
+	cmd->route_len = 0;
+	if(accept(c, ']')) return CAR_CMD_OK;
+
+	do {
+		if((ret = parse_int(c, &v)) < 0) return ret;
+		if(cmd->route_len >= cmd->route_cap) return CAR_CMD_ERR_ROUTE_FULL;
+		cmd->route[cmd->route_len++] = v;
+	} while(accept(c, ','));
+
+	return accept(c, ']') ? CAR_CMD_OK : CAR_CMD_ERR_SYNTAX;
+}
+
+
+// key 比對
+static int key_is(const char *s, size_t n, const char *name){
+	return n == strlen(name) && memcmp(s, name, n) == 0;
+}
+
+
+// 設定路線緩衝並清除結果
+void car_cmd_init(car_cmd *cmd, int *route_buf, int route_cap){
+	cmd->flags = 0;
+	cmd->delivery = 0;
+	cmd->encoding = CAR_CMD_ENC_JSON;
+	cmd->route = route_buf;
+	cmd->route_cap = route_buf ? route_cap : 0;
+	cmd->route_len = 0;
+}
+
+
+// 解析一則訊息
+int car_cmd_parse(const char *payload, size_t len, car_cmd *cmd){
+	cursor c = { .p = payload, .end = payload + len };
+	unsigned int flags = 0;
+	const char *key;
+	size_t key_len;
+	int ret = CAR_CMD_OK;
+
+	cmd->flags = 0;
+	cmd->route_len = 0;
+	if(len > CAR_CMD_MAX_LEN) return CAR_CMD_ERR_TOO_LONG;
+
+	// 1.頂層必須是物件
+	if(!accept(&c, '{')) return CAR_CMD_ERR_SYNTAX;
+
+	// 2.逐一處理欄位
+	if(!accept(&c, '}')){
+		do {
+			if((ret = parse_string(&c, &key, &key_len)) < 0) goto fail;
+			if(!accept(&c, ':')){
+				ret = CAR_CMD_ERR_SYNTAX;
+				goto fail;
+			}
+
+			if(key_is(key, key_len, "start")){
+				if((ret = parse_flag(&c)) < 0) goto fail;
+				if(ret) flags |= CAR_CMD_START;
+			} else if(key_is(key, key_len, "stop")){
+				if((ret = parse_flag(&c)) < 0) goto fail;
+				if(ret) flags |= CAR_CMD_STOP;
+			} else if(key_is(key, key_len, "buzzer_off")){
+				if((ret = parse_flag(&c)) < 0) goto fail;
+				if(ret) flags |= CAR_CMD_BUZZER_OFF;
+			} else if(key_is(key, key_len, "delivery")){
+				if((ret = parse_flag(&c)) < 0) goto fail;
+				cmd->delivery = ret;
+				flags |= CAR_CMD_DELIVERY;
+			} else if(key_is(key, key_len, "encoding")){
+				const char *val;
+				size_t val_len;
+				if((ret = parse_string(&c, &val, &val_len)) < 0) goto fail;
+				if(key_is(val, val_len, "json")){
+					cmd->encoding = CAR_CMD_ENC_JSON;
+					flags |= CAR_CMD_ENCODING;
+				} else if(key_is(val, val_len, "binary")){
+					cmd->encoding = CAR_CMD_ENC_BINARY;
+					flags |= CAR_CMD_ENCODING;
+				}
+			} else if(key_is(key, key_len, "route")){
+				if((ret = parse_route(&c, cmd)) < 0) goto fail;
+				flags |= CAR_CMD_ROUTE;
+			} else {
+				if((ret = skip_value(&c, 1)) < 0) goto fail;
+			}
+		} while(accept(&c, ','));
+
+		if(!accept(&c, '}')){
+			ret = CAR_CMD_ERR_SYNTAX;
+			goto fail;
+		}
+	}
+
+	// 3.物件後面只能有空白
+	skip_ws(&c);
+	if(c.p != c.end && !(c.p + 1 == c.end && *c.p == '\0')){
+		ret = CAR_CMD_ERR_SYNTAX;
+		goto fail;
+	}
+
+	cmd->flags = flags;
+	return CAR_CMD_OK;
+
+fail:
+	cmd->route_len = 0;
+	return ret;
+}
+
+
+// 錯誤碼轉文字
+const char *car_cmd_strerror(int err){
+	switch(err){
+		case CAR_CMD_OK:		return "ok";
+		case CAR_CMD_ERR_SYNTAX:	return "syntax error";
+		case CAR_CMD_ERR_TOO_LONG:	return "payload too long";
+		case CAR_CMD_ERR_TOO_DEEP:	return "nesting too deep";
+		case CAR_CMD_ERR_ROUTE_FULL:	return "route too long";
+		case CAR_CMD_ERR_NUMBER:	return "bad number";
+		default:			return "unknown error";
+	}
+}
@@ -1,25 +1,190 @@
 // MQTT  Rpi對Rpi通訊 (初始化連線、發布、訂閱、關閉) api
 // 使用 Mosquitto library
+// 連線是非阻塞的: 啟動時不等 Wi-Fi/Broker，斷線後依退避時間(加隨機抖動)自動重連，
+// 離線期間重要事件存進固定大小的 outbox，重連後依序補送；遺失的訊息都有計數
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>		// clock_gettime
+#include <pthread.h>
 #include <mosquitto.h>
 #include "mqtt_config.h"
+#include "mqtt_router.h"	// 主題路由 (多個主題各自的 handler)
 
 
+// 一則離線待送訊息
+typedef struct {
+	char topic[MQTT_TOPIC_MAX];
+	unsigned char data[MQTT_OUTBOX_MSG_MAX];	// 內容 (JSON 字串或二進位)
+	int len;
+	int qos;
+} outbox_msg;
+
+// 每個主題的 QoS
+typedef struct {
+	char topic[MQTT_TOPIC_MAX];
+	int qos;
+} topic_qos;
 
 
 // 全局變數
 static struct mosquitto *mosq = NULL;	// Mosquitto client物件
-static mqtt_callback user_cb = NULL;	// 使用者設定的 callback 函式
+static int loop_thread = 0;		// 1 = 有啟動 mosquitto 背景 thread
+static char broker_host[64] = MQTT_BROKER_IP;
+static int broker_port = MQTT_BROKER_PORT;
+
+static volatile int state = MQTT_STATE_DISCONNECTED;	// 連線狀態
+static int closing = 0;				// mqtt_close 中，不再重連
+static int ever_connected = 0;			// 0 = 第一次連線用 connect_async
+static unsigned int conn_gen = 0;		// 每次 (重新) 連線 +1，socket fd 號碼可能被重用
+static unsigned int backoff_ms = 0;		// 目前退避時間
+static unsigned long long retry_at = 0;		// 下一次重連時間 (ns)
+static unsigned long long connect_start = 0;	// 開始連線時間 (ns)
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;	// 保護 outbox/訂閱表/統計 (背景 thread 模式會同時存取)
+static outbox_msg outbox[MQTT_OUTBOX_SLOTS];	// 離線待送環狀緩衝 (滿了覆蓋最舊的)
+static unsigned int outbox_head = 0, outbox_count = 0;
+static char subs[MQTT_MAX_SUBS][MQTT_TOPIC_MAX];	// 已訂閱主題 (重連後重新訂閱)
+static int sub_count = 0;
+static topic_qos qos_table[MQTT_MAX_TOPIC_QOS];	// 每個主題的 QoS (沒設定為 0)
+static int qos_count = 0;
+static mqtt_stats stats;
+
+
+// 單調時鐘 (ns)
+static unsigned long long now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
 
 
-// Mosquitto library 初始化與 Broker 連線
-int mqtt_init(void){
-	
+// 查主題的 QoS
+static int qos_for(const char *topic){
+	for(int i = 0; i < qos_count; i++)
+		if(strcmp(qos_table[i].topic, topic) == 0) return qos_table[i].qos;
+	return 0;
+}
+
+
+// 安排下一次重連: 退避時間加倍 (上限 MQTT_BACKOFF_MAX_MS)，實際等待取 [一半, 全部] 之間的隨機值，
+// 避免多台車同時斷線後一起重連
+static void schedule_retry(void){
+	if(backoff_ms == 0) backoff_ms = MQTT_BACKOFF_MIN_MS;
+	else if(backoff_ms < MQTT_BACKOFF_MAX_MS / 2) backoff_ms *= 2;
+	else backoff_ms = MQTT_BACKOFF_MAX_MS;
+
+	unsigned int wait = backoff_ms / 2 + rand() % (backoff_ms / 2 + 1);
+	retry_at = now_ns() + (unsigned long long)wait * 1000000ULL;
+	state = MQTT_STATE_DISCONNECTED;
+}
+
+
+// 開始非阻塞連線 (結果由 on_connect 通知)
+static void start_connect(void){
 	int rc;
 
+	if(!ever_connected) rc = mosquitto_connect_async(mosq, broker_host, broker_port, MQTT_KEEPALIVE_S);
+	else rc = mosquitto_reconnect_async(mosq);
+	ever_connected = 1;
+	conn_gen++;
+
+	pthread_mutex_lock(&lock);
+	stats.connect_attempts++;
+	if(rc != MOSQ_ERR_SUCCESS) stats.connect_failures++;
+	pthread_mutex_unlock(&lock);
+
+	if(rc != MOSQ_ERR_SUCCESS){
+		fprintf(stderr, "MQTT connect failed: %s (retry in background)\n", mosquitto_strerror(rc));
+		schedule_retry();
+		return;
+	}
+	state = MQTT_STATE_CONNECTING;
+	connect_start = now_ns();
+}
+
+
+// 補送離線期間的訊息 (持有 lock)
+static void replay_outbox(void){
+	while(outbox_count > 0){
+		outbox_msg *m = &outbox[outbox_head];
+		int rc = mosquitto_publish(mosq, NULL, m->topic, m->len, m->data, m->qos, false);
+		if(rc != MOSQ_ERR_SUCCESS) break;	// 又斷線，留到下次
+
+		outbox_head = (outbox_head + 1) % MQTT_OUTBOX_SLOTS;
+		outbox_count--;
+		stats.replayed++;
+	}
+}
+
+
+// Mosquitto callback: CONNACK
+static void on_connect(struct mosquitto *m, void *obj, int rc){
+	if(rc != 0){
+		fprintf(stderr, "MQTT broker refused connection: %d\n", rc);
+		pthread_mutex_lock(&lock);
+		stats.connect_failures++;
+		pthread_mutex_unlock(&lock);
+		if(!loop_thread){
+			schedule_retry();
+			mosquitto_disconnect(mosq);
+		}
+		return;
+	}
+
+	state = MQTT_STATE_CONNECTED;
+	backoff_ms = 0;
+	printf("[MQTT] 已連線 %s:%d\n", broker_host, broker_port);
+
+	// clean session: 重新訂閱，再補送離線訊息
+	pthread_mutex_lock(&lock);
+	stats.connects++;
+	for(int i = 0; i < sub_count; i++)
+		mosquitto_subscribe(mosq, NULL, subs[i], qos_for(subs[i]));
+	replay_outbox();
+	pthread_mutex_unlock(&lock);
+}
+
+
+// Mosquitto callback: 斷線
+static void on_disconnect(struct mosquitto *m, void *obj, int rc){
+	pthread_mutex_lock(&lock);
+	if(state == MQTT_STATE_CONNECTED) stats.disconnects++;
+	pthread_mutex_unlock(&lock);
+
+	if(closing || state == MQTT_STATE_DISCONNECTED) return;	// 已經安排好重連
+	if(state == MQTT_STATE_CONNECTED) fprintf(stderr, "[MQTT] 斷線，背景重連中\n");
+
+	// 背景 thread 模式由 mosquitto 自己重連
+	if(loop_thread) state = MQTT_STATE_DISCONNECTED;
+	else schedule_retry();
+}
+
+
+// Mossquitto callback，收到訊息時會呼叫 (mqtt_subscribe使用)
+static void on_message(struct mosquitto *mosq, void *obj, const struct mosquitto_message *message){
+	if(message->payloadlen > 0){
+		// 將 topic 與 payload 交給路由，分派給符合主題的 handler
+		char msg[message->payloadlen + 1];
+
+		memcpy(msg, message->payload, message->payloadlen);
+		msg[message->payloadlen] = '\0';	// 確保字串結尾
+		mqtt_router_dispatch(message->topic, msg);
+	}
+}
+
+
+// 設定 Broker 位址 (init 之前呼叫，沒設定用 mqtt_config.h 的預設值)
+void mqtt_set_broker(const char *host, int port){
+	if(host) snprintf(broker_host, sizeof(broker_host), "%s", host);
+	if(port > 0) broker_port = port;
+}
+
+
+// 建立 client 並設定 callback
+static int create_client(void){
+
 	// 初始化 mosquitto library
 	mosquitto_lib_init();
 
@@ -28,21 +193,53 @@ int mqtt_init(void){
 	if(!mosq){
 		fprintf(stderr, "Failed to create mosquitto instance\n");
 		return -1;
-	}	
-
-	// 連線到broker
-	rc = mosquitto_connect(mosq, MQTT_BROKER_IP, MQTT_BROKER_PORT, 60);
-	if(rc != MOSQ_ERR_SUCCESS){
-		fprintf(stderr, "Failed to connect to broker: %s\n", mosquitto_strerror(rc));
-		mosquitto_destroy(mosq);
-		return -1;
 	}
 
+	mosquitto_connect_callback_set(mosq, on_connect);
+	mosquitto_disconnect_callback_set(mosq, on_disconnect);
+	mosquitto_message_callback_set(mosq, on_message);
+	mosquitto_max_inflight_messages_set(mosq, MQTT_MAX_INFLIGHT);	// QoS>0 未確認的訊息數上限
+
+	srand(now_ns());
+	closing = 0;
+	ever_connected = 0;
+	backoff_ms = 0;
+	state = MQTT_STATE_DISCONNECTED;
+	return 0;
+}
+
+
+// Mosquitto library 初始化並開始連線 Broker (不啟動背景 thread，不等連線完成)
+int mqtt_init_external(void){
+
+	if(create_client() != 0) return -1;
+
+	// 連線到broker (失敗也沒關係，mqtt_handle_misc 會依退避時間重試)
+	loop_thread = 0;
+	start_connect();
+	return 0;
+}
+
+
+// Mosquitto library 初始化與 Broker 連線，並啟動背景 thread
+int mqtt_init(void){
+
+	int rc;
+
+	if(create_client() != 0) return -1;
+
+	// 背景 thread 斷線後由 mosquitto 自動重連 (1~32 秒指數退避)
+	mosquitto_reconnect_delay_set(mosq, MQTT_BACKOFF_MIN_MS / 1000, MQTT_BACKOFF_MAX_MS / 1000, true);
+	loop_thread = 1;
+	start_connect();
+
 	// 啟動背景 thread，處理訂閱接收
 	rc = mosquitto_loop_start(mosq);
 	if(rc != MOSQ_ERR_SUCCESS){
 		fprintf(stderr, "Failed to start mosquitto loop: %s\n", mosquitto_strerror(rc));
 		mosquitto_destroy(mosq);
+		mosq = NULL;
+		loop_thread = 0;
 		return -1;
 	}
 
@@ -50,81 +247,262 @@ int mqtt_init(void){
 }
 
 
-// 發布訊息
-int mqtt_publish(const char *topic, const char *msg){
-	
-	// 失敗直接結束
+// 事件迴圈用: socket fd
+int mqtt_socket(void){
 	if(!mosq) return -1;
+	return mosquitto_socket(mosq);
+}
 
-	int rc = mosquitto_publish(mosq, NULL, topic, strlen(msg), msg, 0, false);
-	if(rc != MOSQ_ERR_SUCCESS){
-		fprintf(stderr, "Failed to publish message: %s\n", mosquitto_strerror(rc));
-		return -1;
+
+// 事件迴圈用: 連線代數 (每次重新建立 socket 都會改變)
+unsigned int mqtt_conn_gen(void){
+	return conn_gen;
+}
+
+
+// 事件迴圈用: 是否有資料待送
+int mqtt_want_write(void){
+	if(!mosq) return 0;
+	return mosquitto_want_write(mosq);
+}
+
+
+// 讀寫失敗: 連線斷了就安排重連 (mosquitto 通常已呼叫過 on_disconnect)
+static int io_failed(const char *what, int rc){
+	fprintf(stderr, "mqtt %s failed: %s\n", what, mosquitto_strerror(rc));
+	if(state != MQTT_STATE_DISCONNECTED && !closing){
+		schedule_retry();
+		mosquitto_disconnect(mosq);
 	}
+	return -1;
+}
+
+
+// 事件迴圈用: socket 可讀 (收到的訊息會在這裡呼叫 callback)
+int mqtt_handle_read(void){
+	if(!mosq) return -1;
+	int rc = mosquitto_loop_read(mosq, 1);
+	if(rc != MOSQ_ERR_SUCCESS) return io_failed("read", rc);
 	return 0;
 }
 
 
-// Mossquitto callback，收到訊息時會呼叫 (mqtt_subscribe使用)
-static void on_message(struct mosquitto *mosq, void *obj, const struct mosquitto_message *message){
-	if(user_cb && message->payloadlen > 0){
-		// 將 topic 與 payload 傳給使用者的 callback
-		char msg[message->payloadlen + 1];
+// 事件迴圈用: socket 可寫
+int mqtt_handle_write(void){
+	if(!mosq) return -1;
+	int rc = mosquitto_loop_write(mosq, 1);
+	if(rc != MOSQ_ERR_SUCCESS) return io_failed("write", rc);
+	return 0;
+}
 
-		memcpy(msg, message->payload, message->payloadlen);
-		msg[message->payloadlen] = '\0';	// 確保字串結尾
-		user_cb(message->topic, msg);
+
+// 事件迴圈用: keepalive/重連等定期工作
+int mqtt_handle_misc(void){
+	if(!mosq || loop_thread) return -1;
+
+	switch(state){
+
+		// 1.離線: 退避時間到了就重連
+		case MQTT_STATE_DISCONNECTED:
+			if(now_ns() >= retry_at) start_connect();
+			return 0;
+
+		// 2.連線中: 太久沒有 CONNACK 就放棄重來
+		case MQTT_STATE_CONNECTING:
+			if(now_ns() - connect_start >= MQTT_CONNECT_TIMEOUT_MS * 1000000ULL){
+				fprintf(stderr, "MQTT connect timeout\n");
+				pthread_mutex_lock(&lock);
+				stats.connect_failures++;
+				pthread_mutex_unlock(&lock);
+				schedule_retry();
+				mosquitto_disconnect(mosq);
+			}
+			return 0;
+
+		// 3.已連線: keepalive
+		default:
+			break;
+	}
+
+	int rc = mosquitto_loop_misc(mosq);
+	if(rc != MOSQ_ERR_SUCCESS) return io_failed("misc", rc);
+	return 0;
+}
+
+
+// 放進 outbox (持有 lock)，滿了覆蓋最舊的一筆
+static void outbox_push(const char *topic, const void *data, int len, int qos){
+	unsigned int idx;
+
+	if(outbox_count == MQTT_OUTBOX_SLOTS){
+		outbox_head = (outbox_head + 1) % MQTT_OUTBOX_SLOTS;
+		outbox_count--;
+		stats.outbox_overwritten++;
 	}
+	idx = (outbox_head + outbox_count) % MQTT_OUTBOX_SLOTS;
+	snprintf(outbox[idx].topic, MQTT_TOPIC_MAX, "%s", topic);
+	memcpy(outbox[idx].data, data, len);
+	outbox[idx].len = len;
+	outbox[idx].qos = qos;
+	outbox_count++;
+	stats.offline_queued++;
+}
+
+
+// 發布 len bytes (QoS 依主題設定)  flags: MQTT_PUB_CRITICAL = 離線時存進 outbox
+int mqtt_publish_buf(const char *topic, const void *data, int len, int flags){
+	int ret = 0;
+
+	if(!mosq || len < 0) return -1;
+
+	pthread_mutex_lock(&lock);
+	int qos = qos_for(topic);
+
+	// 1.已連線: 直接送 (還有未補送的就先補，保持順序)
+	if(state == MQTT_STATE_CONNECTED){
+		if(outbox_count > 0) replay_outbox();
+		if(outbox_count == 0){
+			int rc = mosquitto_publish(mosq, NULL, topic, len, data, qos, false);
+			if(rc == MOSQ_ERR_SUCCESS){
+				stats.published++;
+				pthread_mutex_unlock(&lock);
+				return 0;
+			}
+			if(rc != MOSQ_ERR_NO_CONN && rc != MOSQ_ERR_CONN_LOST){
+				fprintf(stderr, "Failed to publish message: %s\n", mosquitto_strerror(rc));
+				stats.publish_errors++;
+				pthread_mutex_unlock(&lock);
+				return -1;
+			}
+		}
+	}
+
+	// 2.離線: 重要事件存起來，其他的丟掉並計數
+	if((flags & MQTT_PUB_CRITICAL) && len <= MQTT_OUTBOX_MSG_MAX){
+		outbox_push(topic, data, len, qos);
+	} else {
+		stats.offline_dropped++;
+		ret = -1;
+	}
+	pthread_mutex_unlock(&lock);
+	return ret;
+}
+
+
+// 發布字串  flags: 同 mqtt_publish_buf
+int mqtt_publish_ex(const char *topic, const char *msg, int flags){
+	return mqtt_publish_buf(topic, msg, strlen(msg), flags);
 }
 
 
-// 訂閱主題
+// 發布訊息
+int mqtt_publish(const char *topic, const char *msg){
+	return mqtt_publish_ex(topic, msg, 0);
+}
+
+
+// 設定主題的 QoS (0~2)，發布與訂閱都會用  回傳=> 0成功 -1表滿/參數錯誤
+int mqtt_set_topic_qos(const char *topic, int qos){
+	int ret = 0;
+
+	if(!topic || qos < 0 || qos > 2 || strlen(topic) >= MQTT_TOPIC_MAX) return -1;
+
+	pthread_mutex_lock(&lock);
+	int i;
+	for(i = 0; i < qos_count; i++)
+		if(strcmp(qos_table[i].topic, topic) == 0) break;
+	if(i == qos_count){
+		if(qos_count < MQTT_MAX_TOPIC_QOS) snprintf(qos_table[qos_count++].topic, MQTT_TOPIC_MAX, "%s", topic);
+		else ret = -1;
+	}
+	if(ret == 0) qos_table[i].qos = qos;
+	pthread_mutex_unlock(&lock);
+	return ret;
+}
+
+
+// 訂閱主題 (handler 直接在收訊的執行緒呼叫)
 int mqtt_subscribe(const char *topic, mqtt_callback cb){
-	
-	// 如果失敗 退出
-	if(!mosq) return -1;
+	return mqtt_subscribe_ex(topic, cb, MQTT_ROUTE_INLINE);
+}
 
-	// 設定使用者 callback
-	user_cb = cb;
 
-	// 設定 Mosquitto library 的 message callback
-	mosquitto_message_callback_set(mosq, on_message);
-	
+// 訂閱主題  flags: MQTT_ROUTE_INLINE / MQTT_ROUTE_WORKER
+// 還沒連上也可以訂閱，連線 (含重連) 成功時才送出 SUBSCRIBE
+int mqtt_subscribe_ex(const char *topic, mqtt_callback cb, int flags){
+
+	// 如果失敗 退出
+	if(!mosq || strlen(topic) >= MQTT_TOPIC_MAX) return -1;
+
+	// 加入路由 (同一個主題可以有多個 handler，主題可含 + / #)
+	if(mqtt_router_add(topic, cb, flags) != 0) return -1;
+
+	// 記住主題 (重連後重新訂閱)
+	pthread_mutex_lock(&lock);
+	int i;
+	for(i = 0; i < sub_count; i++)
+		if(strcmp(subs[i], topic) == 0) break;
+	if(i == sub_count){
+		if(sub_count == MQTT_MAX_SUBS){
+			pthread_mutex_unlock(&lock);
+			mqtt_router_remove(topic, cb);
+			return -1;
+		}
+		snprintf(subs[sub_count++], MQTT_TOPIC_MAX, "%s", topic);
+	}
+
 	// 訂閱 topic
-	int rc = mosquitto_subscribe(mosq, NULL, topic, 0);
-	if(rc != MOSQ_ERR_SUCCESS){
-		fprintf(stderr, "Failed to subscribe topic: %s\n", mosquitto_strerror(rc));
-		return -1;
+	if(state == MQTT_STATE_CONNECTED){
+		int rc = mosquitto_subscribe(mosq, NULL, topic, qos_for(topic));
+		if(rc != MOSQ_ERR_SUCCESS)
+			fprintf(stderr, "Failed to subscribe topic: %s (retry on reconnect)\n", mosquitto_strerror(rc));
 	}
+	pthread_mutex_unlock(&lock);
 
 	return 0;
 }
 
 
+// 目前連線狀態 MQTT_STATE_*
+int mqtt_state(void){
+	return state;
+}
+
+
+// 取得統計
+void mqtt_get_stats(mqtt_stats *st){
+	pthread_mutex_lock(&lock);
+	*st = stats;
+	st->outbox_pending = outbox_count;
+	st->state = state;
+	pthread_mutex_unlock(&lock);
+}
+
+
 // 關閉 MQTT client
 int mqtt_close(void){
-	
+
 	// 如果失敗 退出
 	if(!mosq) return -1;
 
 	// 斷線
+	closing = 1;
 	mosquitto_disconnect(mosq);
 
 	// 停止背景 loop
-	mosquitto_loop_stop(mosq, true);
-	
+	if(loop_thread) mosquitto_loop_stop(mosq, true);
+	loop_thread = 0;
+
+	// 停止路由的工作執行緒
+	mqtt_router_close();
+
 	// 銷毀 client 物件
 	mosquitto_destroy(mosq);
 	mosq = NULL;
+	state = MQTT_STATE_DISCONNECTED;
 
 	// 清理 library
-	mosquitto_lib_cleanup();		
+	mosquitto_lib_cleanup();
 
 	return 0;
 }
-
-
-
-
-
-
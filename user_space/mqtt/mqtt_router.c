@@ -0,0 +1,277 @@
+// MQTT 主題路由
+// 訂閱主題依 '/' 拆成層級放進樹 (固定大小節點池，不配置記憶體)，
+// 收到訊息時每一層只看: 同名子節點、'+' 子節點、'#' 子節點
+// 交給工作執行緒的訊息放進 SPSC 無鎖佇列 (和 UART 同一套 uart_queue)，
+// 生產者是收訊的執行緒 (事件迴圈或 mosquitto 背景 thread)，消費者是工作執行緒
+
+#include <stdio.h>
+#include <string.h>
+#include <pthread.h>
+#include "mqtt_router.h"
+#include "uart_queue.h"		// SPSC 佇列
+
+#define NO_NODE	-1
+
+
+// 一個 handler
+typedef struct {
+	mqtt_callback cb;
+	int flags;
+} route_handler;
+
+
+// 樹節點 (一個主題層級)
+typedef struct {
+	char level[MQTT_ROUTER_LEVEL_MAX];	// 層級名稱，"+" / "#" 為萬用字元
+	int first_child;			// 第一個子節點
+	int next_sibling;			// 下一個兄弟節點
+	int nhandlers;
+	route_handler handlers[MQTT_ROUTER_MAX_HANDLERS];
+} router_node;
+
+
+// 全域變數
+static router_node nodes[MQTT_ROUTER_MAX_NODES];
+static int node_count = 0;		// 0 = 還沒建立根節點
+static mqtt_router_stats stats;
+
+static uart_queue_t work_queue;		// 交給工作執行緒的訊息 [cb][topic\0][msg\0]
+static pthread_t worker;
+static int worker_on = 0;
+
+
+// 建立節點
+static int new_node(const char *level, size_t len){
+	if(node_count >= MQTT_ROUTER_MAX_NODES || len >= MQTT_ROUTER_LEVEL_MAX) return NO_NODE;
+
+	router_node *n = &nodes[node_count];
+	memcpy(n->level, level, len);
+	n->level[len] = '\0';
+	n->first_child = NO_NODE;
+	n->next_sibling = NO_NODE;
+	n->nhandlers = 0;
+	return node_count++;
+}
+
+
+// 找子節點
+static int find_child(int parent, const char *level, size_t len){
+	for(int c = nodes[parent].first_child; c != NO_NODE; c = nodes[c].next_sibling){
+		if(strlen(nodes[c].level) == len && memcmp(nodes[c].level, level, len) == 0)
+			return c;
+	}
+	return NO_NODE;
+}
+
+
+// 檢查訂閱主題: 萬用字元必須單獨佔一層，# 只能在最後  回傳=> 1合法 0不合法
+static int valid_filter(const char *filter){
+	for(const char *p = filter; *p; p++){
+		if(*p != '+' && *p != '#') continue;
+		if(p != filter && p[-1] != '/') return 0;
+		if(*p == '+' && p[1] && p[1] != '/') return 0;
+		if(*p == '#' && p[1]) return 0;
+	}
+	return 1;
+}
+
+
+// 沿著 filter 走到最後一層的節點  create: 1 = 沒有就建立
+// 回傳=> 節點  NO_NODE 格式錯誤/節點已滿/找不到
+static int walk(const char *filter, int create){
+	const char *p = filter;
+
+	if(!valid_filter(filter)) return NO_NODE;
+	if(node_count == 0){
+		if(!create || new_node("", 0) == NO_NODE) return NO_NODE;
+	}
+
+	int cur = 0;
+	for(;;){
+		const char *slash = strchr(p, '/');
+		size_t len = slash ? (size_t)(slash - p) : strlen(p);
+
+		// 找/建立這一層
+		int child = find_child(cur, p, len);
+		if(child == NO_NODE){
+			if(!create) return NO_NODE;
+			child = new_node(p, len);
+			if(child == NO_NODE) return NO_NODE;
+
+			// 節點寫好後才接上樹 (註冊在訂閱之前完成，收訊端不會看到一半的節點)
+			nodes[child].next_sibling = nodes[cur].first_child;
+			nodes[cur].first_child = child;
+		}
+		cur = child;
+
+		if(!slash) return cur;
+		p = slash + 1;
+	}
+}
+
+
+// 工作執行緒: 取出訊息呼叫 handler
+static void *worker_main(void *arg){
+	static char buf[UART_QUEUE_BYTES];
+	mqtt_callback cb;
+
+	for(;;){
+		int n = queue_pop(&work_queue, buf, sizeof(buf));
+		if(n < 0) break;		// 已停止
+		if((size_t)n < sizeof(cb) + 2) continue;
+
+		memcpy(&cb, buf, sizeof(cb));
+		const char *topic = buf + sizeof(cb);
+		const char *msg = topic + strlen(topic) + 1;
+		cb(topic, msg);
+	}
+	return NULL;
+}
+
+
+// 第一次有 WORKER handler 時啟動工作執行緒
+static int start_worker(void){
+	if(worker_on) return 0;
+	if(queue_init(&work_queue) != 0) return -1;
+	if(pthread_create(&worker, NULL, worker_main, NULL) != 0){
+		perror("mqtt router worker failed");
+		queue_destroy(&work_queue);
+		return -1;
+	}
+	worker_on = 1;
+	return 0;
+}
+
+
+// 把訊息複製進工作佇列
+static int enqueue(mqtt_callback cb, const char *topic, const char *msg){
+	char rec[UART_QUEUE_BYTES];
+	size_t tlen = strlen(topic) + 1, mlen = strlen(msg) + 1;
+	size_t len = sizeof(cb) + tlen + mlen;
+
+	if(len > sizeof(rec) / 2) return -1;	// 太長 (佇列至少要放得下兩筆)
+	memcpy(rec, &cb, sizeof(cb));
+	memcpy(rec + sizeof(cb), topic, tlen);
+	memcpy(rec + sizeof(cb) + tlen, msg, mlen);
+	return queue_push_buf(&work_queue, rec, len);
+}
+
+
+// 呼叫一個節點上的所有 handler
+static int run_handlers(const router_node *n, const char *topic, const char *msg){
+	for(int i = 0; i < n->nhandlers; i++){
+		const route_handler *h = &n->handlers[i];
+
+		if((h->flags & MQTT_ROUTE_WORKER) && worker_on){
+			if(enqueue(h->cb, topic, msg) == 0) stats.queued++;
+			else stats.dropped++;
+		} else {
+			h->cb(topic, msg);
+			stats.dispatched++;
+		}
+	}
+	return n->nhandlers;
+}
+
+
+// 從 node 的子節點開始比對 p 之後的層級
+static int match(int node, const char *p, const char *topic, const char *msg, int first){
+	const char *slash = strchr(p, '/');
+	size_t len = slash ? (size_t)(slash - p) : strlen(p);
+	int hits = 0;
+
+	// $SYS 之類的系統主題不給第一層萬用字元比對
+	int wild_ok = !(first && *p == '$');
+
+	for(int c = nodes[node].first_child; c != NO_NODE; c = nodes[c].next_sibling){
+		const router_node *n = &nodes[c];
+
+		// 1.# 符合剩下全部
+		if(n->level[0] == '#'){
+			if(wild_ok) hits += run_handlers(n, topic, msg);
+			continue;
+		}
+
+		// 2.同名或 +
+		if(n->level[0] == '+' ? !wild_ok
+		   : (strlen(n->level) != len || memcmp(n->level, p, len) != 0))
+			continue;
+
+		if(slash){
+			hits += match(c, slash + 1, topic, msg, 0);
+		} else {
+			hits += run_handlers(n, topic, msg);
+
+			// "a/#" 也符合 "a"
+			for(int g = n->first_child; g != NO_NODE; g = nodes[g].next_sibling)
+				if(nodes[g].level[0] == '#') hits += run_handlers(&nodes[g], topic, msg);
+		}
+	}
+	return hits;
+}
+
+
+// 註冊 handler
+int mqtt_router_add(const char *filter, mqtt_callback cb, int flags){
+	if(!filter || !*filter || !cb) return -1;
+	if((flags & MQTT_ROUTE_WORKER) && start_worker() != 0) return -1;
+
+	int n = walk(filter, 1);
+	if(n == NO_NODE){
+		fprintf(stderr, "mqtt router: 無法加入主題 %s\n", filter);
+		return -1;
+	}
+
+	router_node *node = &nodes[n];
+	if(node->nhandlers >= MQTT_ROUTER_MAX_HANDLERS) return -1;
+	node->handlers[node->nhandlers].cb = cb;
+	node->handlers[node->nhandlers].flags = flags;
+	node->nhandlers++;
+	return 0;
+}
+
+
+// 移除 handler (節點保留，之後同樣的主題可以再用)
+int mqtt_router_remove(const char *filter, mqtt_callback cb){
+	int n = walk(filter, 0);
+	if(n == NO_NODE) return -1;
+
+	router_node *node = &nodes[n];
+	for(int i = 0; i < node->nhandlers; i++){
+		if(node->handlers[i].cb != cb) continue;
+		memmove(&node->handlers[i], &node->handlers[i + 1],
+			(node->nhandlers - i - 1) * sizeof(route_handler));
+		node->nhandlers--;
+		return 0;
+	}
+	return -1;
+}
+
+
+// 分派一則訊息
+int mqtt_router_dispatch(const char *topic, const char *msg){
+	int hits = 0;
+
+	stats.messages++;
+	if(node_count > 0) hits = match(0, topic, topic, msg, 1);
+	if(hits == 0) stats.unmatched++;
+	return hits;
+}
+
+
+// 取得統計
+void mqtt_router_get_stats(mqtt_router_stats *st){
+	*st = stats;
+}
+
+
+// 停止工作執行緒並清除路由
+void mqtt_router_close(void){
+	if(worker_on){
+		queue_wake(&work_queue);
+		pthread_join(worker, NULL);
+		queue_destroy(&work_queue);
+		worker_on = 0;
+	}
+	node_count = 0;
+}
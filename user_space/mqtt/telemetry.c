@@ -0,0 +1,306 @@
+// 遙測(telemetry) 發布
+// 狀態: 三緩衝信箱 (生產者寫 back，交換到 mid；消費者從 mid 換到 front)，最新值覆蓋舊值
+// 事件: 單一生產者/單一消費者 (SPSC) 環狀佇列，放入後用 eventfd 喚醒事件迴圈
+// 狀態與事件要由同一個執行緒放入 (目前是事件迴圈裡的控制邏輯)
+// 放入事件時，同主題還沒送出的狀態比事件舊，直接作廢 (否則會在事件之後送出，調度中心最後看到舊狀態)
+// 生產者 (控制邏輯) 不上鎖也不碰網路，mqtt_publish 只在事件迴圈裡呼叫
+// 信箱裡放的是 telemetry_record，發布時才依主題協商好的編碼 (JSON/二進位) 編碼
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <stdatomic.h>
+#include <time.h>		// clock_gettime
+#include <sys/eventfd.h>
+#include "telemetry.h"
+#include "mqtt_config.h"	// mqtt_publish
+#include "reactor.h"		// 事件迴圈
+
+#define MID_DIRTY	0x4	// mid 有消費者還沒取走的新狀態
+#define MID_INDEX	0x3
+#define EVENT_MASK	(TELEMETRY_EVENT_SLOTS - 1)
+#define ENCODED_MAX	TELEMETRY_MSG_MAX	// 編碼後最大長度
+
+
+// 一則訊息
+typedef struct {
+	const char *topic;
+	telemetry_record rec;
+} telemetry_msg;
+
+// 主題的編碼方式
+typedef struct {
+	const char *topic;
+	int encoding;
+} topic_encoding;
+
+
+// 狀態信箱 (三緩衝)
+static telemetry_msg status_buf[3];
+static atomic_uint status_mid = 2;		// 中間格索引 | MID_DIRTY
+static unsigned int status_back = 0;		// 生產者正在寫的格
+static unsigned int status_front = 1;		// 消費者正在讀的格
+static telemetry_record posted;			// 生產者上一次放入的狀態 (去重)
+static const char *posted_topic = NULL;
+static uint8_t published[ENCODED_MAX];		// 消費者上一次發布的狀態編碼結果 (去重)
+static int published_len = 0;
+static const char *published_topic = NULL;
+static uint16_t seq = 0;			// 二進位封包序號
+
+static topic_encoding encodings[TELEMETRY_MAX_TOPICS];	// 各主題的編碼 (沒設定 = JSON)
+static int encoding_count = 0;
+
+// 事件佇列 (SPSC)
+static telemetry_msg events[TELEMETRY_EVENT_SLOTS];
+static _Alignas(64) atomic_uint event_head = 0;	// 消費者讀取位置
+static _Alignas(64) atomic_uint event_tail = 0;	// 生產者寫入位置
+
+static int wake_fd = -1;			// 有新事件時喚醒事件迴圈
+static int publish_timer = -1;			// 狀態發布計時器
+
+// 統計 (生產者與消費者各自累加)
+static atomic_ulong status_posted, status_deduped, status_coalesced, events_dropped;
+static unsigned long status_published, events_sent, publish_errors;
+
+
+// 單調時鐘 (ms)
+static uint32_t now_ms(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint32_t)(ts.tv_sec * 1000ULL + ts.tv_nsec / 1000000);
+}
+
+
+// 依主題的編碼方式編碼  回傳=> 長度 -1失敗
+static int encode(const telemetry_msg *m, uint8_t *out){
+	if(telemetry_get_encoding(m->topic) == TELEMETRY_ENC_BINARY)
+		return telemetry_encode_binary(&m->rec, seq, now_ms(), out, ENCODED_MAX);
+	return telemetry_encode_json(&m->rec, (char *)out, ENCODED_MAX);
+}
+
+
+// 發布一則  critical: 離線時由 mqtt client 存起來，重連後補送
+// 回傳=> 0交出去 -1丟棄
+static int publish(const char *topic, const uint8_t *data, int len, int critical){
+	if(mqtt_publish_buf(topic, data, len, critical ? MQTT_PUB_CRITICAL : 0) != 0){
+		publish_errors++;
+		return -1;
+	}
+	seq++;		// 序號只算真的交出去的，接收端看到跳號 = 遺失
+	return 0;
+}
+
+
+// 取出並發布最新狀態 (和上一次發布相同就略過)
+static void publish_status(void){
+
+	// 1.沒有新狀態
+	if(!(atomic_load_explicit(&status_mid, memory_order_acquire) & MID_DIRTY)) return;
+
+	// 2.把 front 換進去，拿回最新那格
+	unsigned int old = atomic_exchange_explicit(&status_mid, status_front, memory_order_acq_rel);
+	status_front = old & MID_INDEX;
+	const telemetry_msg *m = &status_buf[status_front];
+	uint8_t out[ENCODED_MAX];
+	int len = encode(m, out);
+	if(len < 0) return;
+
+	// 3.編碼後和已發布的相同 (週期內來回變化，或 JSON 不含的欄位變了)
+	//   二進位的序號/時間每次不同，只比內容欄位
+	int cmp_len = (len == TELEMETRY_BIN_SIZE && out[0] == TELEMETRY_BIN_MAGIC) ? TELEMETRY_BIN_CONTENT : len;
+	if(m->topic == published_topic && len == published_len && memcmp(out, published, cmp_len) == 0){
+		atomic_fetch_add_explicit(&status_deduped, 1, memory_order_relaxed);
+		return;
+	}
+
+	// 4.丟棄的不算已發布 (下一次同樣的狀態要再送)
+	if(publish(m->topic, out, len, 0) != 0) return;
+	published_topic = m->topic;
+	memcpy(published, out, len);
+	published_len = len;
+	status_published++;
+}
+
+
+// 發布佇列裡所有事件
+static void publish_events(void){
+	unsigned int head = atomic_load_explicit(&event_head, memory_order_relaxed);
+	unsigned int tail = atomic_load_explicit(&event_tail, memory_order_acquire);
+
+	while(head != tail){
+		const telemetry_msg *m = &events[head & EVENT_MASK];
+		uint8_t out[ENCODED_MAX];
+		int len = encode(m, out);
+		if(len > 0 && publish(m->topic, out, len, 1) == 0)
+			events_sent++;
+		if(m->topic == published_topic) published_topic = NULL;	// 事件之後同樣的狀態要再送
+		head++;
+		atomic_store_explicit(&event_head, head, memory_order_release);
+	}
+}
+
+
+// 計時器: 週期發布狀態
+static void on_publish_timer(int fd, uint32_t events, void *arg){
+	publish_status();
+}
+
+
+// eventfd: 有新事件 (事件優先，之後順便送出待送的狀態)
+// 這裡的狀態一定是事件之後放入的 (之前的在 telemetry_event 已作廢)，順序正確
+static void on_wake(int fd, uint32_t events, void *arg){
+	uint64_t cnt;
+
+	if(read(fd, &cnt, sizeof(cnt)) < 0) perror("telemetry wake read failed");
+	publish_events();
+	publish_status();
+}
+
+
+// 初始化
+int telemetry_init(unsigned int period_ms){
+
+	// 1.喚醒用 eventfd
+	wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if(wake_fd < 0){
+		perror("telemetry eventfd failed");
+		return -1;
+	}
+	if(reactor_add(wake_fd, EPOLLIN, on_wake, NULL) != 0){
+		close(wake_fd);
+		wake_fd = -1;
+		return -1;
+	}
+
+	// 2.狀態發布計時器
+	publish_timer = reactor_timer_add(on_publish_timer, NULL);
+	if(publish_timer < 0){
+		telemetry_close();
+		return -1;
+	}
+	return telemetry_set_period(period_ms);
+}
+
+
+// 調整狀態發布週期
+int telemetry_set_period(unsigned int period_ms){
+	if(publish_timer < 0) return -1;
+	if(period_ms == 0) period_ms = TELEMETRY_PERIOD_MS;
+	return reactor_timer_set(publish_timer, period_ms, period_ms);
+}
+
+
+// 設定主題的編碼方式
+int telemetry_set_encoding(const char *topic, int encoding){
+	int i;
+
+	for(i = 0; i < encoding_count; i++)
+		if(strcmp(encodings[i].topic, topic) == 0) break;
+	if(i == encoding_count){
+		if(encoding_count == TELEMETRY_MAX_TOPICS) return -1;
+		encodings[encoding_count++].topic = topic;
+	}
+	encodings[i].encoding = encoding;
+	published_topic = NULL;		// 編碼換了，下一筆狀態一定要送
+	return 0;
+}
+
+
+// 取得主題的編碼方式
+int telemetry_get_encoding(const char *topic){
+	for(int i = 0; i < encoding_count; i++)
+		if(encodings[i].topic == topic || strcmp(encodings[i].topic, topic) == 0)
+			return encodings[i].encoding;
+	return TELEMETRY_ENC_JSON;
+}
+
+
+// 放入狀態
+int telemetry_status(const char *topic, const telemetry_record *rec){
+
+	// 1.和上一筆相同: 不用再送
+	if(topic == posted_topic && telemetry_record_equal(rec, &posted)){
+		atomic_fetch_add_explicit(&status_deduped, 1, memory_order_relaxed);
+		return 0;
+	}
+	posted_topic = topic;
+	posted = *rec;
+
+	// 2.寫進 back，和 mid 交換 (消費者還沒取走的舊值就被覆蓋)
+	telemetry_msg *m = &status_buf[status_back];
+	m->topic = topic;
+	m->rec = *rec;
+
+	unsigned int old = atomic_exchange_explicit(&status_mid, status_back | MID_DIRTY, memory_order_acq_rel);
+	if(old & MID_DIRTY) atomic_fetch_add_explicit(&status_coalesced, 1, memory_order_relaxed);
+	status_back = old & MID_INDEX;
+
+	atomic_fetch_add_explicit(&status_posted, 1, memory_order_relaxed);
+	return 1;
+}
+
+
+// 放入事件
+int telemetry_event(const char *topic, const telemetry_record *rec){
+	uint64_t one = 1;
+
+	unsigned int tail = atomic_load_explicit(&event_tail, memory_order_relaxed);
+	unsigned int head = atomic_load_explicit(&event_head, memory_order_acquire);
+
+	// 1.佇列滿
+	if(tail - head >= TELEMETRY_EVENT_SLOTS){
+		atomic_fetch_add_explicit(&events_dropped, 1, memory_order_relaxed);
+		return -1;
+	}
+
+	// 2.同主題還沒取走的狀態比這個事件舊: 作廢 (要在事件放入前清掉，消費者看到事件時一定也看到作廢)
+	//   消費者已經取走的狀態會在這個事件之前發布，順序正確
+	if(topic == posted_topic){
+		if(atomic_fetch_and_explicit(&status_mid, ~MID_DIRTY, memory_order_acq_rel) & MID_DIRTY)
+			atomic_fetch_add_explicit(&status_coalesced, 1, memory_order_relaxed);
+		posted_topic = NULL;	// 事件之後同樣的狀態要再放入
+	}
+
+	// 3.寫入並發布
+	telemetry_msg *m = &events[tail & EVENT_MASK];
+	m->topic = topic;
+	m->rec = *rec;
+	atomic_store_explicit(&event_tail, tail + 1, memory_order_release);
+
+	// 4.喚醒事件迴圈
+	if(wake_fd >= 0 && write(wake_fd, &one, sizeof(one)) < 0) perror("telemetry wake failed");
+	return 0;
+}
+
+
+// 立即發布所有待送
+void telemetry_flush(void){
+	publish_events();
+	publish_status();
+}
+
+
+// 取得統計
+void telemetry_get_stats(telemetry_stats *st){
+	st->status_posted = atomic_load(&status_posted);
+	st->status_deduped = atomic_load(&status_deduped);
+	st->status_coalesced = atomic_load(&status_coalesced);
+	st->status_published = status_published;
+	st->events_sent = events_sent;
+	st->events_dropped = atomic_load(&events_dropped);
+	st->publish_errors = publish_errors;
+}
+
+
+// 關閉
+void telemetry_close(void){
+	if(publish_timer >= 0) reactor_timer_del(publish_timer);
+	publish_timer = -1;
+
+	if(wake_fd >= 0){
+		reactor_del(wake_fd);
+		close(wake_fd);
+	}
+	wake_fd = -1;
+}
@@ -0,0 +1,137 @@
+// 遙測編碼 (JSON / 固定格式二進位)
+// 不做 I/O、不配置記憶體，車上程式 (telemetry.c) 與測試工具共用
+
+#include <stdio.h>
+#include "telemetry_codec.h"
+
+
+// little endian 寫入/讀出
+static void put16(uint8_t *p, uint16_t v){
+	p[0] = v & 0xFF;
+	p[1] = v >> 8;
+}
+
+static void put32(uint8_t *p, uint32_t v){
+	put16(p, v & 0xFFFF);
+	put16(p + 2, v >> 16);
+}
+
+static uint16_t get16(const uint8_t *p){
+	return p[0] | (uint16_t)p[1] << 8;
+}
+
+static uint32_t get32(const uint8_t *p){
+	return get16(p) | (uint32_t)get16(p + 2) << 16;
+}
+
+
+// 兩筆內容是否相同 (逐欄比較，不受結構填充影響)
+int telemetry_record_equal(const telemetry_record *a, const telemetry_record *b){
+	return a->kind == b->kind && a->status == b->status && a->delivery == b->delivery &&
+	       a->action == b->action && a->node == b->node &&
+	       a->speed_left == b->speed_left && a->speed_right == b->speed_right &&
+	       a->line_code == b->line_code && a->front_cm == b->front_cm;
+}
+
+
+// 編成 JSON (格式和原本 logic.c 送出的字串相同)
+int telemetry_encode_json(const telemetry_record *rec, char *out, size_t cap){
+	int n;
+
+	// 1.節點進度
+	if(rec->kind == TELEMETRY_KIND_NODE)
+		n = snprintf(out, cap, "{\"node\":%u,\"doing\":\"%s\"}",
+			     rec->node, telemetry_action_name(rec->action));
+
+	// 2.狀態 (有送貨狀態才加 delivery_status)
+	else if(rec->delivery != CAR_DELIVERY_NONE)
+		n = snprintf(out, cap, "{\"status\":\"%s\",\"delivery_status\":\"%s\"}",
+			     telemetry_status_name(rec->status), telemetry_delivery_name(rec->delivery));
+	else
+		n = snprintf(out, cap, "{\"status\":\"%s\"}", telemetry_status_name(rec->status));
+
+	if(n < 0 || (size_t)n >= cap) return -1;
+	return n;
+}
+
+
+// 編成二進位
+int telemetry_encode_binary(const telemetry_record *rec, uint16_t seq, uint32_t ts_ms,
+			    uint8_t *out, size_t cap){
+
+	if(cap < TELEMETRY_BIN_SIZE) return -1;
+
+	out[0] = TELEMETRY_BIN_MAGIC;
+	out[1] = TELEMETRY_BIN_VERSION;
+	out[2] = rec->kind;
+	out[3] = rec->status;
+	out[4] = rec->delivery;
+	out[5] = rec->action;
+	put16(&out[6], rec->node);
+	out[8] = (uint8_t)rec->speed_left;
+	out[9] = (uint8_t)rec->speed_right;
+	out[10] = rec->line_code;
+	out[11] = 0;
+	put16(&out[12], rec->front_cm);
+	put16(&out[14], seq);
+	put32(&out[16], ts_ms);
+	return TELEMETRY_BIN_SIZE;
+}
+
+
+// 解碼二進位 (比 v1 長的新版本只讀前面認得的欄位)
+int telemetry_decode_binary(const void *data, size_t len, telemetry_record *rec,
+			    uint16_t *seq, uint32_t *ts_ms){
+	const uint8_t *p = data;
+
+	if(len < TELEMETRY_BIN_SIZE || p[0] != TELEMETRY_BIN_MAGIC || p[1] < 1) return -1;
+
+	rec->kind = p[2];
+	rec->status = p[3];
+	rec->delivery = p[4];
+	rec->action = p[5];
+	rec->node = get16(&p[6]);
+	rec->speed_left = (int8_t)p[8];
+	rec->speed_right = (int8_t)p[9];
+	rec->line_code = p[10];
+	rec->front_cm = get16(&p[12]);
+	if(seq) *seq = get16(&p[14]);
+	if(ts_ms) *ts_ms = get32(&p[16]);
+	return p[1];
+}
+
+
+// 狀態代號轉文字
+const char *telemetry_status_name(int status){
+	switch(status){
+		case CAR_STATUS_MOVING:		return "moving";
+		case CAR_STATUS_OFF_TRACK:	return "off_track";
+		case CAR_STATUS_STUCK:		return "stuck";
+		case CAR_STATUS_RESTART:	return "restart";
+		case CAR_STATUS_ARRIVED:	return "arrived";
+		default:			return "none";
+	}
+}
+
+
+// 送貨狀態代號轉文字
+const char *telemetry_delivery_name(int delivery){
+	switch(delivery){
+		case CAR_DELIVERY_DELIVERING:	return "delivering";
+		case CAR_DELIVERY_RECEIVING:	return "receiving";
+		case CAR_DELIVERY_COMPLETED:	return "completed";
+		default:			return "none";
+	}
+}
+
+
+// 節點動作代號轉文字 (和 route.c action_to_string 相同，測試工具不用連結 route.c)
+const char *telemetry_action_name(int action){
+	switch(action){
+		case 1:		return "STRAIGHT";
+		case 2:		return "RIGHT";
+		case 3:		return "LEFT";
+		case 4:		return "STOP";
+		default:	return "UNKNOWN";
+	}
+}
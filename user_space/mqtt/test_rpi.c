@@ -4,7 +4,8 @@
 #include <string.h>
 #include <unistd.h>
 #include "mqtt_config.h"
-#include "../route/route.h"
+#include "route.h"
+#include "car_cmd.h"
 
 // 全局路線指標
 Route *current_route = NULL;  
@@ -14,22 +15,17 @@ void car_message_cb(const char *topic, const char *msg){
 	printf("Received on %s: %s\n", topic, msg);
 
 	// 解析 Json 格式中 route 陣列，將數字存到raw_steps
-	int raw_steps[15];	// 最多 15 步	
-	int count = 0;
-
-	// 找到 "route":[ 後開始解析
-	const char *p = strstr(msg, "\"route\":[");
-	if(p){
-		p += 9;		// 跳過 "route":[
-		while(*p && *p != ']' && count < 10){
-			if(*p >= '1' && *p <= '4'){
-				// 字元轉數字
-				raw_steps[count++] = *p - '0';
-			}
-			p++;
-		}
+	int raw_steps[64];	// 最多 64 步
+	car_cmd cmd;
+
+	car_cmd_init(&cmd, raw_steps, 64);
+	int ret = car_cmd_parse(msg, strlen(msg), &cmd);
+	if(ret != CAR_CMD_OK){
+		printf("Parse failed: %s\n", car_cmd_strerror(ret));
+		return;
 	}
 
+	int count = cmd.route_len;
 	if(count == 0){
 		printf("No valid steps found.\n");
 		return; 
@@ -0,0 +1,66 @@
+// 測試 車子遙測 (JSON / 二進位)
+// 訂閱車子主題，把收到的遙測解碼後印出；加參數 binary 會先要求車子改用二進位
+// 直接用 mosquitto (mqtt_client 的 callback 只給字串，二進位會被 '\0' 截斷)
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <mosquitto.h>
+#include "mqtt_config.h"
+#include "telemetry_codec.h"
+
+
+// 收到訊息
+static void on_message(struct mosquitto *mosq, void *obj, const struct mosquitto_message *m){
+	telemetry_record rec;
+	uint16_t seq;
+	uint32_t ts;
+	static int last_seq = -1;
+
+	// 1.二進位遙測
+	int ver = telemetry_decode_binary(m->payload, m->payloadlen, &rec, &seq, &ts);
+	if(ver > 0){
+		char json[128];
+		telemetry_encode_json(&rec, json, sizeof(json));
+
+		printf("[BIN v%d] seq %u t=%u ms %s  speed %d/%d line %d%d%d front %u cm (%d bytes)\n",
+		       ver, seq, ts, json, rec.speed_left, rec.speed_right,
+		       (rec.line_code >> 2) & 1, (rec.line_code >> 1) & 1, rec.line_code & 1,
+		       rec.front_cm, m->payloadlen);
+		if(last_seq >= 0 && seq != (uint16_t)(last_seq + 1))
+			printf("  !! 跳號: 遺失 %u 筆\n", (uint16_t)(seq - last_seq - 1));
+		last_seq = seq;
+		return;
+	}
+
+	// 2.JSON (或指令)
+	printf("[JSON] %.*s (%d bytes)\n", m->payloadlen, (const char *)m->payload, m->payloadlen);
+}
+
+
+int main(int argc, char *argv[]){
+
+	// 1.連線
+	mosquitto_lib_init();
+	struct mosquitto *mosq = mosquitto_new(NULL, true, NULL);
+	if(!mosq || mosquitto_connect(mosq, MQTT_BROKER_IP, MQTT_BROKER_PORT, 60) != MOSQ_ERR_SUCCESS){
+		printf("MQTT connect failed\n");
+		return -1;
+	}
+	mosquitto_message_callback_set(mosq, on_message);
+	mosquitto_subscribe(mosq, NULL, MQTT_TOPIC_CAR, 0);
+
+	// 2.協商編碼
+	const char *enc = (argc > 1 && strcmp(argv[1], "binary") == 0) ? "binary" : "json";
+	char cmd[64];
+	snprintf(cmd, sizeof(cmd), "{\"encoding\":\"%s\"}", enc);
+	mosquitto_publish(mosq, NULL, MQTT_TOPIC_CAR, strlen(cmd), cmd, 1, false);
+	printf("要求遙測編碼: %s，Ctrl+C 結束\n", enc);
+
+	// 3.接收
+	mosquitto_loop_forever(mosq, -1, 1);
+
+	mosquitto_destroy(mosq);
+	mosquitto_lib_cleanup();
+	return 0;
+}
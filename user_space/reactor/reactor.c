@@ -0,0 +1,237 @@
+// 事件迴圈(reactor)  單一執行緒 epoll 多工
+// 感測器、UART、MQTT socket、計時器(timerfd) 都註冊在同一個 epoll，
+// 有事件才呼叫 callback，callback 內不可以阻塞 (sleep 改用 reactor_timer_*)
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>		// close, read
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include "reactor.h"
+
+// 一次 epoll_wait 最多取回的事件數
+#define REACTOR_MAX_EVENTS 16
+
+
+// 一個註冊的 fd
+typedef struct {
+	int fd;			// -1 = 未使用
+	int is_timer;		// 1 = 由 reactor 建立的 timerfd (移除時一併 close)
+	reactor_cb cb;
+	void *arg;
+} reactor_handler;
+
+
+// 全域變數
+static int epfd = -1;					// epoll fd
+static reactor_handler handlers[REACTOR_MAX_HANDLERS];	// 已註冊的 fd
+static volatile int running = 0;			// 1 = reactor_run 執行中
+static reactor_prepare_cb prepare_cb = NULL;		// 每輪 epoll_wait 前呼叫
+static void *prepare_arg = NULL;
+
+
+// 找 fd 對應的 handler
+static reactor_handler *find_handler(int fd){
+	for(int i = 0; i < REACTOR_MAX_HANDLERS; i++){
+		if(handlers[i].fd == fd) return &handlers[i];
+	}
+	return NULL;
+}
+
+
+// 初始化
+int reactor_init(void){
+
+	// 已經初始化
+	if(epfd >= 0) return 0;
+
+	for(int i = 0; i < REACTOR_MAX_HANDLERS; i++) handlers[i].fd = -1;
+
+	epfd = epoll_create1(EPOLL_CLOEXEC);
+	if(epfd < 0){
+		perror("reactor epoll_create1 failed");
+		return -1;
+	}
+	return 0;
+}
+
+
+// 註冊 fd
+int reactor_add(int fd, uint32_t events, reactor_cb cb, void *arg){
+
+	if(epfd < 0 || fd < 0 || !cb) return -1;
+
+	// 1.找空位
+	reactor_handler *h = find_handler(-1);
+	if(!h){
+		fprintf(stderr, "reactor_add: handler 已滿 (fd=%d)\n", fd);
+		return -1;
+	}
+
+	// 2.加入 epoll (data 存 handler 指標，事件來時不用再查表)
+	struct epoll_event ev = { .events = events, .data.ptr = h };
+	if(epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) < 0){
+		perror("reactor epoll_ctl add failed");
+		return -1;
+	}
+
+	h->fd = fd;
+	h->is_timer = 0;
+	h->cb = cb;
+	h->arg = arg;
+	return 0;
+}
+
+
+// 修改等待的事件
+int reactor_mod(int fd, uint32_t events){
+
+	reactor_handler *h = find_handler(fd);
+	if(epfd < 0 || fd < 0 || !h) return -1;
+
+	struct epoll_event ev = { .events = events, .data.ptr = h };
+	if(epoll_ctl(epfd, EPOLL_CTL_MOD, fd, &ev) < 0){
+		perror("reactor epoll_ctl mod failed");
+		return -1;
+	}
+	return 0;
+}
+
+
+// 移除 fd
+// 同一輪已取回的事件可能還指向這個 handler，清掉 cb 讓 dispatch 略過
+int reactor_del(int fd){
+
+	reactor_handler *h = find_handler(fd);
+	if(epfd < 0 || fd < 0 || !h) return -1;
+
+	epoll_ctl(epfd, EPOLL_CTL_DEL, fd, NULL);
+	h->fd = -1;
+	h->cb = NULL;
+	h->arg = NULL;
+	return 0;
+}
+
+
+// 計時器到期: 讀掉到期次數再呼叫使用者 callback
+static void timer_dispatch(reactor_handler *h, uint32_t events){
+	uint64_t expirations;
+	int fd = h->fd;
+
+	if(read(fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+		return;		// 已被重設 (EAGAIN)，這次不算到期
+	h->cb(fd, events, h->arg);
+}
+
+
+// 建立計時器
+int reactor_timer_add(reactor_cb cb, void *arg){
+
+	// 1.建立 timerfd (單調時鐘，不受系統校時影響)
+	int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if(tfd < 0){
+		perror("reactor timerfd_create failed");
+		return -1;
+	}
+
+	// 2.註冊到 epoll
+	if(reactor_add(tfd, EPOLLIN, cb, arg) < 0){
+		close(tfd);
+		return -1;
+	}
+	find_handler(tfd)->is_timer = 1;
+	return tfd;
+}
+
+
+// 設定計時器 (first_ms = 0 停止)
+int reactor_timer_set(int tfd, unsigned int first_ms, unsigned int period_ms){
+
+	struct itimerspec its;
+	memset(&its, 0, sizeof(its));
+	its.it_value.tv_sec = first_ms / 1000;
+	its.it_value.tv_nsec = (long)(first_ms % 1000) * 1000000L;
+	its.it_interval.tv_sec = period_ms / 1000;
+	its.it_interval.tv_nsec = (long)(period_ms % 1000) * 1000000L;
+
+	if(timerfd_settime(tfd, 0, &its, NULL) < 0){
+		perror("reactor timerfd_settime failed");
+		return -1;
+	}
+	return 0;
+}
+
+
+// 移除計時器
+int reactor_timer_del(int tfd){
+	if(reactor_del(tfd) < 0) return -1;
+	close(tfd);
+	return 0;
+}
+
+
+// 設定每輪 epoll_wait 前的 callback
+void reactor_set_prepare(reactor_prepare_cb cb, void *arg){
+	prepare_cb = cb;
+	prepare_arg = arg;
+}
+
+
+// 事件迴圈
+int reactor_run(void){
+
+	struct epoll_event events[REACTOR_MAX_EVENTS];
+
+	if(epfd < 0) return -1;
+	running = 1;
+
+	while(running){
+
+		// 1.讓模組更新要等的事件 (例如 MQTT 有資料待送才等 EPOLLOUT)
+		if(prepare_cb) prepare_cb(prepare_arg);
+
+		// 2.等待事件 (沒有逾時，計時器也是 fd)
+		int n = epoll_wait(epfd, events, REACTOR_MAX_EVENTS, -1);
+		if(n < 0){
+			if(errno == EINTR) continue;
+			perror("reactor epoll_wait failed");
+			running = 0;
+			return -1;
+		}
+
+		// 3.依 epoll 回傳順序逐一處理
+		for(int i = 0; i < n && running; i++){
+			reactor_handler *h = events[i].data.ptr;
+
+			// 本輪前面的 callback 已經移除它
+			if(!h->cb || h->fd < 0) continue;
+
+			if(h->is_timer) timer_dispatch(h, events[i].events);
+			else h->cb(h->fd, events[i].events, h->arg);
+		}
+	}
+	return 0;
+}
+
+
+// 停止事件迴圈
+void reactor_stop(void){
+	running = 0;
+}
+
+
+// 釋放資源
+void reactor_close(void){
+
+	if(epfd < 0) return;
+
+	for(int i = 0; i < REACTOR_MAX_HANDLERS; i++){
+		if(handlers[i].fd >= 0 && handlers[i].is_timer) close(handlers[i].fd);
+		handlers[i].fd = -1;
+		handlers[i].cb = NULL;
+	}
+	close(epfd);
+	epfd = -1;
+	prepare_cb = NULL;
+}
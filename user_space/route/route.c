@@ -18,6 +18,14 @@ Route* create_route(int *raw_data, int len){
 		return NULL;
 	}
 
+	// 分配節點類型陣列 (0 = 一般節點，由呼叫者設定最後一步的送貨/接貨)
+	r -> node_type = (int*)calloc(len, sizeof(int));
+	if(!r->node_type){
+		free(r->steps);
+		free(r);
+		return NULL;
+	}
+
 	// 將數字轉 Action enum
 	for(int i = 0; i < len; i++){
 		switch(raw_data[i]) {
@@ -60,6 +68,7 @@ void reset_route(Route *r){
 void free_route(Route *r){
 	if(!r) return;
 	if(r->steps) free(r->steps);
+	if(r->node_type) free(r->node_type);
 	free(r);
 }
 
@@ -97,6 +106,7 @@ Route* reverse_route(Route *r){
 	rev->length = r->length;					// 覆蓋路線長度
 	rev->current = 0;						// 當前步驟-從頭開始
 	rev->steps = (Action*)malloc(sizeof(Action) * r->length);	// 分配動作陣列
+	rev->node_type = (int*)calloc(r->length, sizeof(int));		// 回程節點類型 (一般節點)
 	
 	// 倒敘路線 並左右交換	
 	for(int i = 0; i < r->length; i++){
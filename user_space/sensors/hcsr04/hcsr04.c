@@ -14,6 +14,7 @@ hcsr04_close_all();
 #include <stdio.h>
 #include <stdlib.h> // atoi
 #include <string.h>
+#include <errno.h>
 #include <sys/ioctl.h> 
 
 #define HC_SR04_NUM        4
@@ -26,16 +27,45 @@ hcsr04_close_all();
 #define HC_SR04_ECHO_2     7
 #define HC_SR04_TRIG_3     12
 #define HC_SR04_ECHO_3     13
+// 干擾群組: 同群組在同一時槽一起觸發，不同群組錯開
+// 0(前左)/1(前右) 朝向相近必須分開，各自和朝向相反的 2/3 配對
+#define HC_SR04_GROUP_0    0
+#define HC_SR04_GROUP_1    1
+#define HC_SR04_GROUP_2    0
+#define HC_SR04_GROUP_3    1
 // 四顆超聲波的檔案描述符
 static int fd[4] = {-1,-1,-1,-1};
 static const int trig_pins[HC_SR04_NUM] = { HC_SR04_TRIG_0, HC_SR04_TRIG_1, HC_SR04_TRIG_2, HC_SR04_TRIG_3 };
 static const int echo_pins[HC_SR04_NUM] = { HC_SR04_ECHO_0, HC_SR04_ECHO_1, HC_SR04_ECHO_2, HC_SR04_ECHO_3 };
+static const int groups[HC_SR04_NUM] = { HC_SR04_GROUP_0, HC_SR04_GROUP_1, HC_SR04_GROUP_2, HC_SR04_GROUP_3 };
+static unsigned int last_frame_seq = 0;  // hcsr04_read_frame 上次交出的幀序號
+static int zone_fd = -1;                 // 區間通知用的 fd (同一顆另外開啟，poll 只等 POLLPRI)
+static unsigned int last_zone_seq = 0;   // hcsr04_zone_read 上次交出的改變序號
+static unsigned int filter_mask = 0;     // bit i = 第 i 顆已開啟 driver 濾波
 
 typedef struct {
     int distance;
 } ultrasonic_data;
 
-hcsr04_callback distance_cb = NULL;
+hcsr04_callback_t distance_cb = NULL;
+
+// driver 回報 mm，上層 (logic 的 <5cm 判斷、遙測) 用 cm；-1 (無效) 保持 -1
+static int mm_to_cm(int mm) {
+    return mm < 0 ? -1 : mm / 10;
+}
+
+// driver 的一幀轉成上層的資料
+static void frame_to_data(const struct hc_sr04_frame *frame, hcsr04_all_data *data) {
+    // 逾時、未設定或濾波後不可信的感測器為 -1
+    for(int i=0;i<HC_SR04_NUM;i++) {
+        data->ultrasonic[i].distance = mm_to_cm(frame->distance_mm[i]);
+        data->ultrasonic[i].confidence = frame->confidence[i];
+    }
+    data->seq = frame->seq;
+    data->ts_ns = frame->ts_ns;
+    data->brake_mask = frame->brake_mask;
+    data->filter_mask = filter_mask;
+}
 
 // ---------------- 打開四顆超聲波 ----------------
 int hcsr04_open_all(void) {
@@ -43,7 +73,8 @@ int hcsr04_open_all(void) {
     for(int i=0;i<HC_SR04_NUM;i++) {
         // 建立裝置路徑，例如 /dev/ultrasonic0
         snprintf(path,sizeof(path),HC_SR04_DEV_FMT,i);
-        fd[i] = open(path, O_RDWR);
+        // 非阻塞: driver 只回傳最新完成的量測，還沒有結果時不等待
+        fd[i] = open(path, O_RDWR | O_NONBLOCK);
         if(fd[i]<0) {
             perror("hcsr04_open_all failed");
             for(int j=0;j<i;j++){
@@ -53,34 +84,155 @@ int hcsr04_open_all(void) {
             return -1;
         }
         ioctl(fd[i], HC_SR04_SET_TRIGGER, trig_pins[i]);
+        ioctl(fd[i], HC_SR04_SET_GROUP, groups[i]);
         ioctl(fd[i], HC_SR04_SET_ECHO, echo_pins[i]);
     }
+
+    // 先取一次幀，讓 driver 的 poll 改成「有新幀才可讀」(還沒有幀會回 EAGAIN，忽略)
+    struct hc_sr04_frame frame;
+    ioctl(fd[0], HC_SR04_GET_FRAME, &frame);
+    last_frame_seq = 0;
+    filter_mask = 0;
     return 0;
 }
 
 
 // ---------------- 讀取四顆超聲波距離 ----------------
+// driver 依群組在背景觸發，所有群組都量過一次就是一幀；這裡等待下一幀 (一次 ioctl)
 int hcsr04_read_all(hcsr04_all_data *data) {
-    char buf[16];
-    ssize_t len;
+    struct hc_sr04_frame frame;
 
-    for(int i=0;i<HC_SR04_NUM;i++) {
-        data->ultrasonic[i].distance = -1;
-        if(fd[i]<0) continue;
-        memset(buf, 0, sizeof(buf));
-        len = read(fd[i], buf, sizeof(buf)-1);
-        if(len > 0) {
-            buf[len] = '\0';
-            data->ultrasonic[i].distance = atoi(buf);
-        }
-        usleep(60000); // 測完一顆再delay
+    if(fd[0] < 0) return -1;
+
+    if(ioctl(fd[0], HC_SR04_WAIT_FRAME, &frame) < 0) {
+        if(errno != ETIMEDOUT && errno != EINTR)
+            perror("hcsr04_read_all failed");
+        return -1;
     }
+
+    frame_to_data(&frame, data);
     return 0;
 }
 
 
+// ---------------- 事件迴圈用 ----------------
+int hcsr04_fd(void) {
+    return fd[0];
+}
+
+// 取最新一幀但不等待 (fd 可讀後呼叫)
+int hcsr04_read_frame(hcsr04_all_data *data) {
+    struct hc_sr04_frame frame;
+
+    if(fd[0] < 0) return -1;
+
+    if(ioctl(fd[0], HC_SR04_GET_FRAME, &frame) < 0) {
+        if(errno == EAGAIN) return 0;   // 還沒有任何一幀
+        perror("hcsr04_read_frame failed");
+        return -1;
+    }
+    if(frame.seq == last_frame_seq) return 0;
+    last_frame_seq = frame.seq;
+
+    frame_to_data(&frame, data);
+    return 1;
+}
+
+
+// ---------------- kernel 緊急煞車 ----------------
+// 判斷和 user space 相同 (cm 換成 mm: 小於 N cm = 小於 N*10 mm)
+int hcsr04_set_brake(int idx, int threshold_cm, int debounce) {
+    struct hc_sr04_brake brake;
+
+    if(idx < 0 || idx >= HC_SR04_NUM || fd[idx] < 0) return -1;
+
+    brake.threshold_mm = threshold_cm > 0 ? threshold_cm * 10 : 0;
+    brake.debounce = debounce;
+    if(ioctl(fd[idx], HC_SR04_SET_BRAKE, &brake) < 0) {
+        perror("hcsr04_set_brake failed");
+        return -1;
+    }
+    return 0;
+}
+
+
+// ---------------- driver 多次取樣濾波 ----------------
+int hcsr04_set_filter(int idx, int samples, int outlier_cm, int min_valid, int timeout_us) {
+    struct hc_sr04_filter filter;
+
+    if(idx < 0 || idx >= HC_SR04_NUM || fd[idx] < 0) return -1;
+
+    filter.samples = samples;
+    filter.outlier_mm = outlier_cm > 0 ? outlier_cm * 10 : 0;
+    filter.min_valid = min_valid;
+    filter.timeout_us = timeout_us > 0 ? timeout_us : 0;
+    if(ioctl(fd[idx], HC_SR04_SET_FILTER, &filter) < 0) {
+        filter_mask &= ~(1u << idx);
+        return -1;
+    }
+    if(samples > 1) filter_mask |= 1u << idx;
+    else filter_mask &= ~(1u << idx);
+    return 0;
+}
+
+
+// ---------------- 區間通知 ----------------
+int hcsr04_zone_open(int idx, int caution_cm, int danger_cm, int hysteresis_cm) {
+    struct hc_sr04_zones zones;
+    char path[32];
+
+    if(idx < 0 || idx >= HC_SR04_NUM || fd[idx] < 0 || zone_fd >= 0) return -1;
+
+    // 腳位已由 hcsr04_open_all 設定，這個 fd 只用來等區間改變
+    snprintf(path, sizeof(path), HC_SR04_DEV_FMT, idx);
+    zone_fd = open(path, O_RDWR | O_NONBLOCK);
+    if(zone_fd < 0) {
+        perror("hcsr04_zone_open failed");
+        return -1;
+    }
+
+    zones.caution_mm = caution_cm * 10;
+    zones.danger_mm = danger_cm * 10;
+    zones.hysteresis_mm = hysteresis_cm * 10;
+    if(ioctl(zone_fd, HC_SR04_SET_ZONES, &zones) < 0) {
+        close(zone_fd);
+        zone_fd = -1;
+        return -1;
+    }
+    last_zone_seq = 0;
+    return 0;
+}
+
+int hcsr04_zone_fd(void) {
+    return zone_fd;
+}
+
+// 取目前區間 (POLLPRI 之後呼叫，取過之後 driver 清除 POLLPRI)
+int hcsr04_zone_read(hcsr04_zone_event *ev) {
+    struct hc_sr04_zone_event z;
+
+    if(zone_fd < 0) return -1;
+
+    if(ioctl(zone_fd, HC_SR04_GET_ZONE, &z) < 0) {
+        perror("hcsr04_zone_read failed");
+        return -1;
+    }
+    if(z.seq == last_zone_seq) return 0;
+    last_zone_seq = z.seq;
+
+    ev->zone = z.zone;
+    ev->distance = mm_to_cm(z.distance_mm);
+    ev->brake = z.brake;
+    ev->seq = z.seq;
+    ev->ts_ns = z.ts_ns;
+    return 1;
+}
+
+
 // ---------------- 關閉四顆超聲波 ----------------
 int hcsr04_close_all(void) {
+    if(zone_fd >= 0) close(zone_fd);
+    zone_fd = -1;
     for(int i=0;i<HC_SR04_NUM;i++){
         if(fd[i]>=0) close(fd[i]);
         fd[i]=-1;
@@ -9,7 +9,7 @@
 extern int stop_flag;
 
 // callback СA main.c ]w
-extern hcsr04_callback distance_cb;
+extern hcsr04_callback_t distance_cb;
 
 
 // ---------------- WniŪ ----------------
@@ -17,18 +17,17 @@ void* hcsr04_thread_func(void* arg) {
     hcsr04_all_data data;
 
     while(!stop_flag) {
-        // 1. Ū|Z
+        // 1. ݤU@V|Z
         if(hcsr04_read_all(&data)==0){
             // 2. Is callbackANƶǵ޿h
             if(distance_cb!=NULL){
                 distance_cb(&data); // ^ǥ|Z
             }
         } else {
+            // 3. ŪѵyAաAקK (`ɥ driver XVtױWv)
             fprintf(stderr,"hcsr04 read_all failed\n");
+            usleep(100000);
         }
-
-        // 3. ŪWvAǫC 100ms Ū@
-        usleep(100000);
     }
 
     return NULL;
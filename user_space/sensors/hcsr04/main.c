@@ -4,7 +4,7 @@
 #include "hcsr04.h"
 
 int stop_flag = 0;
-hcsr04_callback distance_cb = NULL;
+hcsr04_callback_t distance_cb = NULL;
 
 void my_distance_cb(hcsr04_all_data *data) {
     for(int i=0;i<4;i++){
@@ -8,7 +8,10 @@
 #include <termios.h>
 #include <stdio.h>
 #include <pthread.h>
+#include <time.h>
+#include <sys/mman.h>
 #include "motor_gpio.h"
+#include "motor_ctrl.h"
 
 
 #define DEVICE_PATH "/dev/motor0"
@@ -16,6 +19,16 @@
 /* 全域變數 */
 static int motor_fd = -1;
 static struct termios orig_termios;
+static int drive_supported = 1;   // driver 支援 IOCTL_SET_DRIVE (舊 driver 回 EINVAL 後改用分開的指令)
+static int ramp_supported = 1;    // driver 支援 IOCTL_SET_RAMP (舊 driver 回 EINVAL 後改為立即設定)
+static struct motor_shm *shm = NULL;  // mmap 共用頁 (motor_shm_open 成功後 set_drive 不走 ioctl)
+static size_t shm_len = 0;
+
+/* 最後寫到共用頁的命令: driver 非同步處理 (可能被拒絕)，確認前不算進 cache_left/right */
+static struct motor_drive shm_sent;
+static int shm_pending = 0;              // 1 = shm_sent 是最後一個命令 (之後沒有走 ioctl 的命令)
+static unsigned int shm_sent_gen;        // 寫入後的 cmd_gen
+static unsigned int shm_sent_rejected;   // 寫入前的 rejected_count
 
 
 pthread_mutex_t motor_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -39,6 +52,24 @@ static motor_state_t motor_state = {
     .period_ns = 200000  // 20ms = 50Hz
 };
 
+/* driver 目前的輸出 (最後一個成功下出去的命令)，和它相同的命令不再下給 driver
+ * motor_state 是預設速度 (前進/後退用)，這裡才是實際輸出 */
+typedef struct {
+    int known;          // 0 = 不確定 (剛開啟、命令失敗、改了週期)，下一個命令一定送出
+    int speed;          // 0-100，方向為 0 時固定為 0
+    int dir;            // 1 / -1 / 0
+} wheel_cache_t;
+
+static wheel_cache_t cache_left, cache_right;
+static unsigned int cache_accel = 0;     // 最後命令的加速度 (0 = 立即，漸變中的同目標不重下)
+static motor_stats stats;
+
+/* 下 ioctl 並計數 (統計系統呼叫次數) */
+static int motor_ioctl(unsigned long req, void *arg) {
+    stats.syscalls++;
+    return ioctl(motor_fd, req, arg);
+}
+
 /* ===== 終端控制函數 ===== */
 
 /* 設定終端為非緩衝模式 */
@@ -86,11 +117,12 @@ int open_motor_device(void) {
 
 /* 設定PWM週期 */
 int set_pwm_period(unsigned int period_ns) {
-    if (ioctl(motor_fd, IOCTL_SET_PERIOD, &period_ns) < 0) {
+    if (motor_ioctl(IOCTL_SET_PERIOD, &period_ns) < 0) {
         perror("設定PWM週期失敗");
         return -1;
     }
     motor_state.period_ns = period_ns;
+    motor_cache_invalidate();    // 占空比要依新週期重下
     printf("PWM週期設定為: %u ns (%.1f Hz)\n", period_ns, 1000000000.0/period_ns);
     return 0;
 }
@@ -104,142 +136,457 @@ unsigned int speed_to_duty_ns(int speed_percent) {
     return (motor_state.period_ns * speed_percent) / 100;
 }
 
-/* 設定左馬達速度和方向 */
-int set_left_motor(int speed, int direction) {
+/* 限制範圍並正規化 (方向只有 1/-1/0，停止時速度當作 0) */
+static void normalize(int *speed, int *dir) {
+    if (*speed < 0) *speed = 0;
+    if (*speed > 100) *speed = 100;
+    *dir = *dir > 0 ? 1 : (*dir < 0 ? -1 : 0);
+    if (*dir == 0) *speed = 0;
+}
+
+static int wheel_same(const wheel_cache_t *c, int speed, int dir) {
+    return c->known && c->speed == speed && c->dir == dir;
+}
+
+static void wheel_set(wheel_cache_t *c, int known, int speed, int dir) {
+    c->known = known;
+    c->speed = speed;
+    c->dir = dir;
+}
+
+/* 單輪命令: 速度 + 方向  回傳=> 1已送出 0和目前相同(省略) -1失敗
+ * 單輪指令會取消 driver 的漸變，另一輪停在漸變途中，之後當作不確定 */
+static int wheel_cmd(wheel_cache_t *c, wheel_cache_t *other, int speed, int direction,
+                     unsigned long speed_req, unsigned long fwd_req,
+                     unsigned long back_req, unsigned long stop_req, const char *name) {
     unsigned int duty_ns;
-    
-    motor_state.left_speed = speed;
-    motor_state.left_dir = direction;
-    
+    unsigned long dir_req;
+
+    normalize(&speed, &direction);
+    if (wheel_same(c, speed, direction) && cache_accel == 0) {
+        stats.suppressed++;
+        return 0;
+    }
+
     // 設定速度(PWM占空比)
     duty_ns = speed_to_duty_ns(speed);
-    if (ioctl(motor_fd, IOCTL_SET_SPEED_LEFT, &duty_ns) < 0) {
-        perror("設定左馬達速度失敗");
-        return -1;
+    if (motor_ioctl(speed_req, &duty_ns) < 0) {
+        fprintf(stderr, "設定%s速度失敗: %s\n", name, strerror(errno));
+        goto fail;
     }
-    
+
     // 設定方向
-    if (direction > 0) {
-        if (ioctl(motor_fd, IOCTL_LEFT_FORWARD) < 0) {
-            perror("左馬達前進指令失敗");
-            return -1;
-        }
-    } else if (direction < 0) {
-        if (ioctl(motor_fd, IOCTL_LEFT_BACKWARD) < 0) {
-            perror("左馬達後退指令失敗");
-            return -1;
-        }
-    }else{
-        if (ioctl(motor_fd, IOCTL_LEFT_STOP) < 0) {
-        perror("左馬達停止指令失敗");
-        return -1;
-        }
+    dir_req = direction > 0 ? fwd_req : (direction < 0 ? back_req : stop_req);
+    if (motor_ioctl(dir_req, NULL) < 0) {
+        fprintf(stderr, "%s方向指令失敗: %s\n", name, strerror(errno));
+        goto fail;
     }
+
+    wheel_set(c, 1, speed, direction);
+    if (cache_accel) {
+        other->known = 0;
+        cache_accel = 0;
+    }
+    shm_pending = 0;     // 共用頁上的舊命令不再是目前輸出 (另一輪維持原本的快取狀態)
+    stats.issued++;
+    return 1;
+
+fail:
+    c->known = 0;
+    shm_pending = 0;
+    stats.errors++;
+    return -1;
+}
+
+/* 設定左馬達速度和方向 */
+int set_left_motor(int speed, int direction) {
+    motor_state.left_speed = speed;
+    motor_state.left_dir = direction;
+
+    if (wheel_cmd(&cache_left, &cache_right, speed, direction, IOCTL_SET_SPEED_LEFT,
+                  IOCTL_LEFT_FORWARD, IOCTL_LEFT_BACKWARD, IOCTL_LEFT_STOP, "左馬達") < 0)
+        return -1;
     return 0;
-    
 }
+
 /* 設定右馬達速度和方向 */
 int set_right_motor(int speed, int direction) {
-    unsigned int duty_ns;
-    
     motor_state.right_speed = speed;
     motor_state.right_dir = direction;
-    
-    // 設定速度(PWM占空比)  
-    duty_ns = speed_to_duty_ns(speed);
-    if (ioctl(motor_fd, IOCTL_SET_SPEED_RIGHT, &duty_ns) < 0) {
-        perror("設定右馬達速度失敗");
+
+    if (wheel_cmd(&cache_right, &cache_left, speed, direction, IOCTL_SET_SPEED_RIGHT,
+                  IOCTL_RIGHT_FORWARD, IOCTL_RIGHT_BACKWARD, IOCTL_RIGHT_STOP, "右馬達") < 0)
+        return -1;
+    return 0;
+}
+
+/* 映射 driver 的共用頁，之後 set_drive 直接寫命令 (driver 每 poll_us 檢查，0 = 每次敲 doorbell) */
+int motor_shm_open(unsigned int poll_us) {
+    void *p;
+
+    if (shm) return 0;
+
+    shm_len = sysconf(_SC_PAGESIZE);
+    p = mmap(NULL, shm_len, PROT_READ | PROT_WRITE, MAP_SHARED, motor_fd, 0);
+    if (p == MAP_FAILED) {
+        perror("馬達共用頁映射失敗，使用 ioctl");
         return -1;
     }
-    
-    // 設定方向
-    if (direction > 0) {
-        if (ioctl(motor_fd, IOCTL_RIGHT_FORWARD) < 0) {
-            perror("右馬達前進指令失敗");
+    if (((struct motor_shm *)p)->magic != MOTOR_SHM_MAGIC ||
+        ((struct motor_shm *)p)->version < MOTOR_SHM_VERSION) {
+        fprintf(stderr, "馬達共用頁版本不符，使用 ioctl\n");
+        munmap(p, shm_len);
+        return -1;
+    }
+    if (motor_ioctl(IOCTL_SET_SHM_POLL, &poll_us) < 0) {
+        perror("設定共用頁檢查週期失敗");
+        munmap(p, shm_len);
+        return -1;
+    }
+    shm = p;
+    printf("馬達共用頁已映射，檢查週期 %u us\n", poll_us);
+    return 0;
+}
+
+/* 寫命令到共用頁 (seqlock: cmd_seq 奇數期間 driver 不會採用) */
+static void shm_write(const struct motor_drive *d) {
+    struct timespec ts;
+    unsigned int seq = shm->cmd_seq;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    __atomic_store_n(&shm->cmd_seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    shm->cmd = *d;
+    shm->cmd_ns = (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+    shm->cmd_gen++;
+    __atomic_store_n(&shm->cmd_seq, seq + 2, __ATOMIC_RELEASE);
+}
+
+/* 讀共用頁狀態區 (seqlock)  回傳=> 0成功 -1 driver 正在寫 */
+static int shm_read_status(struct motor_drive *applied, unsigned int *gen) {
+    unsigned int seq;
+    int tries;
+
+    for (tries = 0; tries < 4; tries++) {
+        seq = __atomic_load_n(&shm->st_seq, __ATOMIC_ACQUIRE);
+        if (seq & 1) continue;
+        *applied = shm->applied;
+        *gen = shm->applied_gen;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&shm->st_seq, __ATOMIC_RELAXED) == seq) return 0;
+    }
+    return -1;
+}
+
+/* 兩個命令的輸出是否相同 (比帶正負號的速度，方向 1 速度 0 和停止一樣) */
+static int drive_equal(const struct motor_drive *a, const struct motor_drive *b) {
+    return a->left_dir * (int)a->left_speed == b->left_dir * (int)b->left_speed &&
+           a->right_dir * (int)a->right_speed == b->right_dir * (int)b->right_speed;
+}
+
+/* 共用頁命令是否已經是 (或即將成為) 目前輸出
+ * driver 已處理到最後的命令 (applied_gen 追上) 就以實際輸出為準 (故障或 ioctl 停車會改掉)
+ * 還在等 driver 檢查時，沒被拒絕 (rejected_count 沒變) 才當作會套用 */
+static int shm_same(const struct motor_drive *d) {
+    struct motor_drive applied;
+    unsigned int gen;
+
+    if (!shm_pending || !drive_equal(d, &shm_sent)) return 0;
+    if (shm_read_status(&applied, &gen) < 0) return 0;   // 讀不到就重下 (無害)
+    if (gen == shm_sent_gen) return drive_equal(&applied, d);
+    return __atomic_load_n(&shm->rejected_count, __ATOMIC_RELAXED) == shm_sent_rejected;
+}
+
+/* 兩輪命令是否和目前輸出相同 (accel 也要相同，漸變中改成立即要重下) */
+static int drive_same(const struct motor_drive *d, unsigned int accel) {
+    return wheel_same(&cache_left, d->left_speed, d->left_dir) &&
+           wheel_same(&cache_right, d->right_speed, d->right_dir) &&
+           cache_accel == accel;
+}
+
+static void drive_record(const struct motor_drive *d, unsigned int accel) {
+    wheel_set(&cache_left, 1, d->left_speed, d->left_dir);
+    wheel_set(&cache_right, 1, d->right_speed, d->right_dir);
+    cache_accel = accel;
+    shm_pending = 0;
+    motor_state.left_speed = d->left_speed;
+    motor_state.right_speed = d->right_speed;
+    motor_state.left_dir = d->left_dir;
+    motor_state.right_dir = d->right_dir;
+    stats.issued++;
+}
+
+static void drive_failed(void) {
+    motor_cache_invalidate();
+    stats.errors++;
+}
+
+/* 寫了共用頁命令: 還沒被 driver 採用，快取當作不確定 (重複的命令由 shm_same 判斷) */
+static void shm_record(const struct motor_drive *d, unsigned int rejected) {
+    shm_sent = *d;
+    shm_sent_gen = shm->cmd_gen;
+    shm_sent_rejected = rejected;
+    shm_pending = 1;
+    cache_left.known = 0;
+    cache_right.known = 0;
+    cache_accel = 0;
+    motor_state.left_speed = d->left_speed;
+    motor_state.right_speed = d->right_speed;
+    motor_state.left_dir = d->left_dir;
+    motor_state.right_dir = d->right_dir;
+    stats.issued++;
+}
+
+/* 舊 driver: 分開的單輪指令  回傳=> 1有送出 0兩輪都省略 -1失敗 */
+static int drive_per_wheel(int left_speed, int left_dir, int right_speed, int right_dir) {
+    unsigned long before = stats.issued;
+
+    if (set_left_motor(left_speed, left_dir) < 0) return -1;
+    if (set_right_motor(right_speed, right_dir) < 0) return -1;
+    return stats.issued != before;
+}
+
+/* 一次設定雙輪方向與速度 (共用頁或一個 ioctl，driver 在同一把鎖內更新兩輪)
+ * 回傳=> 1已送出 0和目前輸出相同(省略，不做系統呼叫) -1失敗 */
+static int drive_cmd(int left_speed, int left_dir, int right_speed, int right_dir) {
+    struct motor_drive d;
+
+    if (!drive_supported)
+        return drive_per_wheel(left_speed, left_dir, right_speed, right_dir);
+
+    // 參數先限制在合法範圍，EINVAL 只可能是 driver 不認得這個指令
+    normalize(&left_speed, &left_dir);
+    normalize(&right_speed, &right_dir);
+    d.left_speed = left_speed;
+    d.right_speed = right_speed;
+    d.left_dir = left_dir;
+    d.right_dir = right_dir;
+
+    // 共用頁: 不需要系統呼叫 (檢查週期為 0 時敲 doorbell，不複製參數)
+    // driver 之後才檢查命令，可能因故障鎖定/參數被拒絕，所以不記進快取，由狀態區確認
+    if (shm) {
+        unsigned int rejected = __atomic_load_n(&shm->rejected_count, __ATOMIC_RELAXED);
+
+        if (shm_same(&d)) {
+            stats.suppressed++;
+            return 0;
+        }
+        shm_write(&d);
+        if (shm->poll_us == 0 && motor_ioctl(IOCTL_SHM_DOORBELL, NULL) < 0) {
+            if (errno != EPERM) perror("馬達 doorbell 失敗");
+            drive_failed();
             return -1;
         }
-    } else if (direction < 0) {
-        if (ioctl(motor_fd, IOCTL_RIGHT_BACKWARD) < 0) {
-            perror("右馬達後退指令失敗");
+        shm_record(&d, rejected);
+        return 1;
+    }
+
+    if (drive_same(&d, 0)) {
+        stats.suppressed++;
+        return 0;
+    }
+
+    if (motor_ioctl(IOCTL_SET_DRIVE, &d) < 0) {
+        if (errno == EPERM) {
+            drive_failed();      // kernel 緊急煞車鎖定中，解除前不出力 (不洗版)
             return -1;
         }
-    }else{
-        if (ioctl(motor_fd, IOCTL_RIGHT_STOP) < 0) {
-        perror("右馬達停止指令失敗");
+        if (errno == EINVAL) {
+            printf("driver 不支援 IOCTL_SET_DRIVE，改用分開的馬達指令\n");
+            drive_supported = 0;
+            return drive_per_wheel(left_speed, left_dir, right_speed, right_dir);
+        }
+        perror("設定雙輪失敗");
+        drive_failed();
         return -1;
+    }
+
+    drive_record(&d, 0);
+    return 1;
+}
+
+int set_drive(int left_speed, int left_dir, int right_speed, int right_dir) {
+    return drive_cmd(left_speed, left_dir, right_speed, right_dir) < 0 ? -1 : 0;
+}
+
+/* 雙輪由 driver 依加速度漸變到目標 (accel: %/s，0 = 立即) */
+int set_drive_ramp(int left_speed, int left_dir, int right_speed, int right_dir, unsigned int accel) {
+    struct motor_ramp r;
+
+    if (!ramp_supported || !drive_supported || accel == 0)
+        return set_drive(left_speed, left_dir, right_speed, right_dir);
+
+    normalize(&left_speed, &left_dir);
+    normalize(&right_speed, &right_dir);
+    if (accel > MOTOR_RAMP_ACCEL_MAX) accel = MOTOR_RAMP_ACCEL_MAX;
+    r.target.left_speed = left_speed;
+    r.target.right_speed = right_speed;
+    r.target.left_dir = left_dir;
+    r.target.right_dir = right_dir;
+    r.left_accel = accel;
+    r.right_accel = accel;
+
+    // 同一個目標的漸變已經在進行 (或已到達)
+    if (drive_same(&r.target, accel)) {
+        stats.suppressed++;
+        return 0;
+    }
+
+    // 漸變只有 ioctl (driver 自己的計時器推進，不經過共用頁)
+    if (motor_ioctl(IOCTL_SET_RAMP, &r) < 0) {
+        if (errno == EPERM) {
+            drive_failed();
+            return -1;
         }
-    return 0;
+        if (errno == EINVAL) {
+            printf("driver 不支援 IOCTL_SET_RAMP，改為立即設定速度\n");
+            ramp_supported = 0;
+            return set_drive(left_speed, left_dir, right_speed, right_dir);
+        }
+        perror("設定漸變失敗");
+        drive_failed();
+        return -1;
     }
+
+    // 記錄目標 (實際輸出由 driver 漸變過去)
+    drive_record(&r.target, accel);
+    return 0;
 }
 
-/* 停止所有馬達 */
+/* 停止所有馬達 (安全路徑: 不論目前狀態都會下 ioctl，也會取消漸變與共用頁上的舊命令) */
 int stop_all_motors(void) {
-	
-        int ret = 0;
+    int ret = 0;
 
-        pthread_mutex_lock(&motor_mutex); 	 // 上鎖，保護馬達操作
+    pthread_mutex_lock(&motor_mutex);    // 上鎖，保護馬達操作
 
-    if (ioctl(motor_fd, IOCTL_BOTH_STOP) < 0) {
+    if (motor_ioctl(IOCTL_BOTH_STOP, NULL) < 0) {
         perror("停止馬達失敗");
-        return -1;
+        drive_failed();
+        ret = -1;
     } else {
-	motor_state.left_dir = 0;
-    	motor_state.right_dir = 0;
-  	printf("所有馬達已停止\n");
-    
-        }
-        pthread_mutex_unlock(&motor_mutex); 	// 解鎖
+        motor_state.left_dir = 0;
+        motor_state.right_dir = 0;
+        wheel_set(&cache_left, 1, 0, 0);
+        wheel_set(&cache_right, 1, 0, 0);
+        cache_accel = 0;
+        shm_pending = 0;
+        stats.issued++;
+        printf("所有馬達已停止\n");
+    }
+
+    pthread_mutex_unlock(&motor_mutex);  // 解鎖
     return ret;
 }
 
+/* 目前的輸出 (帶正負號的速度 %)  回傳=> 0成功 -1不確定
+ * 最後的命令走共用頁時讀 driver 的狀態區 (實際輸出) */
+int motor_get_drive(int *left, int *right) {
+    struct motor_drive applied;
+    unsigned int gen;
+
+    if (shm_pending) {
+        if (shm_read_status(&applied, &gen) < 0) return -1;
+        *left = applied.left_dir * (int)applied.left_speed;
+        *right = applied.right_dir * (int)applied.right_speed;
+        return 0;
+    }
+    if (!cache_left.known || !cache_right.known) return -1;
+    *left = cache_left.dir * cache_left.speed;
+    *right = cache_right.dir * cache_right.speed;
+    return 0;
+}
+
+/* 下一個命令一定送出 (driver 狀態可能被其他程式或 driver 自己改過) */
+void motor_cache_invalidate(void) {
+    cache_left.known = 0;
+    cache_right.known = 0;
+    shm_pending = 0;
+}
+
+void motor_get_stats(motor_stats *st) {
+    *st = stats;
+}
+
+/* 故障鎖定 (kernel 緊急煞車)  回傳=> MOTOR_FAULT_* (0 = 沒有) -1 無法讀取
+ * 有共用頁時直接讀狀態區，不做系統呼叫 */
+int motor_fault(void) {
+    struct motor_fault f;
+    int fault;
+
+    if (shm) {
+        fault = __atomic_load_n(&shm->fault, __ATOMIC_ACQUIRE);
+    } else {
+        memset(&f, 0, sizeof(f));
+        if (motor_ioctl(IOCTL_GET_FAULT, &f) < 0) return -1;
+        fault = f.latched;
+    }
+
+    // driver 自己停了車，快取的輸出不再正確
+    if (fault) motor_cache_invalidate();
+    return fault;
+}
+
+/* 解除故障鎖定，馬達維持停止等下一個命令 */
+int motor_clear_fault(void) {
+    if (motor_ioctl(IOCTL_CLEAR_FAULT, NULL) < 0) {
+        if (errno != EINVAL) perror("解除馬達故障失敗");  // EINVAL: 舊 driver 沒有故障鎖定
+        return -1;
+    }
+    wheel_set(&cache_left, 1, 0, 0);
+    wheel_set(&cache_right, 1, 0, 0);
+    cache_accel = 0;
+    shm_pending = 0;
+    return 0;
+}
+
 /* ===== 預定義動作函數 ===== */
+/* 只有真的改變輸出才印出 (每個 tick 重複呼叫不會洗版) */
 
 /* 前進 */
 void move_forward(void) {
-    set_left_motor(motor_state.left_speed, 1);
-    set_right_motor(motor_state.right_speed, 1);
-    printf("前進 - 左馬達:%d%%, 右馬達:%d%%\n", 
-           motor_state.left_speed, motor_state.right_speed);
+    if (drive_cmd(motor_state.left_speed, 1, motor_state.right_speed, 1) > 0)
+        printf("前進 - 左馬達:%d%%, 右馬達:%d%%\n",
+               motor_state.left_speed, motor_state.right_speed);
 }
 
 /* 後退 */
 void move_backward(void) {
-    set_left_motor(motor_state.left_speed, -1);
-    set_right_motor(motor_state.right_speed, -1);
-    printf("後退 - 左馬達:%d%%, 右馬達:%d%%\n", 
-           motor_state.left_speed, motor_state.right_speed);
+    if (drive_cmd(motor_state.left_speed, -1, motor_state.right_speed, -1) > 0)
+        printf("後退 - 左馬達:%d%%, 右馬達:%d%%\n",
+               motor_state.left_speed, motor_state.right_speed);
 }
 
 /* 左轉 */
 void turn_left(void) {
-    set_left_motor(motor_state.left_speed, -1);  // 左馬達反轉
-    set_right_motor(motor_state.right_speed, 1); // 右馬達前進
-    printf("左轉 - 左馬達:-%d%%, 右馬達:+%d%%\n", 
-           motor_state.left_speed, motor_state.right_speed);
+    // 左馬達反轉，右馬達前進
+    if (drive_cmd(motor_state.left_speed, -1, motor_state.right_speed, 1) > 0)
+        printf("左轉 - 左馬達:-%d%%, 右馬達:+%d%%\n",
+               motor_state.left_speed, motor_state.right_speed);
 }
 
 /* 右轉 */
 void turn_right(void) {
-    set_left_motor(motor_state.left_speed, 1);   // 左馬達前進
-    set_right_motor(motor_state.right_speed, -1); // 右馬達反轉
-    printf("右轉 - 左馬達:+%d%%, 右馬達:-%d%%\n", 
-           motor_state.left_speed, motor_state.right_speed);
+    // 左馬達前進，右馬達反轉
+    if (drive_cmd(motor_state.left_speed, 1, motor_state.right_speed, -1) > 0)
+        printf("右轉 - 左馬達:+%d%%, 右馬達:-%d%%\n",
+               motor_state.left_speed, motor_state.right_speed);
 }
 
 /* 遞增 */
 void add_motor_speed(void) {
-    set_left_motor(motor_state.left_speed, motor_state.left_dir);   // 左馬達加速
-    set_right_motor(motor_state.right_speed, motor_state.right_dir); // 左馬達加速
-    printf("加速 - 左馬達:+%d%%, 右馬達:+%d%%\n", 
-           motor_state.left_speed, motor_state.right_speed);
+    if (drive_cmd(motor_state.left_speed, motor_state.left_dir,
+                  motor_state.right_speed, motor_state.right_dir) > 0)
+        printf("加速 - 左馬達:+%d%%, 右馬達:+%d%%\n",
+               motor_state.left_speed, motor_state.right_speed);
 }
 
 /* 遞減 */
 void reduce_motor_speed(void) {
-    set_left_motor(motor_state.left_speed, motor_state.left_dir);   // 左馬達加速
-    set_right_motor(motor_state.right_speed, motor_state.right_dir); // 左馬達加速
-    printf("加速 - 左馬達:-%d%%, 右馬達:-%d%%\n", 
-           motor_state.left_speed, motor_state.right_speed);
+    if (drive_cmd(motor_state.left_speed, motor_state.left_dir,
+                  motor_state.right_speed, motor_state.right_dir) > 0)
+        printf("減速 - 左馬達:-%d%%, 右馬達:-%d%%\n",
+               motor_state.left_speed, motor_state.right_speed);
 }
 
 /* ===== 顯示函數 ===== */
@@ -274,7 +621,7 @@ void show_help(void) {
     printf("\n速度控制:\n");
     printf("  +/= - 增加速度\n");
     printf("  -/_ - 減少速度\n");
-    printf("  1-9 - 直接設定速度(10%-90%)\n");
+    printf("  1-9 - 直接設定速度(10%%-90%%)\n");
     printf("  0   - 設定速度為100%%\n");
     printf("\n其他:\n");
     printf("  i/I - 顯示狀態\n");
@@ -0,0 +1,85 @@
+// 馬達狀態監看 (唯讀映射 driver 共用頁，不用 ioctl，不影響車子)
+// 用法: ./motor_monitor [間隔ms]  Ctrl+C 結束
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include "motor_gpio.h"
+
+#define DEVICE_PATH "/dev/motor0"
+
+
+static const char *dir_name(int dir){
+	return dir > 0 ? "前進" : (dir < 0 ? "後退" : "停止");
+}
+
+static const char *src_name(unsigned int src){
+	switch(src){
+		case MOTOR_SRC_IOCTL:	return "ioctl";
+		case MOTOR_SRC_SHM:	return "共用頁";
+		case MOTOR_SRC_STOP:	return "停車";
+		case MOTOR_SRC_RAMP:	return "漸變";
+		case MOTOR_SRC_FAULT:	return "故障";
+		default:		return "-";
+	}
+}
+
+// 讀一份一致的狀態 (st_seq 奇數或前後不同就重讀)
+static void read_status(const volatile struct motor_shm *shm, struct motor_shm *out){
+	unsigned int seq;
+
+	do {
+		while((seq = __atomic_load_n(&shm->st_seq, __ATOMIC_ACQUIRE)) & 1)
+			;
+		*out = *(const struct motor_shm *)shm;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+	} while(__atomic_load_n(&shm->st_seq, __ATOMIC_RELAXED) != seq);
+}
+
+
+int main(int argc, char *argv[]){
+	int interval_ms = argc > 1 ? atoi(argv[1]) : 100;
+	struct motor_shm st;
+	unsigned int last_seq = ~0u;
+	long page = sysconf(_SC_PAGESIZE);
+
+	// 1.唯讀開啟 (關閉時 driver 不會停車)
+	int fd = open(DEVICE_PATH, O_RDONLY);
+	if(fd < 0){
+		perror("open " DEVICE_PATH);
+		return 1;
+	}
+	const volatile struct motor_shm *shm = mmap(NULL, page, PROT_READ, MAP_SHARED, fd, 0);
+	if(shm == MAP_FAILED){
+		perror("mmap");
+		return 1;
+	}
+	if(shm->magic != MOTOR_SHM_MAGIC){
+		fprintf(stderr, "不是馬達共用頁 (magic %08x)\n", shm->magic);
+		return 1;
+	}
+	printf("共用頁 v%u，driver 檢查週期 %u us\n", shm->version, shm->poll_us);
+
+	// 2.狀態有變化才印
+	struct timespec ts = { interval_ms / 1000, (long)(interval_ms % 1000) * 1000000L };
+	for(;;){
+		read_status(shm, &st);
+		if(st.st_seq != last_seq){
+			last_seq = st.st_seq;
+			printf("左 %s %3u%%  右 %s %3u%%  來源 %-6s gen %u  套用 %u/丟棄 %u",
+			       dir_name(st.applied.left_dir), st.applied.left_speed,
+			       dir_name(st.applied.right_dir), st.applied.right_speed,
+			       src_name(st.source), st.applied_gen, st.applied_count, st.rejected_count);
+			if(st.applied_cmd_ns && st.applied_ns >= st.applied_cmd_ns)
+				printf("  命令->套用 %llu us", (unsigned long long)(st.applied_ns - st.applied_cmd_ns) / 1000);
+			if(st.fault)
+				printf("  [故障鎖定 %u]", st.fault);
+			printf("\n");
+		}
+		nanosleep(&ts, NULL);
+	}
+	return 0;
+}
@@ -1,11 +1,25 @@
 // TCRT5000循跡感測器應用層
 #include "tcrt5000.h"
+#include "tcrt5000_ioctl.h"
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+
+#define TCRT5000_BATCH 32	// 一次 read() 最多讀回的樣本數
 
 static int fd = -1;
+static tcrt5000_data last_data;	// 最後一次收到的狀態 (driver 只在變化時送資料)
+
+// 二進位樣本緩衝 (一次 read() 讀多筆，再逐筆交出)
+static struct tcrt5000_sample batch[TCRT5000_BATCH];
+static int batch_len = 0;
+static int batch_pos = 0;
+static int have_seq = 0;		// 是否已收到第一筆 (用來判斷跳號)
+static unsigned long dropped = 0;	// 遺失的樣本數
 
 // 開檔案
 int tcrt5000_open(void){
@@ -16,21 +30,50 @@ int tcrt5000_open(void){
 		return 0;
 	}
 
-	// 調用 driver 模組
-	fd = open("/dev/tcrt5000", O_RDONLY);
+	// 調用 driver 模組 (非阻塞，等待交給 tcrt5000_wait)
+	fd = open("/dev/tcrt5000", O_RDONLY | O_NONBLOCK);
 	if(fd < 0){
 		perror("tcrt5000_open failed");
 		return -1;
 	}
 
+	// 切換成二進位樣本模式 (省去文字格式化/解析)
+	int mode = TCRT5000_MODE_BINARY;
+	if(ioctl(fd, TCRT5000_SET_MODE, &mode) < 0){
+		perror("tcrt5000 set binary mode failed");
+		close(fd);
+		fd = -1;
+		return -1;
+	}
+	batch_len = batch_pos = 0;
+	have_seq = 0;
+
 	// 成功開啟
 	printf("tcrt5000 opened successfully\n");
 	return 0;
 }
 
 
-// 讀取檔案
-int tcrt5000_read(tcrt5000_data *data) {
+// 等待狀態變化
+// 回傳=> 1有資料可讀  0逾時  -1失敗
+int tcrt5000_wait(int timeout_ms){
+
+	if(fd < 0) return -1;
+
+	struct pollfd pfd = { .fd = fd, .events = POLLIN };
+	int ret = poll(&pfd, 1, timeout_ms);
+	if(ret < 0){
+		if(errno == EINTR) return 0;
+		perror("tcrt5000 poll failed");
+		return -1;
+	}
+	return ret > 0;
+}
+
+
+// 讀取一筆狀態變化
+// 回傳=> 1讀到一筆  0目前沒有變化  -1失敗
+int tcrt5000_read_event(tcrt5000_data *data){
 
 	// 1.檢查是否已開啟
 	if(fd < 0){
@@ -38,27 +81,66 @@ int tcrt5000_read(tcrt5000_data *data) {
 		return -1;
 	}
 
-	// 2.讀取檔案
-	char buf[16];		// 裝讀取的值
-	ssize_t len = read(fd, buf, sizeof(buf) - 1);
+	// 2.緩衝用完才再讀檔案 (一次讀回多筆)
+	if(batch_pos >= batch_len){
+		ssize_t len = read(fd, batch, sizeof(batch));
 
-	if(len < 0){
-		perror("tcrt5000 read failed");
-		return -1;
-	}
+		if(len < 0){
+			if(errno == EAGAIN) return 0;	// 沒有新的狀態變化
+			perror("tcrt5000 read failed");
+			return -1;
+		}
 
-	// 3.結尾加上字串結束符號
-	buf[len] = '\0';
+		batch_len = len / sizeof(batch[0]);
+		batch_pos = 0;
+		if(batch_len == 0) return 0;
+	}
 
-	// 4.如果傳回值小於3個值代表有問題
-	if(len < 3){	
-		fprintf(stderr, "tcrt5000_read: 解析錯誤, buf= '%s'\n", buf);
+	// 3.取出一筆並檢查格式版本
+	const struct tcrt5000_sample *s = &batch[batch_pos++];
+	if(s->version != TCRT5000_SAMPLE_VERSION){
+		fprintf(stderr, "tcrt5000_read: 不支援的樣本版本 %d\n", s->version);
 		return -1;
 	}
 
-	data->left = buf[0] - '0';
-	data->middle = buf[1] - '0';
-	data->right = buf[2] - '0';
+	// 4.序號跳號代表中間有遺失
+	if(have_seq && s->seq != last_data.seq + 1 && s->seq != last_data.seq)
+		dropped += s->seq - last_data.seq - 1;
+	have_seq = 1;
+
+	last_data.left = (s->state >> 2) & 0x1;
+	last_data.middle = (s->state >> 1) & 0x1;
+	last_data.right = s->state & 0x1;
+	last_data.seq = s->seq;
+	last_data.ts_ns = s->ts_ns;
+	*data = last_data;
+
+	return 1;
+}
+
+
+// 遺失的樣本數
+unsigned long tcrt5000_dropped(void){
+	return dropped;
+}
+
+
+// 裝置的 fd (EPOLLIN 後用 tcrt5000_read_event 讀到回傳 0 為止)
+int tcrt5000_fd(void){
+	return fd;
+}
+
+
+// 讀取目前狀態 (把尚未處理的變化讀完，回傳最新的)
+int tcrt5000_read(tcrt5000_data *data) {
+
+	int ret;
+
+	// 讀到沒有新的變化為止
+	while((ret = tcrt5000_read_event(data)) > 0);
+	if(ret < 0) return -1;
+
+	*data = last_data;
 
 	// 成功
 	// printf("tcrt5000 read successfully\n");
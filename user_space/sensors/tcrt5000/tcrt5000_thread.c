@@ -16,16 +16,26 @@ extern tcrt5000_callback logic_cb;
 extern tcrt5000_callback logic_cb;
 
 
-// 循跡紅外線執行續
+// 循跡紅外線執行續 (driver 有狀態變化才會被喚醒)
 void* tcrt5000_thread_func(void* arg){
 	
 	tcrt5000_data sensor;
+	int ret;
 
 	// 停止條件
 	while(!stop_flag){
 		
-		// 1.讀取感測器
-		if(tcrt5000_read(&sensor) == 0){
+		// 1.等待狀態變化 (逾時只是為了定期檢查 stop_flag)
+		ret = tcrt5000_wait(TCRT5000_WAIT_MS);
+		if(ret < 0){
+			fprintf(stderr, "TCRT5000 讀取失敗\n");
+			usleep(TCRT5000_WAIT_MS * 1000);
+			continue;
+		}
+		if(ret == 0) continue;
+
+		// 2.依序處理每一筆變化
+		while((ret = tcrt5000_read_event(&sensor)) > 0){
 			
 			// 將3個感測器組成一個 code(二進位轉十進未)
 			int code = sensor.left*4 + sensor.middle*2 + sensor.right*1;
@@ -34,13 +44,11 @@ void* tcrt5000_thread_func(void* arg){
             		if(logic_cb != NULL && !node_active){
                 		logic_cb(code);
             		}		
-		} else {
+		}
+		if(ret < 0){
 			fprintf(stderr, "TCRT5000 讀取失敗\n");
 		}	
-
-		// 2.控制循環讀取的平率 (50~100 ms)
-		usleep(20000);	// 20ms
 	}
 
 	return NULL;
-}
\ No newline at end of file
+}
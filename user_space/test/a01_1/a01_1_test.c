@@ -5,10 +5,12 @@
 #include <pthread.h>    // pthread_create() 建立紅外線感測器的執行緒
 #include <stdbool.h>    // 使用 bool 型別
 #include <sys/time.h>   // gettimeofday() 取得當前時間 (毫秒)
+#include <time.h>       // clock_gettime() 單調時鐘
 #include <string.h>     // memset, 字串相關函數
 
 #include "tcrt5000.h"   // 紅外線感測器模組 (循跡用)
 #include "motor_ctrl.h" // 馬達控制函式庫
+#include "line_ctrl.h"  // 循跡控制器 (編碼歷史/偏移趨勢)
 #include "uart_thread.h" 
  
 
@@ -31,7 +33,6 @@
 #define LEFT_BIAS_CORRECT 4    // 行駛過程左輪補償，因為車體偏左
 
 // 狀態歷史紀錄 (用於分析趨勢)
-#define STATE_HISTORY 10       // 保存最近 10 筆感測器狀態
 #define LINEAR_CHECK_N 7       // 檢查最近 7 筆狀態
 #define LINEAR_THRESHOLD 4     // 至少 3 次同方向偏移，才算有趨勢
 #define DEBOUNCE_COUNT 3        // 去抖動：連續幾次相同才算有效
@@ -47,8 +48,6 @@ static int right_derail_count = 0;  // 右偏累積次數 (出軌判斷)
 static long right_derail_time = 0;  // 右偏開始計時
 
 volatile int stop_flag = 0;         // 停止旗標 (被設成 1 時程式就會停車)
-int last_codes[STATE_HISTORY];      // 紀錄最近 10 次狀態碼
-int history_idx = 0;                // 環形緩衝區索引 (指向最新狀態的位置)
 
 bool node_active = false;           // 節點標記 (保留功能，這裡沒用到)
 tcrt5000_callback logic_cb = NULL;  // 紅外線感測器的回呼函數
@@ -65,6 +64,13 @@ long get_millis(void){
     return tv.tv_sec * 1000 + tv.tv_usec / 1000;
 }
 
+// 單調時鐘 (ns)，給 line_ctrl 的編碼歷史用
+unsigned long long now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
 // 限制馬達速度在 [SPEED_MIN, SPEED_MAX] 範圍內
 int clamp_speed(int speed){
     if(speed < SPEED_MIN) return SPEED_MIN;
@@ -72,45 +78,6 @@ int clamp_speed(int speed){
     return speed;
 }
 
-// 找出「最近一次非出軌的狀態」
-// 出軌 (code=0) 不算有效，避免用錯誤的狀態做判斷
-int find_last_valid(){
-    for(int i = 1; i <= STATE_HISTORY; i++){
-        int idx = (history_idx - i + STATE_HISTORY) % STATE_HISTORY;
-        int code = last_codes[idx];
-        if(code != 0) { // 只要不是出軌就當作有效
-            return code;
-        }
-    }
-    return 2;  // 如果完全找不到，預設成「直行」
-}
-
-// 判斷最近 5 次狀態裡「左偏」是否占大多數
-bool is_left_shift(){
-    int left_count = 0;
-    for(int i = 1; i <= LINEAR_CHECK_N; i++){
-        int idx = (history_idx - i + STATE_HISTORY) % STATE_HISTORY;
-        int s = last_codes[idx];
-        if(s == 1 || s == 3){ // 狀態 1=太左, 3=微左
-            left_count++;
-        }
-    }
-    return left_count >= LINEAR_THRESHOLD;
-}
-
-// 判斷最近 5 次狀態裡「右偏」是否占大多數
-bool is_right_shift(){
-    int right_count = 0;
-    for(int i = 1; i <= LINEAR_CHECK_N; i++){
-        int idx = (history_idx - i + STATE_HISTORY) % STATE_HISTORY;
-        int s = last_codes[idx];
-        if(s == 4 || s == 6){ // 狀態 4=太右, 6=微右
-            right_count++;
-        }
-    }
-    return right_count >= LINEAR_THRESHOLD;
-}
-
 
 // ============================================================================
 // 馬達控制函數 (直接驅動左右馬達)
@@ -161,14 +128,14 @@ void handle_state(int code){
         // --------------------------------------------------------------
         case 0: // 出軌處理
 {
-    int last_valid = find_last_valid(); // 找出出軌前最後有效狀態
+    int last_valid = line_ctrl_last_code(); // 找出出軌前最後有效狀態
     long now = get_millis();
 
     // ------------------------------------------------------------
     // 判斷趨勢：左偏 / 右偏
     // ------------------------------------------------------------
-    bool trend_left = is_left_shift();
-    bool trend_right = is_right_shift();
+    bool trend_left = line_ctrl_trend(LINEAR_CHECK_N, LINEAR_THRESHOLD) > 0;
+    bool trend_right = line_ctrl_trend(LINEAR_CHECK_N, LINEAR_THRESHOLD) < 0;
 
     // ------------------------------------------------------------
     // 強力掃回模式 flag
@@ -413,8 +380,7 @@ void logic(int code){
 
     // 連續出現 N 次才採用
     if(repeat_count >= DEBOUNCE_COUNT){
-        last_codes[history_idx] = code;		// 把當前狀態存進歷史紀錄
-        history_idx = (history_idx + 1) % STATE_HISTORY;	// 更新索引 (環形陣列)
+        line_ctrl_update(code, now_ns());		// 把當前狀態存進 line_ctrl 的歷史紀錄
         handle_state(code);			// 執行對應動作
         repeat_count = 0; 			// 重置，避免卡住
     }
@@ -429,9 +395,7 @@ int main(){
     printf("循跡車控制程式 - 出軌恢復版\n");
 
     // 初始化狀態緩衝區 (一開始預設為「直行」)
-    for(int i = 0; i < STATE_HISTORY; i++){
-        last_codes[i] = 2;
-    }
+    line_ctrl_init(NULL);
 
     // 設定回呼函數
     logic_cb = logic;
@@ -28,10 +28,12 @@
 #include <pthread.h>
 #include <stdbool.h>
 #include <sys/time.h>
+#include <time.h>
 #include <string.h>
 
 #include "tcrt5000.h"
 #include "motor_ctrl.h"
+#include "line_ctrl.h"
 #include "uart_thread.h"
 
 // ============================================================================
@@ -47,7 +49,6 @@
 #define SPEED_MAJOR 10           // 大幅修正幅度
 #define SPEED_RECOVER 15         // 出軌恢復專用 - 更大幅度的掃回速度
 
-#define STATE_HISTORY 10         // 紀錄最近 10 次狀態
 #define LINEAR_CHECK_N 5         // 檢查最近 5 次狀態判斷趨勢
 #define LINEAR_THRESHOLD 3       // 至少 3 次偏移才算有趨勢
 
@@ -60,8 +61,6 @@ static int right_derail_count = 0;
 static long right_derail_time = 0;
 
 volatile int stop_flag = 0;
-int last_codes[STATE_HISTORY];
-int history_idx = 0;
 
 volatile bool red_on = false;
 
@@ -80,47 +79,19 @@ long get_millis(void){
     return tv.tv_sec * 1000 + tv.tv_usec / 1000;
 }
 
+// 單調時鐘 (ns)，給 line_ctrl 的編碼歷史用
+unsigned long long now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
 int clamp_speed(int speed){
     if(speed < SPEED_MIN) return SPEED_MIN;
     if(speed > SPEED_MAX) return SPEED_MAX;
     return speed;
 }
 
-int find_last_valid(){
-    for(int i = 1; i <= STATE_HISTORY; i++){
-        int idx = (history_idx - i + STATE_HISTORY) % STATE_HISTORY;
-        int code = last_codes[idx];
-        if(code != 0) {
-            return code;
-        }
-    }
-    return 2;  // 預設正常
-}
-
-bool is_left_shift(){
-    int left_count = 0;
-    for(int i = 1; i <= LINEAR_CHECK_N; i++){
-        int idx = (history_idx - i + STATE_HISTORY) % STATE_HISTORY;
-        int s = last_codes[idx];
-        if(s == 1 || s == 3){
-            left_count++;
-        }
-    }
-    return left_count >= LINEAR_THRESHOLD;
-}
-
-bool is_right_shift(){
-    int right_count = 0;
-    for(int i = 1; i <= LINEAR_CHECK_N; i++){
-        int idx = (history_idx - i + STATE_HISTORY) % STATE_HISTORY;
-        int s = last_codes[idx];
-        if(s == 4 || s == 6){
-            right_count++;
-        }
-    }
-    return right_count >= LINEAR_THRESHOLD;
-}
-
 void apply_motor_speed(int left_speed, int right_speed){
     left_speed = clamp_speed(left_speed);
     right_speed = clamp_speed(right_speed);
@@ -163,12 +134,12 @@ void handle_state(int code){
         // ====================================================================
         case 0:
         {
-            int last_valid = find_last_valid();  // 找出軌前的最後有效狀態
+            int last_valid = line_ctrl_last_code();  // 找出軌前的最後有效狀態
             
             // ================================================================
             // 情境1: 有明確「左偏」趨勢 → 應該往右掃回
             // ================================================================
-            if(is_left_shift()){
+            if(line_ctrl_trend(LINEAR_CHECK_N, LINEAR_THRESHOLD) > 0){
                 printf("[出軌恢復] 檢測到左偏趨勢 → 執行右掃修正\n");
                 
                 // 根據出軌前的狀態決定修正力道
@@ -201,7 +172,7 @@ void handle_state(int code){
             // ================================================================
             // 情境2: 有明確「右偏」趨勢 → 應該往左掃回
             // ================================================================
-            else if(is_right_shift()){
+            else if(line_ctrl_trend(LINEAR_CHECK_N, LINEAR_THRESHOLD) < 0){
                 printf("[出軌恢復] 檢測到右偏趨勢 → 執行左掃修正\n");
                 
                 // 根據出軌前的狀態決定修正力道
@@ -381,16 +352,10 @@ void handle_state(int code){
 // 主回調函數
 // ============================================================================
 void logic(int code){
-    last_codes[history_idx] = code;
-    history_idx = (history_idx + 1) % STATE_HISTORY;
+    line_ctrl_update(code, now_ns());
     
     #ifdef DEBUG_MODE
-    printf("[LOGIC] 狀態:%d | 歷史:", code);
-    for(int i = 0; i < STATE_HISTORY; i++){
-        int idx = (history_idx - 1 - i + STATE_HISTORY) % STATE_HISTORY;
-        printf("%d ", last_codes[idx]);
-    }
-    printf("\n");
+    printf("[LOGIC] 狀態:%d | 出軌前:%d 趨勢:%d\n", code, line_ctrl_last_code(), line_ctrl_trend(LINEAR_CHECK_N, LINEAR_THRESHOLD));
     #endif
     
     handle_state(code);
@@ -425,9 +390,7 @@ int main(){
     printf("║     循跡車控制程式 - 直線循跡+UART		     ║\n");
     printf("╚════════════════════════════════════════════╝\n\n");
 
-    for(int i = 0; i < STATE_HISTORY; i++){
-        last_codes[i] = 2;
-    }
+    line_ctrl_init(NULL);
 
     logic_cb = logic;
     node_active = false;
@@ -3,10 +3,12 @@
 #include <pthread.h>
 #include <stdbool.h>
 #include <sys/time.h>
+#include <time.h>
 #include <string.h>
 
 #include "tcrt5000.h"        // 紅外線循跡感測器模組
 #include "motor_ctrl.h"      // 馬達控制器
+#include "line_ctrl.h"       // 循跡控制器 (編碼歷史/偏移趨勢)
 
 // --------------------- 設定參數 ---------------------
 #define DERAIL_SET_COUNT 6       // 判定出軌需連續偵測次數
@@ -14,7 +16,6 @@
 #define SPEED_INIT 40            // 馬達初始速度
 #define SPEED1 5               // 微調修正幅度
 #define SPEED2 10              // 大幅修正幅度
-#define STATE_HISTORY 10         // 紀錄最近狀態數量
 #define LINEAR_CHECK_N 5         // 判斷線性偏移時檢查最近 N 個狀態
 
 // --------------------- 全域變數 ---------------------
@@ -22,8 +23,6 @@ static int derail_count = 0;       // 出軌累計次數
 static long derail_time = 0;       // 出軌累計起始時間
 volatile int stop_flag = 0;        // 停止旗標，用於結束主迴圈
 
-int last_codes[STATE_HISTORY];     // 最近 STATE_HISTORY 次感測器狀態
-int history_idx = 0;               // 紀錄陣列索引，循環使用
 
 bool node_active = false;
 tcrt5000_callback logic_cb = NULL;
@@ -38,27 +37,11 @@ long get_millis(void){
     return tv.tv_sec * 1000 + tv.tv_usec / 1000;
 }
 
-// 找最近一次非出軌狀態，避免出軌誤判
-int find_last_valid(){
-    for(int i=0;i<STATE_HISTORY;i++){
-        int idx = (history_idx - 1 - i + STATE_HISTORY) % STATE_HISTORY; // 循環索引
-        int code = last_codes[idx];
-        if(code != 0) return code; // 0表示出軌，其它都是有效狀態
-    }
-    return 2; // 如果全部是出軌，預設回線上
-}
-
-// 判斷最近 N 個歷史狀態是否有線性偏移趨勢
-bool is_linear_shift(){
-    int count = 0;
-    for(int i=1;i<=LINEAR_CHECK_N;i++){
-        int idx = (history_idx - i + STATE_HISTORY) % STATE_HISTORY;
-        int s = last_codes[idx];
-        if(s==1 || s==3 || s==4 || s==6){ // 偏左或偏右
-            count++;
-        }
-    }
-    return count > 0; // 最近有偏移趨勢
+// 單調時鐘 (ns)，給 line_ctrl 的編碼歷史用
+unsigned long long now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
 }
 
 // --------------------- switch case 動作函數 ---------------------
@@ -77,9 +60,9 @@ bool is_linear_shift(){
 void handle_state(int code){
     switch(code){
         case 0: // 出軌
-            if(is_linear_shift()){
+            if(line_ctrl_trend(LINEAR_CHECK_N, 1) != 0){
                 // 如果最近有偏移趨勢 → 0 是偏移造成的，立即拉回線上
-                int restore = find_last_valid();
+                int restore = line_ctrl_last_code();
                 handle_state(restore); // 遞迴呼叫恢復前一個有效狀態
                 derail_count = 0;
                 derail_time = 0;
@@ -163,23 +146,20 @@ void handle_state(int code){
 
 /*
  * 每次感測器回傳狀態時呼叫
- * 1. 紀錄最近 STATE_HISTORY 個狀態
+ * 1. 紀錄最近 LINE_CTRL_HISTORY 個狀態
  * 2. 呼叫 handle_state 控制馬達
  */
 void logic(int code){
-    last_codes[history_idx++] = code;             // 更新歷史狀態
-    if(history_idx>=STATE_HISTORY) history_idx=0; // 循環索引
+    line_ctrl_update(code, now_ns());        // 更新歷史狀態
 	
-	printf("[SIM] 當前狀態: %d, 歷史: ", code);
-	for(int i=0;i<STATE_HISTORY;i++) printf("%d ", last_codes[i]);
-	printf("\n");
+	printf("[SIM] 當前狀態: %d, 出軌前: %d\n", code, line_ctrl_last_code());
     handle_state(code);                           // 呼叫 switch case 函數
 }
 
 // --------------------- main ---------------------
 int main(){
     // 初始化歷史狀態為線上
-    memset(last_codes,2,sizeof(last_codes));
+    line_ctrl_init(NULL);
 	
 	// 指定 callback
     logic_cb = logic;
@@ -0,0 +1,169 @@
+// 測試 UART 執行緒重複啟動/停止 (不需要 Pico)
+// 用 pty 代替 /dev/serial0，兩種啟動方式各 start/stop 數次，
+// 比較前後開啟的 fd 數量 (每次啟動的 queue eventfd、uart fd 都要在停止時關閉)
+// 每次啟動後從 pty 另一端送一個 CMD 封包，確認能收到 ACK (重新啟動後仍可收發)
+// 同時 TX queue 也在送指令，另一端收到的位元組不可有 CRC 錯誤或重新同步 (ACK 不能和 TX 交錯)
+// 另一端的 PING 也要收到原封不動的 PONG，統計的 tx_frames 要算到所有送出的封包
+// 另外確認開啟裝置失敗時也不會留下 eventfd
+
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <dirent.h>
+#include "uart_thread.h"
+#include "uart_proto.h"
+
+#define RESTART_ROUNDS	5	// 每種啟動方式的次數
+#define ACK_TIMEOUT_MS	500
+#define TX_FLOOD	32	// 等 ACK 期間 TX queue 同時送出的指令數
+
+
+// 目前開啟的 fd 數量
+static int count_fds(void){
+	DIR *d = opendir("/proc/self/fd");
+	struct dirent *e;
+	int n = 0;
+
+	if(!d) return -1;
+	while((e = readdir(d)) != NULL)
+		if(e->d_name[0] != '.') n++;
+	closedir(d);
+	return n - 1;	// 不算 opendir 自己的 fd
+}
+
+
+// pty 另一端收到的封包
+static int got_ack = -1;
+static int got_pong = -1;
+static int frames_seen = 0;
+
+static void on_frame(uint8_t type, uint8_t seq, const uint8_t *payload, size_t len, void *arg){
+	frames_seen++;
+	if(type == UART_FRAME_ACK) got_ack = seq;
+	if(type == UART_FRAME_PONG && len == 8 && memcmp(payload, "rtt-test", 8) == 0) got_pong = seq;
+}
+
+
+// 從 pty 另一端送 CMD(seq)，等 ACK  回傳=> 0收到且沒有錯誤 -1逾時/資料錯誤
+static int ping_ack(int master, uint8_t seq, int event_loop){
+	uint8_t frame[UART_PROTO_MAX_FRAME];
+	uint8_t buf[256];
+	uart_proto_parser parser;
+	struct pollfd pfd = { .fd = master, .events = POLLIN };
+
+	uart_proto_parser_init(&parser);
+	got_ack = got_pong = -1;
+	frames_seen = 0;
+
+	int n = uart_proto_encode(UART_FRAME_CMD, seq, "S", 1, frame);
+	if(write(master, frame, n) != n) return -1;
+	n = uart_proto_encode(UART_FRAME_PING, seq, "rtt-test", 8, frame);
+	if(write(master, frame, n) != n) return -1;
+	for(int i = 0; i < TX_FLOOD; i++) uart_send("L");
+
+	// 只啟動 TX thread 時由這裡代替事件迴圈讀 UART
+	if(event_loop){
+		usleep(20000);
+		uart_handle_rx();
+	}
+
+	while(got_ack != seq || got_pong != seq || frames_seen < TX_FLOOD + 2){
+		if(poll(&pfd, 1, ACK_TIMEOUT_MS) <= 0) return -1;
+		n = read(master, buf, sizeof(buf));
+		if(n <= 0) return -1;
+		uart_proto_feed(&parser, buf, n, on_frame, NULL);
+	}
+	if(parser.crc_errors || parser.resyncs){
+		printf("     CRC 錯誤 %lu 重新同步 %lu\n", parser.crc_errors, parser.resyncs);
+		return -1;
+	}
+
+	// 所有封包 (指令 + ACK + PONG) 都由 TX thread 送出並計數
+	// (TX thread 在 write() 返回後才計數，可能比這裡讀到資料晚一點)
+	uart_stats st;
+	for(int i = 0; i < 50; i++){
+		uart_get_stats(&st);
+		if(st.tx_frames == TX_FLOOD + 2) break;
+		usleep(2000);
+	}
+	if(st.tx_frames != TX_FLOOD + 2 || st.rx_frames != 2){
+		printf("     統計 tx_frames %lu rx_frames %lu\n", st.tx_frames, st.rx_frames);
+		return -1;
+	}
+	return 0;
+}
+
+
+// 一種啟動方式 start/stop 數次  回傳=> 失敗次數
+static int run_rounds(const char *dev, int master, int tx_only){
+	const char *name = tx_only ? "uart_thread_start_tx" : "uart_thread_start";
+	int fail = 0;
+	int i;
+
+	for(i = 0; i < RESTART_ROUNDS; i++){
+		int before = count_fds();
+		int ret = tx_only ? uart_thread_start_tx(dev) : uart_thread_start(dev);
+		if(ret != 0){
+			printf("FAIL %s 第 %d 次啟動失敗\n", name, i + 1);
+			return fail + 1;
+		}
+		if(ping_ack(master, i, tx_only) != 0){
+			printf("FAIL %s 第 %d 次啟動後沒有收到 ACK\n", name, i + 1);
+			fail++;
+		}
+		uart_thread_stop();
+
+		int after = count_fds();
+		if(after != before){
+			printf("FAIL %s 第 %d 次: fd %d -> %d\n", name, i + 1, before, after);
+			fail++;
+		}
+	}
+	if(!fail) printf("ok   %s x%d\n", name, RESTART_ROUNDS);
+	return fail;
+}
+
+
+// 開啟不存在的裝置數次  回傳=> 失敗次數
+static int run_open_fail(void){
+	int before = count_fds();
+	int i;
+
+	for(i = 0; i < RESTART_ROUNDS; i++){
+		if(uart_thread_start("/dev/null/no_uart") == 0 || uart_thread_start_tx("/dev/null/no_uart") == 0){
+			printf("FAIL 不存在的裝置竟然啟動成功\n");
+			uart_thread_stop();
+			return 1;
+		}
+	}
+	int after = count_fds();
+	if(after != before){
+		printf("FAIL 啟動失敗 x%d: fd %d -> %d\n", RESTART_ROUNDS * 2, before, after);
+		return 1;
+	}
+	printf("ok   啟動失敗 x%d\n", RESTART_ROUNDS * 2);
+	return 0;
+}
+
+
+int main(void){
+
+	// 1.建立 pty
+	int master = posix_openpt(O_RDWR | O_NOCTTY);
+	if(master < 0 || grantpt(master) < 0 || unlockpt(master) < 0){
+		perror("pty 建立失敗");
+		return 1;
+	}
+	const char *dev = ptsname(master);
+
+	// 2.兩種啟動方式，以及開啟失敗
+	int fail = run_rounds(dev, master, 0) + run_rounds(dev, master, 1) + run_open_fail();
+
+	close(master);
+	printf("%s\n", fail ? "UART restart test FAILED" : "UART restart test passed");
+	return fail ? 1 : 0;
+}
@@ -4,6 +4,9 @@
 #include <fcntl.h>	// open()
 #include <unistd.h>	// read(),write(),close()
 #include <string.h>
+#include <termios.h>	// tcgetattr(),tcsetattr()
+#include <sys/ioctl.h>
+#include <linux/serial.h>	// struct serial_struct, ASYNC_LOW_LATENCY
 #include "uart.h"
 
 
@@ -26,6 +29,87 @@ int uart_open(const char *device){
 		perror("uart_open failed");	// 顯示錯誤訊息
 		return -1;
 	}
+
+	// 不依賴系統預設值，明確設定鮑率/raw/8N1
+	uart_config cfg = UART_CONFIG_DEFAULT;
+	if(uart_configure(&cfg) < 0){
+		close(uart_fd);
+		uart_fd = -1;
+		return -1;
+	}
+	return 0;
+}
+
+
+// 鮑率數字轉 termios 常數
+static speed_t baud_to_speed(int baud){
+	switch(baud){
+		case 9600:	return B9600;
+		case 19200:	return B19200;
+		case 38400:	return B38400;
+		case 57600:	return B57600;
+		case 115200:	return B115200;
+		case 230400:	return B230400;
+		case 460800:	return B460800;
+		case 921600:	return B921600;
+		default:	return 0;
+	}
+}
+
+
+// 套用 UART 設定
+// 0  成功
+// -1 失敗
+int uart_configure(const uart_config *cfg){
+
+	struct termios tio;
+
+	// 未開啟 UART
+	if(uart_fd < 0) return -1;
+
+	speed_t speed = baud_to_speed(cfg->baud);
+	if(speed == 0){
+		fprintf(stderr, "uart_configure: 不支援的鮑率 %d\n", cfg->baud);
+		return -1;
+	}
+
+	if(tcgetattr(uart_fd, &tio) < 0){
+		perror("uart tcgetattr failed");
+		return -1;
+	}
+
+	// 1.raw 模式: 不處理換行/回顯/控制字元
+	cfmakeraw(&tio);
+
+	// 2.8N1，不用硬體流控，忽略數據機控制線
+	tio.c_cflag &= ~(PARENB | CSTOPB | CSIZE | CRTSCTS);
+	tio.c_cflag |= CS8 | CLOCAL | CREAD;
+
+	// 3.read() 回傳條件
+	tio.c_cc[VMIN] = cfg->vmin;
+	tio.c_cc[VTIME] = cfg->vtime_ds;
+
+	// 4.鮑率
+	cfsetispeed(&tio, speed);
+	cfsetospeed(&tio, speed);
+
+	if(tcsetattr(uart_fd, TCSANOW, &tio) < 0){
+		perror("uart tcsetattr failed");
+		return -1;
+	}
+	tcflush(uart_fd, TCIOFLUSH);	// 丟掉開啟前殘留的資料
+
+	// 5.低延遲: 驅動收到資料立刻交給 tty 層，不等批次
+	if(cfg->low_latency){
+		struct serial_struct ser;
+		if(ioctl(uart_fd, TIOCGSERIAL, &ser) == 0){
+			ser.flags |= ASYNC_LOW_LATENCY;
+			if(ioctl(uart_fd, TIOCSSERIAL, &ser) < 0)
+				perror("uart low latency not supported");
+		} else {
+			perror("uart TIOCGSERIAL not supported");
+		}
+	}
 	return 0;
 }
 
@@ -50,6 +134,12 @@ int uart_close(void){
 }
 
 
+// 取得 fd
+int uart_get_fd(void){
+	return uart_fd;
+}
+
+
 // 讀取UART資料
 // buf: 儲存獨到的資料  len: buf的大小，最多len個bytes
 int uart_read(char *buf, size_t len){
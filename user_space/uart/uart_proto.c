@@ -0,0 +1,113 @@
+// UART 封包協定 (編碼/解析)，不做 I/O，由 uart_thread.c 使用
+// 封包: [SYNC][type][seq][len][payload][CRC16]
+
+#include <string.h>
+#include "uart_proto.h"
+
+
+// CRC16-CCITT (多項式 0x1021，起始 0xFFFF)
+uint16_t uart_proto_crc16(const uint8_t *data, size_t len){
+	uint16_t crc = 0xFFFF;
+
+	for(size_t i = 0; i < len; i++){
+		crc ^= (uint16_t)data[i] << 8;
+		for(int b = 0; b < 8; b++)
+			crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+	}
+	return crc;
+}
+
+
+// 編碼封包
+int uart_proto_encode(uint8_t type, uint8_t seq, const void *payload, size_t len, uint8_t *out){
+
+	if(len > UART_PROTO_MAX_PAYLOAD) return -1;
+
+	out[0] = UART_PROTO_SYNC;
+	out[1] = type;
+	out[2] = seq;
+	out[3] = (uint8_t)len;
+	if(len) memcpy(&out[4], payload, len);
+
+	uint16_t crc = uart_proto_crc16(&out[1], 3 + len);
+	out[4 + len] = crc & 0xFF;
+	out[5 + len] = crc >> 8;
+	return len + UART_PROTO_OVERHEAD;
+}
+
+
+// 初始化解析器
+void uart_proto_parser_init(uart_proto_parser *p){
+	memset(p, 0, sizeof(*p));
+}
+
+
+// 丟掉 buf 開頭 n 個位元組
+static void drop(uart_proto_parser *p, size_t n){
+	memmove(p->buf, p->buf + n, p->len - n);
+	p->len -= n;
+}
+
+
+// 解析 buf 內完整的封包
+static int parse(uart_proto_parser *p, uart_proto_frame_cb cb, void *arg){
+	int frames = 0;
+
+	for(;;){
+		// 1.找 SYNC，前面的雜訊丟掉
+		size_t i = 0;
+		while(i < p->len && p->buf[i] != UART_PROTO_SYNC) i++;
+		if(i){
+			p->resyncs += i;
+			drop(p, i);
+		}
+
+		// 2.標頭還沒收齊
+		if(p->len < 4) break;
+
+		// 3.長度不合理: 這個 SYNC 是假的，跳過它
+		size_t plen = p->buf[3];
+		if(plen > UART_PROTO_MAX_PAYLOAD){
+			p->resyncs++;
+			drop(p, 1);
+			continue;
+		}
+
+		// 4.封包還沒收齊
+		size_t total = plen + UART_PROTO_OVERHEAD;
+		if(p->len < total) break;
+
+		// 5.CRC 錯誤: 只丟掉 SYNC，從後面的位元組重新找
+		uint16_t crc = uart_proto_crc16(&p->buf[1], 3 + plen);
+		uint16_t rx = p->buf[4 + plen] | (uint16_t)p->buf[5 + plen] << 8;
+		if(crc != rx){
+			p->crc_errors++;
+			drop(p, 1);
+			continue;
+		}
+
+		// 6.完整封包
+		if(cb) cb(p->buf[1], p->buf[2], &p->buf[4], plen, arg);
+		frames++;
+		drop(p, total);
+	}
+	return frames;
+}
+
+
+// 餵入位元組 (一次放不下就分段解析)
+int uart_proto_feed(uart_proto_parser *p, const uint8_t *data, size_t len,
+		    uart_proto_frame_cb cb, void *arg){
+	int frames = 0;
+
+	while(len > 0){
+		size_t n = sizeof(p->buf) - p->len;
+		if(n > len) n = len;
+		memcpy(p->buf + p->len, data, n);
+		p->len += n;
+		data += n;
+		len -= n;
+		frames += parse(p, cb, arg);
+	}
+	return frames;
+}
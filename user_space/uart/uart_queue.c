@@ -1,110 +1,219 @@
 // UART 柱列 Queue
-// 用於 tx/rx緩衝
+// 用於 tx/rx緩衝，每個方向只有一個生產者與一個消費者 (SPSC)，不需要 mutex
 
 #include <string.h>
 #include <stdio.h>
-#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include "uart_queue.h"
 
-// 1.初始化
-void queue_init(uart_queue_t *q){
-	q->head = 0;	// 隊頭索引
-	q->tail = 0;	// 隊尾索引
-	q->count = 0;	// 當前元素數量
-	
-	// 初始化互斥鎖，保戶多執行緒存取
-	pthread_mutex_init(&q->mutex, NULL);
-	
-	// 初始化條件變數，供thread等候或喚醒
-	pthread_cond_init(&q->cond, NULL);
-}
-
+#define QUEUE_MASK	(UART_QUEUE_BYTES - 1)
+#define QUEUE_HDR	2		// 每筆紀錄的長度欄位 (bytes)
+#define QUEUE_WRAP	0xFFFF		// 長度欄位為此值 = 尾端剩餘空間跳過，回到開頭
 
 
-// 將資料傳入 queue
-// 成功回傳0 失敗回傳-1(queue滿)
-int queue_push(uart_queue_t *q, const char *data){
-	
-	// 上鎖，保護共享資源
-	pthread_mutex_lock(&q->mutex);
-
-	if(q->count >= UART_QUEUE_SIZE){
-		// queue滿了
-		pthread_mutex_unlock(&q->mutex);
+// 1.初始化
+int queue_init(uart_queue_t *q){
+	atomic_init(&q->head, 0);	// 隊頭位置
+	atomic_init(&q->tail, 0);	// 隊尾位置
+	atomic_init(&q->parked, 0);
+	atomic_init(&q->stop, 0);
+
+	// 消費者睡著時的喚醒通道
+	q->efd = eventfd(0, EFD_CLOEXEC);
+	if(q->efd < 0){
+		perror("uart queue eventfd failed");
 		return -1;
 	}
-
-	// 複製字串到隊尾
-	strncpy(q->data[q->tail], data, UART_DATA_MAX -1);
-	q->data[q->tail][UART_DATA_MAX-1] = '\0';	// 確保字串結尾
-	
-	// 更新 tail 索引
-	q->tail = (q->tail+1)%UART_QUEUE_SIZE;
-	q->count++;
-
-	// 喚醒可能在 queue_pop 等待的 thread
-	pthread_cond_signal(&q->cond);
-
-	// 解鎖
-	pthread_mutex_unlock(&q->mutex);
 	return 0;
 }
 
 
-// 從 queue 取資料(阻塞)
-// 成功回傳0 失敗回傳-1
-int queue_pop(uart_queue_t *q, char *buf, size_t buf_size){
-	
-	// 上鎖
-	pthread_mutex_lock(&q->mutex); 
+// 消費者在睡才喚醒 (沒有人在等就不做 syscall)
+static void wake_consumer(uart_queue_t *q){
+	uint64_t one = 1;
 
-	// 如果queue空，等待cond被喚醒
-	while(q->count == 0){
-		pthread_cond_wait(&q->cond, &q->mutex);
+	// 和 queue_pop 的 parked=1 -> 再檢查一次 配對，避免漏掉喚醒
+	atomic_thread_fence(memory_order_seq_cst);
+	if(atomic_load_explicit(&q->parked, memory_order_relaxed)){
+		if(write(q->efd, &one, sizeof(one)) < 0) perror("uart queue wake failed");
 	}
+}
+
 
-	// 取出隊頭資料
-	strncpy(buf, q->data[q->head], buf_size-1);
-	buf[buf_size-1] = '\0';
+// 將資料傳入 queue (生產者)
+// 成功回傳0 失敗回傳-1(queue滿)
+int queue_push_buf(uart_queue_t *q, const void *data, size_t len){
+
+	if(len == 0 || len >= QUEUE_WRAP) return -1;
+
+	size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+	size_t head = atomic_load_explicit(&q->head, memory_order_acquire);
+	size_t pos = tail & QUEUE_MASK;
+	size_t contig = UART_QUEUE_BYTES - pos;		// 到緩衝尾端的連續空間
+	size_t need = QUEUE_HDR + len;
+	size_t pad = (contig < need) ? contig : 0;	// 放不下就跳到開頭
+
+	// 1.空間不足
+	if(tail + pad + need - head > UART_QUEUE_BYTES) return -1;
+
+	// 2.尾端放不下: 留跳過標記 (剩不到 2 bytes 時消費者會自己跳過)
+	if(pad){
+		if(contig >= QUEUE_HDR){
+			uint16_t mark = QUEUE_WRAP;
+			memcpy(&q->data[pos], &mark, QUEUE_HDR);
+		}
+		tail += pad;
+		pos = 0;
+	}
 
-	// 更新 head 索引
-	q->head = (q->head + 1)%UART_QUEUE_SIZE;
-	q->count--;
+	// 3.寫入 [長度][資料]
+	uint16_t hdr = len;
+	memcpy(&q->data[pos], &hdr, QUEUE_HDR);
+	memcpy(&q->data[pos + QUEUE_HDR], data, len);
 
-	// 解鎖
-	pthread_mutex_unlock(&q->mutex);
+	// 4.發布 (release: 資料先寫好消費者才看得到新的 tail)
+	atomic_store_explicit(&q->tail, tail + need, memory_order_release);
+	wake_consumer(q);
 	return 0;
 }
 
 
-// 判斷 queue 是否為空
-// 空回傳非0 否則回傳0
-int queue_is_empty(uart_queue_t *q){
-	
-	int empty;
-	pthread_mutex_lock(&q->mutex);
-	empty = (q->count == 0);
-	pthread_mutex_unlock(&q->mutex);
-	return empty;
+// 將字串傳入 queue
+int queue_push(uart_queue_t *q, const char *data){
+	return queue_push_buf(q, data, strlen(data));
 }
 
 
-// 釋放queue的 mutex與cond
-void queue_destroy(uart_queue_t *q){
-	pthread_mutex_destroy(&q->mutex);
-	pthread_cond_destroy(&q->cond);
-}
+// 取出一筆 (不等待)
+// 回傳資料長度，0 表示沒有資料
+int queue_try_pop(uart_queue_t *q, char *buf, size_t buf_size){
+
+	size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+
+	for(;;){
+		size_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+		if(head == tail) return 0;	// 空
+
+		size_t pos = head & QUEUE_MASK;
+		size_t contig = UART_QUEUE_BYTES - pos;
+		uint16_t hdr;
+
+		// 1.尾端剩餘空間/跳過標記 -> 回到開頭
+		if(contig < QUEUE_HDR){
+			head += contig;
+			continue;
+		}
+		memcpy(&hdr, &q->data[pos], QUEUE_HDR);
+		if(hdr == QUEUE_WRAP){
+			head += contig;
+			continue;
+		}
 
+		// 2.複製資料 (太長截斷) 並補字串結尾
+		size_t n = hdr < buf_size - 1 ? hdr : buf_size - 1;
+		memcpy(buf, &q->data[pos + QUEUE_HDR], n);
+		buf[n] = '\0';
 
+		// 3.釋放空間給生產者
+		atomic_store_explicit(&q->head, head + QUEUE_HDR + hdr, memory_order_release);
+		return n;
+	}
+}
 
 
+// 從 queue 取資料(阻塞)
+// 回傳資料長度，-1 表示已停止
+int queue_pop(uart_queue_t *q, char *buf, size_t buf_size){
 
+	uint64_t cnt;
+
+	for(;;){
+		// 1.有資料直接取
+		int n = queue_try_pop(q, buf, buf_size);
+		if(n > 0) return n;
+		if(atomic_load(&q->stop)) return -1;
+
+		// 2.宣告要睡了，再檢查一次 (生產者可能剛好放進來)
+		atomic_store(&q->parked, 1);
+		atomic_thread_fence(memory_order_seq_cst);
+		n = queue_try_pop(q, buf, buf_size);
+		if(n > 0 || atomic_load(&q->stop)){
+			atomic_store(&q->parked, 0);
+			if(n > 0) return n;
+			return -1;
+		}
+
+		// 3.等生產者喚醒
+		if(read(q->efd, &cnt, sizeof(cnt)) < 0) perror("uart queue wait failed");
+		atomic_store(&q->parked, 0);
+	}
+}
 
 
+// 從兩個 queue 取資料(阻塞)，q0 優先 (兩個 queue 的消費者是同一個 thread)
+// 回傳資料長度，-1 表示已停止
+int queue_pop2(uart_queue_t *q0, uart_queue_t *q1, char *buf, size_t buf_size){
+
+	struct pollfd pfd[2] = {
+		{ .fd = q0->efd, .events = POLLIN },
+		{ .fd = q1->efd, .events = POLLIN },
+	};
+	uint64_t cnt;
+	int i;
+
+	for(;;){
+		// 1.有資料直接取
+		int n = queue_try_pop(q0, buf, buf_size);
+		if(n == 0) n = queue_try_pop(q1, buf, buf_size);
+		if(n > 0) return n;
+		if(atomic_load(&q0->stop) || atomic_load(&q1->stop)) return -1;
+
+		// 2.兩個 queue 都宣告要睡了，再檢查一次 (同 queue_pop)
+		atomic_store(&q0->parked, 1);
+		atomic_store(&q1->parked, 1);
+		atomic_thread_fence(memory_order_seq_cst);
+		n = queue_try_pop(q0, buf, buf_size);
+		if(n == 0) n = queue_try_pop(q1, buf, buf_size);
+		if(n > 0 || atomic_load(&q0->stop) || atomic_load(&q1->stop)){
+			atomic_store(&q0->parked, 0);
+			atomic_store(&q1->parked, 0);
+			if(n > 0) return n;
+			return -1;
+		}
+
+		// 3.等任一個生產者喚醒
+		if(poll(pfd, 2, -1) < 0) perror("uart queue wait failed");
+		for(i = 0; i < 2; i++)
+			if((pfd[i].revents & POLLIN) && read(pfd[i].fd, &cnt, sizeof(cnt)) < 0)
+				perror("uart queue wait failed");
+		atomic_store(&q0->parked, 0);
+		atomic_store(&q1->parked, 0);
+	}
+}
 
 
+// 判斷 queue 是否為空
+// 空回傳非0 否則回傳0
+int queue_is_empty(uart_queue_t *q){
+	return atomic_load_explicit(&q->head, memory_order_acquire) ==
+	       atomic_load_explicit(&q->tail, memory_order_acquire);
+}
 
 
+// 停止並喚醒消費者
+void queue_wake(uart_queue_t *q){
+	uint64_t one = 1;
 
+	atomic_store(&q->stop, 1);
+	if(write(q->efd, &one, sizeof(one)) < 0) perror("uart queue wake failed");
+}
 
 
+// 釋放 eventfd
+void queue_destroy(uart_queue_t *q){
+	if(q->efd >= 0) close(q->efd);
+	q->efd = -1;
+}
@@ -4,43 +4,150 @@
 #include <pthread.h>
 #include <string.h>
 #include <unistd.h>
+#include <poll.h>
+#include <time.h>		// clock_gettime
+#include <stdatomic.h>
+#include <sys/eventfd.h>
 #include "uart.h"
 #include "uart_queue.h"
 #include "uart_thread.h"
+#include "uart_proto.h"
+
+// TX thread 一次 write() 最多合併的位元組數
+#define UART_TX_BATCH 512
 
 
 // 全域變數
 static uart_queue_t tx_queue;	// tx queue存放要發送的資料
 static uart_queue_t rx_queue;	// rx queue存放接收到的資料
+static uart_queue_t reply_queue;	// ACK/PONG 回應封包 (RX 端放入，TX thread 送出)
 static pthread_t tx_thread;	// tx thread執行緒
 static pthread_t rx_thread;	// rx thread執行緒
+static int rx_thread_on = 0;	// 1 = 有建立 RX thread (0 = RX 由事件迴圈處理)
+static int rx_stop_fd = -1;	// 喚醒 RX thread 結束用的 eventfd
 static volatile int stop_flag = 0;	// 停止執行緒旗標 1停止 0運行
 static uart_rx_callback_t rx_callback = NULL;
+static uart_proto_parser rx_parser;	// RX 封包解析器
+static uint8_t tx_seq = 0;		// 下一個送出封包的序號 (只有 uart_send 的呼叫者寫)
+
+// 統計: 每個欄位只有一個 thread 寫 (tx_* = TX thread，其餘 = RX thread 或事件迴圈)
+// uart_get_stats 可能在別的 thread 讀，所以都用 atomic (relaxed，只需要不撕裂)
+static struct {
+	atomic_ulong tx_frames, tx_writes;				// TX thread
+	atomic_ulong rx_frames, acks, crc_errors, resyncs, pongs;	// RX 端
+	atomic_uchar last_ack;
+	atomic_uint rtt_last_us, rtt_min_us, rtt_max_us, rtt_avg_us;
+} stats;
+
+#define STAT_GET(f)	atomic_load_explicit(&stats.f, memory_order_relaxed)
+#define STAT_SET(f, v)	atomic_store_explicit(&stats.f, (v), memory_order_relaxed)
+#define STAT_ADD(f, n)	atomic_fetch_add_explicit(&stats.f, (n), memory_order_relaxed)
+
 
 // 註冊 callback
 void uart_set_rx_callback(uart_rx_callback_t cb){
 	rx_callback = cb;
 }
 
+// 單調時鐘 (ns)
+static uint64_t now_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+// 收到 PONG: 用送出時間算來回延遲
+static void on_pong(const uint8_t *payload, size_t len){
+	uint64_t sent;
+
+	if(len != sizeof(sent)) return;
+	memcpy(&sent, payload, sizeof(sent));
+
+	unsigned int rtt = (now_ns() - sent) / 1000;
+	unsigned long pongs = STAT_GET(pongs);
+	STAT_SET(rtt_last_us, rtt);
+	if(pongs == 0 || rtt < STAT_GET(rtt_min_us)) STAT_SET(rtt_min_us, rtt);
+	if(rtt > STAT_GET(rtt_max_us)) STAT_SET(rtt_max_us, rtt);
+	STAT_SET(rtt_avg_us, pongs == 0 ? rtt : (STAT_GET(rtt_avg_us) * 7 + rtt) / 8);
+	STAT_ADD(pongs, 1);
+}
+
+
+// 回應封包 ACK/PONG 交給 TX thread 送出 (RX 端呼叫)
+// 只有 TX thread 寫 UART fd，封包不會和 TX 的部分寫入交錯；RX 端用自己的 reply queue，TX queue 仍是單一生產者
+static void send_reply(uint8_t type, uint8_t seq, const uint8_t *payload, size_t len){
+	uint8_t frame[UART_PROTO_MAX_FRAME];
+	int n = uart_proto_encode(type, seq, payload, len, frame);
+	if(n > 0 && queue_push_buf(&reply_queue, frame, n) != 0)
+		fprintf(stderr, "reply queue 已滿，丟棄回應封包 type=%d seq=%d\n", type, seq);
+}
+
+
+// 解析出一個封包
+static void on_frame(uint8_t type, uint8_t seq, const uint8_t *payload, size_t len, void *arg){
+	char buf[UART_PROTO_MAX_PAYLOAD + 1];
+
+	STAT_ADD(rx_frames, 1);
+
+	// 1.對方確認收到我們的封包
+	if(type == UART_FRAME_ACK){
+		STAT_ADD(acks, 1);
+		STAT_SET(last_ack, seq);
+		return;
+	}
+
+	// 2.來回延遲量測
+	if(type == UART_FRAME_PONG){
+		on_pong(payload, len);
+		return;
+	}
+	if(type == UART_FRAME_PING){
+		send_reply(UART_FRAME_PONG, seq, payload, len);
+		return;
+	}
+
+	// 3.指令/文字: 回 ACK，交給 rx queue / callback
+	send_reply(UART_FRAME_ACK, seq, NULL, 0);
+	if(len == 0) return;
+	memcpy(buf, payload, len);
+	buf[len] = '\0';	// 確保字串結尾
+	queue_push_buf(&rx_queue, buf, len);	// 保留 queue 緩衝
+	if(rx_callback) rx_callback(buf, len);	// 事件驅動
+}
+
+
+// 讀一次 uart 交給封包解析器  回傳=> 讀到的位元組數
+static int rx_once(char *buf, size_t buf_size){
+
+	int n = uart_read(buf, buf_size);
+	if(n > 0){
+		uart_proto_feed(&rx_parser, (const uint8_t *)buf, n, on_frame, NULL);
+		STAT_SET(crc_errors, rx_parser.crc_errors);
+		STAT_SET(resyncs, rx_parser.resyncs);
+	}
+	return n;
+}
+
+
 // RX 執行緒函式(read)
 static void* uart_rx_thread_func(void *arg){
 	
 	// 暫存從 uart 讀到的資料
 	char buf[UART_DATA_MAX];
+	struct pollfd pfd[2] = {
+		{ .fd = uart_get_fd(), .events = POLLIN },
+		{ .fd = rx_stop_fd, .events = POLLIN },		// uart_thread_stop 喚醒
+	};
 
 	while(!stop_flag){
 		
+		// 睡到有資料或要結束 (不再每 1ms 醒來檢查)
+		if(poll(pfd, 2, -1) < 0) continue;
+		if(pfd[1].revents) break;
+
 		// 從 uart 讀資料
-		int n = uart_read(buf, sizeof(buf)-1);
-		if(n > 0){
-    			buf[n] = '\0';	// 確保字串結尾
-    			if(strlen(buf) > 0){  // 過濾空字串
-        			queue_push(&rx_queue, buf);	// 保留 queue 緩衝
-        			if(rx_callback) rx_callback(buf, n);	// 事件驅動
-    			}
-		} else {
-    			usleep(1000);	// 沒資料短暫休息，避免 cpu 空轉
-		}		
+		if(pfd[0].revents & POLLIN) rx_once(buf, sizeof(buf));
 	}
 	return NULL;
 
@@ -50,44 +157,115 @@ static void* uart_rx_thread_func(void *arg){
 // TX 執行緒函式(write)
 static void* uart_tx_thread_func(void *arg){
 	
-	// 儲存要發送的資料
-	char buf[UART_DATA_MAX]="";
+	// 儲存要發送的封包 (多個封包合併，+1 給 queue_pop 補的 '\0')
+	char buf[UART_TX_BATCH + 1];
 	
 	while(!stop_flag){
 		
-		// 從 TX queue 取資料，如果 queue 空會阻塞等待 cond
-		queue_pop(&tx_queue, buf, sizeof(buf));
-		if(stop_flag) break;	// 停止旗標設置
+		// 1.取第一個封包 (回應優先)，兩個 queue 都空會阻塞等待 eventfd 喚醒
+		int len = queue_pop2(&reply_queue, &tx_queue, buf, sizeof(buf));
+		if(len < 0 || stop_flag) break;	// 停止旗標設置
+		int frames = 1;
+
+		// 2.把已經排隊的封包一起帶走 (剩餘空間要放得下最大封包)
+		while(UART_TX_BATCH - len >= UART_PROTO_MAX_FRAME){
+			int n = queue_try_pop(&reply_queue, buf + len, sizeof(buf) - len);
+			if(n <= 0) n = queue_try_pop(&tx_queue, buf + len, sizeof(buf) - len);
+			if(n <= 0) break;
+			len += n;
+			frames++;
+		}
 		
-		// 發送資料到 uart
-		printf("debug: %d\n", strlen(buf));
-		int n = uart_write(buf, strlen(buf));
-		if(n < 0){
+		// 3.一次 write() 送出 (處理部分寫入)
+		int off = 0;
+		while(off < len){
+			int n = uart_write(buf + off, len - off);
+			if(n < 0) break;
+			off += n;
+		}
+		if(off < len){
 			perror("uart_write 失敗");
 		} else {
-			printf("UART 已發送: %s\n", buf);
+			STAT_ADD(tx_frames, frames);
+			STAT_ADD(tx_writes, 1);
 		}
 	}
 	return NULL;
 }	
 
 
+// 建立 queue (每次啟動都會建立新的 eventfd，停止/失敗時由 uart_queues_destroy 關閉)
+static int uart_queues_init(void){
+	if(queue_init(&tx_queue) < 0) return -1;
+	if(queue_init(&rx_queue) < 0){
+		queue_destroy(&tx_queue);
+		return -1;
+	}
+	if(queue_init(&reply_queue) < 0){
+		queue_destroy(&tx_queue);
+		queue_destroy(&rx_queue);
+		return -1;
+	}
+	return 0;
+}
+
+
+// 釋放 queue 的 eventfd
+static void uart_queues_destroy(void){
+	queue_destroy(&tx_queue);
+	queue_destroy(&rx_queue);
+	queue_destroy(&reply_queue);
+}
+
+
+// 統計歸零 (啟動時，thread 還沒建立)
+static void uart_stats_reset(void){
+	STAT_SET(tx_frames, 0);
+	STAT_SET(tx_writes, 0);
+	STAT_SET(rx_frames, 0);
+	STAT_SET(acks, 0);
+	STAT_SET(last_ack, 0);
+	STAT_SET(crc_errors, 0);
+	STAT_SET(resyncs, 0);
+	STAT_SET(pongs, 0);
+	STAT_SET(rtt_last_us, 0);
+	STAT_SET(rtt_min_us, 0);
+	STAT_SET(rtt_max_us, 0);
+	STAT_SET(rtt_avg_us, 0);
+}
+
+
 // 啟動 UART 執行緒
 int uart_thread_start(const char *device){
 	
 	// 初始化
-	queue_init(&tx_queue);
-	queue_init(&rx_queue);
+	if(uart_queues_init() < 0) return -1;
+	uart_proto_parser_init(&rx_parser);
+	uart_stats_reset();
 
 	// 開啟UART
-	if(uart_open(device) < 0) return -1;
+	if(uart_open(device) < 0){
+		uart_queues_destroy();
+		return -1;
+	}
 
 	stop_flag = 0;	// 設定運行
 
+	rx_stop_fd = eventfd(0, EFD_CLOEXEC);
+	if(rx_stop_fd < 0){
+		perror("RX stop eventfd 建立失敗");
+		uart_close();
+		uart_queues_destroy();
+		return -1;
+	}
+
 	// 建立 TX 執行緒
 	if(pthread_create(&tx_thread, NULL, uart_tx_thread_func, NULL) != 0){
 		perror("TX thread 建立失敗");
+		close(rx_stop_fd);
+		rx_stop_fd = -1;
 		uart_close();
+		uart_queues_destroy();
 		return -1;
 	}
 
@@ -95,54 +273,135 @@ int uart_thread_start(const char *device){
 	if(pthread_create(&rx_thread, NULL, uart_rx_thread_func, NULL) != 0){
 		perror("RX thread 建立失敗");
 		stop_flag = 1;
-		pthread_cond_signal(&tx_queue.cond);	//  喚醒 TX thread
+		queue_wake(&tx_queue);	//  喚醒 TX thread
 		pthread_join(tx_thread, NULL);
+		close(rx_stop_fd);
+		rx_stop_fd = -1;
+		uart_close();
+		uart_queues_destroy();
+		return -1;
+	}
+	rx_thread_on = 1;
+	return 0;
+}
+
+
+// 只啟動 TX 執行緒 (RX 由事件迴圈呼叫 uart_handle_rx)
+int uart_thread_start_tx(const char *device){
+
+	// 初始化
+	if(uart_queues_init() < 0) return -1;
+	uart_proto_parser_init(&rx_parser);
+	uart_stats_reset();
+
+	// 開啟UART
+	if(uart_open(device) < 0){
+		uart_queues_destroy();
+		return -1;
+	}
+
+	stop_flag = 0;	// 設定運行
+	rx_thread_on = 0;
+
+	// 建立 TX 執行緒
+	if(pthread_create(&tx_thread, NULL, uart_tx_thread_func, NULL) != 0){
+		perror("TX thread 建立失敗");
 		uart_close();
+		uart_queues_destroy();
 		return -1;
 	}
 	return 0;
 }
 
 
+// 事件迴圈: UART fd 可讀
+int uart_handle_rx(void){
+	char buf[UART_DATA_MAX];
+	return rx_once(buf, sizeof(buf));
+}
+
+
 // 停止 UART 執行緒
 void uart_thread_stop(){
 	
 	// 設置停止旗標
 	stop_flag = 1;
 
-	// 喚醒可能阻塞在 queue 的 thread
-	pthread_cond_signal(&tx_queue.cond);
-	pthread_cond_signal(&rx_queue.cond);
+	// 喚醒可能阻塞在 queue / poll 的 thread
+	queue_wake(&tx_queue);
+	queue_wake(&rx_queue);
+	queue_wake(&reply_queue);
+	if(rx_stop_fd >= 0){
+		uint64_t one = 1;
+		if(write(rx_stop_fd, &one, sizeof(one)) < 0) perror("RX stop 喚醒失敗");
+	}
 
 	// 等待 thread 安全退出
 	pthread_join(tx_thread, NULL);
-	pthread_join(rx_thread, NULL);
+	if(rx_thread_on) pthread_join(rx_thread, NULL);
+	rx_thread_on = 0;
+	if(rx_stop_fd >= 0) close(rx_stop_fd);
+	rx_stop_fd = -1;
 
 	// 關閉 UART
 	uart_close();
 
-	// 釋放queue 資源	
-	queue_destroy(&tx_queue);
-	queue_destroy(&rx_queue);
+	// 釋放queue 資源 (關閉這次啟動建立的 eventfd，重新啟動才不會累積)
+	uart_queues_destroy();
 }
 
 
-// Logic層呼叫: 非阻塞發送
-int uart_send(const char *data){
-	if(queue_push(&tx_queue, data) != 0){
-		fprintf(stderr, "TX queue 已滿，無法發送資料: %s\n", data);
+// Logic層呼叫: 非阻塞發送封包 (不上鎖，只複製封包本身)
+int uart_send_frame(uint8_t type, const void *payload, size_t len){
+	uint8_t frame[UART_PROTO_MAX_FRAME];
+
+	int n = uart_proto_encode(type, tx_seq, payload, len, frame);
+	if(n < 0){
+		fprintf(stderr, "UART payload 太長: %zu bytes\n", len);
 		return -1;
 	}
+	if(queue_push_buf(&tx_queue, frame, n) != 0){
+		fprintf(stderr, "TX queue 已滿，無法發送封包 type=%d\n", type);
+		return -1;
+	}
+	tx_seq++;
 	return 0;
 }
 
 
+// Logic層呼叫: 非阻塞發送指令 (例如 "L" "R" "D" "S")
+int uart_send(const char *data){
+	return uart_send_frame(UART_FRAME_CMD, data, strlen(data));
+}
+
+
+// 統計
+void uart_get_stats(uart_stats *s){
+	s->tx_frames = STAT_GET(tx_frames);
+	s->tx_writes = STAT_GET(tx_writes);
+	s->rx_frames = STAT_GET(rx_frames);
+	s->acks = STAT_GET(acks);
+	s->last_ack = STAT_GET(last_ack);
+	s->crc_errors = STAT_GET(crc_errors);
+	s->resyncs = STAT_GET(resyncs);
+	s->pongs = STAT_GET(pongs);
+	s->rtt_last_us = STAT_GET(rtt_last_us);
+	s->rtt_min_us = STAT_GET(rtt_min_us);
+	s->rtt_max_us = STAT_GET(rtt_max_us);
+	s->rtt_avg_us = STAT_GET(rtt_avg_us);
+}
+
+
+// 送出 PING (payload = 目前時間，Pico 原封不動送回)
+int uart_ping(void){
+	uint64_t t = now_ns();
+	return uart_send_frame(UART_FRAME_PING, &t, sizeof(t));
+}
+
+
 // Logic層呼叫: 非阻塞接收
 int uart_receive(char *buf, size_t buf_size){
-	if(queue_is_empty(&rx_queue)) return 0;	// 沒有資料
-	int ret = queue_pop(&rx_queue, buf, buf_size);
-	printf("[DEBUG] uart_recieve pop success, queue count left= %d\n", rx_queue.count);
-	return ret;
+	return queue_try_pop(&rx_queue, buf, buf_size);	// 0 = 沒有資料
 }
 
 
@@ -0,0 +1,57 @@
+// 調度中心指令解析 標頭檔 (MQTT_TOPIC_CAR 的 JSON)
+// 一次掃描 payload，不配置記憶體，結果寫進呼叫者準備好的結構與路線緩衝
+// 例: {"start":1}  {"stop":1}  {"buzzer_off":1}  {"route":[1,12,3],"delivery":1}
+//     {"encoding":"binary"} / {"encoding":"json"}  協商車子回報遙測的編碼
+#ifndef __CAR_CMD_H__
+#define __CAR_CMD_H__
+
+#include <stddef.h>
+
+#define CAR_CMD_MAX_LEN		4096	// payload 上限 (bytes)，超過直接拒絕
+#define CAR_CMD_MAX_DEPTH	8	// 未知欄位的巢狀層數上限
+
+// 指令旗標 (同一則訊息可以有多個)
+#define CAR_CMD_START		0x01	// "start":1
+#define CAR_CMD_STOP		0x02	// "stop":1
+#define CAR_CMD_ROUTE		0x04	// "route":[...]
+#define CAR_CMD_DELIVERY	0x08	// "delivery":0/1 (有出現才設)
+#define CAR_CMD_BUZZER_OFF	0x10	// "buzzer_off":1
+#define CAR_CMD_ENCODING	0x20	// "encoding":"json"/"binary" (認得的值才設)
+
+// 遙測編碼 (和 telemetry_codec.h 的 TELEMETRY_ENC_* 相同)
+#define CAR_CMD_ENC_JSON	0
+#define CAR_CMD_ENC_BINARY	1
+
+// 錯誤碼
+#define CAR_CMD_OK		0
+#define CAR_CMD_ERR_SYNTAX	-1	// 不是合法的 JSON 物件
+#define CAR_CMD_ERR_TOO_LONG	-2	// payload 超過 CAR_CMD_MAX_LEN
+#define CAR_CMD_ERR_TOO_DEEP	-3	// 巢狀超過 CAR_CMD_MAX_DEPTH
+#define CAR_CMD_ERR_ROUTE_FULL	-4	// 路線步驟超過 route_cap
+#define CAR_CMD_ERR_NUMBER	-5	// 數字格式錯誤或超出範圍
+
+
+// 解析結果
+typedef struct {
+	unsigned int flags;	// CAR_CMD_* 旗標
+	int delivery;		// 1 = 送貨  0 = 接貨 (CAR_CMD_DELIVERY 時有效)
+	int encoding;		// CAR_CMD_ENC_* (CAR_CMD_ENCODING 時有效)
+	int *route;		// 路線緩衝 (呼叫者提供)
+	int route_cap;		// 路線緩衝大小
+	int route_len;		// 解析出的步驟數
+} car_cmd;
+
+
+// ------------ API 介面 -------------
+
+// 設定路線緩衝並清除結果
+void car_cmd_init(car_cmd *cmd, int *route_buf, int route_cap);
+
+// 解析一則訊息 (payload 不需要 '\0' 結尾)
+// 回傳=> CAR_CMD_OK 或 CAR_CMD_ERR_*，失敗時 cmd->flags 為 0
+int car_cmd_parse(const char *payload, size_t len, car_cmd *cmd);
+
+// 錯誤碼轉文字
+const char *car_cmd_strerror(int err);
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef SONIC_CHARDEV_H
+#define SONIC_CHARDEV_H
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+#define HC_SR04_MAX_SENSORS 4   // 最多 4 顆 (/dev/ultrasonic0~3)
+
+// 一幀: 所有感測器各量測一次後的結果
+struct hc_sr04_frame {
+    __u32 seq;                               // 幀序號 (每完成一幀 +1)
+    __u32 valid_mask;                        // bit i = 第 i 顆本幀有有效距離
+    __u64 ts_ns;                             // 幀完成時間 CLOCK_MONOTONIC (ns)
+    __s32 distance_mm[HC_SR04_MAX_SENSORS];  // 距離 (mm)，-1 = 逾時/未設定/濾波後不可信
+    __u32 brake_mask;                        // bit i = 第 i 顆的緊急煞車已觸發 (距離恢復後清除)
+    __u8  confidence[HC_SR04_MAX_SENSORS];   // 0~100 (%)：濾波視窗內採用的樣本比例 (沒濾波 = 有效 100 / 無效 0)
+};
+
+// 緊急煞車 (HC_SR04_SET_BRAKE): 連續 debounce 次量測距離小於 threshold_mm 時，
+// driver 在回波中斷內直接呼叫馬達 driver 的 motor_emergency_stop()，馬達鎖定直到 user space 解除
+// 逾時 (沒有回波) 不計數也不重置
+#define HC_SR04_BRAKE_DEBOUNCE_MAX 16
+
+struct hc_sr04_brake {
+    __u32 threshold_mm;    // 煞車距離 (mm)，0 = 關閉
+    __u32 debounce;        // 連續幾次量測才觸發 (1 ~ HC_SR04_BRAKE_DEBOUNCE_MAX)
+};
+
+// 多次取樣濾波 (HC_SR04_SET_FILTER): driver 保留每顆最近 samples 次回波，
+// 距離取中位數，和中位數相差超過 outlier_mm 的樣本剔除後再取一次中位數
+// 採用的樣本少於 min_valid 時這次結果視為無效 (read 回 -EIO、幀內 -1)
+// 煞車、區間、read、幀都用濾波後的距離；samples = 1 即原本的單次量測
+// 回波脈寬超過 timeout_us 記為逾時 (限制量測距離，0 = 到時槽結束為止)
+#define HC_SR04_FILTER_MAX 9
+
+struct hc_sr04_filter {
+    __u32 samples;         // 視窗大小 N (1 ~ HC_SR04_FILTER_MAX)
+    __u32 outlier_mm;      // 離群門檻 (mm)，0 = 不剔除
+    __u32 min_valid;       // 至少幾個樣本採用才算有效 (1 ~ samples)
+    __u32 timeout_us;      // 回波逾時 (us)，0 = 時槽長度
+};
+
+// 距離區間 (HC_SR04_SET_ZONES): driver 每次量測都分類，區間改變 (或煞車觸發/恢復) 時
+// 才喚醒這個 file 的 poll (POLLPRI)，user space 不用每幀讀取比較
+// 進入較近的區間: 距離 < 門檻；離開: 距離 >= 門檻 + hysteresis_mm (避免在門檻附近來回跳)
+// 逾時 (沒有回波) 不改變區間
+#define HC_SR04_ZONE_UNKNOWN 0   // 還沒有量測結果 (或未設定區間)
+#define HC_SR04_ZONE_CLEAR   1   // >= caution_mm
+#define HC_SR04_ZONE_CAUTION 2   // < caution_mm
+#define HC_SR04_ZONE_DANGER  3   // < danger_mm
+
+struct hc_sr04_zones {
+    __u32 caution_mm;      // 0 = 關閉區間通知
+    __u32 danger_mm;       // 需小於 caution_mm
+    __u32 hysteresis_mm;   // 離開區間要多遠離門檻
+};
+
+// 目前區間 (HC_SR04_GET_ZONE)，取過之後 POLLPRI 清除直到下一次改變
+struct hc_sr04_zone_event {
+    __u32 zone;            // HC_SR04_ZONE_*
+    __u32 seq;             // 改變次數 (區間或煞車狀態)
+    __s32 distance_mm;     // 最後一次改變時的距離
+    __u32 brake;           // 1 = 這顆的緊急煞車已觸發 (見 HC_SR04_SET_BRAKE)
+    __u64 ts_ns;           // 最後一次改變的時間 CLOCK_MONOTONIC
+};
+
+// ioctl 的魔術數字及命令編號
+#define HC_SR04_IOC_MAGIC 'H'
+#define HC_SR04_SET_TRIGGER _IOW(HC_SR04_IOC_MAGIC, 1, int) // 設定 trigger 腳位
+#define HC_SR04_SET_ECHO    _IOW(HC_SR04_IOC_MAGIC, 2, int) // 設定 echo 腳位
+#define HC_SR04_SET_GROUP   _IOW(HC_SR04_IOC_MAGIC, 3, int) // 設定干擾群組 (同群組同時觸發)
+#define HC_SR04_GET_FRAME   _IOR(HC_SR04_IOC_MAGIC, 4, struct hc_sr04_frame) // 取最新一幀 (不等待)
+#define HC_SR04_WAIT_FRAME  _IOR(HC_SR04_IOC_MAGIC, 5, struct hc_sr04_frame) // 等待下一幀
+#define HC_SR04_SET_BRAKE   _IOW(HC_SR04_IOC_MAGIC, 6, struct hc_sr04_brake) // 設定這顆的緊急煞車
+#define HC_SR04_SET_ZONES   _IOW(HC_SR04_IOC_MAGIC, 7, struct hc_sr04_zones) // 設定區間門檻，這個 file 改為區間通知
+#define HC_SR04_GET_ZONE    _IOR(HC_SR04_IOC_MAGIC, 8, struct hc_sr04_zone_event) // 取目前區間 (不等待)
+#define HC_SR04_SET_FILTER  _IOW(HC_SR04_IOC_MAGIC, 9, struct hc_sr04_filter) // 設定這顆的多次取樣濾波與逾時
+
+#endif
@@ -1,36 +1,73 @@
 #ifndef __HCSR04_H__
 #define __HCSR04_H__
-#define HC_SR04_SET_TRIGGER  _IOW('U', 0, int)
-#define HC_SR04_SET_ECHO     _IOW('U', 1, int)
+
+#include "hc_sr_ioctl.h"	// 與 driver 共用的 ioctl 定義
 
 
 // 單顆超聲波的距離資料
 typedef struct {
-    int distance; // 單位: cm
+    int distance;   // 單位: cm
+    int confidence; // 0~100 (%)：driver 濾波視窗內採用的樣本比例 (沒濾波 = 有效 100 / 無效 0)
 } hcsr04_data;
 
 
-// 四顆超聲波的資料集合
+// 四顆超聲波的資料集合 (driver 的一幀)
 typedef struct {
     hcsr04_data ultrasonic[4]; // ultrasonic[0]~[3]
+    unsigned int seq;          // 幀序號
+    unsigned int brake_mask;   // bit i = 第 i 顆的 kernel 緊急煞車已觸發 (馬達已被 driver 停下)
+    unsigned int filter_mask;  // bit i = 第 i 顆的距離已由 driver 中位數濾波 (單一雜訊已剔除，不用再連續計數)
+    unsigned long long ts_ns;  // 幀完成時間 CLOCK_MONOTONIC (ns)
 } hcsr04_all_data;
 
 // callback 型態，由邏輯層實作
-typedef void(*hcsr04_callback)(hcsr04_all_data *data);
+typedef void(*hcsr04_callback_t)(hcsr04_all_data *data);
+
+
+// 單顆的距離區間 (driver 分類，只有改變時才通知)
+typedef struct {
+    int zone;                  // HC_SR04_ZONE_* (CLEAR/CAUTION/DANGER，UNKNOWN = 還沒有量測)
+    int distance;              // 改變時的距離 (cm)
+    int brake;                 // 1 = kernel 緊急煞車已觸發
+    unsigned int seq;          // 改變次數
+    unsigned long long ts_ns;  // 改變時間 CLOCK_MONOTONIC (ns)
+} hcsr04_zone_event;
 
 
 // ----------------- API -----------------
 int hcsr04_open_all(void);               // 打開四顆超聲波
-int hcsr04_read_all(hcsr04_all_data *d); // 讀取四顆距離
+int hcsr04_read_all(hcsr04_all_data *d); // 等待並讀取下一幀四顆距離
 int hcsr04_close_all(void);              // 關閉四顆超聲波
 
+// kernel 緊急煞車: 第 idx 顆連續 debounce 次小於 threshold_cm 時，driver 在中斷內直接停車並鎖定馬達
+// (需用 motor_clear_fault 解除)，threshold_cm = 0 關閉
+// 回傳=> 0成功 -1失敗 (例如馬達 driver 沒載入，只能靠 user space 判斷)
+int hcsr04_set_brake(int idx, int threshold_cm, int debounce);
+
+// driver 多次取樣濾波: 第 idx 顆取最近 samples 次回波的中位數，和中位數相差超過 outlier_cm 的剔除，
+// 採用的少於 min_valid 次就回報無效 (-1)；回波超過 timeout_us 算逾時 (0 = 不限制)
+// 之後煞車、區間、幀都是濾波後的距離
+// 回傳=> 0成功 -1失敗 (舊 driver 不支援，距離是單次量測)
+int hcsr04_set_filter(int idx, int samples, int outlier_cm, int min_valid, int timeout_us);
+
+// 區間通知: 另外開一個第 idx 顆的 fd，driver 依門檻 (cm) 分類，只有區間或煞車狀態改變時
+// fd 才有 POLLPRI (事件迴圈等 EPOLLPRI)，不用每幀讀取比較；離開區間要多遠離 hysteresis_cm
+// 回傳=> 0成功 -1失敗 (舊 driver 不支援，改用幀)
+int hcsr04_zone_open(int idx, int caution_cm, int danger_cm, int hysteresis_cm);
+int hcsr04_zone_fd(void);                         // 區間通知的 fd，未開啟為 -1
+int hcsr04_zone_read(hcsr04_zone_event *ev);      // 不等待  回傳=> 1有改變  0沒有  -1失敗
+
+// 給事件迴圈 (epoll) 用: fd 可讀代表有新的一幀，再用 hcsr04_read_frame 取出
+int hcsr04_fd(void);                            // 等待幀用的 fd，未開啟為 -1
+int hcsr04_read_frame(hcsr04_all_data *data);   // 不等待  回傳=> 1新的一幀  0沒有新幀  -1失敗
+
 
 // 執行緒函式，供 pthread_create 使用
 void* hcsr04_thread_func(void* arg);
 
 
 // callback 指標，供logic.c 設定
-extern hcsr04_callback distance_cb;
+extern hcsr04_callback_t distance_cb;
 
 
 #endif
@@ -0,0 +1,78 @@
+// 循跡 PID 控制器 標頭檔
+// 把 3 位元循跡編碼換算成線的偏移量，以 PID (微分取自帶時間戳的編碼歷史) 算左右輪差速，
+// 再加上依偏移量降速的前饋，輸出每輪速度 (有上下限)
+// 取代 logic()/handle_state() 裡 SPEED_INIT ± SPEED1/SPEED2 的查表與 is_left_shift()/find_last_valid()
+#ifndef __LINE_CTRL_H__
+#define __LINE_CTRL_H__
+
+#define LINE_CTRL_HISTORY	8	// 編碼歷史長度
+#define LINE_CTRL_TICK_MS	10	// 建議的固定 tick 週期 (ms)
+
+
+// 控制參數 (偏移量單位: 感測器格，-2 ~ +2，正 = 線在車身右側)
+typedef struct {
+	float kp;		// 比例增益 (% / 格)
+	float ki;		// 積分增益 (% / 格·秒)
+	float kd;		// 微分增益 (% / (格/秒))
+	float i_limit;		// 積分上限 (格·秒)，防止積分飽和
+	int cruise;		// 直線巡航速度 (%)
+	float slow_gain;	// 前饋降速 (% / 格)，偏越多越慢
+	int speed_min;		// 每輪最低速度 (%)
+	int speed_max;		// 每輪最高速度 (%)
+	float lost_offset;	// 出軌 (000) 時沿用上次方向的偏移量 (格)
+	int lost_ms;		// 出軌超過這個時間才回報 (ms)
+} line_ctrl_params;
+
+// 預設參數
+#define LINE_CTRL_DEFAULTS { \
+	.kp = 8.0f, .ki = 2.0f, .kd = 0.3f, .i_limit = 2.0f, \
+	.cruise = 55, .slow_gain = 5.0f, \
+	.speed_min = 20, .speed_max = 90, \
+	.lost_offset = 3.0f, .lost_ms = 300 }
+
+
+// 一次 tick 的輸出
+typedef struct {
+	int left;		// 左輪速度 (%)
+	int right;		// 右輪速度 (%)
+	float offset;		// 估計的偏移量 (格)
+	float derivative;	// 偏移量變化率 (格/秒)
+} line_ctrl_output;
+
+
+// tick 結果
+#define LINE_CTRL_OK	0	// 有新的輸出
+#define LINE_CTRL_LOST	1	// 出軌超過 lost_ms (應該停車)
+#define LINE_CTRL_IDLE	2	// 還沒有任何有效編碼
+
+
+// ------------ API 介面 -------------
+
+// 初始化，p = NULL 使用預設參數
+void line_ctrl_init(const line_ctrl_params *p);
+
+// 調整參數 (不清除狀態)
+void line_ctrl_set_params(const line_ctrl_params *p);
+
+// 取得目前參數
+void line_ctrl_get_params(line_ctrl_params *p);
+
+// 清除歷史與積分 (停車、節點動作結束後呼叫)
+void line_ctrl_reset(void);
+
+// 記錄一筆循跡編碼 (左*4 + 中*2 + 右)，ts_ns = 變化時間 CLOCK_MONOTONIC
+// 節點/終點編碼 (111, 101) 不影響控制
+void line_ctrl_update(int code, unsigned long long ts_ns);
+
+// 出軌前最後一個循跡編碼 (001/011/010/110/100)，還沒有資料回傳 2 (置中)
+int line_ctrl_last_code(void);
+
+// 最近 n 筆 (最多 LINE_CTRL_HISTORY) 偏移量中同一側達到 threshold 筆才算有趨勢 (出軌的筆數不算)
+// 回傳=> 1線在右側(車身左偏)  -1線在左側(車身右偏)  0沒有明顯趨勢
+int line_ctrl_trend(int n, int threshold);
+
+// 固定週期呼叫，now_ns = 目前時間 CLOCK_MONOTONIC，dt_ms = tick 週期
+// 回傳=> LINE_CTRL_OK / LINE_CTRL_LOST / LINE_CTRL_IDLE
+int line_ctrl_tick(unsigned long long now_ns, int dt_ms, line_ctrl_output *out);
+
+#endif
@@ -8,27 +8,61 @@
 // 節點鎖定旗標 (外部可用 extern 引用)
 extern bool node_active;
 
+// 目前路線 (main.c 定義)
+extern Route *my_route;
+
+// 建立控制 tick 與到站用的計時器，需在 reactor_init() 之後呼叫  回傳=> 0成功 -1失敗
+int logic_init(void);
+
+// 取消進行中的節點動作/到站等待並解鎖節點
+void logic_reset(void);
+
 // ----------------- 超聲波避障 -----------------
 
+// 前方距離連續 EMERGENCY_FRAMES 幀小於 EMERGENCY_DIST_CM 就緊急停止
+// 同樣的門檻也設給 kernel (hcsr04_set_brake)，driver 在回波中斷內直接停車，這裡的判斷是備援
+#define EMERGENCY_DIST_CM	5
+#define EMERGENCY_FRAMES	3
+#define EMERGENCY_FRAMES_FILTERED 1	// driver 已做中位數濾波 (單一雜訊已剔除)，一幀就算
+
+// 前方那顆的 driver 濾波 (hcsr04_set_filter): 最近 3 次取中位數，至少 2 次一致才有效
+// 障礙物出現後第 2 次量測就反應 (原本要連續 3 幀)，回波超過 SONIC_TIMEOUT_US (約 2m) 當作沒有
+#define SONIC_FILTER_N		3
+#define SONIC_FILTER_MIN_VALID	2
+#define SONIC_OUTLIER_CM	5
+#define SONIC_TIMEOUT_US	12000
+
+// 距離區間 (driver 分類，改變時才通知): 小於 CAUTION_DIST_CM 巡航降到 CAUTION_CRUISE
+#define CAUTION_DIST_CM		20
+#define ZONE_HYST_CM		2	// 離開區間要多遠離門檻，避免在門檻附近來回切換
+#define CAUTION_CRUISE		35	// 警戒區的巡航速度 (%)
+
 // 緊急停止，停止馬達、蜂鳴器、紅燈，並通知 MQTT 調度中心
 void emergency_stop(void);
 
 // 解除緊急狀態，關閉蜂鳴器與紅燈，並通知 MQTT 調度中心
 void emergency_clear(void);
 
-// 超聲波 callback，hcsr04_thread_func 讀到距離時呼叫
+// 超聲波 callback，事件迴圈收到一幀距離時呼叫
 void hcsr04_callback(hcsr04_all_data *data);
 
+// 超聲波區間 callback，前方那顆的區間或 kernel 煞車狀態改變時呼叫 (取代每幀的 hcsr04_callback)
+void hcsr04_zone_callback(hcsr04_zone_event *ev);
+
 
 // ----------------- 節點處理 -----------------
 
-// 讀取下一節點，並控制馬達與燈號
-void handle_node(Route *route);
+// 讀取下一節點並開始節點動作 (由感測器事件與控制 tick 推進，不會阻塞)
+// 回傳=> 1開始處理(完成後解鎖 node_active)  0沒有下一步/不需要等待
+int handle_node(Route *route);
 
 
 // ----------------- 循跡邏輯 -----------------
 
-// 根據紅外線編碼判斷行駛邏輯
+// 根據紅外線編碼判斷行駛邏輯 (沿線行駛交給 line_ctrl PID)
 void logic(int code);
 
+// 同 logic()，帶 driver 記錄的變化時間 (CLOCK_MONOTONIC ns)，給 PID 算微分
+void logic_event(int code, unsigned long long ts_ns);
+
 #endif
@@ -0,0 +1,51 @@
+// 節點動作(maneuver) 狀態機 標頭檔
+// 直行/左轉/右轉/停車 拆成 減速 -> 原地轉 -> 找回線 -> 恢復 幾個階段，
+// 每個階段由感測器條件結束 (例如中間感測器重新看到線)，並有逾時保護，不使用 sleep
+#ifndef __MANEUVER_H__
+#define __MANEUVER_H__
+
+#include "route.h"	// Action
+
+
+// 各階段參數
+#define MANEUVER_SPEED_DECEL	40	// 減速通過節點的速度 (%)
+#define MANEUVER_SPEED_PIVOT	45	// 原地轉的速度 (%)
+#define MANEUVER_SPEED_SEEK	35	// 找回線時放慢的轉速 (%)
+#define MANEUVER_ACCEL		400	// 減速/原地轉/恢復 的加速度 (%/s，driver 漸變，避免打滑)
+#define MANEUVER_ADVANCE_MS	250	// 減速階段至少前進多久: 感測器在車軸前方，讓車軸到達節點再轉
+#define MANEUVER_CLEAR_MS	50	// 連續多久沒有 111 才算離開節點橫線 (過濾橫線上的抖動)
+#define MANEUVER_DECEL_MS	1000	// 減速階段逾時: 車身通過節點橫線 (code 離開 111)
+#define MANEUVER_PIVOT_MS	1500	// 原地轉逾時: 中間感測器離線再回到線上
+#define MANEUVER_REACQUIRE_MS	300	// 找回線逾時: 回到置中 (010)，逾時視為已在線上
+
+
+// 動作階段
+typedef enum {
+	MANEUVER_IDLE,		// 沒有動作
+	MANEUVER_DECELERATE,	// 減速通過節點
+	MANEUVER_PIVOT,		// 原地轉，等中間感測器重新看到線
+	MANEUVER_REACQUIRE,	// 放慢轉速，等線回到正中間
+	MANEUVER_RESUME		// 恢復直行 (下一次 tick 結束)
+} maneuver_phase_t;
+
+
+// ------------ API 介面 -------------
+
+// 開始一個節點動作 (會立刻下第一個馬達指令)
+void maneuver_start(Action action);
+
+// 推進狀態機，code = 目前循跡編碼 (左*4 + 中*2 + 右)
+// 感測器事件與控制迴圈的固定 tick 都要呼叫
+// 回傳=> 1進行中  0完成  -1逾時失敗(已停車)
+int maneuver_tick(int code);
+
+// 是否有動作進行中
+int maneuver_active(void);
+
+// 目前階段 (debug 用)
+maneuver_phase_t maneuver_phase(void);
+
+// 取消動作 (不動馬達，由呼叫者決定停車或繼續)
+void maneuver_cancel(void);
+
+#endif
@@ -22,6 +22,11 @@ int stop_all_motors(void);
 
 int open_motor_device(void);
 
+// 映射 driver 的命令/狀態共用頁，之後 set_drive 不走系統呼叫 (停車仍用 ioctl，立即生效)
+// poll_us: driver 檢查新命令的週期 (us)，0 = 每次命令敲 doorbell
+// 回傳=> 0成功 -1失敗 (維持 ioctl)
+int motor_shm_open(unsigned int poll_us);
+
 
 // 低階控制指令 (精細控制，適合微調 / 自訂行為)
 // -------------------------------------------------
@@ -36,6 +41,50 @@ int set_left_motor(int speed, int direction);
 // direction: 方向 (1=前進, -1=後退, 0=停止)
 int set_right_motor(int speed, int direction);
 
+// 一次設定雙輪 (一個 ioctl，兩輪同時改變；舊 driver 自動改用上面兩個函式)
+// 回傳=> 0成功 -1失敗
+int set_drive(int left_speed, int left_dir, int right_speed, int right_dir);
+
+// 雙輪由 driver 依加速度漸變到目標，不用在 user space 分好幾步下指令
+// accel: 每秒最多改變的速度 (%/s)，0 = 立即 (同 set_drive)；舊 driver 自動改用 set_drive
+// 停車 (stop_all_motors) 與 set_drive 會取消進行中的漸變
+// 回傳=> 0成功 -1失敗
+int set_drive_ramp(int left_speed, int left_dir, int right_speed, int right_dir, unsigned int accel);
+
+
+
+// 命令快取與統計
+// -------------------------------------------------
+// 上面的命令和 driver 目前的輸出相同時直接省略 (不做系統呼叫)，
+// 每個控制 tick 重下相同命令不花成本；停車 (stop_all_motors) 一定送出
+
+typedef struct {
+	unsigned long issued;		// 實際下給 driver 的命令
+	unsigned long suppressed;	// 和目前輸出相同被省略的命令
+	unsigned long syscalls;		// ioctl 次數 (共用頁命令不算)
+	unsigned long errors;		// 失敗的命令
+} motor_stats;
+
+void motor_get_stats(motor_stats *st);
+
+// 目前的輸出 (帶正負號的速度 %，負 = 後退)
+// 回傳=> 0成功 -1不確定 (還沒下過命令或上一個命令失敗)
+int motor_get_drive(int *left, int *right);
+
+// driver 狀態可能被別人改過時呼叫，下一個命令一定送出
+void motor_cache_invalidate(void);
+
+
+// 故障鎖定 (kernel 緊急煞車)
+// -------------------------------------------------
+// 超聲波 driver 觸發煞車時直接在 kernel 停車並鎖定，之後出力命令失敗 (errno = EPERM)，停車照常
+
+// 回傳=> 0沒有鎖定  >0 鎖定中 (MOTOR_FAULT_*)  -1無法讀取；有共用頁時不做系統呼叫
+int motor_fault(void);
+
+// 解除鎖定，馬達維持停止  回傳=> 0成功 -1失敗
+int motor_clear_fault(void);
+
 // 程式結束時清理並關閉設備
 void cleanup_and_exit(int sig);
 
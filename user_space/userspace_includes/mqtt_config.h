@@ -16,10 +16,48 @@
 #define MQTT_TOPIC_CALLING	"statusMSG/callingCar"		// 任務指示
 
 
+// 連線與離線緩衝設定
+#define MQTT_KEEPALIVE_S	60	// keepalive (秒)
+#define MQTT_CONNECT_TIMEOUT_MS	10000	// 送出連線後等 CONNACK 的上限
+#define MQTT_BACKOFF_MIN_MS	1000	// 重連退避時間 (每次失敗加倍，實際等待再隨機取一半~全部)
+#define MQTT_BACKOFF_MAX_MS	32000
+#define MQTT_MAX_INFLIGHT	20	// QoS>0 尚未確認的訊息數上限
+#define MQTT_OUTBOX_SLOTS	32	// 離線時保留的重要訊息數 (滿了覆蓋最舊的)
+#define MQTT_OUTBOX_MSG_MAX	256	// outbox 每則訊息最大長度 (bytes)
+#define MQTT_TOPIC_MAX		64	// 主題最大長度 (含 '\0')
+#define MQTT_MAX_SUBS		16	// 訂閱主題數
+#define MQTT_MAX_TOPIC_QOS	8	// 可個別設定 QoS 的主題數
+
+// 發布選項
+#define MQTT_PUB_CRITICAL	0x01	// 離線時存進 outbox，重連後補送
+
+// 連線狀態
+#define MQTT_STATE_DISCONNECTED	0	// 離線 (等待退避時間後重連)
+#define MQTT_STATE_CONNECTING	1	// 已送出連線，等 CONNACK
+#define MQTT_STATE_CONNECTED	2
+
+
 // 訂閱訊息的 callback 型態
 typedef void (*mqtt_callback)(const char *topic, const char *msg);
 
 
+// 統計 (遺失的訊息 = offline_dropped + outbox_overwritten)
+typedef struct {
+	unsigned long published;		// 直接送出
+	unsigned long publish_errors;		// 送出失敗 (非斷線原因)
+	unsigned long offline_queued;		// 離線時存進 outbox
+	unsigned long replayed;			// 重連後從 outbox 補送
+	unsigned long offline_dropped;		// 離線時丟棄的一般訊息
+	unsigned long outbox_overwritten;	// outbox 滿了被覆蓋的重要訊息
+	unsigned long connect_attempts;		// 嘗試連線次數
+	unsigned long connect_failures;		// 連線失敗/逾時/被拒
+	unsigned long connects;			// 連線成功
+	unsigned long disconnects;		// 連線中斷
+	unsigned int outbox_pending;		// outbox 目前待送
+	int state;				// MQTT_STATE_*
+} mqtt_stats;
+
+
 // ------------  MQTT api  -----------------
 
 // 訂閱訊息的 callback 型態
@@ -34,6 +72,54 @@ int mqtt_subscribe(const char *topic, mqtt_callback cb);
 // 訂閱指定頻道 topic，收到訊息會呼叫 callback (return 成功0  失敗1)
 int mqtt_close(void);
 
+// 同 mqtt_subscribe，flags 為 MQTT_ROUTE_WORKER 時 callback 在工作執行緒執行 (見 mqtt_router.h)
+// 每個主題可各自註冊 handler，主題可含 + / # 萬用字元
+int mqtt_subscribe_ex(const char *topic, mqtt_callback cb, int flags);
+
+
+// ------------  連線與離線緩衝  -----------------
+
+// 設定 Broker 位址 (init 之前呼叫，沒設定用 MQTT_BROKER_IP/PORT)
+void mqtt_set_broker(const char *host, int port);
+
+// 發布訊息  flags: MQTT_PUB_CRITICAL 離線時存進 outbox 重連後補送 (return 送出或存起來0  丟棄-1)
+int mqtt_publish_ex(const char *topic, const char *msg, int flags);
+
+// 同 mqtt_publish_ex，發布 len bytes (可含 0，例如二進位遙測)
+int mqtt_publish_buf(const char *topic, const void *data, int len, int flags);
+
+// 設定主題的 QoS 0~2 (發布與訂閱都適用，預設 0)  (return 成功0  失敗-1)
+int mqtt_set_topic_qos(const char *topic, int qos);
+
+// 目前連線狀態 MQTT_STATE_*
+int mqtt_state(void);
+
+// 取得統計
+void mqtt_get_stats(mqtt_stats *st);
+
+
+// ------------  事件迴圈 (epoll) 模式  -----------------
+// 用 mqtt_init_external() 取代 mqtt_init()，不建立 mosquitto 背景 thread，
+// socket 交給事件迴圈: 可讀呼叫 mqtt_handle_read，可寫呼叫 mqtt_handle_write，
+// 定期呼叫 mqtt_handle_misc (keepalive、連線逾時、斷線重連)；socket 會隨重連改變
+
+// 開始非阻塞連線但不啟動背景 thread，不等連線結果 (return 成功0  無法建立 client -1)
+int mqtt_init_external(void);
+
+// 取得 socket fd，未連線為 -1
+int mqtt_socket(void);
+
+// 連線代數: 每次 (重新) 連線都會改變；重連後 fd 號碼可能相同，要用這個判斷是否重新註冊
+unsigned int mqtt_conn_gen(void);
+
+// 是否有資料等著送出 (1 = 需要等 EPOLLOUT)
+int mqtt_want_write(void);
+
+// socket 可讀 / 可寫 / 定期維護 (return 成功0  失敗-1)
+int mqtt_handle_read(void);
+int mqtt_handle_write(void);
+int mqtt_handle_misc(void);
+
 
 #endif
 
@@ -0,0 +1,47 @@
+// MQTT 主題路由 標頭檔
+// 依訂閱主題(可含 + / # 萬用字元) 建立樹狀索引，收到訊息時沿著主題層級一路比對，
+// 分派給所有符合的 handler；比對成本和主題層數成正比，和註冊數量無關
+// handler 可以選擇交給工作執行緒執行，避免慢的 handler 卡住 MQTT 網路處理
+#ifndef __MQTT_ROUTER_H__
+#define __MQTT_ROUTER_H__
+
+#include "mqtt_config.h"	// mqtt_callback
+
+#define MQTT_ROUTER_MAX_NODES		64	// 樹節點數 (每個主題層級一個)
+#define MQTT_ROUTER_MAX_HANDLERS	4	// 同一個訂閱主題最多 handler 數
+#define MQTT_ROUTER_LEVEL_MAX		32	// 一個層級名稱最大長度 (含 '\0')
+
+// handler 選項
+#define MQTT_ROUTE_INLINE	0x00	// 在收訊的執行緒直接呼叫 (事件迴圈模式 = 事件迴圈)
+#define MQTT_ROUTE_WORKER	0x01	// 複製訊息交給工作執行緒呼叫 (handler 不可碰事件迴圈的狀態)
+
+
+// 統計
+typedef struct {
+	unsigned long messages;		// 收到的訊息
+	unsigned long unmatched;	// 沒有任何 handler 的訊息
+	unsigned long dispatched;	// 直接呼叫的 handler 次數
+	unsigned long queued;		// 交給工作執行緒的次數
+	unsigned long dropped;		// 工作佇列滿/訊息太長而丟棄
+} mqtt_router_stats;
+
+
+// ------------ API 介面 -------------
+
+// 註冊 handler  filter: 訂閱主題，可含 + (一層) 與 # (最後一層，之後全部)
+// 回傳=> 0成功  -1主題格式錯誤/節點或 handler 已滿/工作執行緒建立失敗
+int mqtt_router_add(const char *filter, mqtt_callback cb, int flags);
+
+// 移除 handler  回傳=> 0成功 -1找不到
+int mqtt_router_remove(const char *filter, mqtt_callback cb);
+
+// 分派一則訊息  回傳=> 符合的 handler 數
+int mqtt_router_dispatch(const char *topic, const char *msg);
+
+// 取得統計
+void mqtt_router_get_stats(mqtt_router_stats *st);
+
+// 停止工作執行緒並清除所有路由
+void mqtt_router_close(void);
+
+#endif
@@ -0,0 +1,54 @@
+// 事件迴圈(reactor) 標頭檔
+// 單一執行緒用 epoll 同時等待 感測器/UART/MQTT/計時器 的 fd，有事件才呼叫對應的 callback
+#ifndef __REACTOR_H__
+#define __REACTOR_H__
+
+#include <stdint.h>
+#include <sys/epoll.h>	// EPOLLIN, EPOLLOUT, EPOLLPRI
+
+// 同時可註冊的 fd 數量 (含計時器)
+#define REACTOR_MAX_HANDLERS 32
+
+// fd 事件 callback  events: EPOLLIN/EPOLLOUT/EPOLLPRI...
+typedef void (*reactor_cb)(int fd, uint32_t events, void *arg);
+
+// 每次 epoll_wait 前呼叫 (例如更新 MQTT 是否需要 EPOLLOUT)
+typedef void (*reactor_prepare_cb)(void *arg);
+
+
+// ------------ API 介面 -------------
+
+// 初始化  回傳=> 0成功 -1失敗
+int reactor_init(void);
+
+// 註冊 fd  回傳=> 0成功 -1失敗
+int reactor_add(int fd, uint32_t events, reactor_cb cb, void *arg);
+
+// 修改 fd 等待的事件  回傳=> 0成功 -1失敗
+int reactor_mod(int fd, uint32_t events);
+
+// 移除 fd (不會 close)  回傳=> 0成功 -1失敗
+int reactor_del(int fd);
+
+// 建立計時器 (timerfd)，到期時呼叫 cb  回傳=> 計時器 fd，-1失敗
+int reactor_timer_add(reactor_cb cb, void *arg);
+
+// 設定計時器  first_ms: 第一次到期(0=停止)  period_ms: 之後的週期(0=只觸發一次)
+int reactor_timer_set(int tfd, unsigned int first_ms, unsigned int period_ms);
+
+// 移除並關閉計時器
+int reactor_timer_del(int tfd);
+
+// 設定每輪 epoll_wait 前的 callback
+void reactor_set_prepare(reactor_prepare_cb cb, void *arg);
+
+// 執行事件迴圈直到 reactor_stop()  回傳=> 0正常結束 -1失敗
+int reactor_run(void);
+
+// 讓 reactor_run() 在本輪結束後返回
+void reactor_stop(void);
+
+// 釋放資源 (關閉所有計時器與 epoll)
+void reactor_close(void);
+
+#endif
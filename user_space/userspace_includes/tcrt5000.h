@@ -23,20 +23,37 @@ typedef struct {
 	int left;	// 左邊感測器 0/1
 	int middle;	// 中間感測器 0/1
 	int right;	// 右邊感測器 0/1
+	unsigned int seq;		// driver 序號 (跳號代表有遺失)
+	unsigned long long ts_ns;	// 變化時間 CLOCK_MONOTONIC (ns)
 } tcrt5000_data;
 
 
 // callback 型態
 typedef void(*tcrt5000_callback)(int code);
 
+// 執行緒等待狀態變化的逾時 (ms)，只用來定期檢查 stop_flag
+#define TCRT5000_WAIT_MS 200
+
 // ------------ API 介面 -------------
 
 // 開啟裝置  回傳=> 0成功 -1失敗
 int tcrt5000_open(void);
 
-// 讀取一次資料  回傳=> 0成功  -1失敗
+// 讀取目前狀態(最新的一筆)  回傳=> 0成功  -1失敗
 int tcrt5000_read(tcrt5000_data *data);
 
+// 讀取一筆狀態變化  回傳=> 1讀到  0沒有新變化  -1失敗
+int tcrt5000_read_event(tcrt5000_data *data);
+
+// 等待狀態變化  回傳=> 1有資料  0逾時  -1失敗
+int tcrt5000_wait(int timeout_ms);
+
+// 目前為止偵測到遺失的樣本數 (依序號跳號計算)
+unsigned long tcrt5000_dropped(void);
+
+// 裝置的 fd (給事件迴圈 epoll 用)，未開啟為 -1
+int tcrt5000_fd(void);
+
 // 關閉裝置  回傳=> 0成功 -1失敗
 int tcrt5000_close(void);
 
@@ -0,0 +1,29 @@
+// TCRT5000 driver 與 user space 共用的定義 (ioctl / 二進位樣本格式)
+#ifndef __TCRT5000_IOCTL_H__
+#define __TCRT5000_IOCTL_H__
+
+#include <linux/ioctl.h>
+#include <linux/types.h>
+
+// 二進位樣本格式版本，格式有變動時 +1
+#define TCRT5000_SAMPLE_VERSION 1
+
+// 一筆二進位樣本 (固定 16 bytes，一次 read() 可以讀多筆)
+struct tcrt5000_sample {
+	__u8  version;		// 格式版本 TCRT5000_SAMPLE_VERSION
+	__u8  state;		// bit2=左 bit1=中 bit0=右
+	__u16 reserved;
+	__u32 seq;		// 序號，每次狀態變化 +1 (跳號代表有遺失)
+	__u64 ts_ns;		// 發生時間 CLOCK_MONOTONIC (ns)
+};
+
+// read() 輸出模式
+#define TCRT5000_MODE_TEXT	0	// 文字 "010\n" (預設，cat 使用)
+#define TCRT5000_MODE_BINARY	1	// struct tcrt5000_sample 陣列
+
+// ioctl 的魔術數字及命令編號
+#define TCRT5000_IOC_MAGIC 'T'
+#define TCRT5000_SET_MODE _IOW(TCRT5000_IOC_MAGIC, 1, int)	// 設定 read() 模式
+#define TCRT5000_GET_MODE _IOR(TCRT5000_IOC_MAGIC, 2, int)	// 取得 read() 模式
+
+#endif
@@ -0,0 +1,64 @@
+// 遙測(telemetry) 發布 標頭檔
+// 控制邏輯只把狀態/事件放進無鎖信箱，不直接呼叫 mqtt_publish；
+// 由事件迴圈 (reactor) 取出後發布:
+//   狀態 telemetry_status(): 相同內容去重，最新值覆蓋舊值，固定週期最多發布一次
+//   事件 telemetry_event() : 到站/卡住等邊緣事件，立即喚醒事件迴圈發布，不合併；離線時存進 MQTT outbox
+// 發布時依主題設定的編碼 (JSON/二進位，見 telemetry_codec.h) 編碼
+#ifndef __TELEMETRY_H__
+#define __TELEMETRY_H__
+
+#include <stddef.h>
+#include "telemetry_codec.h"
+
+#define TELEMETRY_MSG_MAX	128	// 編碼後一則訊息最大長度
+#define TELEMETRY_MAX_TOPICS	4	// 可個別設定編碼的主題數
+#define TELEMETRY_EVENT_SLOTS	16	// 事件佇列格數 (必須是 2 的次方)
+#define TELEMETRY_PERIOD_MS	200	// 預設狀態發布週期 (ms)
+
+
+// 統計
+typedef struct {
+	unsigned long status_posted;	// 放進信箱的狀態
+	unsigned long status_deduped;	// 和上一筆相同被略過
+	unsigned long status_coalesced;	// 還沒發布就被新狀態覆蓋 (或被之後的同主題事件作廢)
+	unsigned long status_published;	// 實際發布的狀態
+	unsigned long events_sent;	// 實際發布的事件
+	unsigned long events_dropped;	// 佇列滿被丟掉的事件
+	unsigned long publish_errors;	// 發布失敗 (離線時的狀態會被丟棄，計在這裡)
+} telemetry_stats;
+
+
+// ------------ API 介面 -------------
+
+// 建立喚醒用 eventfd 與發布計時器並註冊到事件迴圈 (reactor_init 之後呼叫)
+// period_ms: 狀態發布週期，0 用 TELEMETRY_PERIOD_MS  回傳=> 0成功 -1失敗
+int telemetry_init(unsigned int period_ms);
+
+// 調整狀態發布週期 (ms)
+int telemetry_set_period(unsigned int period_ms);
+
+// 放入狀態 (生產者，不做網路 I/O)  topic 必須是常數字串
+// 回傳=> 1放入  0和上一筆相同略過
+int telemetry_status(const char *topic, const telemetry_record *rec);
+
+// 放入邊緣事件 (生產者，不做網路 I/O，不合併)  topic 必須是常數字串
+// 回傳=> 0成功  -1佇列滿
+int telemetry_event(const char *topic, const telemetry_record *rec);
+
+// 設定主題的編碼 TELEMETRY_ENC_JSON / TELEMETRY_ENC_BINARY (事件迴圈呼叫，預設 JSON)
+// 回傳=> 0成功 -1主題表滿
+int telemetry_set_encoding(const char *topic, int encoding);
+
+// 取得主題的編碼
+int telemetry_get_encoding(const char *topic);
+
+// 立即發布所有待送的狀態與事件 (消費者，事件迴圈結束前呼叫)
+void telemetry_flush(void);
+
+// 取得統計
+void telemetry_get_stats(telemetry_stats *st);
+
+// 移除計時器並關閉 eventfd
+void telemetry_close(void);
+
+#endif
@@ -0,0 +1,80 @@
+// 遙測編碼 標頭檔 (車上程式與測試工具共用)
+// 一筆遙測 = telemetry_record，可編成:
+//   JSON  : 和原本調度中心用的字串相同 ({"status":...} / {"node":..,"doing":..})，除錯用
+//   二進位: 固定 20 bytes、little endian、帶版本號，另外帶速度與感測器摘要
+//
+// 二進位格式 v1:
+//   [0] 0xC7 [1] 版本 [2] kind [3] status [4] delivery [5] action [6..7] node
+//   [8] 左輪速度 [9] 右輪速度 [10] 循跡編碼 [11] 保留(0) [12..13] 前方距離 cm
+//   [14..15] 序號 [16..19] 發布時間 ms
+// 新版本只會在後面加欄位，解碼器接受 >= 20 bytes 且版本 >= 1 的封包
+#ifndef __TELEMETRY_CODEC_H__
+#define __TELEMETRY_CODEC_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define TELEMETRY_BIN_MAGIC	0xC7	// 二進位封包第一個 byte (JSON 一定是 '{')
+#define TELEMETRY_BIN_VERSION	1
+#define TELEMETRY_BIN_SIZE	20	// v1 長度
+#define TELEMETRY_BIN_CONTENT	14	// 序號之前的內容欄位長度 (比較內容是否相同用)
+
+// 編碼方式
+#define TELEMETRY_ENC_JSON	0
+#define TELEMETRY_ENC_BINARY	1
+
+// 種類
+#define TELEMETRY_KIND_STATUS	0	// 狀態 (status/delivery_status)
+#define TELEMETRY_KIND_NODE	1	// 節點進度 (node/doing)
+
+// 狀態
+#define CAR_STATUS_NONE		0
+#define CAR_STATUS_MOVING	1
+#define CAR_STATUS_OFF_TRACK	2
+#define CAR_STATUS_STUCK	3
+#define CAR_STATUS_RESTART	4
+#define CAR_STATUS_ARRIVED	5
+
+// 送貨狀態
+#define CAR_DELIVERY_NONE	0
+#define CAR_DELIVERY_DELIVERING	1
+#define CAR_DELIVERY_RECEIVING	2
+#define CAR_DELIVERY_COMPLETED	3
+
+
+// 一筆遙測 (序號與時間在編碼時才加上)
+typedef struct {
+	uint8_t kind;		// TELEMETRY_KIND_*
+	uint8_t status;		// CAR_STATUS_*
+	uint8_t delivery;	// CAR_DELIVERY_*
+	uint8_t action;		// 節點動作 (route.h Action)
+	uint16_t node;		// 第幾個節點
+	int8_t speed_left;	// 左輪速度 0~100
+	int8_t speed_right;	// 右輪速度 0~100
+	uint8_t line_code;	// 循跡編碼 (左*4 + 中*2 + 右)
+	uint16_t front_cm;	// 前方超聲波距離 (cm，0 = 沒有資料)
+} telemetry_record;
+
+
+// ------------ API 介面 -------------
+
+// 兩筆內容是否相同  回傳=> 1相同 0不同
+int telemetry_record_equal(const telemetry_record *a, const telemetry_record *b);
+
+// 編成 JSON 字串 (含 '\0')  回傳=> 字串長度  -1空間不足
+int telemetry_encode_json(const telemetry_record *rec, char *out, size_t cap);
+
+// 編成二進位  回傳=> 長度 (TELEMETRY_BIN_SIZE)  -1空間不足
+int telemetry_encode_binary(const telemetry_record *rec, uint16_t seq, uint32_t ts_ms,
+			    uint8_t *out, size_t cap);
+
+// 解碼二進位 (seq/ts_ms 可為 NULL)  回傳=> 封包版本  -1不是遙測封包/長度不足
+int telemetry_decode_binary(const void *data, size_t len, telemetry_record *rec,
+			    uint16_t *seq, uint32_t *ts_ms);
+
+// 代號轉文字
+const char *telemetry_status_name(int status);
+const char *telemetry_delivery_name(int delivery);
+const char *telemetry_action_name(int action);
+
+#endif
@@ -3,13 +3,29 @@
 #define UART_H
 
 #include <stddef.h>
+#include <sys/types.h>	// ssize_t
 
 // 每次傳輸最大資料長度(和queue一樣)
 #define UART_DATA_MAX 128
 
-// 開啟 UART device 
+
+// UART 設定 (固定 8N1 raw 模式，不做任何字元轉換)
+typedef struct {
+	int baud;		// 鮑率 (9600 ~ 921600)
+	int vmin;		// read() 至少等到幾個位元組 (VMIN)
+	int vtime_ds;		// read() 逾時，單位 0.1 秒 (VTIME)，0 = 不逾時
+	int low_latency;	// 1 = 開啟 ASYNC_LOW_LATENCY (驅動不支援時只警告)
+} uart_config;
+
+// 預設: 115200 8N1，有資料就回傳 (VMIN=1, VTIME=0)，低延遲
+#define UART_CONFIG_DEFAULT { .baud = 115200, .vmin = 1, .vtime_ds = 0, .low_latency = 1 }
+
+// 開啟 UART device (並套用 UART_CONFIG_DEFAULT)
 int uart_open(const char *device);
 
+// 套用 UART 設定 (需先 uart_open)  0成功 -1失敗
+int uart_configure(const uart_config *cfg);
+
 // 關閉 UART device
 int uart_close(void);
 
@@ -23,4 +39,8 @@ int uart_read(char *buf, size_t buf_size);
 int uart_write(const char *data, ssize_t len);
 
 
+// 取得 UART 的 fd (給事件迴圈 epoll 用)，未開啟為 -1
+int uart_get_fd(void);
+
+
 #endif 
@@ -0,0 +1,53 @@
+// UART 封包協定 標頭檔 (Rpi <-> Pico)
+// 封包格式: [SYNC][type][seq][len][payload ... len bytes][CRC16 低位][CRC16 高位]
+// CRC16-CCITT (0xFFFF 起始) 涵蓋 type/seq/len/payload，收到 CMD/TEXT 要回 ACK(seq)
+#ifndef UART_PROTO_H
+#define UART_PROTO_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define UART_PROTO_SYNC		0xA5	// 封包起始
+#define UART_PROTO_MAX_PAYLOAD	64	// payload 上限 (bytes)
+#define UART_PROTO_OVERHEAD	6	// sync + type + seq + len + crc(2)
+#define UART_PROTO_MAX_FRAME	(UART_PROTO_MAX_PAYLOAD + UART_PROTO_OVERHEAD)
+
+// 封包類型
+#define UART_FRAME_CMD	0x01	// 指令 (燈號/輸送帶，例如 "L" "R" "D" "S")
+#define UART_FRAME_ACK	0x02	// 確認收到，seq = 被確認的封包序號，沒有 payload
+#define UART_FRAME_TEXT	0x03	// 文字訊息 (debug)
+#define UART_FRAME_PING	0x04	// 量測來回延遲，payload = 送出時間 (8 bytes)
+#define UART_FRAME_PONG	0x05	// 回應 PING，payload 原封不動送回
+
+
+// 解析器 (每個接收方向一個)
+typedef struct {
+	uint8_t buf[UART_PROTO_MAX_FRAME * 2];	// 尚未解析完的位元組
+	size_t len;				// buf 內的位元組數
+	unsigned long crc_errors;		// CRC 錯誤次數
+	unsigned long resyncs;			// 丟掉的雜訊位元組數
+} uart_proto_parser;
+
+// 解析出一個封包時呼叫
+typedef void (*uart_proto_frame_cb)(uint8_t type, uint8_t seq,
+				    const uint8_t *payload, size_t len, void *arg);
+
+
+// ------------ API 介面 -------------
+
+// 計算 CRC16-CCITT
+uint16_t uart_proto_crc16(const uint8_t *data, size_t len);
+
+// 編碼一個封包到 out (大小至少 UART_PROTO_MAX_FRAME)
+// 回傳=> 封包長度  -1 payload 太長
+int uart_proto_encode(uint8_t type, uint8_t seq, const void *payload, size_t len, uint8_t *out);
+
+// 初始化解析器
+void uart_proto_parser_init(uart_proto_parser *p);
+
+// 餵入收到的位元組，每解析出一個 CRC 正確的封包就呼叫 cb
+// 雜訊或 CRC 錯誤時從下一個 SYNC 重新同步  回傳=> 解析出的封包數
+int uart_proto_feed(uart_proto_parser *p, const uint8_t *data, size_t len,
+		    uart_proto_frame_cb cb, void *arg);
+
+#endif
@@ -1,38 +1,55 @@
 // Queue 標頭檔(uart_thread.c使用)  
+// 單一生產者/單一消費者 (SPSC) 無鎖環狀緩衝，存放不定長度的資料
+// 生產者不上鎖，只有消費者在 queue_pop 睡著時才用 eventfd 喚醒
 #ifndef UART_QUEUE_H
 #define UART_QUEUE_H
 
-#include <pthread.h>
+#include <stddef.h>
+#include <stdatomic.h>
 #include "uart.h"
 
-// 最大柱列長度
-#define UART_QUEUE_SIZE 64 
+// 環狀緩衝大小 (bytes，必須是 2 的次方)，每筆資料另佔 2 bytes 長度
+#define UART_QUEUE_BYTES 8192
 
 
 // queue 結構體
+// head 只有消費者寫、tail 只有生產者寫，分開放在不同 cache line 避免互相干擾
 typedef struct {
-	char data[UART_QUEUE_SIZE][UART_DATA_MAX];	// 存放字串資料
-	int head;	// 隊頭索引
-	int tail;	// 隊尾索引
-	int count;	// 當前元素數量
-	pthread_mutex_t mutex;	// 互斥鎖，保護多thread 同時存取
-	pthread_cond_t cond;	// 條件變數，通知 TX thread 有新資料
+	unsigned char data[UART_QUEUE_BYTES];		// 存放 [長度][資料] 紀錄
+	_Alignas(64) atomic_size_t head;		// 消費者讀取位置 (只增不減)
+	_Alignas(64) atomic_size_t tail;		// 生產者寫入位置 (只增不減)
+	_Alignas(64) atomic_int parked;		// 1 = 消費者在 queue_pop 等待
+	atomic_int stop;			// 1 = 停止，queue_pop 回傳 -1
+	int efd;				// 喚醒消費者用的 eventfd
 } uart_queue_t;
 
-// 初始化 queue
-void queue_init(uart_queue_t *q);
+// 初始化 queue  成功回傳0 失敗回傳-1
+int queue_init(uart_queue_t *q);
 
-// 放入資料 push
+// 放入字串 push (生產者)  成功回傳0 失敗回傳-1(queue滿)
 int queue_push(uart_queue_t *q, const char *data);
 
-// 取出資料 pop
+// 放入 len bytes 資料 (生產者)  成功回傳0 失敗回傳-1(queue滿/太長)
+int queue_push_buf(uart_queue_t *q, const void *data, size_t len);
+
+// 取出一筆資料 pop (消費者，queue 空時阻塞)
+// buf 會補 '\0'，資料超過 buf_size-1 會截斷  回傳=> 資料長度  -1已停止
 int queue_pop(uart_queue_t *q, char *buf, size_t buf_size);
 
+// 從兩個 queue 取出一筆 (兩個 queue 的消費者是同一個 thread)，q0 有資料先取 q0
+// 都是空的就阻塞到任一個有資料  回傳=> 資料長度  -1任一個已停止
+int queue_pop2(uart_queue_t *q0, uart_queue_t *q1, char *buf, size_t buf_size);
+
+// 取出一筆資料但不等待 (消費者)  回傳=> 資料長度  0沒有資料
+int queue_try_pop(uart_queue_t *q, char *buf, size_t buf_size);
+
 // 判斷 queue 是否為空
 int queue_is_empty(uart_queue_t *q);
 
+// 停止並喚醒阻塞在 queue_pop 的消費者
+void queue_wake(uart_queue_t *q);
+
 // 釋放資源 
 void queue_destroy(uart_queue_t *q);
 
 #endif
-
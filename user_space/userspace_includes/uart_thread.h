@@ -3,6 +3,23 @@
 #define UART_THREAD_H
 
 #include <stddef.h>	// size_t
+#include <stdint.h>	// uint8_t
+
+// 封包統計
+typedef struct {
+	unsigned long tx_frames;	// 送出的封包數
+	unsigned long tx_writes;	// write() 次數 (多個封包合併成一次)
+	unsigned long rx_frames;	// 收到的正確封包數
+	unsigned long acks;		// 收到的 ACK 數
+	uint8_t last_ack;		// 最後被確認的序號
+	unsigned long crc_errors;	// CRC 錯誤數
+	unsigned long resyncs;		// 重新同步丟掉的位元組數
+	unsigned long pongs;		// 收到的 PONG 數
+	unsigned int rtt_last_us;	// 最近一次來回延遲 (us)
+	unsigned int rtt_min_us;	// 最小來回延遲 (us)
+	unsigned int rtt_max_us;	// 最大來回延遲 (us)
+	unsigned int rtt_avg_us;	// 平均來回延遲 (us，指數平均)
+} uart_stats;
 
 typedef	void(*uart_rx_callback_t)(const char *data, size_t len);
 
@@ -13,16 +30,37 @@ void uart_set_rx_callback(uart_rx_callback_t cb);
 int uart_thread_start(const char *device);
 
 
+// 只啟動 TX thread，RX 交給事件迴圈 (fd 用 uart_get_fd 取得)
+int uart_thread_start_tx(const char *device);
+
+
+// 事件迴圈在 UART fd 可讀時呼叫，讀一次並交給 rx callback
+// 回傳=> 讀到的位元組數  0沒有資料  -1失敗
+int uart_handle_rx(void);
+
+
 // 停止 uart thread
 void uart_thread_stop(void);
 
 
-// 非阻塞發送資料到uart 
+// 非阻塞發送資料到uart (包成 CMD 封包，最多 UART_PROTO_MAX_PAYLOAD bytes)
 // data要傳送的字串  0表示成功 -1表示queue滿了  
 int uart_send(const char *data);
 
 
-// 非阻塞接收uart資料	
+// 非阻塞發送指定類型的封包 (見 uart_proto.h)  0表示成功 -1失敗
+int uart_send_frame(uint8_t type, const void *payload, size_t len);
+
+
+// 取得封包統計
+void uart_get_stats(uart_stats *s);
+
+
+// 送出 PING 量測來回延遲，結果見 uart_get_stats 的 rtt_*  0表示成功 -1失敗
+int uart_ping(void);
+
+
+// 非阻塞接收uart資料 (封包的 payload)	
 // buf儲存接收到的資料  0表示沒有資料可讀  >0表示成功讀到資料了
 int uart_receive(char *buf, size_t buf_size);
 